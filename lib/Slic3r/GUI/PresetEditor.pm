@@ -445,6 +445,7 @@ sub options {
         infill_every_layers infill_only_where_needed
         solid_infill_every_layers fill_angle solid_infill_below_area 
         only_retract_when_crossing_perimeters infill_first
+        optimize_infill_travel optimize_gap_fill_travel optimize_support_material_travel
         max_print_speed max_volumetric_speed
         perimeter_speed small_perimeter_speed external_perimeter_speed infill_speed 
         solid_infill_speed top_solid_infill_speed support_material_speed 
@@ -464,7 +465,7 @@ sub options {
         notes
         complete_objects extruder_clearance_radius extruder_clearance_height
         gcode_comments output_filename_format
-        label_printed_objects
+        label_printed_objects render_copies_once
         post_process
         perimeter_extruder infill_extruder solid_infill_extruder
         support_material_extruder support_material_interface_extruder
@@ -578,6 +579,8 @@ sub build {
             $optgroup->append_single_option_line('solid_infill_below_area');
             $optgroup->append_single_option_line('only_retract_when_crossing_perimeters');
             $optgroup->append_single_option_line('infill_first');
+            $optgroup->append_single_option_line('optimize_infill_travel');
+            $optgroup->append_single_option_line('optimize_gap_fill_travel');
         }
     }
     
@@ -625,6 +628,7 @@ sub build {
             $optgroup->append_single_option_line('support_material_interface_spacing');
             $optgroup->append_single_option_line('support_material_buildplate_only');
             $optgroup->append_single_option_line('dont_support_bridges');
+            $optgroup->append_single_option_line('optimize_support_material_travel');
         }
     }
 
@@ -731,6 +735,7 @@ sub build {
             my $optgroup = $page->new_optgroup('Output file');
             $optgroup->append_single_option_line('gcode_comments');
             $optgroup->append_single_option_line('label_printed_objects');
+            $optgroup->append_single_option_line('render_copies_once');
             
             {
                 my $option = $optgroup->get_option('output_filename_format');
@@ -983,6 +988,7 @@ sub _update {
     my $have_sequential_printing = $config->complete_objects;
     $self->get_field($_)->toggle($have_sequential_printing)
         for qw(extruder_clearance_radius extruder_clearance_height);
+    $self->get_field('render_copies_once')->toggle(!$have_sequential_printing);
     
     my $have_ooze_prevention = $config->ooze_prevention;
     $self->get_field($_)->toggle($have_ooze_prevention)
@@ -1253,6 +1259,7 @@ sub options {
         bed_shape z_offset z_steps_per_mm has_heatbed
         fan_percentage
         gcode_flavor use_relative_e_distances
+        gcode_precision_xyz gcode_precision_e gcode_trim_zeros
         serial_port serial_speed
         host_type print_host octoprint_apikey
         use_firmware_retraction pressure_advance vibration_limit
@@ -1407,6 +1414,9 @@ sub build {
         {
             my $optgroup = $page->new_optgroup('Firmware');
             $optgroup->append_single_option_line('gcode_flavor');
+            $optgroup->append_single_option_line('gcode_precision_xyz');
+            $optgroup->append_single_option_line('gcode_precision_e');
+            $optgroup->append_single_option_line('gcode_trim_zeros');
         }
         {
             my $optgroup = $page->new_optgroup('Advanced');
@@ -149,6 +149,7 @@ public:
             "infill_every_layers"s, "infill_only_where_needed"s,
             "solid_infill_every_layers"s, "fill_angle"s, "solid_infill_below_area"s, ""s,
             "only_retract_when_crossing_perimeters"s, "infill_first"s,
+            "optimize_infill_travel"s, "optimize_gap_fill_travel"s, "optimize_support_material_travel"s,
             "max_print_speed"s, "max_volumetric_speed"s,
             "perimeter_speed"s, "small_perimeter_speed"s, "external_perimeter_speed"s, "infill_speed"s, ""s,
             "solid_infill_speed"s, "top_solid_infill_speed"s, "support_material_speed"s,
@@ -166,7 +167,7 @@ public:
             "support_material_contact_distance"s, "support_material_buildplate_only"s, "dont_support_bridges"s,
             "notes"s,
             "complete_objects"s, "extruder_clearance_radius"s, "extruder_clearance_height"s,
-            "gcode_comments"s, "output_filename_format"s,
+            "gcode_comments"s, "output_filename_format"s, "render_copies_once"s,
             "post_process"s,
             "perimeter_extruder"s, "infill_extruder"s, "solid_infill_extruder"s,
             "support_material_extruder"s, "support_material_interface_extruder"s,
@@ -218,6 +219,7 @@ public:
         {
             "bed_shape"s, "z_offset"s, "z_steps_per_mm"s, "has_heatbed"s,
             "gcode_flavor"s, "use_relative_e_distances"s,
+            "gcode_precision_xyz"s, "gcode_precision_e"s, "gcode_trim_zeros"s,
             "serial_port"s, "serial_speed"s,
             "host_type"s, "print_host"s, "octoprint_apikey"s,
             "use_firmware_retraction"s, "pressure_advance"s, "vibration_limit"s,
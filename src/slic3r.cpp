@@ -1,5 +1,7 @@
 #include "slic3r.hpp"
+#include "GCodeAnalyzer.hpp"
 #include "GCodeSender.hpp"
+#include "GCodeTimeEstimator.hpp"
 #include "Geometry.hpp"
 #include "IO.hpp"
 #include "Log.hpp"
@@ -395,6 +397,53 @@ int CLI::run(int argc, char **argv) {
                 boost::nowide::cout << "Queue size: " << sender.queue_size() << std::endl;
             }
             boost::nowide::cout << "Print completed!" << std::endl;
+        } else if (opt_key == "estimate_time") {
+            // Get last sliced G-code or the manually supplied one
+            std::string gcode_file{ this->config.getString("gcode_file", "") };
+            if (gcode_file.empty())
+                gcode_file = this->last_outfile;
+            
+            if (gcode_file.empty()) {
+                Slic3r::Log::error("CLI") <<  "error: no G-code file to estimate; supply a model to slice or --gcode-file" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            
+            GCodeTimeEstimator estimator;
+            estimator.apply_config(this->full_print_config);
+            estimator.parse_file(gcode_file);
+            
+            const auto duration = [](double seconds) {
+                std::ostringstream ss;
+                ss << std::fixed << std::setprecision(0);
+                if (seconds >= 3600) ss << std::floor(seconds/3600) << "h ";
+                if (seconds >= 60) ss << std::floor(std::fmod(seconds, 3600)/60) << "m ";
+                ss << std::setprecision(1) << std::fmod(seconds, 60) << "s";
+                return ss.str();
+            };
+            boost::nowide::cout << "Estimated print time: " << duration(estimator.time) << std::endl
+                << "  travel: " << duration(estimator.travel_time) << std::endl;
+            for (size_t role = 0; role <= erSupportMaterialInterface; ++role) {
+                if (estimator.role_times[role] > 0)
+                    boost::nowide::cout << "  " << GCodeTimeEstimator::role_name(ExtrusionRole(role)) << ": "
+                        << duration(estimator.role_times[role]) << std::endl;
+            }
+            boost::nowide::cout << "Time per layer:" << std::endl;
+            for (const GCodeTimeEstimator::LayerTime &layer : estimator.layers) {
+                boost::nowide::cout << "  " << std::fixed << std::setprecision(3) << layer.print_z << ": "
+                    << duration(layer.time) << std::endl;
+            }
+        } else if (opt_key == "gcode_stats") {
+            std::string gcode_file{ this->config.getString("gcode_file", "") };
+            if (gcode_file.empty())
+                gcode_file = this->last_outfile;
+            
+            if (gcode_file.empty()) {
+                Slic3r::Log::error("CLI") <<  "error: no G-code file to analyze; supply a model to slice or --gcode-file" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            
+            GCodeAnalyzer analyzer(this->full_print_config);
+            boost::nowide::cout << analyzer.analyze_file(gcode_file).json();
         } else {
             Slic3r::Log::error("CLI") <<  "error: option not supported yet: " << opt_key << std::endl;
             exit(EXIT_FAILURE);
@@ -0,0 +1,222 @@
+#include <catch.hpp>
+
+#include <random>
+#include <sstream>
+#include "test_data.hpp"
+#include "libslic3r.h"
+#include "CompactGeometry.hpp"
+#include "Layer.hpp"
+
+using namespace Slic3r;
+using namespace Slic3r::Test;
+
+SCENARIO("CompactPolygons: lossless packing of paths") {
+    GIVEN("Random polygons, an empty path and extreme coordinates") {
+        std::mt19937 rng(1234);
+        std::uniform_int_distribution<coord_t> coord(-scale_(200), scale_(200));
+        Polygons polygons;
+        for (size_t i = 0; i < 50; ++i) {
+            Polygon polygon;
+            for (size_t j = 0; j < 3 + i % 20; ++j)
+                polygon.points.push_back(Point(coord(rng), coord(rng)));
+            polygons.push_back(polygon);
+        }
+        polygons.push_back(Polygon());
+        Polygon extreme;
+        extreme.points.push_back(Point(std::numeric_limits<coord_t>::max(), std::numeric_limits<coord_t>::min()));
+        extreme.points.push_back(Point(std::numeric_limits<coord_t>::min(), std::numeric_limits<coord_t>::max()));
+        extreme.points.push_back(Point(coord_t(0), coord_t(0)));
+        polygons.push_back(extreme);
+
+        const CompactPolygons packed(polygons);
+        THEN("every path decodes to the original points") {
+            REQUIRE(packed.size() == polygons.size());
+            for (size_t i = 0; i < polygons.size(); ++i)
+                REQUIRE(packed.polygon(i).points == polygons[i].points);
+            const Polylines polylines = packed.polylines();
+            REQUIRE(polylines.size() == polygons.size());
+            REQUIRE(polylines.front().points == polygons.front().points);
+        }
+        THEN("the packed form is smaller") {
+            REQUIRE(packed.memory_usage() < memory_usage(polygons));
+        }
+    }
+}
+
+SCENARIO("CompactSurfaces: lossless packing of surfaces") {
+    GIVEN("A holed surface with non default attributes") {
+        ExPolygon expolygon;
+        expolygon.contour = Polygon::new_scale({ Pointf(0, 0), Pointf(20, 0), Pointf(20, 20), Pointf(0, 20) });
+        expolygon.holes.push_back(Polygon::new_scale({ Pointf(5, 5), Pointf(5, 10), Pointf(10, 10), Pointf(10, 5) }));
+        expolygon.holes.push_back(Polygon::new_scale({ Pointf(12, 12), Pointf(12, 15), Pointf(15, 15) }));
+        Surface surface(stBottom | stBridge, expolygon);
+        surface.thickness = 0.4;
+        surface.thickness_layers = 2;
+        surface.bridge_angle = PI / 3;
+        surface.extra_perimeters = 1;
+        const Surfaces surfaces { surface, Surface(stInternal, ExPolygon(expolygon.contour)) };
+
+        const Surfaces unpacked = CompactSurfaces(surfaces).surfaces();
+        THEN("geometry and attributes are restored") {
+            REQUIRE(unpacked.size() == 2);
+            for (size_t i = 0; i < surfaces.size(); ++i) {
+                REQUIRE(unpacked[i].surface_type == surfaces[i].surface_type);
+                REQUIRE(unpacked[i].thickness == surfaces[i].thickness);
+                REQUIRE(unpacked[i].thickness_layers == surfaces[i].thickness_layers);
+                REQUIRE(unpacked[i].bridge_angle == surfaces[i].bridge_angle);
+                REQUIRE(unpacked[i].extra_perimeters == surfaces[i].extra_perimeters);
+                REQUIRE(unpacked[i].expolygon.contour.points == surfaces[i].expolygon.contour.points);
+                REQUIRE(unpacked[i].expolygon.holes.size() == surfaces[i].expolygon.holes.size());
+                for (size_t j = 0; j < surfaces[i].expolygon.holes.size(); ++j)
+                    REQUIRE(unpacked[i].expolygon.holes[j].points == surfaces[i].expolygon.holes[j].points);
+            }
+        }
+    }
+}
+
+SCENARIO("CompactExtrusions: lossless packing of extrusions") {
+    GIVEN("A collection of loops, paths and nested collections") {
+        ExtrusionPath outer(erExternalPerimeter, 0.05, 0.45f, 0.2f);
+        outer.polyline.points = Polygon::new_scale({ Pointf(0, 0), Pointf(20, 0), Pointf(20, 20), Pointf(0, 20), Pointf(0, 0) }).points;
+        ExtrusionPath overhang(erOverhangPerimeter, 0.07, 0.5f, 0.2f);
+        overhang.polyline.points = Polygon::new_scale({ Pointf(0, 0), Pointf(10, 10) }).points;
+        ExtrusionLoop loop(ExtrusionPaths { outer, overhang }, elrContourInternalPerimeter);
+
+        ExtrusionEntityCollection infill;
+        infill.no_sort = true;
+        ExtrusionPath solid(erSolidInfill, 0.04, 0.4f, 0.2f);
+        solid.polyline.points = Polygon::new_scale({ Pointf(1, 1), Pointf(19, 1), Pointf(19, 2) }).points;
+        infill.append(solid);
+        infill.append(ExtrusionPath(erGapFill, 0.01, 0.1f, 0.2f));
+
+        ExtrusionEntityCollection collection;
+        collection.append(loop);
+        collection.append(infill);
+        collection.append(ExtrusionEntityCollection());
+        collection.orig_indices = { 2, 0, 1 };
+
+        const CompactExtrusions packed(collection);
+        ExtrusionEntityCollection unpacked;
+        packed.collection(&unpacked);
+        THEN("the tree, the attributes and the points are restored") {
+            REQUIRE(packed.items_count() == collection.items_count());
+            REQUIRE(unpacked.items_count() == collection.items_count());
+            REQUIRE(unpacked.orig_indices == collection.orig_indices);
+            REQUIRE(unpacked.entities.size() == 3);
+
+            const ExtrusionLoop* unpacked_loop = dynamic_cast<const ExtrusionLoop*>(unpacked.entities[0]);
+            REQUIRE(unpacked_loop != nullptr);
+            REQUIRE(unpacked_loop->role == elrContourInternalPerimeter);
+            REQUIRE(unpacked_loop->paths.size() == 2);
+            for (size_t i = 0; i < 2; ++i) {
+                REQUIRE(unpacked_loop->paths[i].role == loop.paths[i].role);
+                REQUIRE(unpacked_loop->paths[i].mm3_per_mm == loop.paths[i].mm3_per_mm);
+                REQUIRE(unpacked_loop->paths[i].width == loop.paths[i].width);
+                REQUIRE(unpacked_loop->paths[i].height == loop.paths[i].height);
+                REQUIRE(unpacked_loop->paths[i].polyline.points == loop.paths[i].polyline.points);
+            }
+
+            const ExtrusionEntityCollection* unpacked_infill = dynamic_cast<const ExtrusionEntityCollection*>(unpacked.entities[1]);
+            REQUIRE(unpacked_infill != nullptr);
+            REQUIRE(unpacked_infill->no_sort);
+            REQUIRE(unpacked_infill->entities.size() == 2);
+            const ExtrusionPath* unpacked_solid = dynamic_cast<const ExtrusionPath*>(unpacked_infill->entities[0]);
+            REQUIRE(unpacked_solid != nullptr);
+            REQUIRE(unpacked_solid->role == erSolidInfill);
+            REQUIRE(unpacked_solid->polyline.points == solid.polyline.points);
+
+            const ExtrusionEntityCollection* empty = dynamic_cast<const ExtrusionEntityCollection*>(unpacked.entities[2]);
+            REQUIRE(empty != nullptr);
+            REQUIRE(empty->empty());
+        }
+        THEN("the packed form is smaller") {
+            REQUIRE(packed.memory_usage() < memory_usage(collection));
+        }
+    }
+}
+
+// G-code without the comment lines, which hold the export time and the config
+static std::string
+without_comments(const std::stringstream &gcode)
+{
+    std::istringstream in(gcode.str());
+    std::string result, line;
+    while (std::getline(in, line))
+        if (line.compare(0, 1, ";") != 0)
+            result += line + "\n";
+    return result;
+}
+
+// points of the paths and loops of a collection, in order
+static std::vector<Points>
+extrusion_points(const ExtrusionEntityCollection &collection)
+{
+    std::vector<Points> points;
+    for (const ExtrusionEntity* entity : collection.flatten().entities)
+        points.push_back(entity->as_polyline().points);
+    return points;
+}
+
+SCENARIO("Print: compact layer geometry") {
+    GIVEN("A print of a 20mm cube with infill") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("fill_density", "20%");
+
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+        std::stringstream reference;
+        Slic3r::Test::gcode(reference, print);
+        const LayerRegion &layerm = *print->objects.front()->layers.at(10)->regions.front();
+        const Surfaces fill_surfaces = layerm.fill_surfaces.surfaces;
+        const Surfaces slices = layerm.slices.surfaces;
+        const std::vector<Points> perimeters = extrusion_points(layerm.perimeters);
+        const std::vector<Points> fills = extrusion_points(layerm.fills);
+        REQUIRE(!perimeters.empty());
+        REQUIRE(!fills.empty());
+        REQUIRE(!fill_surfaces.empty());
+
+        WHEN("compact_layer_geometry is enabled") {
+            config->set("compact_layer_geometry", true);
+            Slic3r::Model compact_model;
+            auto compact_print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, compact_model, config)};
+            std::stringstream gcode;
+            Slic3r::Test::gcode(gcode, compact_print);
+            LayerRegion &compact_layerm = *compact_print->objects.front()->layers.at(10)->regions.front();
+
+            THEN("the G-code is unchanged") {
+                REQUIRE(without_comments(gcode) == without_comments(reference));
+            }
+            THEN("the layer geometry is packed after export") {
+                REQUIRE(compact_layerm.is_compact());
+                REQUIRE(compact_layerm.fill_surfaces.empty());
+                REQUIRE(compact_layerm.slices.empty());
+                REQUIRE(compact_layerm.perimeters.empty());
+                REQUIRE(compact_layerm.fills.empty());
+            }
+            THEN("it is restored identically when expanded") {
+                compact_print->expand_layer_geometry();
+                REQUIRE(!compact_layerm.is_compact());
+                REQUIRE(compact_layerm.fill_surfaces.size() == fill_surfaces.size());
+                for (size_t i = 0; i < fill_surfaces.size(); ++i) {
+                    REQUIRE(compact_layerm.fill_surfaces.surfaces[i].surface_type == fill_surfaces[i].surface_type);
+                    REQUIRE(compact_layerm.fill_surfaces.surfaces[i].expolygon.contour.points == fill_surfaces[i].expolygon.contour.points);
+                }
+                REQUIRE(compact_layerm.slices.size() == slices.size());
+                for (size_t i = 0; i < slices.size(); ++i)
+                    REQUIRE(compact_layerm.slices.surfaces[i].expolygon.contour.points == slices[i].expolygon.contour.points);
+                REQUIRE(extrusion_points(compact_layerm.perimeters) == perimeters);
+                REQUIRE(extrusion_points(compact_layerm.fills) == fills);
+            }
+            THEN("a new export reprocesses nothing and gives the same G-code") {
+                std::stringstream again;
+                Slic3r::Test::gcode(again, compact_print);
+                REQUIRE(compact_layerm.is_compact());
+                REQUIRE(without_comments(again) == without_comments(reference));
+            }
+            THEN("packing reports the memory saved") {
+                compact_print->expand_layer_geometry();
+                REQUIRE(compact_print->compact_layer_geometry() > 0);
+            }
+        }
+    }
+}
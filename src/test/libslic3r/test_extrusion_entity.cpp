@@ -77,3 +77,63 @@ SCENARIO("ExtrusionEntityCollection: Polygon flattening") {
         }
     }
 }
+
+SCENARIO("ExtrusionEntityCollection: travel optimization") {
+    srand(0xC0FFEE);
+    GIVEN("A greedy chain of short infill segments and a few gap fills") {
+        ExtrusionEntityCollection sample;
+        for (size_t i = 0; i < 200; i++) {
+            ExtrusionPath path {random_path(2, -scale_(50), scale_(50))};
+            path.role = (i % 10 == 0) ? erGapFill : erInternalInfill;
+            sample.append(path);
+        }
+        ExtrusionEntityCollection chained;
+        sample.chained_path_from(Point(0,0), &chained);
+        auto travel = [](const ExtrusionEntityCollection &coll) {
+            double length = 0;
+            Point pos(0,0);
+            for (const auto* e : coll.entities) {
+                length += pos.distance_to(e->first_point());
+                pos = e->last_point();
+            }
+            return length;
+        };
+        const double greedy_travel = travel(chained);
+
+        WHEN("All the infill roles are optimized") {
+            ExtrusionEntityCollection optimized {chained};
+            const double saved = optimized.optimize_travel(Point(0,0), { erInternalInfill, erGapFill });
+            THEN("The travel is shorter and the reported saving matches") {
+                INFO("greedy travel: " << greedy_travel << ", optimized travel: " << travel(optimized));
+                REQUIRE(saved > 0);
+                REQUIRE(travel(optimized) < greedy_travel);
+                REQUIRE(std::abs(greedy_travel - travel(optimized) - saved) < 1);
+                REQUIRE(optimized.size() == chained.size());
+            }
+            THEN("The result is deterministic") {
+                ExtrusionEntityCollection again {chained};
+                again.optimize_travel(Point(0,0), { erInternalInfill, erGapFill });
+                for (size_t i = 0; i < optimized.size(); i++) {
+                    REQUIRE(again.entities[i]->first_point() == optimized.entities[i]->first_point());
+                    REQUIRE(again.entities[i]->last_point() == optimized.entities[i]->last_point());
+                }
+            }
+        }
+        WHEN("Only gap fill is optimized") {
+            ExtrusionEntityCollection optimized {chained};
+            optimized.optimize_travel(Point(0,0), { erGapFill });
+            THEN("Infill paths keep their relative order and direction") {
+                std::vector<ExtrusionEntity*> before, after;
+                for (auto* e : chained.entities)
+                    if (dynamic_cast<ExtrusionPath*>(e)->role == erInternalInfill) before.push_back(e);
+                for (auto* e : optimized.entities)
+                    if (dynamic_cast<ExtrusionPath*>(e)->role == erInternalInfill) after.push_back(e);
+                REQUIRE(before.size() == after.size());
+                for (size_t i = 0; i < before.size(); i++) {
+                    REQUIRE(before[i]->first_point() == after[i]->first_point());
+                    REQUIRE(before[i]->last_point() == after[i]->last_point());
+                }
+            }
+        }
+    }
+}
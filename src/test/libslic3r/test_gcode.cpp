@@ -1,5 +1,6 @@
 #include <catch.hpp>
 #include <regex>
+#include <sstream>
 #include "test_data.hpp"
 #include "GCodeReader.hpp"
 #include "GCode.hpp"
@@ -10,6 +11,12 @@ using namespace Slic3r;
 
 #include "GCode/CoolingBuffer.hpp"
 #include "GCode.hpp"
+#include "GCodeAnalyzer.hpp"
+#include "GCodeSink.hpp"
+#include "GCodeTemplate.hpp"
+#include "GCodeTimeEstimator.hpp"
+#include "GCode/Filter.hpp"
+#include "GCode/VibrationLimit.hpp"
 
 SCENARIO("Cooling buffer speed factor rewrite enforces precision") {
     GIVEN("GCode line of set speed") {
@@ -21,6 +28,651 @@ SCENARIO("Cooling buffer speed factor rewrite enforces precision") {
     }
 }
 
+SCENARIO("GCodeSink keeps whole lines in its chunks") {
+    GIVEN("A sink filled with many short lines and a few partial ones") {
+        GCodeSink sink;
+        std::string reference;
+        for (size_t i = 0; i < 20000; ++i) {
+            const std::string line = "G1 X" + std::to_string(i) + " Y" + std::to_string(i * 2) + " E1.00000\n";
+            // write some lines in two parts
+            if (i % 7 == 0) {
+                sink += line.substr(0, 5);
+                sink += line.substr(5);
+            } else {
+                sink += line;
+            }
+            reference += line;
+        }
+        std::string big(GCodeSink::chunk_size, 'x');
+        big.back() = '\n';
+        sink += std::string(big);
+        reference += big;
+        sink += "M107\n";
+        reference += "M107\n";
+
+        THEN("the text is preserved") {
+            REQUIRE(sink.size() == reference.size());
+            REQUIRE(sink.str() == reference);
+            std::ostringstream out;
+            sink.write(out);
+            REQUIRE(out.str() == reference);
+        }
+        THEN("it is split in several chunks ending with a newline") {
+            REQUIRE(sink.chunks().size() > 2);
+            for (size_t i = 0; i + 1 < sink.chunks().size(); ++i)
+                REQUIRE(sink.chunks()[i].back() == '\n');
+        }
+        WHEN("it is moved into another sink") {
+            GCodeSink other;
+            other += "G28\n";
+            const size_t chunks = sink.chunks().size();
+            other += std::move(sink);
+            THEN("the chunks are taken over") {
+                REQUIRE(sink.empty());
+                REQUIRE(other.chunks().size() == chunks + 1);
+                REQUIRE(other.str() == "G28\n" + reference);
+            }
+        }
+    }
+}
+
+SCENARIO("Cooling buffer processes chunked layers like whole ones") {
+    GIVEN("A slow down of a layer with bridges, wipes and external perimeters") {
+        std::string layer;
+        for (size_t i = 0; i < 5000; ++i) {
+            layer += "G1 F1800.000;_EXTRUDE_SET_SPEED\n";
+            layer += "G1 X" + std::to_string(i) + " Y1.000 E0.10000\n";
+            if (i % 3 == 0) layer += ";_BRIDGE_FAN_START\nG1 F600.000;_EXTRUDE_SET_SPEED\nG1 X1 Y2 E3\n;_BRIDGE_FAN_END\n";
+            if (i % 5 == 0) layer += "G1 F3000.000;_EXTRUDE_SET_SPEED;_EXTERNAL_PERIMETER\n";
+            if (i % 11 == 0) layer += "G1 F2400.000;_WIPE\n";
+        }
+        auto cool = [] (GCodeSink &&gcode) {
+            // a fresh writer each time, as it skips fan commands that don't change the speed
+            GCode gcodegen;
+            gcodegen.config.cooling.value = true;
+            gcodegen.config.slowdown_below_layer_time.value = 60;
+            gcodegen.config.disable_fan_first_layers.value = 0;
+            gcodegen.config.bridge_fan_speed.value = 100;
+            CoolingBuffer buffer(gcodegen);
+            gcodegen.elapsed_time = 10;
+            gcodegen.elapsed_time_external = 1;
+            GCodeSink out;
+            buffer.append(std::move(gcode), "object", 2, 0.6, &out);
+            buffer.flush(&out);
+            return out.str();
+        };
+        GCodeSink whole;
+        whole += std::string(layer);
+        GCodeSink chunked;
+        for (size_t pos = 0; pos < layer.size(); ) {
+            const size_t end = layer.find('\n', pos) + 1;
+            chunked += layer.substr(pos, end - pos);
+            pos = end;
+        }
+        REQUIRE(whole.chunks().size() == 1);
+        REQUIRE(chunked.chunks().size() > 1);
+        const std::string result = cool(std::move(whole));
+        THEN("the output is the same") {
+            REQUIRE(result == cool(std::move(chunked)));
+        }
+        THEN("markers are consumed and speeds are reduced") {
+            REQUIRE(result.find(";_") == std::string::npos);
+            REQUIRE(result.find("G1 F1800.000\n") == std::string::npos);
+            REQUIRE(result.find("G1 F600.000\n") != std::string::npos);
+        }
+    }
+}
+
+SCENARIO("Cooling buffer slows down the speeds recorded by the G-code generator") {
+    GIVEN("A short layer with an infill, a bridge and an external perimeter") {
+        GCode gcodegen;
+        gcodegen.config.cooling.value = true;
+        gcodegen.config.slowdown_below_layer_time.value = 20;
+        gcodegen.config.min_print_speed.value = 1;
+        gcodegen.config.disable_fan_first_layers.value = 0;
+        CoolingBuffer buffer(gcodegen);
+        // the feedrates in the text are not used when they were recorded
+        const std::string layer =
+            "G1 F1;_EXTRUDE_SET_SPEED\n"
+            "G1 X1 Y1 E1\n"
+            ";_BRIDGE_FAN_START\n"
+            "G1 F1;_EXTRUDE_SET_SPEED\n"
+            "G1 X2 Y2 E2\n"
+            ";_BRIDGE_FAN_END\n"
+            "G1 F1;_EXTRUDE_SET_SPEED;_EXTERNAL_PERIMETER\n"
+            "G1 X3 Y3 E3\n";
+        gcodegen.extrusion_speeds = {
+            { 3000, false, false },
+            { 1200, true,  false },
+            { 1800, false, true },
+        };
+        gcodegen.elapsed_time          = 10;
+        gcodegen.elapsed_time_bridges  = 2;
+        gcodegen.elapsed_time_external = 6;
+        WHEN("the layer is flushed") {
+            GCodeSink in, out;
+            in += layer;
+            buffer.append(std::move(in), "object", 1, 0.4, &out);
+            REQUIRE(gcodegen.extrusion_speeds.empty());
+            buffer.flush(&out);
+            const std::string gcode = out.str();
+            THEN("the infill and the external perimeter are slowed down by the same factor") {
+                // (10 - 2) / (20 - 2)
+                REQUIRE(gcode.find("G1 F1333.333\nG1 X1") != std::string::npos);
+                REQUIRE(gcode.find("G1 F800.000\nG1 X3") != std::string::npos);
+            }
+            THEN("the bridge keeps its speed, which is left as it was written") {
+                REQUIRE(gcode.find("G1 F1\nG1 X2") != std::string::npos);
+            }
+        }
+        WHEN("the writer formats the feedrates with one decimal and trims the zeros") {
+            gcodegen.writer.config.gcode_precision_xyz.value = 1;
+            gcodegen.writer.config.gcode_trim_zeros.value = true;
+            GCodeSink in, out;
+            in += layer;
+            buffer.append(std::move(in), "object", 1, 0.4, &out);
+            buffer.flush(&out);
+            const std::string gcode = out.str();
+            THEN("the slowed down feedrates are formatted the same way") {
+                REQUIRE(gcode.find("G1 F1333.3\nG1 X1") != std::string::npos);
+                REQUIRE(gcode.find("G1 F800\nG1 X3") != std::string::npos);
+            }
+        }
+    }
+}
+
+SCENARIO("G-code generator follows the speeds of the configuration applied to it") {
+    GIVEN("A G-code generator with a single extruder and an external perimeter path") {
+        GCode gcodegen;
+        PlaceholderParser pp;
+        gcodegen.placeholder_parser = &pp;
+        PrintConfig print_config;
+        print_config.default_acceleration.value   = 1500;
+        print_config.perimeter_acceleration.value = 800;
+        print_config.infill_acceleration.value    = 2000;
+        gcodegen.apply_print_config(print_config);
+        gcodegen.set_extruders(std::vector<unsigned int>{0});
+        gcodegen.set_extruder(0);
+
+        ExtrusionPath path(erExternalPerimeter, 0.05, 0.5, 0.2);
+        path.polyline.append(Point(0, 0));
+        path.polyline.append(Point::new_scale(10, 0));
+        PrintRegionConfig region_config;
+        region_config.perimeter_speed.value = 40;
+        region_config.external_perimeter_speed.value   = 50;
+        region_config.external_perimeter_speed.percent = true;
+        gcodegen.apply_region_config(region_config);
+
+        WHEN("the path is extruded") {
+            const std::string gcode = gcodegen.extrude(path);
+            THEN("the speed is relative to the perimeter speed of the region") {
+                REQUIRE(gcode.find("G1 F1200.000\n") != std::string::npos);
+            }
+            THEN("the perimeter acceleration is used") {
+                REQUIRE(gcode.find("M204 P800 T800") != std::string::npos);
+            }
+        }
+        WHEN("another region is applied") {
+            region_config.perimeter_speed.value = 60;
+            gcodegen.apply_region_config(region_config);
+            THEN("its speeds are used for the next paths") {
+                REQUIRE(gcodegen.extrude(path).find("G1 F1800.000\n") != std::string::npos);
+            }
+        }
+        WHEN("the path is on the first layer") {
+            gcodegen.first_layer = true;
+            gcodegen.config.first_layer_speed.value   = 50;
+            gcodegen.config.first_layer_speed.percent = true;
+            THEN("the first layer speed is relative to the speed of the role") {
+                REQUIRE(gcodegen.extrude(path).find("G1 F600.000\n") != std::string::npos);
+            }
+        }
+        WHEN("the path is infill") {
+            path.role = erInternalInfill;
+            region_config.infill_speed.value = 70;
+            gcodegen.apply_region_config(region_config);
+            const std::string gcode = gcodegen.extrude(path);
+            THEN("the infill speed and acceleration are used") {
+                REQUIRE(gcode.find("G1 F4200.000\n") != std::string::npos);
+                REQUIRE(gcode.find("M204 P2000 T2000") != std::string::npos);
+            }
+        }
+    }
+}
+
+SCENARIO("G-code generator writes a recorded extrusion again for another copy") {
+    GIVEN("A square perimeter loop and an infill path") {
+        PrintConfig print_config;
+        print_config.use_relative_e_distances.value = true;
+        auto generator = [&print_config] (PlaceholderParser* pp) {
+            std::unique_ptr<GCode> gcodegen { new GCode() };
+            gcodegen->placeholder_parser = pp;
+            gcodegen->apply_print_config(print_config);
+            gcodegen->enable_cooling_markers = true;
+            gcodegen->set_extruders(std::vector<unsigned int>{0});
+            gcodegen->set_extruder(0);
+            return gcodegen;
+        };
+        ExtrusionPath perimeter(erExternalPerimeter, 0.05, 0.5, 0.2);
+        perimeter.polyline.points = Polygon::new_scale({ Pointf(0, 0), Pointf(10, 0), Pointf(10, 10), Pointf(0, 10), Pointf(0, 0) }).points;
+        const ExtrusionLoop loop(perimeter, elrContourInternalPerimeter);
+        ExtrusionPath infill(erInternalInfill, 0.04, 0.4, 0.2);
+        infill.polyline.points = Polygon::new_scale({ Pointf(2, 2), Pointf(8, 2), Pointf(8, 8) }).points;
+
+        PlaceholderParser pp;
+        auto recorder = generator(&pp);
+        WrittenExtrusion written_loop, written_infill;
+        recorder->recording = &written_loop;
+        recorder->extrude(loop, "perimeter");
+        recorder->recording = &written_infill;
+        recorder->extrude(infill, "infill");
+        recorder->recording = nullptr;
+
+        WHEN("they are written again from another origin") {
+            auto replayed = generator(&pp), extruded = generator(&pp);
+            replayed->set_origin(Pointf(30, 5));
+            extruded->set_origin(Pointf(30, 5));
+            // start from where the recorder started, so that the seam is the same
+            replayed->set_last_pos(Point(0, 0));
+            extruded->set_last_pos(Point(0, 0));
+            std::string replayed_gcode = replayed->extrude(written_loop);
+            replayed_gcode += replayed->extrude(written_infill);
+            std::string extruded_gcode = extruded->extrude(loop, "perimeter");
+            extruded_gcode += extruded->extrude(infill, "infill");
+            THEN("the G-code is the same as when they are extruded from there") {
+                REQUIRE(written_loop.loop);
+                REQUIRE(written_infill.paths.size() == 1);
+                REQUIRE(replayed_gcode == extruded_gcode);
+            }
+            THEN("the cooling data are recorded in the same way") {
+                REQUIRE(replayed->extrusion_speeds.size() == extruded->extrusion_speeds.size());
+                REQUIRE(replayed->elapsed_time == Approx(extruded->elapsed_time));
+                REQUIRE(replayed->get_cog().x == Approx(extruded->get_cog().x));
+            }
+        }
+    }
+}
+
+SCENARIO("G-code filters") {
+    PrintConfig config;
+    GIVEN("A vibration limit of 10 Hz") {
+        config.vibration_limit.value = 10;
+        VibrationLimit filter(config);
+        WHEN("the X axis changes direction twice in a row") {
+            GCodeSink gcode;
+            gcode += "G1 F6000\nG1 X10 Y0\nG1 X10.15 Y0\nG1 X10 Y0\nG1 X10.15 Y0\n";
+            filter.process(&gcode, true);
+            THEN("a pause is inserted before the second change") {
+                // 0.15 mm at 100 mm/s take 1.5 ms, the limit is 100 ms
+                REQUIRE(gcode.str() == "G1 F6000\nG1 X10 Y0\nG1 X10.15 Y0\nG1 X10 Y0\nG4 P98\nG1 X10.15 Y0\n");
+            }
+        }
+    }
+    GIVEN("A pipeline of filters writing to a stream") {
+        struct Tag : public GCodeFilter {
+            std::string tag;
+            size_t processed {0};
+            Tag(std::string _tag) : tag(_tag) {};
+            void process(GCodeSink* gcode, bool flush) override {
+                std::string text = gcode->str();
+                if (!text.empty()) text.insert(text.size() - 1, " " + this->tag);
+                gcode->clear();
+                *gcode += text;
+                ++this->processed;
+                if (flush) *gcode += "; flushed by " + this->tag + "\n";
+            };
+        };
+        std::ostringstream out;
+        GCodeFilterPipeline pipeline(out);
+        Tag* a = new Tag("a");
+        Tag* b = new Tag("b");
+        pipeline.add(std::unique_ptr<GCodeFilter>(a));
+        pipeline.add(std::unique_ptr<GCodeFilter>(b));
+        WHEN("many layers are pushed, then flushed") {
+            std::string expected;
+            for (size_t i = 0; i < 100; ++i) {
+                GCodeSink layer;
+                layer += "G1 Z" + std::to_string(i) + "\n";
+                pipeline.push(std::move(layer));
+                expected += "G1 Z" + std::to_string(i) + " a b\n";
+            }
+            pipeline.push(GCodeSink(), true);
+            expected += "; flushed by a b\n; flushed by b\n";
+            THEN("they went through the filters in order and are all written") {
+                REQUIRE(a->processed == 101);
+                REQUIRE(b->processed == 101);
+                REQUIRE(out.str() == expected);
+            }
+        }
+        WHEN("a filter fails") {
+            struct Fail : public GCodeFilter {
+                void process(GCodeSink*, bool) override { throw std::runtime_error("filter failed"); };
+            };
+            pipeline.add(std::unique_ptr<GCodeFilter>(new Fail()));
+            GCodeSink layer;
+            layer += "G1 Z0\n";
+            THEN("the error is reported to the generator") {
+                REQUIRE_THROWS_WITH(pipeline.push(std::move(layer), true), "filter failed");
+            }
+        }
+    }
+}
+
+SCENARIO("GCodeReader parses the arguments of each line once") {
+    GIVEN("A few lines of G-code, the last one without a newline") {
+        const std::string gcode =
+            "G1 X10.5 Y-2.25 F1800 ; move\n"
+            "\n"
+            "G1  E1.5\tZ0.3 X1 X2\r\n"
+            "M117 Printing S12345678901234567.5\n"
+            "G92 E0";
+        std::vector<GCodeReader::GCodeLine> lines;
+        std::vector<float> X;
+        GCodeReader reader;
+        reader.parse(gcode, [&lines, &X] (GCodeReader &reader, const GCodeReader::GCodeLine &line) {
+            lines.push_back(line);
+            X.push_back(reader.X);
+        });
+        THEN("every line is parsed") {
+            REQUIRE(lines.size() == 5);
+            REQUIRE(lines[0].raw == "G1 X10.5 Y-2.25 F1800 ; move");
+            REQUIRE(lines[0].cmd == "G1");
+            REQUIRE(lines[0].comment == " move");
+            REQUIRE(lines[1].cmd.empty());
+            REQUIRE(lines[4].cmd == "G92");
+        }
+        THEN("the arguments are parsed like atof() does") {
+            REQUIRE(lines[0].get_float('X') == float(atof("10.5")));
+            REQUIRE(lines[0].get_float('Y') == float(atof("-2.25")));
+            REQUIRE(lines[0].get_float('F') == 1800);
+            REQUIRE(lines[2].get_float('E') == float(atof("1.5")));
+            REQUIRE(lines[2].get_float('Z') == float(atof("0.3")));
+            REQUIRE(lines[3].get_float('P') == 0);
+            REQUIRE(lines[3].get_float('S') == float(atof("12345678901234567.5")));
+        }
+        THEN("the first occurrence of an argument is used") {
+            REQUIRE(lines[2].get_float('X') == 1);
+            REQUIRE(lines[2].get_string('X') == "1");
+        }
+        THEN("the missing arguments are not set") {
+            REQUIRE_FALSE(lines[0].has('Z'));
+            REQUIRE_FALSE(lines[1].has('X'));
+            REQUIRE(lines[0].get_string('Z').empty());
+        }
+        THEN("the position is updated after each move") {
+            REQUIRE(X == std::vector<float>({ 0, 10.5, 10.5, 1, 1 }));
+            REQUIRE(reader.Z == Approx(0.3));
+            REQUIRE(reader.E == 0);
+        }
+        THEN("parsing a stream gives the same lines") {
+            std::istringstream stream(gcode);
+            GCodeReader stream_reader;
+            size_t i = 0;
+            stream_reader.parse_stream(stream, [&lines, &i] (GCodeReader &, const GCodeReader::GCodeLine &line) {
+                REQUIRE(line.raw == lines[i].raw);
+                REQUIRE(line.get_float('X') == lines[i].get_float('X'));
+                ++i;
+            });
+            REQUIRE(i == lines.size());
+        }
+    }
+    GIVEN("A line using another extrusion axis") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("extrusion_axis", "A");
+        GCodeReader reader;
+        reader.apply_config(config->config());
+        reader.parse_line("G1 X1 A2.5", [] (GCodeReader &, const GCodeReader::GCodeLine &line) {
+            THEN("it is read as E") {
+                REQUIRE(line.get_float('E') == 2.5);
+                REQUIRE(line.get_string('E') == "2.5");
+                REQUIRE_FALSE(line.has('A'));
+            }
+        });
+    }
+    GIVEN("A line changed with set()") {
+        GCodeReader reader;
+        reader.parse_line("G1 X1 Y2", [] (GCodeReader &, GCodeReader::GCodeLine line) {
+            line.set('Y', "3.5");
+            line.set('Z', "0.2");
+            THEN("the text and the values are updated") {
+                REQUIRE(line.raw == "G1 Z0.2 X1 Y3.5");
+                REQUIRE(line.new_Y() == 3.5);
+                REQUIRE(line.new_Z() == 0.2f);
+            }
+        });
+    }
+}
+
+SCENARIO("Print time estimation") {
+    // accelerating at 1000 mm/s^2 from the jerk speed to 100 mm/s takes 0.09 s
+    // and 4.95 mm; stopping takes 0.1 s and 5 mm
+    const std::string setup = "M201 X5000 Y5000\nM204 S1000\nM205 X10 Y10\n";
+    const double straight_100mm = 0.09 + 0.1 + (100 - 4.95 - 5) / 100;
+    GIVEN("A straight move of 100 mm at 100 mm/s") {
+        GCodeTimeEstimator estimator;
+        estimator.parse(setup + "G1 X100 F6000\n");
+        THEN("it accelerates and decelerates along a trapezoid") {
+            REQUIRE(estimator.time == Approx(straight_100mm));
+        }
+    }
+    GIVEN("The same move split in many segments") {
+        GCodeTimeEstimator estimator;
+        std::ostringstream gcode;
+        gcode << setup;
+        for (size_t i = 1; i <= 100; ++i)
+            gcode << "G1 X" << i << " F6000\n";
+        estimator.parse(gcode.str());
+        THEN("the speed is kept from one segment to the next, beyond the lookahead buffer") {
+            REQUIRE(estimator.time == Approx(straight_100mm));
+        }
+    }
+    GIVEN("The same move split in segments too short for the lookahead buffer to plan a stop") {
+        GCodeTimeEstimator estimator;
+        std::ostringstream gcode;
+        gcode << setup;
+        for (size_t i = 1; i <= 1000; ++i)
+            gcode << "G1 X" << i * 0.1 << " F6000\n";
+        estimator.parse(gcode.str());
+        THEN("the speed is limited like in the firmware") {
+            REQUIRE(estimator.time > straight_100mm + 0.1);
+        }
+    }
+    GIVEN("The same length with a right angle in the middle") {
+        GCodeTimeEstimator estimator;
+        estimator.parse(setup + "G1 X50 F6000\nG1 Y50\n");
+        THEN("it slows down for the corner") {
+            // the corner is taken at the jerk speed
+            REQUIRE(estimator.time == Approx(3 * 0.09 + 0.1 + (100 - 3 * 4.95 - 5) / 100));
+        }
+    }
+    GIVEN("A dwell") {
+        GCodeTimeEstimator estimator;
+        estimator.parse(setup + "G1 X100 F6000\nG4 P500\nG4 S2\n");
+        THEN("its duration is added") {
+            REQUIRE(estimator.time == Approx(straight_100mm + 2.5));
+        }
+    }
+    GIVEN("Two layers with perimeters, infill and travel moves") {
+        GCodeTimeEstimator estimator;
+        estimator.parse(setup +
+            "G1 Z0.3 F6000\n"
+            "G1 X10 Y10\n"
+            ";ROLE:perimeter\n"
+            "G1 X20 E1\n"
+            "G1 Y20 E2\n"
+            ";ROLE:infill\n"
+            "G1 X10 E3\n"
+            "G1 Z0.5\n"
+            "G1 X20 Y10\n"
+            ";ROLE:external perimeter\n"
+            "G1 X10 E4\n"
+        );
+        THEN("the time is broken down per layer") {
+            REQUIRE(estimator.layers.size() == 2);
+            REQUIRE(estimator.layers[0].print_z == Approx(0.3));
+            REQUIRE(estimator.layers[1].print_z == Approx(0.5));
+            REQUIRE(estimator.layers[0].time + estimator.layers[1].time == Approx(estimator.time));
+        }
+        THEN("the time is broken down per feature") {
+            REQUIRE(estimator.role_times[erPerimeter] > 0);
+            REQUIRE(estimator.role_times[erInternalInfill] > 0);
+            REQUIRE(estimator.role_times[erExternalPerimeter] > 0);
+            REQUIRE(estimator.role_times[erSolidInfill] == 0);
+            REQUIRE(estimator.role_times[erPerimeter] > estimator.role_times[erInternalInfill]);
+        }
+    }
+    GIVEN("The G-code exported for a cube, without comments") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("gcode_comments", false);
+        config->set("skirts", 1);
+        config->set("fill_density", 0.2);
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+        std::stringstream exported;
+        Slic3r::Test::gcode(exported, print);
+        GCodeTimeEstimator estimator;
+        estimator.apply_config(config->config());
+        estimator.parse(exported.str());
+        THEN("every extrusion is attributed to the role of its path") {
+            for (ExtrusionRole role : { erSkirt, erPerimeter, erExternalPerimeter, erInternalInfill, erSolidInfill, erTopSolidInfill })
+                REQUIRE(estimator.role_times[role] > 0);
+            REQUIRE(estimator.role_times[erNone] == 0);
+            REQUIRE(estimator.role_times[erSupportMaterial] == 0);
+            double total = estimator.travel_time;
+            for (double role_time : estimator.role_times)
+                total += role_time;
+            REQUIRE(total == Approx(estimator.time));
+        }
+    }
+}
+
+SCENARIO("G-code analysis") {
+    GIVEN("The G-code of a cube with two extruders") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        config->set("gcode_comments", false);
+        config->set("perimeter_extruder", 2);
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+        std::stringstream gcode;
+        Slic3r::Test::gcode(gcode, print);
+        const std::string exported {gcode.str()};
+
+        GCodeAnalyzer analyzer(config->config());
+        analyzer.threads = 1;
+        analyzer.min_chunk_size = exported.size();
+        const GCodeStats whole {analyzer.analyze(exported)};
+        analyzer.threads = 4;
+        analyzer.min_chunk_size = 1000;
+        const GCodeStats chunked {analyzer.analyze(exported)};
+
+        THEN("analyzing it in one piece gives the results of the estimator") {
+            GCodeTimeEstimator estimator;
+            estimator.apply_config(config->config());
+            estimator.parse(exported);
+            REQUIRE(whole.time == Approx(estimator.time));
+            REQUIRE(whole.layers.size() == estimator.layers.size());
+            REQUIRE(whole.extent.max.z == Approx(whole.layers.back().print_z));
+            REQUIRE(whole.filament_used.size() == 2);
+            REQUIRE(whole.filament_used[0] > 0);
+            REQUIRE(whole.filament_used[1] > 0);
+            REQUIRE(whole.max_volumetric_speed > 0);
+            REQUIRE(whole.toolchanges > 0);
+            const size_t reported {exported.find("; toolchanges = ")};
+            REQUIRE(reported != std::string::npos);
+            REQUIRE(whole.toolchanges == std::stoul(exported.substr(reported + 16)));
+        }
+        THEN("the filament is broken down per role from the tags of the G-code generator") {
+            REQUIRE(whole.role_filament[erPerimeter] > 0);
+            REQUIRE(whole.role_filament[erExternalPerimeter] > 0);
+            REQUIRE(whole.role_filament[erSolidInfill] > 0);
+            REQUIRE(whole.role_filament[erNone] == 0);
+        }
+        THEN("analyzing it in chunks gives the same results") {
+            REQUIRE(chunked.lines == whole.lines);
+            REQUIRE(chunked.moves == whole.moves);
+            REQUIRE(chunked.toolchanges == whole.toolchanges);
+            REQUIRE(chunked.extent.min.x == Approx(whole.extent.min.x));
+            REQUIRE(chunked.extent.max.y == Approx(whole.extent.max.y));
+            REQUIRE(chunked.filament_used.size() == whole.filament_used.size());
+            for (size_t i = 0; i < whole.filament_used.size(); ++i)
+                REQUIRE(chunked.filament_used[i] == Approx(whole.filament_used[i]));
+            for (size_t role = 0; role <= erSupportMaterialInterface; ++role)
+                REQUIRE(chunked.role_filament[role] == Approx(whole.role_filament[role]));
+            REQUIRE(chunked.max_volumetric_speed == Approx(whole.max_volumetric_speed));
+            REQUIRE(chunked.layers.size() == whole.layers.size());
+            // the chunks are cut at layer changes, where the printer nearly stops anyway
+            REQUIRE(chunked.time == Approx(whole.time).epsilon(0.01));
+        }
+        THEN("the statistics are written as JSON") {
+            const std::string json {chunked.json()};
+            REQUIRE(json.find("\"filament_used\": [") != std::string::npos);
+            REQUIRE(json.find("\"toolchanges\": ") != std::string::npos);
+            REQUIRE(json.find("\"perimeter\": {") != std::string::npos);
+            REQUIRE(json.find("\"layers\": [") != std::string::npos);
+        }
+    }
+}
+
+SCENARIO("Custom G-code templates expand like the placeholder parser") {
+    GIVEN("A placeholder parser with single and multiple values") {
+        PlaceholderParser pp;
+        pp.set("foo", "12");
+        pp.set("bar", std::vector<std::string> { "1.5", "2.5", "3.5" });
+        pp.set("baz_1", "single");
+        pp.set("brackets", "[foo]");
+        pp.set("name", "ba");
+        const std::vector<std::string> templates {
+            "",
+            "G1 Z[foo]\nM104 S[bar] T[bar_2]",
+            "[bar_0] [bar_1] [bar_3] [bar_01] [bar_x] [baz_1] [unknown] [] [ [foo",
+            "[bar_4] [bar_3]",
+            "[brackets] [[name]r]",
+            "M117 {[foo] * 2} {[bar_1] + [layer_num]}\n{if [layer_num] > 2}M106 S255\nG1 X{[foo]/4} ; [layer_z]",
+            "{if [current_retraction] == 0}G1 E{2^3}\n{log10(100)} {bad expression} \\{[foo]\\}",
+        };
+
+        WHEN("they are expanded for each layer with their values set") {
+            THEN("the G-code is the same as with a copy of the parser") {
+                for (const std::string &gcode : templates) {
+                    const GCodeTemplate tmpl(gcode);
+                    REQUIRE(tmpl.gcode() == gcode);
+                    for (int layer = 0; layer < 5; ++layer) {
+                        GCodeTemplate::Values values;
+                        values.set("layer_num", layer);
+                        values.set("layer_z", 0.3 + layer * 0.2);
+                        values.set("current_retraction", layer % 2 == 0 ? 0.0 : 1.5);
+                        PlaceholderParser copy { pp };
+                        copy.set("layer_num", layer);
+                        copy.set("layer_z", 0.3 + layer * 0.2);
+                        copy.set("current_retraction", layer % 2 == 0 ? 0.0 : 1.5);
+                        REQUIRE(tmpl.process(pp, values) == apply_math(copy.process(gcode)));
+                    }
+                }
+            }
+        }
+        WHEN("a value overrides a placeholder having multiple values") {
+            GCodeTemplate::Values values;
+            values.set("bar", "7");
+            PlaceholderParser copy { pp };
+            copy.set("bar", "7");
+            const std::string gcode { "[bar] [bar_0] [bar_1]" };
+            THEN("its other values are not used anymore") {
+                REQUIRE(GCodeTemplate(gcode).process(pp, values) == apply_math(copy.process(gcode)));
+                REQUIRE(GCodeTemplate(gcode).process(pp, values) == "7 [bar_0] [bar_1]");
+            }
+        }
+    }
+    GIVEN("Expressions with the same form and different numbers") {
+        THEN("each one gets its own result") {
+            REQUIRE(apply_math("{1 + 2}") == "3");
+            REQUIRE(apply_math("{3 + 4}") == "7");
+            REQUIRE(apply_math("{2^3} {3^2}") == "8 9");
+            REQUIRE(apply_math("{if 3 > 2}G1\n{if 2 > 3}G2\nG3") == apply_math("{if 4 > 2}G1\n{if 2 > 4}G2\nG3"));
+            REQUIRE(apply_math("{1e1 + 1.5e-1}") == apply_math("{10.15}"));
+        }
+    }
+}
+
 SCENARIO( "Test of COG calculation") {
     GIVEN("A default configuration and a print test object") {
         auto config {Slic3r::Config::new_from_defaults()};
@@ -1,6 +1,9 @@
 #include <catch.hpp>
+#include <cstdio>
 #include <memory>
+#include <random>
 
+#include "GCodeFormatter.hpp"
 #include "GCodeWriter.hpp"
 #include "test_options.hpp"
 
@@ -125,3 +128,83 @@ SCENARIO("set_speed emits values with fixed-point output.") {
         }
     }
 }
+
+SCENARIO("GCodeFormatter rounds like printf") {
+    // printf("%.*f") as written by std::fixed << std::setprecision()
+    auto printf_fixed = [] (double value, int precision) {
+        char buf[512];
+        snprintf(buf, sizeof(buf), "%.*f", precision, value);
+        return std::string(buf);
+    };
+    auto fixed = [] (double value, int precision, bool trim_zeros = false) {
+        std::string out;
+        GCodeFormatter::append_fixed(&out, value, precision, trim_zeros);
+        return out;
+    };
+    GIVEN("Random values of all magnitudes and values close to a rounding tie") {
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<double> mantissa(-1.0, 1.0);
+        std::uniform_int_distribution<int> exponent(-8, 12);
+        std::vector<double> values { 0.0, -0.0, 0.0005, 0.0015, 2.5, -2.5, 1.0005, 0.1, 203.2005, -0.0001, 1e300, 1e-300 };
+        for (size_t i = 0; i < 20000; ++i)
+            values.push_back(mantissa(rng) * std::pow(10.0, exponent(rng)));
+        for (size_t i = 0; i < 2000; ++i)
+            values.push_back((std::floor(mantissa(rng) * 1e6) + 0.5) / 1000.0);
+        THEN("the output is the same as printf for every precision") {
+            for (double value : values)
+                for (int precision = 0; precision <= 9; ++precision)
+                    REQUIRE(fixed(value, precision) == printf_fixed(value, precision));
+        }
+    }
+    GIVEN("Trailing zero trimming") {
+        THEN("zeros and dangling dots are dropped") {
+            REQUIRE(fixed(10.5, 3, true) == "10.5");
+            REQUIRE(fixed(2.0, 3, true) == "2");
+            REQUIRE(fixed(-0.0001, 3, true) == "0");
+            REQUIRE(fixed(-1.25, 5, true) == "-1.25");
+            REQUIRE(fixed(100.0, 0, true) == "100");
+        }
+    }
+    GIVEN("Integers and general notation") {
+        std::string out;
+        GCodeFormatter::append_int(&out, -1234567890123LL);
+        out += " ";
+        GCodeFormatter::append_general(&out, 255.0 * 35 / 100.0);
+        THEN("they are written like an ostream with default flags") {
+            REQUIRE(out == "-1234567890123 89.25");
+        }
+    }
+}
+
+SCENARIO("GCodeWriter number precision and trimming") {
+    GIVEN("A writer with a single extruder") {
+        GCodeWriter writer;
+        std::vector<unsigned int> extruder_ids {0};
+        writer.set_extruders(extruder_ids);
+        writer.set_extruder(0);
+        WHEN("the default precision is used") {
+            THEN("coordinates have 3 decimals and E has 5") {
+                REQUIRE_THAT(writer.travel_to_xy(Pointf(10, 20.5)), Catch::Equals("G1 X10.000 Y20.500 F7800.000\n"));
+                REQUIRE_THAT(writer.extrude_to_xy(Pointf(10, 21), 0.25), Catch::Equals("G1 X10.000 Y21.000 E0.25000\n"));
+            }
+        }
+        WHEN("the precision is changed and trailing zeros are trimmed") {
+            writer.config.gcode_precision_xyz.value = 2;
+            writer.config.gcode_precision_e.value = 4;
+            writer.config.gcode_trim_zeros.value = true;
+            THEN("the numbers are shorter") {
+                REQUIRE_THAT(writer.travel_to_xy(Pointf(10, 20.5)), Catch::Equals("G1 X10 Y20.5 F7800\n"));
+                // 10.125 is an exact tie, which printf rounds to even
+                REQUIRE_THAT(writer.extrude_to_xy(Pointf(10.125, 21.006), 0.25), Catch::Equals("G1 X10.12 Y21.01 E0.25\n"));
+            }
+        }
+        WHEN("G-code is appended to an existing buffer") {
+            std::string gcode {"G92 E0\n"};
+            writer.set_speed(&gcode, 1800);
+            writer.extrude_to_xy(&gcode, Pointf(1, 2), 0.5);
+            THEN("it is the same as concatenating the returned strings") {
+                REQUIRE_THAT(gcode, Catch::Equals("G92 E0\nG1 F1800.000\nG1 X1.000 Y2.000 E0.50000\n"));
+            }
+        }
+    }
+}
@@ -7,7 +7,9 @@
 #include "Polyline.hpp"
 #include "Line.hpp"
 #include "Geometry.hpp"
+#include "PolylineCollection.hpp"
 #include "ClipperUtils.hpp"
+#include "OverhangClassifier.hpp"
 
 using namespace Slic3r;
 
@@ -161,6 +163,72 @@ TEST_CASE("Offsetting a line generates a polygon correctly"){
     REQUIRE(area.area() == Polygon(std::vector<Point>({Point(10,5),Point(20,5),Point(20,15),Point(10,15)})).area());
 }
 
+TEST_CASE("Offsetting the same polygons several times gives the results of offset() and offset2()"){
+    // a square with a notch and a square hole, in the usual orientations
+    Polygons polygons {
+        Polygon({ Point::new_scale(0, 0), Point::new_scale(20, 0), Point::new_scale(20, 20), Point::new_scale(11, 20),
+            Point::new_scale(10, 12), Point::new_scale(9, 20), Point::new_scale(0, 20) }),
+        Polygon({ Point::new_scale(5, 5), Point::new_scale(5, 8), Point::new_scale(15, 8), Point::new_scale(15, 5) }),
+    };
+    PolygonOffsetter offsetter(polygons);
+    for (const float delta : { -scale_(0.45), +scale_(0.2), -scale_(1.5), +scale_(3.) }) {
+        auto expected = offset(polygons, delta);
+        auto result = offsetter.offset(delta);
+        REQUIRE(result.size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+            REQUIRE(result[i].points == expected[i].points);
+    }
+    for (const float delta : { -scale_(0.6), -scale_(2.) }) {
+        auto expected = offset2(polygons, delta, -delta / 2);
+        auto result = offsetter.offset2(delta, -delta / 2);
+        REQUIRE(result.size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+            REQUIRE(result[i].points == expected[i].points);
+    }
+}
+
+TEST_CASE("Overhangs are classified like by clipping against the whole lower layer"){
+    // a large slice with a hole containing an island, and a small slice
+    Polygons lower {
+        Polygon({ Point::new_scale(0, 0), Point::new_scale(40, 0), Point::new_scale(40, 40), Point::new_scale(0, 40) }),
+        Polygon({ Point::new_scale(10, 10), Point::new_scale(10, 30), Point::new_scale(30, 30), Point::new_scale(30, 10) }),
+        Polygon({ Point::new_scale(15, 15), Point::new_scale(25, 15), Point::new_scale(25, 25), Point::new_scale(15, 25) }),
+        Polygon({ Point::new_scale(50, 0), Point::new_scale(55, 0), Point::new_scale(55, 5), Point::new_scale(50, 5) }),
+    };
+    OverhangClassifier classifier(lower);
+    // small square loops in every situation: on supported or unsupported
+    // areas and across edges
+    Polygons loops;
+    for (double x = -5; x < 60; x += 1.7)
+        for (double y = -5; y < 45; y += 2.3)
+            loops.push_back(Polygon({ Point::new_scale(x, y), Point::new_scale(x + 1.5, y), Point::new_scale(x + 1.5, y + 2), Point::new_scale(x, y + 2) }));
+    // large loops around the island, around the hole and around everything
+    for (double d : { 3.0, 7.0, 12.0 })
+        loops.push_back(Polygon({ Point::new_scale(20 - d, 20 - d), Point::new_scale(20 + d, 20 - d), Point::new_scale(20 + d, 20 + d), Point::new_scale(20 - d, 20 + d) }));
+    loops.push_back(Polygon({ Point::new_scale(-2, -2), Point::new_scale(60, -2), Point::new_scale(60, 45), Point::new_scale(-2, 45) }));
+
+    Polylines all;
+    for (const Polygon &loop : loops) {
+        Polylines supported, overhanging;
+        classifier.classify(loop, &supported, &overhanging);
+        auto expected_supported = intersection_pl(loop, lower);
+        auto expected_overhanging = diff_pl(loop, lower);
+        REQUIRE(supported.size() == expected_supported.size());
+        for (size_t i = 0; i < supported.size(); ++i)
+            REQUIRE(supported[i].points == expected_supported[i].points);
+        REQUIRE(overhanging.size() == expected_overhanging.size());
+        for (size_t i = 0; i < overhanging.size(); ++i)
+            REQUIRE(overhanging[i].points == expected_overhanging[i].points);
+        all.push_back(loop.split_at_first_point());
+    }
+    auto overhanging = classifier.overhanging(all);
+    auto expected = diff_pl(all, lower);
+    double length = 0, expected_length = 0;
+    for (const Polyline &polyline : overhanging) length += polyline.length();
+    for (const Polyline &polyline : expected) expected_length += polyline.length();
+    REQUIRE(length == Approx(expected_length));
+}
+
 SCENARIO("Circle Fit, TaubinFit with Newton's method") {
     GIVEN("A vector of Pointfs arranged in a half-circle with approximately the same distance R from some point") {
         Pointf expected_center(-6, 0);
@@ -254,6 +322,76 @@ SCENARIO("Circle Fit, TaubinFit with Newton's method") {
 }
 
 
+SCENARIO("Arc fitting") {
+    // the arcs must stay within tolerance of the segments they replace
+    auto check_tolerance = [] (const Pointfs& points, const Geometry::FittedArc& arc, double tolerance) {
+        const double radius = std::hypot(points[arc.start].x - arc.center.x, points[arc.start].y - arc.center.y);
+        for (size_t i = arc.start + 1; i <= arc.end; ++i) {
+            const Pointf middle((points[i-1].x + points[i].x) / 2, (points[i-1].y + points[i].y) / 2);
+            REQUIRE(std::abs(std::hypot(points[i].x - arc.center.x, points[i].y - arc.center.y) - radius) <= tolerance);
+            REQUIRE(std::abs(std::hypot(middle.x - arc.center.x, middle.y - arc.center.y) - radius) <= tolerance);
+        }
+    };
+    GIVEN("A polyline following a circle of radius 20 with a little noise, turning clockwise") {
+        Pointfs points;
+        for (size_t i = 0; i <= 60; ++i) {
+            const double angle = -PI * i / 60 * 0.9;
+            const double noise = (i % 3) * 0.002;
+            points.push_back(Pointf(5 + (20 + noise) * cos(angle), 7 + (20 + noise) * sin(angle)));
+        }
+        WHEN("arcs are fitted with a tolerance of 0.02 mm") {
+            const Geometry::FittedArcs arcs = Geometry::fit_arcs(points, 0.02);
+            THEN("the whole polyline is one clockwise arc around the center of the circle") {
+                REQUIRE(arcs.size() == 1);
+                REQUIRE(arcs.front().start == 0);
+                REQUIRE(arcs.front().end == points.size() - 1);
+                REQUIRE_FALSE(arcs.front().ccw);
+                REQUIRE(std::abs(arcs.front().center.x - 5) < 0.01);
+                REQUIRE(std::abs(arcs.front().center.y - 7) < 0.01);
+                check_tolerance(points, arcs.front(), 0.02);
+            }
+        }
+        WHEN("arcs are fitted with a tolerance smaller than the noise") {
+            const Geometry::FittedArcs arcs = Geometry::fit_arcs(points, 0.0005);
+            THEN("no arc is found") {
+                REQUIRE(arcs.empty());
+            }
+        }
+    }
+    GIVEN("A counter-clockwise and a clockwise arc of different radii joined by a corner and a straight line") {
+        Pointfs points;
+        for (size_t i = 0; i <= 20; ++i)
+            points.push_back(Pointf(10 * cos(PI / 2 * i / 20), 10 * sin(PI / 2 * i / 20)));
+        points.push_back(Pointf(-10, 10));
+        points.push_back(Pointf(-20, 10));
+        for (size_t i = 1; i <= 30; ++i)
+            points.push_back(Pointf(-20 - 5 * sin(PI * i / 30), 15 - 5 * cos(PI * i / 30)));
+        const Geometry::FittedArcs arcs = Geometry::fit_arcs(points, 0.01);
+        THEN("each arc is found and is within tolerance") {
+            REQUIRE(arcs.size() == 2);
+            REQUIRE(arcs[0].start == 0);
+            REQUIRE(arcs[0].end == 20);
+            REQUIRE(arcs[0].ccw);
+            REQUIRE(arcs[1].start == 22);
+            REQUIRE(arcs[1].end == points.size() - 1);
+            REQUIRE_FALSE(arcs[1].ccw);
+            for (const Geometry::FittedArc& arc : arcs)
+                check_tolerance(points, arc, 0.01);
+        }
+    }
+    GIVEN("Straight and zigzag polylines") {
+        Pointfs straight, zigzag;
+        for (size_t i = 0; i < 20; ++i) {
+            straight.push_back(Pointf(i, 2 * i));
+            zigzag.push_back(Pointf(i, i % 2));
+        }
+        THEN("no arc is found") {
+            REQUIRE(Geometry::fit_arcs(straight, 0.01).empty());
+            REQUIRE(Geometry::fit_arcs(zigzag, 0.01).empty());
+        }
+    }
+}
+
 TEST_CASE("Chained path working correctly"){
     // if chained_path() works correctly, these points should be joined with no diagonal paths
     // (thus 26 units long)
@@ -266,6 +404,47 @@ TEST_CASE("Chained path working correctly"){
     }
 }
 
+TEST_CASE("Chained path matches the linear nearest-neighbour walk"){
+    // grid points with duplicates produce plenty of equidistant candidates
+    Points points;
+    for (coord_t i = 0; i < 400; ++i)
+        points.push_back(Point((i * 7919) % 23 * 10, (i * 104729) % 17 * 10));
+    for (coord_t i = 0; i < 50; ++i)
+        points.push_back(points.at(i * 3));
+
+    std::vector<Points::size_type> expected;
+    {
+        PointConstPtrs my_points;
+        for (const Point &p : points) my_points.push_back(&p);
+        Point start_near = points.front();
+        while (!my_points.empty()) {
+            int idx = start_near.nearest_point_index(my_points);
+            start_near = *my_points[idx];
+            expected.push_back(my_points[idx] - &points.front());
+            my_points.erase(my_points.begin() + idx);
+        }
+    }
+    std::vector<Points::size_type> indices;
+    Geometry::chained_path(points, indices);
+    REQUIRE(indices == expected);
+}
+
+TEST_CASE("Chained path of polylines reverses to the nearest endpoint"){
+    Polylines polylines(3);
+    polylines[0].points = {Point(0,0), Point(100,0)};
+    polylines[1].points = {Point(300,0), Point(200,0)};
+    polylines[2].points = {Point(400,0), Point(500,0)};
+    Polylines chained = PolylineCollection::chained_path_from(polylines, Point(0,0));
+    REQUIRE(chained.size() == 3);
+    REQUIRE(chained[0].first_point().coincides_with(Point(0,0)));
+    REQUIRE(chained[1].first_point().coincides_with(Point(200,0)));
+    REQUIRE(chained[2].first_point().coincides_with(Point(400,0)));
+
+    chained = PolylineCollection::chained_path_from(polylines, Point(0,0), true);
+    REQUIRE(chained[1].first_point().coincides_with(Point(300,0)));
+    REQUIRE(chained[2].first_point().coincides_with(Point(400,0)));
+}
+
 SCENARIO("Line distances"){
     GIVEN("A line"){
         auto line = Line(Point(0, 0), Point(20, 0));
@@ -376,3 +555,74 @@ TEST_CASE("Triangle Simplification does not result in less than 3 points"){
 }
 
     
+
+// The recursive formulation that MultiPoint::_douglas_peucker() replaced.
+static Points
+recursive_douglas_peucker(const Points &points, const double tolerance)
+{
+    Points results;
+    double dmax = 0;
+    size_t index = 0;
+    Line full(points.front(), points.back());
+    for (Points::const_iterator it = points.begin() + 1; it != points.end(); ++it) {
+        double d = it->distance_to(full);
+        if (d > dmax) {
+            index = it - points.begin();
+            dmax = d;
+        }
+    }
+    if (dmax >= tolerance) {
+        Points dp0(points.begin(), points.begin() + index + 1);
+        Points dp1 = recursive_douglas_peucker(dp0, tolerance);
+        results.insert(results.end(), dp1.begin(), dp1.end() - 1);
+        dp0.assign(points.begin() + index, points.end());
+        dp1 = recursive_douglas_peucker(dp0, tolerance);
+        results.insert(results.end(), dp1.begin(), dp1.end());
+    } else {
+        results.push_back(points.front());
+        results.push_back(points.back());
+    }
+    return results;
+}
+
+TEST_CASE("Douglas-Peucker simplification matches the recursive formulation"){
+    // noisy circles and random walks at several scales and tolerances,
+    // including points exactly at the tolerance and coincident points
+    for (int shape = 0; shape < 40; ++shape) {
+        Points points;
+        const size_t n = 20 + shape * 37;
+        coord_t x = 0, y = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (shape % 2 == 0) {
+                const double angle = 2 * PI * i / n;
+                const double radius = scale_(10) + (coord_t)((i * 7919) % 2001) * (shape + 1) - 1000 * (shape + 1);
+                points.push_back(Point(radius * cos(angle), radius * sin(angle)));
+            } else {
+                x += (coord_t)((i * 104729) % 201) * (shape + 1) * 10;
+                y += ((coord_t)((i * 7919) % 201) - 100) * (shape + 1) * 10;
+                points.push_back(Point(x, y));
+                if (i % 13 == 0) points.push_back(Point(x, y));
+            }
+        }
+        for (double tolerance : { 0.5, 10., 1000., (double)SCALED_RESOLUTION, (double)scale_(0.1), (double)scale_(1.) }) {
+            const Points expected = recursive_douglas_peucker(points, tolerance);
+            REQUIRE(MultiPoint::_douglas_peucker(points, tolerance) == expected);
+            Polyline polyline;
+            polyline.points = points;
+            polyline.simplify(tolerance);
+            REQUIRE(polyline.points == expected);
+        }
+    }
+}
+
+TEST_CASE("Douglas-Peucker simplification of one or two points returns both ends"){
+    for (const Points &points : { Points { Point(10, 20) }, Points { Point(10, 20), Point(30, 40) } }) {
+        const Points expected = recursive_douglas_peucker(points, 10.);
+        REQUIRE(expected.size() == 2);
+        REQUIRE(MultiPoint::_douglas_peucker(points, 10.) == expected);
+        Polyline polyline;
+        polyline.points = points;
+        polyline.simplify(10.);
+        REQUIRE(polyline.points == expected);
+    }
+}
@@ -0,0 +1,130 @@
+#include <catch.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "MotionPlanner.hpp"
+
+using namespace Slic3r;
+
+/// A layer with a grid of square islands, each one with a square hole.
+static ExPolygons
+islands_grid(size_t count)
+{
+    ExPolygons islands;
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t j = 0; j < count; ++j) {
+            ExPolygon island;
+            const coord_t x = scale_(i * 10.0), y = scale_(j * 10.0);
+            island.contour.points = { Point(x, y), Point(x + scale_(6), y), Point(x + scale_(6), y + scale_(6)), Point(x, y + scale_(6)) };
+            island.holes.push_back(Polygon({ Point(x + scale_(2), y + scale_(2)), Point(x + scale_(2), y + scale_(4)), Point(x + scale_(4), y + scale_(4)), Point(x + scale_(4), y + scale_(2)) }));
+            islands.push_back(island);
+        }
+    }
+    return islands;
+}
+
+SCENARIO("Motion planner graph search") {
+    GIVEN("A grid graph with some of its edges missing") {
+        // edges weighted by their length, like the ones of the planner
+        const size_t size = 30;
+        MotionPlannerGraph graph;
+        std::vector<std::vector<std::pair<size_t,double>>> edges(size * size);
+        std::mt19937 rng(42);
+        for (size_t i = 0; i < size * size; ++i)
+            graph.nodes.push_back(Point(scale_((i % size) + (rng() % 100) / 200.0), scale_((i / size) + (rng() % 100) / 200.0)));
+        for (size_t i = 0; i < size * size; ++i) {
+            for (size_t j : { i + 1, i + size }) {
+                if (j >= size * size || (j == i + 1 && j % size == 0) || rng() % 4 == 0) continue;
+                const double length = graph.nodes[i].distance_to(graph.nodes[j]);
+                graph.add_edge(i, j, length);
+                graph.add_edge(j, i, length);
+                edges[i].push_back(std::make_pair(j, length));
+                edges[j].push_back(std::make_pair(i, length));
+            }
+        }
+        graph.build_index();
+
+        // Dijkstra from the first node
+        std::vector<double> dist(size * size, std::numeric_limits<double>::infinity());
+        std::vector<bool> done(size * size, false);
+        dist[0] = 0;
+        for (size_t k = 0; k < size * size; ++k) {
+            size_t u = 0;
+            double best = std::numeric_limits<double>::infinity();
+            for (size_t i = 0; i < size * size; ++i)
+                if (!done[i] && dist[i] < best) { u = i; best = dist[i]; }
+            if (best == std::numeric_limits<double>::infinity()) break;
+            done[u] = true;
+            for (const auto &edge : edges[u])
+                dist[edge.first] = std::min(dist[edge.first], dist[u] + edge.second);
+        }
+
+        THEN("the paths found are the shortest ones") {
+            for (size_t to = 1; to < size * size; to += 7) {
+                Polyline path = graph.shortest_path(0, to);
+                REQUIRE(path.first_point() == graph.nodes[0]);
+                REQUIRE(path.last_point() == graph.nodes[to]);
+                if (dist[to] != std::numeric_limits<double>::infinity())
+                    REQUIRE(path.length() == Approx(dist[to]));
+            }
+        }
+        THEN("the nodes are found like with a linear search") {
+            for (size_t i = 0; i < 1000; ++i) {
+                const Point point(scale_((rng() % 3200) / 100.0 - 1), scale_((rng() % 3200) / 100.0 - 1));
+                REQUIRE(graph.find_node(point) == (size_t)point.nearest_point_index(graph.nodes));
+            }
+            for (const Point &node : graph.nodes)
+                REQUIRE(graph.nodes[graph.find_node(node)] == node);
+        }
+    }
+}
+
+SCENARIO("Motion planner on a layer with many islands") {
+    GIVEN("A planner over a grid of islands") {
+        const ExPolygons islands = islands_grid(8);
+        MotionPlanner lazy(islands);
+        MotionPlanner prepared(islands);
+        prepared.prepare();
+        REQUIRE(prepared.islands_count() == islands.size());
+
+        THEN("travel moves between islands go around them, prepared or not") {
+            for (size_t i = 0; i < islands.size(); i += 5) {
+                const Point from(islands[i].contour.points[0].x + scale_(1), islands[i].contour.points[0].y + scale_(1));
+                const Point to(islands[islands.size() - 1 - i].contour.points[2].x - scale_(1), islands[islands.size() - 1 - i].contour.points[2].y - scale_(1));
+                const Polyline path = prepared.shortest_path(from, to);
+                REQUIRE(path.first_point() == from);
+                REQUIRE(path.last_point() == to);
+                REQUIRE(path.points == lazy.shortest_path(from, to).points);
+                REQUIRE(path.length() >= from.distance_to(to) - SCALED_EPSILON);
+            }
+        }
+    }
+}
+
+SCENARIO("Motion planner benchmark", "[.benchmark]") {
+    GIVEN("A layer with 400 islands") {
+        const ExPolygons islands = islands_grid(20);
+        const auto start = std::chrono::steady_clock::now();
+        MotionPlanner planner(islands);
+        planner.prepare();
+        const auto prepared = std::chrono::steady_clock::now();
+
+        std::mt19937 rng(1);
+        double length = 0;
+        const size_t queries = 2000;
+        for (size_t i = 0; i < queries; ++i) {
+            const ExPolygon &a = islands[rng() % islands.size()];
+            const ExPolygon &b = islands[rng() % islands.size()];
+            length += planner.shortest_path(a.contour.points[0], b.contour.points[2]).length();
+        }
+        const auto done = std::chrono::steady_clock::now();
+        std::cout << "Motion planner: prepared in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(prepared - start).count() << " ms, "
+            << queries << " travel moves in "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(done - prepared).count() << " ms" << std::endl;
+        REQUIRE(length > 0);
+    }
+}
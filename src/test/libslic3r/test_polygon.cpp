@@ -1,7 +1,11 @@
 
 #include <catch.hpp>
 
+#include <random>
+
+#include "BoundingBox.hpp"
 #include "Point.hpp"
+#include "PointKernels.hpp"
 #include "Polygon.hpp"
 
 
@@ -45,4 +49,75 @@ SCENARIO("Remove collinear points from Polygon") {
             }
         }
     }
-}
\ No newline at end of file
+}
+SCENARIO("Point kernels match the scalar implementation") {
+    std::mt19937 rng(4242);
+    std::uniform_int_distribution<coord_t> coord(-scale_(100), scale_(100));
+    // coarse coordinates produce plenty of equidistant and coincident points
+    std::uniform_int_distribution<coord_t> grid(-5, 5);
+
+    GIVEN("Random polygons of every size up to 40 points") {
+        THEN("Polygon::contains agrees with the scalar crossing test") {
+            for (size_t n = 3; n <= 40; ++n) {
+                Polygon polygon;
+                for (size_t i = 0; i < n; ++i) {
+                    const double angle = 2 * PI * i / n;
+                    const double radius = scale_(10 + (rng() % 40));
+                    polygon.points.push_back(Point(radius * cos(angle), radius * sin(angle)));
+                }
+                // test the vertices themselves, their neighbourhood and random points
+                Points queries;
+                for (const Point &p : polygon.points) {
+                    queries.push_back(p);
+                    queries.push_back(Point(p.x - 1, p.y));
+                    queries.push_back(Point(p.x / 2, p.y));
+                }
+                for (size_t i = 0; i < 50; ++i)
+                    queries.push_back(Point(coord(rng) / 2, coord(rng) / 2));
+                for (const Point &q : queries)
+                    REQUIRE(polygon.contains(q) == PointKernels::scalar::polygon_contains(polygon.points, q));
+            }
+        }
+    }
+    GIVEN("Random point sets of every size up to 40 points") {
+        THEN("Point::nearest_point_index agrees with the scalar search, ties included") {
+            for (size_t n = 0; n <= 40; ++n) {
+                Points points;
+                for (size_t i = 0; i < n; ++i)
+                    points.push_back(Point(grid(rng), grid(rng)));
+                for (size_t i = 0; i < 30; ++i) {
+                    const Point from(grid(rng), grid(rng));
+                    REQUIRE(from.nearest_point_index(points) == PointKernels::scalar::nearest_point_index(points, from));
+                }
+                for (Point &p : points) p = Point(coord(rng), coord(rng));
+                for (size_t i = 0; i < 30; ++i) {
+                    const Point from(coord(rng), coord(rng));
+                    REQUIRE(from.nearest_point_index(points) == PointKernels::scalar::nearest_point_index(points, from));
+                }
+            }
+        }
+        THEN("BoundingBox agrees with the scalar reduction") {
+            for (size_t n = 1; n <= 40; ++n) {
+                Points points;
+                for (size_t i = 0; i < n; ++i)
+                    points.push_back(Point(coord(rng), coord(rng)));
+                Point min, max;
+                PointKernels::scalar::bounding_box(points, &min, &max);
+                const BoundingBox bb(points);
+                REQUIRE(bb.defined);
+                REQUIRE(bb.min == min);
+                REQUIRE(bb.max == max);
+            }
+        }
+    }
+    GIVEN("A point farther than the vector kernels can convert exactly") {
+        Points points;
+        for (coord_t i = 0; i < 10; ++i)
+            points.push_back(Point(i, i));
+        points.push_back(Point((coord_t)1 << 60, (coord_t)0));
+        const Point from((coord_t)1 << 60, (coord_t)1);
+        THEN("the result is still the one of the scalar search") {
+            REQUIRE(from.nearest_point_index(points) == 10);
+        }
+    }
+}
@@ -38,6 +38,55 @@ SCENARIO("PrintObject: Perimeter generation") {
     }
 }
 
+SCENARIO("PrintObject: Perimeter generation of the islands in parallel") {
+    GIVEN("Two hollow squares and default config") {
+        auto config {Slic3r::Config::new_from_defaults()};
+        Slic3r::Model model;
+        auto print {Slic3r::Test::init_print({TestMesh::two_hollow_squares}, model, config)};
+        print->objects[0]->slice();
+        auto& object = *(print->objects.at(0));
+
+        // the paths of the perimeters and gap fill, and the fill surfaces of every layer
+        auto results {[&object] () {
+            std::vector<Slic3r::Polylines> paths;
+            std::vector<std::vector<Slic3r::Points>> fill_surfaces;
+            for (auto* layer : object.layers) {
+                for (auto* layerm : layer->regions) {
+                    paths.emplace_back();
+                    for (const auto* entity : layerm->perimeters.flatten().entities)
+                        paths.back().push_back(entity->as_polyline());
+                    for (const auto* entity : layerm->thin_fills.flatten().entities)
+                        paths.back().push_back(entity->as_polyline());
+                    fill_surfaces.emplace_back();
+                    for (const auto& polygon : (Slic3r::Polygons)layerm->fill_surfaces)
+                        fill_surfaces.back().push_back(polygon.points);
+                }
+            }
+            return std::make_pair(paths, fill_surfaces);
+        }};
+
+        WHEN("the islands of each layer are processed by 4 threads") {
+            for (auto* layer : object.layers) layer->make_perimeters(1);
+            const auto serial {results()};
+            for (auto* layer : object.layers) layer->make_perimeters(4);
+            const auto parallel {results()};
+            THEN("every layer has the perimeters of both islands") {
+                for (auto* layer : object.layers)
+                    REQUIRE(layer->regions[0]->perimeters.size() == 2);
+            }
+            THEN("the perimeters, gap fill and fill surfaces are the same as with a single thread") {
+                REQUIRE(parallel.first.size() == serial.first.size());
+                for (size_t i = 0; i < serial.first.size(); ++i) {
+                    REQUIRE(parallel.first[i].size() == serial.first[i].size());
+                    for (size_t j = 0; j < serial.first[i].size(); ++j)
+                        REQUIRE(parallel.first[i][j].points == serial.first[i][j].points);
+                }
+                REQUIRE(parallel.second == serial.second);
+            }
+        }
+    }
+}
+
 SCENARIO("Print: Skirt generation") {
     GIVEN("20mm cube and default config") {
         auto config {Slic3r::Config::new_from_defaults()};
@@ -4,6 +4,8 @@
 #include "test_data.hpp"
 #include "libslic3r.h"
 #include "GCodeReader.hpp"
+#include "GCode/Filter.hpp"
+#include "PrintGCode.hpp"
 
 using namespace Slic3r::Test;
 using namespace Slic3r;
@@ -248,6 +250,468 @@ SCENARIO( "PrintGCode basic functionality") {
             }
         }
 
+        WHEN("travel optimization is enabled for infill, gap fill and support material") {
+            config->set("fill_density", "20%");
+            config->set("support_material", true);
+            auto travel_length = [] (std::stringstream& gcode) {
+                double length {0.0};
+                auto reader {GCodeReader()};
+                reader.parse_stream(gcode, [&length] (GCodeReader& self, const GCodeReader::GCodeLine& line)
+                {
+                    if (line.travel()) length += line.dist_XY();
+                });
+                return length;
+            };
+            std::stringstream greedy_gcode, optimized_gcode;
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::overhang}, model, config)};
+                Slic3r::Test::gcode(greedy_gcode, print);
+            }
+            config->set("optimize_infill_travel", true);
+            config->set("optimize_gap_fill_travel", true);
+            config->set("optimize_support_material_travel", true);
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::overhang}, model, config)};
+                Slic3r::Test::gcode(optimized_gcode, print);
+            }
+            const double greedy_travel {travel_length(greedy_gcode)};
+            const double optimized_travel {travel_length(optimized_gcode)};
+            THEN("travel distance is reduced by a few percent") {
+                const double reduction {(greedy_travel - optimized_travel) / greedy_travel};
+                INFO("greedy travel: " << greedy_travel << "mm, optimized travel: " << optimized_travel
+                    << "mm (" << 100.0 * reduction << "% reduction)");
+                REQUIRE(optimized_travel < greedy_travel);
+                REQUIRE(reduction > 0.03);
+            }
+        }
+
+        WHEN("the layers of several objects are prepared by several threads") {
+            config->set("fill_density", "20%");
+            config->set("support_material", true);
+            config->set("layer_gcode", ";Layer:[layer_num] ([layer_z] mm)");
+            // the comments hold the export time and the config
+            auto without_comments = [] (const std::stringstream& gcode) {
+                std::istringstream in(gcode.str());
+                std::string result, line;
+                while (std::getline(in, line))
+                    if (line.compare(0, 1, ";") != 0) result += line + "\n";
+                return result;
+            };
+            std::stringstream serial_gcode, parallel_gcode;
+            config->set("threads", 1);
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::overhang, TestMesh::cube_20x20x20}, model, config)};
+                Slic3r::Test::gcode(serial_gcode, print);
+            }
+            config->set("threads", 4);
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::overhang, TestMesh::cube_20x20x20}, model, config)};
+                Slic3r::Test::gcode(parallel_gcode, print);
+            }
+            THEN("the G-code is the same as with a single thread") {
+                REQUIRE(without_comments(parallel_gcode).size() > 0);
+                REQUIRE(without_comments(parallel_gcode) == without_comments(serial_gcode));
+            }
+        }
+
+        WHEN("the copies of a sequential print are rendered by several threads") {
+            config->set("fill_density", "20%");
+            config->set("complete_objects", true);
+            config->set("gcode_comments", true);
+            config->set("layer_gcode", ";Layer:[layer_num] ([layer_z] mm)");
+            // everything but the date and the threads setting, the statistics included
+            auto without_threads = [] (const std::stringstream& gcode) {
+                std::istringstream in(gcode.str());
+                std::string result, line;
+                while (std::getline(in, line))
+                    if (line.compare(0, 14, "; generated by") != 0 && line.compare(0, 11, "; threads =") != 0) result += line + "\n";
+                return result;
+            };
+            auto export_gcode = [&config] (int threads, std::stringstream* gcode) {
+                config->set("threads", threads);
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::overhang, TestMesh::cube_20x20x20}, model, config)};
+                PrintObject* object {print->objects.back()};
+                Points copies {object->copies()};
+                copies.push_back(Point(copies.front().x, copies.front().y + scale_(40)));
+                object->set_copies(copies);
+                Slic3r::Test::gcode(*gcode, print);
+            };
+            std::stringstream serial_gcode, parallel_gcode;
+            export_gcode(1, &serial_gcode);
+            export_gcode(4, &parallel_gcode);
+            THEN("the G-code is the same as with a single thread") {
+                REQUIRE(without_threads(parallel_gcode).size() > 0);
+                REQUIRE(without_threads(parallel_gcode) == without_threads(serial_gcode));
+            }
+            THEN("there is a travel to each copy after the first one") {
+                const std::string exported {parallel_gcode.str()};
+                size_t travels {0};
+                for (size_t pos = exported.find("move to origin position for next object"); pos != std::string::npos;
+                        pos = exported.find("move to origin position for next object", pos + 1))
+                    ++travels;
+                REQUIRE(travels == 2);
+            }
+            AND_WHEN("the copies can't be started from the state expected, E being never reset") {
+                config->set("gcode_flavor", "mach3");
+                config->set("avoid_crossing_perimeters", true);
+                std::stringstream serial_gcode, parallel_gcode;
+                export_gcode(1, &serial_gcode);
+                export_gcode(4, &parallel_gcode);
+                THEN("the copies rendered again give the same G-code as with a single thread") {
+                    REQUIRE(without_threads(parallel_gcode).size() > 0);
+                    REQUIRE(without_threads(parallel_gcode) == without_threads(serial_gcode));
+                }
+            }
+        }
+
+        WHEN("avoid_crossing_perimeters is enabled on objects with holes") {
+            config->set("avoid_crossing_perimeters", true);
+            config->set("fill_density", "20%");
+            auto without_comments = [] (const std::stringstream& gcode) {
+                std::istringstream in(gcode.str());
+                std::string result, line;
+                while (std::getline(in, line))
+                    if (line.compare(0, 1, ";") != 0) result += line + "\n";
+                return result;
+            };
+            // with a single thread the graphs are built lazily, otherwise ahead of the export
+            std::stringstream lazy_gcode, prepared_gcode;
+            config->set("threads", 1);
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::cube_with_hole, TestMesh::two_hollow_squares}, model, config)};
+                Slic3r::Test::gcode(lazy_gcode, print);
+            }
+            config->set("threads", 4);
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::cube_with_hole, TestMesh::two_hollow_squares}, model, config)};
+                Slic3r::Test::gcode(prepared_gcode, print);
+            }
+            THEN("the travel moves are the same with planners built ahead") {
+                REQUIRE(without_comments(prepared_gcode).size() > 0);
+                REQUIRE(without_comments(prepared_gcode) == without_comments(lazy_gcode));
+            }
+        }
+
+        WHEN("the layers are planned with aligned seams") {
+            config->set("seam_position", "aligned");
+            config->set("perimeters", 3);
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({TestMesh::overhang, TestMesh::cube_with_hole}, model, config)};
+            print->process();
+            std::stringstream out;
+            PrintGCode printgcode(*print, out);
+            std::vector<ExtrusionLoop> loops;
+            for (const auto* object : print->objects) {
+                for (const auto* layer : object->layers) {
+                    const auto plan = printgcode.plan_layer(layer);
+                    for (const auto& extruder : plan.by_extruder)
+                        for (const auto& island : extruder.second)
+                            for (const auto& region : std::get<0>(island.second))
+                                for (const auto* entity : region.second.entities)
+                                    if (const auto* loop = dynamic_cast<const ExtrusionLoop*>(entity))
+                                        loops.push_back(*loop);
+                }
+            }
+            THEN("the seam candidates of the perimeters are found") {
+                REQUIRE(loops.size() > 0);
+                for (const auto& loop : loops)
+                    REQUIRE(loop.seam_candidates.extruder == 0);
+            }
+            THEN("the seams are placed like when the candidates are found while emitting") {
+                auto generator = [&print] () {
+                    std::unique_ptr<GCode> gcodegen { new GCode() };
+                    gcodegen->placeholder_parser = &print->placeholder_parser;
+                    gcodegen->apply_print_config(print->config);
+                    gcodegen->config.seam_position.value = spAligned;
+                    gcodegen->set_extruders(std::vector<unsigned int>{0});
+                    gcodegen->set_extruder(0);
+                    return gcodegen;
+                };
+                auto planned = generator(), unplanned = generator();
+                for (const auto& loop : loops) {
+                    ExtrusionLoop without_candidates { loop };
+                    without_candidates.seam_candidates = SeamCandidates();
+                    REQUIRE(planned->extrude(loop, "perimeter") == unplanned->extrude(without_candidates, "perimeter"));
+                }
+            }
+        }
+
+        WHEN("the copies of an object are rendered once") {
+            config->set("fill_density", "20%");
+            config->set("label_printed_objects", true);
+            // extrusion moves of each copy of each layer, in G-code coordinates
+            auto export_copies = [&config] (bool render_once) {
+                config->set("render_copies_once", render_once);
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::cube_with_hole}, model, config)};
+                PrintObject* object {print->objects.front()};
+                Points copies {object->copies()};
+                copies.push_back(Point(copies.front().x + scale_(30), copies.front().y));
+                copies.push_back(Point(copies.front().x, copies.front().y + scale_(30)));
+                object->set_copies(copies);
+                std::stringstream gcode;
+                Slic3r::Test::gcode(gcode, print);
+
+                std::vector<std::vector<Pointfs>> moves;
+                std::istringstream in(gcode.str());
+                std::string line;
+                while (std::getline(in, line)) {
+                    if (line.find("; printing object") == 0) {
+                        if (line.find(" copy 0") != std::string::npos) moves.emplace_back();
+                        moves.back().emplace_back();
+                    } else if (line.compare(0, 4, "G1 X") == 0 && line.find(" E") != std::string::npos && !moves.empty()) {
+                        moves.back().back().emplace_back(std::stod(line.substr(4)), std::stod(line.substr(line.find(" Y") + 2)));
+                    }
+                }
+                return moves;
+            };
+            const auto rendered_once = export_copies(true);
+            const auto rendered = export_copies(false);
+            THEN("every copy of a layer has the moves of the first one, shifted") {
+                REQUIRE(rendered_once.size() == rendered.size());
+                for (const auto& layer : rendered_once) {
+                    REQUIRE(layer.size() == 3);
+                    REQUIRE(layer.front().size() > 0);
+                    for (size_t copy = 1; copy < layer.size(); ++copy) {
+                        REQUIRE(layer[copy].size() == layer.front().size());
+                        const Pointf offset(layer[copy].front().x - layer.front().front().x, layer[copy].front().y - layer.front().front().y);
+                        REQUIRE(std::abs(offset.x) + std::abs(offset.y) == Approx(30).margin(0.002));
+                        for (size_t i = 0; i < layer[copy].size(); ++i) {
+                            REQUIRE(layer[copy][i].x - offset.x == Approx(layer.front()[i].x).margin(0.002));
+                            REQUIRE(layer[copy][i].y - offset.y == Approx(layer.front()[i].y).margin(0.002));
+                        }
+                    }
+                }
+            }
+            THEN("the copies have as many extrusion moves as when each one is rendered") {
+                for (size_t i = 0; i < rendered.size(); ++i) {
+                    size_t count = 0, count_once = 0;
+                    for (const auto& copy : rendered[i]) count += copy.size();
+                    for (const auto& copy : rendered_once[i]) count_once += copy.size();
+                    REQUIRE(count_once == Approx(count).epsilon(0.05));
+                }
+            }
+        }
+
+        WHEN("the layers alternate between two sets of three extruders") {
+            config->set("perimeter_extruder", 1);
+            config->set("infill_extruder", 2);
+            config->set("solid_infill_extruder", 3);
+            config->set("solid_infill_every_layers", 2);
+            // toolchanges written, and the ones reported at the end of the G-code
+            auto toolchanges = [&config] (bool render_once, size_t* reported, size_t* avoided) {
+                config->set("render_copies_once", render_once);
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+                if (render_once) {
+                    PrintObject* object {print->objects.front()};
+                    Points copies {object->copies()};
+                    copies.push_back(Point(copies.front().x + scale_(30), copies.front().y));
+                    object->set_copies(copies);
+                }
+                std::stringstream gcode;
+                Slic3r::Test::gcode(gcode, print);
+
+                size_t count {0};
+                std::string tool;
+                std::istringstream in(gcode.str());
+                std::string line;
+                while (std::getline(in, line)) {
+                    if (line.size() > 1 && line[0] == 'T') {
+                        if (!tool.empty() && line != tool) ++count;
+                        tool = line;
+                    } else if (line.find("; toolchanges = ") == 0) {
+                        *reported = std::stoul(line.substr(16));
+                    } else if (line.find("; toolchanges avoided = ") == 0) {
+                        *avoided = std::stoul(line.substr(24));
+                    }
+                }
+                return count;
+            };
+            size_t reported {0}, avoided {0};
+            const size_t count {toolchanges(false, &reported, &avoided)};
+            THEN("the toolchanges are counted") {
+                REQUIRE(count > 0);
+                REQUIRE(reported == count);
+            }
+            THEN("the extruders are ordered to avoid some of them") {
+                REQUIRE(avoided > 0);
+            }
+            size_t reported_once {0}, avoided_once {0};
+            const size_t count_once {toolchanges(true, &reported_once, &avoided_once)};
+            THEN("the copies rendered once select their extruders too") {
+                REQUIRE(reported_once == count_once);
+                REQUIRE(avoided_once > 0);
+            }
+        }
+
+        WHEN("a concentric infill, which is extruded as a whole, uses a second extruder") {
+            config->set("perimeter_extruder", 1);
+            config->set("infill_extruder", 2);
+            config->set("solid_infill_extruder", 3);
+            config->set("solid_infill_every_layers", 2);
+            config->set("fill_pattern", "concentric");
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+            Slic3r::Test::gcode(gcode, print);
+
+            // the extruders of each layer, and the toolchanges written
+            std::vector<std::set<int>> layers;
+            int first_tool {-1}, tool {-1};
+            size_t count {0}, avoided {0};
+            std::istringstream in(gcode.str());
+            std::string line;
+            while (std::getline(in, line)) {
+                if (line.size() > 1 && line[0] == 'T') {
+                    const int t {std::stoi(line.substr(1))};
+                    if (tool < 0) first_tool = t;
+                    else if (t != tool) ++count;
+                    tool = t;
+                } else if (line.find("; toolchanges avoided = ") == 0) {
+                    avoided = std::stoul(line.substr(24));
+                } else if (line.find("G1 Z") == 0) {
+                    layers.emplace_back();
+                } else if (line.find("G1 ") == 0 && line.find(" E") != std::string::npos
+                    && (line.find(" X") != std::string::npos || line.find(" Y") != std::string::npos)) {
+                    if (!layers.empty()) layers.back().insert(tool);
+                }
+            }
+            // the toolchanges using the extruders of each layer in id order,
+            // the current one first, and the fewest using them in any order
+            size_t baseline {0};
+            int baseline_end {first_tool};
+            std::map<int, size_t> fewest {{first_tool, 0}};
+            for (const auto& extruders : layers) {
+                if (extruders.empty()) continue;
+                const bool current {extruders.count(baseline_end) > 0};
+                baseline += extruders.size() - (current ? 1 : 0);
+                if (!current || extruders.size() > 1)
+                    baseline_end = *std::prev(extruders.end(), *extruders.rbegin() == baseline_end ? 2 : 1);
+                std::map<int, size_t> next;
+                for (const auto& entry : fewest) {
+                    for (const int end : extruders) {
+                        const bool keep {extruders.count(entry.first) > 0 && (end != entry.first || extruders.size() == 1)};
+                        const size_t changes {entry.second + extruders.size() - (keep ? 1 : 0)};
+                        if (next.count(end) == 0 || changes < next[end]) next[end] = changes;
+                    }
+                }
+                fewest = std::move(next);
+            }
+            THEN("the toolchanges are planned with the extruder of the concentric infill") {
+                REQUIRE(layers.size() > 2);
+                REQUIRE(std::any_of(layers.cbegin(), layers.cend(), [] (const std::set<int>& e) { return e.count(1) > 0; }));
+                REQUIRE(count > 0);
+                size_t optimal {std::numeric_limits<size_t>::max()};
+                for (const auto& end : fewest) optimal = std::min(optimal, end.second);
+                REQUIRE(count == optimal);
+            }
+            THEN("the toolchanges avoided are the ones the plan saves over the id order") {
+                REQUIRE(avoided > 0);
+                REQUIRE(count + avoided == baseline);
+            }
+        }
+
+        WHEN("pressure advance is enabled") {
+            config->set("pressure_advance", 10);
+            config->set("retract_length", "1");
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20, TestMesh::cube_20x20x20}, model, config)};
+            Slic3r::Test::gcode(gcode, print);
+            auto exported {gcode.str()};
+            double retracted = 1;
+            GCodeReader reader;
+            reader.apply_config(print->config);
+            reader.parse(exported, [&retracted] (GCodeReader&, const GCodeReader::GCodeLine& line) {
+                if ((line.extruding() && line.dist_XY() == 0) || line.retracting())
+                    retracted += line.dist_E();
+            });
+            THEN("the pressure is regulated") {
+                REQUIRE(exported.find("; pressure advance") != std::string::npos);
+                REQUIRE(exported.find("; pressure discharge") != std::string::npos);
+            }
+            THEN("all retractions are compensated") {
+                REQUIRE(std::abs(retracted) < 0.01);
+            }
+        }
+
+        WHEN("a G-code filter is registered in the print") {
+            struct Mark : public GCodeFilter {
+                void process(GCodeSink* gcode, bool flush) override {
+                    if (!gcode->empty()) *gcode += "; filtered\n";
+                    if (flush) *gcode += "; flushed\n";
+                };
+            };
+            Slic3r::Model model;
+            auto print {Slic3r::Test::init_print({TestMesh::cube_20x20x20}, model, config)};
+            print->gcode_filters.push_back([] (const PrintConfig&) {
+                return std::unique_ptr<GCodeFilter>(new Mark());
+            });
+            Slic3r::Test::gcode(gcode, print);
+            auto exported {gcode.str()};
+            THEN("it processes all the layers, in order, before the end G-code") {
+                const size_t flushed = exported.find("; flushed");
+                REQUIRE(flushed != std::string::npos);
+                REQUIRE(exported.find("; flushed", flushed + 1) == std::string::npos);
+                size_t filtered = 0;
+                for (size_t pos = exported.find("; filtered"); pos < flushed; pos = exported.find("; filtered", pos + 1))
+                    ++filtered;
+                REQUIRE(filtered == print->objects.front()->layers.size());
+                REQUIRE(exported.rfind("G1 X") < flushed);
+                REQUIRE(exported.find("M104 S0", flushed) != std::string::npos);
+            }
+        }
+
+        WHEN("native G-code arcs are enabled on a round object") {
+            auto count_moves = [] (const std::string& gcode, size_t* arcs) {
+                size_t moves = 0;
+                *arcs = 0;
+                std::istringstream in(gcode);
+                std::string line;
+                while (std::getline(in, line)) {
+                    if (line.compare(0, 3, "G1 ") == 0) ++moves;
+                    if (line.compare(0, 3, "G2 ") == 0 || line.compare(0, 3, "G3 ") == 0) ++*arcs;
+                }
+                return moves + *arcs;
+            };
+            config->set("layer_height", 0.4);
+            config->set("first_layer_height", 0.4);
+            double filament_lines, filament_arcs;
+            std::stringstream gcode_arcs;
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::sphere_50mm}, model, config)};
+                Slic3r::Test::gcode(gcode, print);
+                filament_lines = print->total_used_filament;
+            }
+            config->set("gcode_arcs", true);
+            {
+                Slic3r::Model model;
+                auto print {Slic3r::Test::init_print({TestMesh::sphere_50mm}, model, config)};
+                Slic3r::Test::gcode(gcode_arcs, print);
+                filament_arcs = print->total_used_filament;
+            }
+            size_t arcs_without, arcs_with;
+            const size_t moves_without = count_moves(gcode.str(), &arcs_without);
+            const size_t moves_with = count_moves(gcode_arcs.str(), &arcs_with);
+            THEN("the curved perimeters are written with far fewer commands") {
+                INFO("moves: " << moves_without << " without arcs, " << moves_with << " with " << arcs_with << " arcs");
+                REQUIRE(arcs_without == 0);
+                REQUIRE(arcs_with > 0);
+                REQUIRE(moves_with * 2 < moves_without);
+                REQUIRE(gcode_arcs.str().size() * 2 < gcode.str().size());
+            }
+            THEN("the same amount of filament is extruded") {
+                REQUIRE(std::abs(filament_arcs - filament_lines) < 0.01);
+            }
+        }
+
         WHEN("layer_num represents the layer's index from z=0") {
             config->set("layer_gcode", ";Layer:[layer_num] ([layer_z] mm)");
             config->set("layer_height", 1.0);
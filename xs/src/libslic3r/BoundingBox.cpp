@@ -1,4 +1,5 @@
 #include "BoundingBox.hpp"
+#include "PointKernels.hpp"
 #include <algorithm>
 
 namespace Slic3r {
@@ -18,7 +19,13 @@ BoundingBoxBase<PointClass>::BoundingBoxBase(const std::vector<PointClass> &poin
     }
     this->defined = true;
 }
-template BoundingBoxBase<Point>::BoundingBoxBase(const std::vector<Point> &points);
+template <>
+BoundingBoxBase<Point>::BoundingBoxBase(const std::vector<Point> &points)
+{
+    if (points.empty()) CONFESS("Empty point set supplied to BoundingBoxBase constructor");
+    PointKernels::bounding_box(points, &this->min, &this->max);
+    this->defined = true;
+}
 template BoundingBoxBase<Pointf>::BoundingBoxBase(const std::vector<Pointf> &points);
 
 template <class PointClass>
@@ -36,6 +36,10 @@ class BoundingBoxBase
     bool contains(const PointClass &point) const;
 };
 
+/// Integer bounding boxes are computed by a vectorized kernel (see PointKernels.hpp).
+template <>
+BoundingBoxBase<Point>::BoundingBoxBase(const std::vector<Point> &points);
+
 template <class PointClass>
 class BoundingBox3Base : public BoundingBoxBase<PointClass>
 {
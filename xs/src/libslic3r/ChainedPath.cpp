@@ -0,0 +1,261 @@
+#include "ChainedPath.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace Slic3r {
+
+void
+ChainingIndex::add(const Point &point, size_t item)
+{
+    assert(!this->built);
+    this->points.push_back(point);
+    this->items.push_back(item);
+}
+
+void
+ChainingIndex::reserve(size_t endpoints)
+{
+    this->points.reserve(endpoints);
+    this->items.reserve(endpoints);
+}
+
+void
+ChainingIndex::build()
+{
+    const size_t n = this->points.size();
+    this->built = true;
+    this->live_endpoints = n;
+    this->removed.assign(n, false);
+    this->tree_pos.assign(n, 0);
+    this->live.assign(n, 0);
+    this->tree.resize(n);
+    for (size_t i = 0; i < n; ++i) this->tree[i] = i;
+    this->_build(0, n, true);
+
+    // group endpoints by item
+    size_t item_count = 0;
+    for (size_t i = 0; i < n; ++i)
+        item_count = std::max(item_count, this->items[i] + 1);
+    this->item_offsets.assign(item_count + 1, 0);
+    for (size_t i = 0; i < n; ++i)
+        ++this->item_offsets[this->items[i] + 1];
+    for (size_t i = 0; i < item_count; ++i)
+        this->item_offsets[i + 1] += this->item_offsets[i];
+    this->item_endpoints.resize(n);
+    std::vector<size_t> fill(this->item_offsets.begin(), this->item_offsets.end() - 1);
+    for (size_t i = 0; i < n; ++i)
+        this->item_endpoints[fill[this->items[i]]++] = i;
+}
+
+void
+ChainingIndex::_build(size_t lo, size_t hi, bool split_x)
+{
+    if (lo >= hi) return;
+    const size_t mid = (lo + hi) / 2;
+    const Points &pts = this->points;
+    std::nth_element(this->tree.begin() + lo, this->tree.begin() + mid, this->tree.begin() + hi,
+        [&pts, split_x](size_t a, size_t b) {
+            return split_x ? pts[a].x < pts[b].x : pts[a].y < pts[b].y;
+        });
+    this->tree_pos[this->tree[mid]] = mid;
+    this->live[mid] = hi - lo;
+    this->_build(lo, mid, !split_x);
+    this->_build(mid + 1, hi, !split_x);
+}
+
+void
+ChainingIndex::remove_item(size_t item)
+{
+    assert(this->built);
+    if (item + 1 >= this->item_offsets.size()) return;
+    for (size_t k = this->item_offsets[item]; k < this->item_offsets[item + 1]; ++k) {
+        const size_t endpoint = this->item_endpoints[k];
+        if (this->removed[endpoint]) continue;
+        this->removed[endpoint] = true;
+        --this->live_endpoints;
+
+        // decrement the live counters from the root down to the endpoint's node
+        const size_t pos = this->tree_pos[endpoint];
+        size_t lo = 0, hi = this->tree.size();
+        while (lo < hi) {
+            const size_t mid = (lo + hi) / 2;
+            --this->live[mid];
+            if (pos == mid) break;
+            if (pos < mid) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+    }
+}
+
+int
+ChainingIndex::nearest(const Point &from) const
+{
+    assert(this->built);
+    int best = -1;
+    double best_d = -1;
+    this->_nearest(0, this->tree.size(), true, from, &best, &best_d);
+    return best;
+}
+
+bool
+ChainingIndex::_better(size_t endpoint, double d, int best, double best_d) const
+{
+    if (best == -1 || d < best_d) return true;
+    if (d > best_d) return false;
+    if (this->tie_break == tbFirst || d < EPSILON)
+        return (int)endpoint < best;
+    return (int)endpoint > best;
+}
+
+void
+ChainingIndex::_nearest(size_t lo, size_t hi, bool split_x, const Point &from, int* best, double* best_d) const
+{
+    if (lo >= hi) return;
+    const size_t mid = (lo + hi) / 2;
+    if (this->live[mid] == 0) return;
+
+    const size_t endpoint = this->tree[mid];
+    const Point &p = this->points[endpoint];
+    if (!this->removed[endpoint]) {
+        const double dx = from.x - p.x;
+        const double dy = from.y - p.y;
+        const double d = dx*dx + dy*dy;
+        if (this->_better(endpoint, d, *best, *best_d)) {
+            *best = endpoint;
+            *best_d = d;
+        }
+    }
+
+    // visit the half containing the query point first; the other one can only
+    // hold a better (or equally distant) candidate if the splitting line is
+    // not farther than the best distance found so far
+    const double diff = split_x ? (double)(from.x - p.x) : (double)(from.y - p.y);
+    if (diff < 0) {
+        this->_nearest(lo, mid, !split_x, from, best, best_d);
+        if (*best == -1 || diff*diff <= *best_d)
+            this->_nearest(mid + 1, hi, !split_x, from, best, best_d);
+    } else {
+        this->_nearest(mid + 1, hi, !split_x, from, best, best_d);
+        if (*best == -1 || diff*diff <= *best_d)
+            this->_nearest(lo, mid, !split_x, from, best, best_d);
+    }
+}
+
+// Moves must save at least this much travel to be applied, which keeps
+// rounding noise from making the search cycle.
+constexpr double CHAIN_OPTIMIZER_MIN_GAIN = SCALED_EPSILON;
+
+double
+ChainOptimizer::travel_length(const Point &start, const Items &chain)
+{
+    double length = 0;
+    Point pos = start;
+    for (const Item &item : chain) {
+        length += pos.distance_to(item.first);
+        pos = item.last;
+    }
+    return length;
+}
+
+double
+ChainOptimizer::optimize(const Point &start, Items* chain) const
+{
+    if (chain->size() < 2) return 0;
+    const double initial = travel_length(start, *chain);
+    for (size_t pass = 0; pass < this->max_passes; ++pass) {
+        const bool two_opt = this->_two_opt(start, chain);
+        const bool or_opt  = this->_or_opt(start, chain);
+        if (!two_opt && !or_opt) break;
+    }
+    return initial - travel_length(start, *chain);
+}
+
+bool
+ChainOptimizer::_two_opt(const Point &start, Items* chain) const
+{
+    Items &c = *chain;
+    const size_t n = c.size();
+    bool improved = false;
+    for (size_t i = 0; i < n; ++i) {
+        const Point &prev = (i == 0) ? start : c[i-1].last;
+        const size_t j_max = std::min(n, i + this->window);
+        for (size_t j = i; j < j_max; ++j) {
+            // the reversed run may only contain items that can be flipped
+            if (!c[j].movable || !c[j].can_reverse) break;
+            
+            // reversing [i, j] only changes the two edges at its boundaries,
+            // the inner ones are walked backwards with the same length
+            double delta = prev.distance_to(c[j].last) - prev.distance_to(c[i].first);
+            if (j + 1 < n)
+                delta += c[i].first.distance_to(c[j+1].first) - c[j].last.distance_to(c[j+1].first);
+            if (delta < -CHAIN_OPTIMIZER_MIN_GAIN) {
+                std::reverse(c.begin() + i, c.begin() + j + 1);
+                for (size_t k = i; k <= j; ++k) {
+                    std::swap(c[k].first, c[k].last);
+                    c[k].reversed = !c[k].reversed;
+                }
+                improved = true;
+            }
+        }
+    }
+    return improved;
+}
+
+bool
+ChainOptimizer::_or_opt(const Point &start, Items* chain) const
+{
+    Items &c = *chain;
+    const size_t n = c.size();
+    bool improved = false;
+    for (size_t k = 0; k < n; ++k) {
+        if (!c[k].movable) continue;
+        
+        // travel saved by taking item k out of the chain
+        const Point &prev = (k == 0) ? start : c[k-1].last;
+        double removal_gain = prev.distance_to(c[k].first);
+        if (k + 1 < n)
+            removal_gain += c[k].last.distance_to(c[k+1].first) - prev.distance_to(c[k+1].first);
+        
+        // try to insert it after item q (q == -1 means before the first item)
+        const int q_min = std::max(-1, (int)k - (int)this->window - 1);
+        const int q_max = std::min((int)n - 1, (int)(k + this->window));
+        int best_q = 0;
+        bool best_flip = false;
+        double best_delta = -CHAIN_OPTIMIZER_MIN_GAIN;
+        for (int q = q_min; q <= q_max; ++q) {
+            if (q == (int)k || q == (int)k - 1) continue;
+            const Point &a = (q == -1) ? start : c[q].last;
+            const bool has_b = q + 1 < (int)n;
+            for (int flip = 0; flip <= (c[k].can_reverse ? 1 : 0); ++flip) {
+                const Point &entry = flip ? c[k].last : c[k].first;
+                const Point &exit  = flip ? c[k].first : c[k].last;
+                double delta = a.distance_to(entry) - removal_gain;
+                if (has_b)
+                    delta += exit.distance_to(c[q+1].first) - a.distance_to(c[q+1].first);
+                if (delta < best_delta) {
+                    best_delta = delta;
+                    best_q = q;
+                    best_flip = flip;
+                }
+            }
+        }
+        if (best_delta < -CHAIN_OPTIMIZER_MIN_GAIN) {
+            Item item = c[k];
+            if (best_flip) {
+                std::swap(item.first, item.last);
+                item.reversed = !item.reversed;
+            }
+            c.erase(c.begin() + k);
+            // positions after k shifted by one after the erase
+            const size_t pos = (best_q < (int)k) ? best_q + 1 : best_q;
+            c.insert(c.begin() + pos, item);
+            improved = true;
+        }
+    }
+    return improved;
+}
+
+}
@@ -0,0 +1,119 @@
+#ifndef slic3r_ChainedPath_hpp_
+#define slic3r_ChainedPath_hpp_
+
+#include "libslic3r.h"
+#include "Point.hpp"
+#include <vector>
+
+namespace Slic3r {
+
+/// Spatial index over the endpoints of a set of items (points, polylines,
+/// extrusion entities) used to build greedy nearest-neighbour chains.
+/// Endpoints are stored in a static 2D tree; removed items are only flagged
+/// and the per-subtree count of live endpoints lets queries skip exhausted
+/// branches, so a whole chain costs O(n log n) instead of O(n^2).
+///
+/// Candidates at the same distance are resolved by their insertion order,
+/// which makes the result identical to the linear scans it replaces.
+class ChainingIndex
+{
+    public:
+    enum TieBreak {
+        /// The endpoint added first wins (like PolylineCollection::chained_path).
+        tbFirst,
+        /// The endpoint added last wins, except for coincident endpoints where
+        /// the first one wins (like Point::nearest_point_index).
+        tbLast,
+    };
+
+    ChainingIndex(TieBreak tie_break = tbFirst)
+        : tie_break(tie_break), built(false), live_endpoints(0) {};
+
+    /// Register an endpoint belonging to the given item. Endpoints are
+    /// identified by their insertion order. Must be called before build().
+    void add(const Point &point, size_t item);
+    void reserve(size_t endpoints);
+    void build();
+
+    /// Returns the id of the live endpoint nearest to the given point,
+    /// or -1 if all items were removed.
+    int nearest(const Point &from) const;
+    const Point& point(size_t endpoint) const { return this->points[endpoint]; };
+    size_t item(size_t endpoint) const { return this->items[endpoint]; };
+
+    /// Remove all the endpoints of an item.
+    void remove_item(size_t item);
+    bool empty() const { return this->live_endpoints == 0; };
+
+    private:
+    TieBreak tie_break;
+    bool built;
+    size_t live_endpoints;
+
+    // endpoint data, indexed by endpoint id
+    Points points;
+    std::vector<size_t> items;
+    std::vector<size_t> tree_pos;
+    std::vector<bool> removed;
+
+    // implicit balanced tree: the node of range [lo, hi) is (lo + hi) / 2,
+    // its split axis alternates with depth starting with X
+    std::vector<size_t> tree;
+    std::vector<size_t> live;
+
+    // endpoints of each item (CSR layout)
+    std::vector<size_t> item_offsets;
+    std::vector<size_t> item_endpoints;
+
+    void _build(size_t lo, size_t hi, bool split_x);
+    void _nearest(size_t lo, size_t hi, bool split_x, const Point &from, int* best, double* best_d) const;
+    bool _better(size_t endpoint, double d, int best, double best_d) const;
+};
+
+/// Local search refinement of an open chain of items, typically seeded by the
+/// greedy order built with ChainingIndex. It applies 2-opt moves (reversal of
+/// a run of consecutive items, which flips each of them) and Or-opt moves
+/// (relocation of a single item, optionally flipped) as long as they shorten
+/// the total travel between the items.
+/// Both moves only look a bounded number of positions ahead and the number of
+/// sweeps over the chain is capped, so the work is bounded and the result does
+/// not depend on timing.
+class ChainOptimizer
+{
+    public:
+    struct Item {
+        /// Entry and exit points in the current orientation.
+        Point first;
+        Point last;
+        /// Caller's identifier of the item.
+        size_t id;
+        /// Whether the item was flipped with respect to its original orientation.
+        bool reversed;
+        bool can_reverse;
+        /// Items that are not movable keep their relative order and orientation.
+        bool movable;
+        Item(const Point &first, const Point &last, size_t id, bool can_reverse = true, bool movable = true)
+            : first(first), last(last), id(id), reversed(false), can_reverse(can_reverse), movable(movable) {};
+    };
+    typedef std::vector<Item> Items;
+
+    /// Maximum distance (in chain positions) between the ends of a move.
+    size_t window;
+    /// Maximum number of improvement sweeps over the chain.
+    size_t max_passes;
+
+    ChainOptimizer(size_t window = 32, size_t max_passes = 4)
+        : window(window), max_passes(max_passes) {};
+
+    /// Reorder the chain in place and return the travel length saved.
+    double optimize(const Point &start, Items* chain) const;
+    static double travel_length(const Point &start, const Items &chain);
+
+    private:
+    bool _two_opt(const Point &start, Items* chain) const;
+    bool _or_opt(const Point &start, Items* chain) const;
+};
+
+}
+
+#endif
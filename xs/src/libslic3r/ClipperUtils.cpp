@@ -35,6 +35,7 @@ T
 ClipperPath_to_Slic3rMultiPoint(const ClipperLib::Path &input)
 {
     T retval;
+    retval.points.reserve(input.size());
     for (ClipperLib::Path::const_iterator pit = input.begin(); pit != input.end(); ++pit)
         retval.points.push_back(Point( (*pit).X, (*pit).Y ));
     return retval;
@@ -46,6 +47,7 @@ T
 ClipperPaths_to_Slic3rMultiPoints(const ClipperLib::Paths &input)
 {
     T retval;
+    retval.reserve(input.size());
     for (ClipperLib::Paths::const_iterator it = input.begin(); it != input.end(); ++it)
         retval.push_back(ClipperPath_to_Slic3rMultiPoint<typename T::value_type>(*it));
     return retval;
@@ -71,6 +73,7 @@ ClipperLib::Path
 Slic3rMultiPoint_to_ClipperPath(const MultiPoint &input)
 {
     ClipperLib::Path retval;
+    retval.reserve(input.points.size());
     for (Points::const_iterator pit = input.points.begin(); pit != input.points.end(); ++pit)
         retval.push_back(ClipperLib::IntPoint( (*pit).x, (*pit).y ));
     return retval;
@@ -81,6 +84,7 @@ ClipperLib::Paths
 Slic3rMultiPoints_to_ClipperPaths(const T &input)
 {
     ClipperLib::Paths retval;
+    retval.reserve(input.size());
     for (typename T::const_iterator it = input.begin(); it != input.end(); ++it)
         retval.push_back(Slic3rMultiPoint_to_ClipperPath(*it));
     return retval;
@@ -263,6 +267,57 @@ offset2_ex(const Polygons &polygons, const float delta1, const float delta2,
     return ClipperPaths_to_Slic3rExPolygons(output);
 }
 
+PolygonOffsetter::PolygonOffsetter(const Polygons &polygons, double scale,
+    ClipperLib::JoinType joinType, double miterLimit)
+    : _scale(scale), _joinType(joinType), _miterLimit(miterLimit)
+{
+    ClipperLib::Paths input = Slic3rMultiPoints_to_ClipperPaths(polygons);
+    scaleClipperPolygons(input, scale);
+    if (joinType == jtRound) {
+        this->_co.ArcTolerance = miterLimit;
+    } else {
+        this->_co.MiterLimit = miterLimit;
+    }
+    this->_co.AddPaths(input, joinType, ClipperLib::etClosedPolygon);
+}
+
+/// Scaled output, like the one of the first step of _offset2().
+ClipperLib::Paths
+PolygonOffsetter::_offset(const float delta)
+{
+    ClipperLib::Paths output;
+    this->_co.Execute(output, (delta*this->_scale));
+    return output;
+}
+
+Polygons
+PolygonOffsetter::offset(const float delta)
+{
+    ClipperLib::Paths output = this->_offset(delta);
+    scaleClipperPolygons(output, 1/this->_scale);
+    return ClipperPaths_to_Slic3rMultiPoints<Polygons>(output);
+}
+
+Polygons
+PolygonOffsetter::offset2(const float delta1, const float delta2)
+{
+    ClipperLib::Paths output1 = this->_offset(delta1);
+    
+    // perform second offset
+    ClipperLib::ClipperOffset co;
+    if (this->_joinType == jtRound) {
+        co.ArcTolerance = this->_miterLimit;
+    } else {
+        co.MiterLimit = this->_miterLimit;
+    }
+    co.AddPaths(output1, this->_joinType, ClipperLib::etClosedPolygon);
+    ClipperLib::Paths output;
+    co.Execute(output, (delta2*this->_scale));
+    
+    scaleClipperPolygons(output, 1/this->_scale);
+    return ClipperPaths_to_Slic3rMultiPoints<Polygons>(output);
+}
+
 template <class T>
 T
 _clipper_do(const ClipperLib::ClipType clipType, const Polygons &subject, 
@@ -74,6 +74,27 @@ Slic3r::ExPolygons offset2_ex(const Slic3r::Polygons &polygons, const float delt
     const float delta2, double scale = CLIPPER_OFFSET_SCALE, ClipperLib::JoinType joinType = ClipperLib::jtMiter, 
     double miterLimit = 3);
 
+/// Offsets the same polygons by several distances. The polygons are converted
+/// and added to a ClipperOffset once, and every offset is computed from that
+/// state, with the same result as offset() or offset2() with the same arguments.
+class PolygonOffsetter {
+    public:
+    PolygonOffsetter(const Slic3r::Polygons &polygons, double scale = CLIPPER_OFFSET_SCALE,
+        ClipperLib::JoinType joinType = ClipperLib::jtMiter, double miterLimit = 3);
+    PolygonOffsetter(const PolygonOffsetter&) = delete;
+    PolygonOffsetter& operator=(const PolygonOffsetter&) = delete;
+    Slic3r::Polygons offset(const float delta);
+    Slic3r::Polygons offset2(const float delta1, const float delta2);
+    
+    private:
+    ClipperLib::ClipperOffset _co;
+    double _scale;
+    ClipperLib::JoinType _joinType;
+    double _miterLimit;
+    
+    ClipperLib::Paths _offset(const float delta);
+};
+
 template <class T>
 T _clipper_do(ClipperLib::ClipType clipType, const Slic3r::Polygons &subject, 
     const Slic3r::Polygons &clip, const ClipperLib::PolyFillType fillType, bool safety_offset_ = false);
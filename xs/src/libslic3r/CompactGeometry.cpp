@@ -0,0 +1,373 @@
+#include "CompactGeometry.hpp"
+
+namespace Slic3r {
+
+// Deltas are computed with unsigned arithmetic, so they wrap around instead of
+// overflowing and the decoder restores the exact coordinates in any case.
+static inline uint64_t
+zigzag_delta(coord_t value, coord_t previous)
+{
+    const int64_t delta = (int64_t)((uint64_t)value - (uint64_t)previous);
+    return ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+}
+
+static inline coord_t
+unzigzag_delta(uint64_t encoded, coord_t previous)
+{
+    const uint64_t delta = (encoded >> 1) ^ (~(encoded & 1) + 1);
+    return (coord_t)((uint64_t)previous + delta);
+}
+
+static inline void
+put_varint(std::vector<uint8_t> &out, uint64_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static inline uint64_t
+get_varint(const uint8_t* &in)
+{
+    uint64_t value = 0;
+    for (unsigned int shift = 0; ; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) break;
+    }
+    return value;
+}
+
+CompactPolygons::CompactPolygons(const Polygons &polygons)
+{
+    this->offsets.reserve(polygons.size());
+    for (const Polygon &polygon : polygons)
+        this->append(polygon.points);
+    this->shrink_to_fit();
+}
+
+CompactPolygons::CompactPolygons(const Polylines &polylines)
+{
+    this->offsets.reserve(polylines.size());
+    for (const Polyline &polyline : polylines)
+        this->append(polyline.points);
+    this->shrink_to_fit();
+}
+
+void
+CompactPolygons::append(const Points &points)
+{
+    if (this->offsets.empty() && !points.empty())
+        this->origin = points.front();
+    this->offsets.push_back((uint32_t)this->data.size());
+    put_varint(this->data, points.size());
+    Point previous = this->origin;
+    for (const Point &p : points) {
+        put_varint(this->data, zigzag_delta(p.x, previous.x));
+        put_varint(this->data, zigzag_delta(p.y, previous.y));
+        previous = p;
+    }
+}
+
+void
+CompactPolygons::clear()
+{
+    this->origin = Point(0, 0);
+    this->data.clear();
+    this->offsets.clear();
+}
+
+void
+CompactPolygons::shrink_to_fit()
+{
+    this->data.shrink_to_fit();
+    this->offsets.shrink_to_fit();
+}
+
+Points
+CompactPolygons::points(size_t idx) const
+{
+    const uint8_t* in = this->data.data() + this->offsets.at(idx);
+    Points points;
+    points.resize(get_varint(in));
+    Point previous = this->origin;
+    for (Point &p : points) {
+        p.x = unzigzag_delta(get_varint(in), previous.x);
+        p.y = unzigzag_delta(get_varint(in), previous.y);
+        previous = p;
+    }
+    return points;
+}
+
+Polyline
+CompactPolygons::polyline(size_t idx) const
+{
+    Polyline polyline;
+    polyline.points = this->points(idx);
+    return polyline;
+}
+
+Polygons
+CompactPolygons::polygons() const
+{
+    Polygons polygons;
+    polygons.reserve(this->size());
+    for (size_t i = 0; i < this->size(); ++i)
+        polygons.push_back(this->polygon(i));
+    return polygons;
+}
+
+Polylines
+CompactPolygons::polylines() const
+{
+    Polylines polylines;
+    polylines.reserve(this->size());
+    for (size_t i = 0; i < this->size(); ++i)
+        polylines.push_back(this->polyline(i));
+    return polylines;
+}
+
+size_t
+CompactPolygons::memory_usage() const
+{
+    return this->data.capacity() + this->offsets.capacity() * sizeof(uint32_t);
+}
+
+CompactSurfaces::CompactSurfaces(const Surfaces &surfaces)
+{
+    this->attributes.reserve(surfaces.size());
+    for (const Surface &surface : surfaces) {
+        Attributes attr;
+        attr.surface_type       = surface.surface_type;
+        attr.thickness_layers   = surface.thickness_layers;
+        attr.extra_perimeters   = surface.extra_perimeters;
+        attr.holes              = (uint32_t)surface.expolygon.holes.size();
+        attr.thickness          = surface.thickness;
+        attr.bridge_angle       = surface.bridge_angle;
+        this->attributes.push_back(attr);
+
+        this->polygons.append(surface.expolygon.contour);
+        for (const Polygon &hole : surface.expolygon.holes)
+            this->polygons.append(hole);
+    }
+    this->polygons.shrink_to_fit();
+}
+
+void
+CompactSurfaces::clear()
+{
+    this->attributes.clear();
+    this->polygons.clear();
+}
+
+Surfaces
+CompactSurfaces::surfaces() const
+{
+    Surfaces surfaces;
+    surfaces.reserve(this->attributes.size());
+    size_t idx = 0;
+    for (const Attributes &attr : this->attributes) {
+        ExPolygon expolygon;
+        expolygon.contour = this->polygons.polygon(idx++);
+        expolygon.holes.reserve(attr.holes);
+        for (uint32_t i = 0; i < attr.holes; ++i)
+            expolygon.holes.push_back(this->polygons.polygon(idx++));
+
+        Surface surface(attr.surface_type, expolygon);
+        surface.thickness           = attr.thickness;
+        surface.thickness_layers    = attr.thickness_layers;
+        surface.bridge_angle        = attr.bridge_angle;
+        surface.extra_perimeters    = attr.extra_perimeters;
+        surfaces.push_back(surface);
+    }
+    return surfaces;
+}
+
+size_t
+CompactSurfaces::memory_usage() const
+{
+    return this->attributes.capacity() * sizeof(Attributes) + this->polygons.memory_usage();
+}
+
+CompactExtrusions::CompactExtrusions(const ExtrusionEntityCollection &collection)
+{
+    this->_append(collection);
+    this->items = collection.items_count();
+    this->entries.shrink_to_fit();
+    this->polylines.shrink_to_fit();
+    this->orig_indices.shrink_to_fit();
+}
+
+void
+CompactExtrusions::_append(const ExtrusionEntity &entity)
+{
+    if (const ExtrusionPath* path = dynamic_cast<const ExtrusionPath*>(&entity)) {
+        this->_append(*path);
+    } else if (const ExtrusionLoop* loop = dynamic_cast<const ExtrusionLoop*>(&entity)) {
+        Entry entry {};
+        entry.type  = etLoop;
+        entry.role  = (uint8_t)loop->role;
+        entry.count = (uint32_t)loop->paths.size();
+        this->entries.push_back(entry);
+        for (const ExtrusionPath &path : loop->paths)
+            this->_append(path);
+    } else if (const ExtrusionEntityCollection* collection = dynamic_cast<const ExtrusionEntityCollection*>(&entity)) {
+        Entry entry {};
+        entry.type      = etCollection;
+        entry.count     = (uint32_t)collection->entities.size();
+        entry.no_sort   = collection->no_sort;
+        entry.has_orig_indices = !collection->orig_indices.empty()
+            && collection->orig_indices.size() == collection->entities.size();
+        this->entries.push_back(entry);
+        if (entry.has_orig_indices)
+            this->orig_indices.insert(this->orig_indices.end(),
+                collection->orig_indices.begin(), collection->orig_indices.end());
+        for (const ExtrusionEntity* child : collection->entities)
+            this->_append(*child);
+    }
+}
+
+void
+CompactExtrusions::_append(const ExtrusionPath &path)
+{
+    Entry entry {};
+    entry.type          = etPath;
+    entry.role          = (uint8_t)path.role;
+    entry.mm3_per_mm    = path.mm3_per_mm;
+    entry.width         = path.width;
+    entry.height        = path.height;
+    this->entries.push_back(entry);
+    this->polylines.append(path.polyline);
+}
+
+void
+CompactExtrusions::clear()
+{
+    this->entries.clear();
+    this->polylines.clear();
+    this->orig_indices.clear();
+    this->items = 0;
+}
+
+void
+CompactExtrusions::collection(ExtrusionEntityCollection* collection) const
+{
+    collection->clear();
+    collection->orig_indices.clear();
+    collection->no_sort = false;
+    if (this->entries.empty()) return;
+    Cursor cursor;
+    this->_decode_collection(&cursor, collection);
+}
+
+ExtrusionEntity*
+CompactExtrusions::_decode(Cursor* cursor) const
+{
+    const Entry &entry = this->entries.at(cursor->entry);
+    switch (entry.type) {
+        case etPath:
+            return new ExtrusionPath(this->_decode_path(cursor));
+        case etLoop: {
+            ExtrusionLoop* loop = new ExtrusionLoop((ExtrusionLoopRole)entry.role);
+            ++cursor->entry;
+            loop->paths.reserve(entry.count);
+            for (uint32_t i = 0; i < entry.count; ++i)
+                loop->paths.push_back(this->_decode_path(cursor));
+            return loop;
+        }
+        default: {
+            ExtrusionEntityCollection* collection = new ExtrusionEntityCollection();
+            this->_decode_collection(cursor, collection);
+            return collection;
+        }
+    }
+}
+
+ExtrusionPath
+CompactExtrusions::_decode_path(Cursor* cursor) const
+{
+    const Entry &entry = this->entries.at(cursor->entry++);
+    ExtrusionPath path((ExtrusionRole)entry.role, entry.mm3_per_mm, entry.width, entry.height);
+    path.polyline = this->polylines.polyline(cursor->polyline++);
+    return path;
+}
+
+void
+CompactExtrusions::_decode_collection(Cursor* cursor, ExtrusionEntityCollection* collection) const
+{
+    const Entry &entry = this->entries.at(cursor->entry++);
+    collection->no_sort = entry.no_sort;
+    if (entry.has_orig_indices) {
+        collection->orig_indices.assign(
+            this->orig_indices.begin() + cursor->orig_index,
+            this->orig_indices.begin() + cursor->orig_index + entry.count);
+        cursor->orig_index += entry.count;
+    }
+    // entities are owned by the collection
+    collection->entities.reserve(entry.count);
+    for (uint32_t i = 0; i < entry.count; ++i)
+        collection->entities.push_back(this->_decode(cursor));
+}
+
+size_t
+CompactExtrusions::memory_usage() const
+{
+    return this->entries.capacity() * sizeof(Entry) + this->polylines.memory_usage()
+        + this->orig_indices.capacity() * sizeof(uint32_t);
+}
+
+size_t
+memory_usage(const Points &points)
+{
+    return points.capacity() * sizeof(Point);
+}
+
+size_t
+memory_usage(const Polygons &polygons)
+{
+    size_t bytes = polygons.capacity() * sizeof(Polygon);
+    for (const Polygon &polygon : polygons)
+        bytes += memory_usage(polygon.points);
+    return bytes;
+}
+
+size_t
+memory_usage(const Polylines &polylines)
+{
+    size_t bytes = polylines.capacity() * sizeof(Polyline);
+    for (const Polyline &polyline : polylines)
+        bytes += memory_usage(polyline.points);
+    return bytes;
+}
+
+size_t
+memory_usage(const Surfaces &surfaces)
+{
+    size_t bytes = surfaces.capacity() * sizeof(Surface);
+    for (const Surface &surface : surfaces)
+        bytes += memory_usage(surface.expolygon.contour.points) + memory_usage(surface.expolygon.holes);
+    return bytes;
+}
+
+size_t
+memory_usage(const ExtrusionEntityCollection &collection)
+{
+    size_t bytes = collection.entities.capacity() * sizeof(ExtrusionEntity*)
+        + collection.orig_indices.capacity() * sizeof(size_t);
+    for (const ExtrusionEntity* entity : collection.entities) {
+        if (const ExtrusionPath* path = dynamic_cast<const ExtrusionPath*>(entity)) {
+            bytes += sizeof(ExtrusionPath) + memory_usage(path->polyline.points);
+        } else if (const ExtrusionLoop* loop = dynamic_cast<const ExtrusionLoop*>(entity)) {
+            bytes += sizeof(ExtrusionLoop) + loop->paths.capacity() * sizeof(ExtrusionPath);
+            for (const ExtrusionPath &path : loop->paths)
+                bytes += memory_usage(path.polyline.points);
+        } else if (const ExtrusionEntityCollection* child = dynamic_cast<const ExtrusionEntityCollection*>(entity)) {
+            bytes += sizeof(ExtrusionEntityCollection) + memory_usage(*child);
+        }
+    }
+    return bytes;
+}
+
+}
@@ -0,0 +1,145 @@
+#ifndef slic3r_CompactGeometry_hpp_
+#define slic3r_CompactGeometry_hpp_
+
+#include "libslic3r.h"
+#include "ExtrusionEntityCollection.hpp"
+#include "Point.hpp"
+#include "Polygon.hpp"
+#include "Polyline.hpp"
+#include "Surface.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace Slic3r {
+
+/// Packed storage for a set of point sequences (polygons or polylines).
+/// Points are stored in a single byte buffer as zigzag varint deltas from the
+/// previous point; the first point of each path is relative to the origin of
+/// the collection so that any path can be decoded on its own.
+/// Typical layer geometry takes 3-6 bytes per point instead of 16.
+class CompactPolygons
+{
+    public:
+    CompactPolygons() {};
+    explicit CompactPolygons(const Polygons &polygons);
+    explicit CompactPolygons(const Polylines &polylines);
+
+    void append(const Points &points);
+    void append(const MultiPoint &path) { this->append(path.points); };
+    size_t size() const { return this->offsets.size(); };
+    bool empty() const { return this->offsets.empty(); };
+    void clear();
+    /// Releases the excess capacity of the buffers.
+    void shrink_to_fit();
+
+    /// Decodes a single path.
+    Points points(size_t idx) const;
+    Polygon polygon(size_t idx) const { return Polygon(this->points(idx)); };
+    Polyline polyline(size_t idx) const;
+    /// Decodes all the paths.
+    Polygons polygons() const;
+    Polylines polylines() const;
+
+    /// Heap memory used by the packed representation, in bytes.
+    size_t memory_usage() const;
+
+    private:
+    Point origin;
+    std::vector<uint8_t> data;
+    /// Start of each path in data.
+    std::vector<uint32_t> offsets;
+};
+
+/// Packed copy of a set of surfaces: the geometry of the expolygons goes to a
+/// CompactPolygons (contour first, then the holes) and the other attributes
+/// are stored aside.
+class CompactSurfaces
+{
+    public:
+    CompactSurfaces() {};
+    explicit CompactSurfaces(const Surfaces &surfaces);
+
+    size_t size() const { return this->attributes.size(); };
+    bool empty() const { return this->attributes.empty(); };
+    void clear();
+    Surfaces surfaces() const;
+
+    /// Heap memory used by the packed representation, in bytes.
+    size_t memory_usage() const;
+
+    private:
+    struct Attributes {
+        SurfaceType     surface_type;
+        unsigned short  thickness_layers;
+        unsigned short  extra_perimeters;
+        uint32_t        holes;
+        double          thickness;
+        double          bridge_angle;
+    };
+    std::vector<Attributes> attributes;
+    CompactPolygons polygons;
+};
+
+/// Packed copy of a tree of extrusions: the points of the paths go to a
+/// CompactPolygons, and the paths, loops and collections are stored aside
+/// in depth-first order. The seam candidates of the loops, which are only
+/// found on the copies made for the G-code export, are not kept.
+class CompactExtrusions
+{
+    public:
+    CompactExtrusions() {};
+    explicit CompactExtrusions(const ExtrusionEntityCollection &collection);
+
+    bool empty() const { return this->entries.empty() || this->entries.front().count == 0; };
+    /// items_count() of the packed collection.
+    size_t items_count() const { return this->items; };
+    void clear();
+    /// Decodes the packed collection into *collection, replacing its content.
+    void collection(ExtrusionEntityCollection* collection) const;
+
+    /// Heap memory used by the packed representation, in bytes.
+    size_t memory_usage() const;
+
+    private:
+    enum EntryType : uint8_t { etPath, etLoop, etCollection };
+    struct Entry {
+        double          mm3_per_mm;
+        float           width;
+        float           height;
+        /// Paths of a loop, entities of a collection.
+        uint32_t        count;
+        EntryType       type;
+        /// ExtrusionRole of a path, ExtrusionLoopRole of a loop.
+        uint8_t         role;
+        bool            no_sort;
+        /// Whether the orig_indices of a collection were stored.
+        bool            has_orig_indices;
+    };
+    /// Position of the decoder in entries, polylines and orig_indices.
+    struct Cursor {
+        size_t entry {0};
+        size_t polyline {0};
+        size_t orig_index {0};
+    };
+    std::vector<Entry> entries;
+    CompactPolygons polylines;
+    std::vector<uint32_t> orig_indices;
+    size_t items {0};
+
+    void _append(const ExtrusionEntity &entity);
+    void _append(const ExtrusionPath &path);
+    ExtrusionEntity* _decode(Cursor* cursor) const;
+    ExtrusionPath _decode_path(Cursor* cursor) const;
+    void _decode_collection(Cursor* cursor, ExtrusionEntityCollection* collection) const;
+};
+
+/// Heap memory used by unpacked geometry, in bytes.
+size_t memory_usage(const Points &points);
+size_t memory_usage(const Polygons &polygons);
+size_t memory_usage(const Polylines &polylines);
+size_t memory_usage(const Surfaces &surfaces);
+size_t memory_usage(const ExtrusionEntityCollection &collection);
+
+}
+
+#endif
@@ -1,6 +1,12 @@
 #include <string>
 
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <vector>
 #include <exprtk/exprtk.hpp>
 #include "ConditionalGCode.hpp"
 namespace Slic3r {
@@ -46,6 +52,143 @@ std::string apply_math(const std::string& input) {
 
 
 
+/// An expression compiled with variables in place of its numbers.
+struct CompiledExpression {
+    std::vector<double> numbers;
+    exprtk::symbol_table<double> symbol_table;
+    exprtk::expression<double> expression;
+    bool valid {false};
+};
+
+static inline bool is_digit(char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; }
+static inline bool is_alpha(char c) { return std::isalpha(static_cast<unsigned char>(c)) != 0; }
+static inline bool is_alnum(char c) { return std::isalnum(static_cast<unsigned char>(c)) != 0; }
+static inline bool is_space(char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; }
+
+static inline bool is_operator(char c) {
+    return c != 0 && std::strchr("+-*/%^<>=!&|,;?", c) != nullptr;
+}
+
+/// Replaces the numbers of an expression by the variables slic3r_n0,
+/// slic3r_n1... and gives their values, parsed like exprtk does. Returns false
+/// when the expression has anything that could make a number parse
+/// differently from a variable, like an implicit multiplication, a string or
+/// an assignment.
+static bool split_numbers(const std::string& expression, std::string* form, std::vector<double>* numbers) {
+    if (expression.find_first_of("'#:$[]{}") != std::string::npos
+        || expression.find("//") != std::string::npos || expression.find("/*") != std::string::npos
+        || expression.find("slic3r_n") != std::string::npos)
+        return false;
+    for (const char* assignment : { "+=", "-=", "*=", "/=", "%=" })
+        if (expression.find(assignment) != std::string::npos) return false;
+
+    form->clear();
+    numbers->clear();
+    char previous = 0;      // last character that isn't a space
+    bool exponent = false;  // exprtk computes integer powers of constants by multiplication
+    size_t i = 0;
+    while (i < expression.size()) {
+        const char c = expression[i];
+        if (is_alpha(c) || c == '_') {
+            // symbols like log10 keep their digits
+            size_t end = i;
+            while (end < expression.size() && (is_alnum(expression[end]) || expression[end] == '_' || expression[end] == '.')) ++end;
+            form->append(expression, i, end - i);
+            previous = c;
+            exponent = false;
+            i = end;
+            continue;
+        }
+        const bool number = is_digit(c)
+            || (c == '.' && i + 1 < expression.size() && is_digit(expression[i + 1]));
+        if (!number) {
+            form->push_back(c);
+            if (!is_space(c)) previous = c;
+            if (c == '^') exponent = true;
+            else if (!is_space(c) && c != '+' && c != '-') exponent = false;
+            ++i;
+            continue;
+        }
+
+        // digits with a dot and an exponent, like exprtk's scan_number()
+        size_t end = i;
+        bool dot = false, e = false;
+        while (end < expression.size()) {
+            const char d = expression[end];
+            if (is_digit(d)) {
+                ++end;
+            } else if (d == '.' && !dot && !e) {
+                dot = true;
+                ++end;
+            } else if ((d == 'e' || d == 'E') && !e) {
+                size_t digit = end + 1;
+                if (digit < expression.size() && (expression[digit] == '+' || expression[digit] == '-')) ++digit;
+                if (digit >= expression.size() || !is_digit(expression[digit])) break;
+                e = true;
+                end = digit;
+            } else {
+                break;
+            }
+        }
+        size_t next = end;
+        while (next < expression.size() && is_space(expression[next])) ++next;
+        if ((previous != 0 && previous != '(' && !is_operator(previous))
+            || (next < expression.size() && expression[next] != ')' && !is_operator(expression[next])))
+            return false;
+
+        if (exponent) {
+            // the exponent stays a constant
+            form->append(expression, i, end - i);
+        } else {
+            double value;
+            if (!exprtk::details::string_to_real(expression.substr(i, end - i), value)) return false;
+            *form += "slic3r_n" + std::to_string(numbers->size());
+            numbers->push_back(value);
+        }
+        previous = '0';
+        exponent = false;
+        i = end;
+    }
+    return true;
+}
+
+/// Same as exprtk::compute(), but the expressions only differing by their
+/// numbers, like the ones of custom G-code for each layer, are only compiled
+/// once by each thread.
+static bool compute(const std::string& expression_string, double& result) {
+    std::string form;
+    std::vector<double> numbers;
+    if (!split_numbers(expression_string, &form, &numbers))
+        return exprtk::compute(expression_string, result);
+
+    static thread_local std::map<std::string, std::unique_ptr<CompiledExpression>> cache;
+    auto it = cache.find(form);
+    if (it == cache.end()) {
+        if (cache.size() >= 256) cache.clear();
+        std::unique_ptr<CompiledExpression> compiled { new CompiledExpression() };
+        compiled->numbers.assign(numbers.size(), 0);
+        compiled->symbol_table.add_constants();
+        for (size_t i = 0; i < numbers.size(); ++i)
+            compiled->symbol_table.add_variable("slic3r_n" + std::to_string(i), compiled->numbers[i]);
+        compiled->expression.register_symbol_table(compiled->symbol_table);
+        // without rewriting the operations on the variables, which would
+        // round differently from the constants folded by exprtk::compute()
+        exprtk::parser<double> parser { exprtk::parser<double>::settings_t(
+            exprtk::parser<double>::settings_t::compile_all_opts - exprtk::parser<double>::settings_t::e_strength_reduction) };
+        compiled->valid = parser.compile(form, compiled->expression);
+        it = cache.emplace(form, std::move(compiled)).first;
+    }
+    CompiledExpression& compiled = *it->second;
+    if (!compiled.valid)
+        return exprtk::compute(expression_string, result);
+    std::copy(numbers.cbegin(), numbers.cend(), compiled.numbers.begin());
+    result = compiled.expression.value();
+    // the sign of NaN depends on the folding of the constants
+    if (std::isnan(result))
+        return exprtk::compute(expression_string, result);
+    return true;
+}
+
 /// Evaluate expressions with exprtk
 /// Everything must resolve to a number.
 std::string evaluate(const std::string& expression_string) {
@@ -55,7 +198,7 @@ std::string evaluate(const std::string& expression_string) {
     std::cerr << __FILE__ << ":" << __LINE__ << " "<< "Evaluating expression: " << expression_string << std::endl;
     #endif
     double num_result = double(0);
-    if ( exprtk::compute(expression_string, num_result)) { 
+    if (compute(expression_string, num_result)) { 
         result << num_result;
     } else {
         #if SLIC3R_DEBUG
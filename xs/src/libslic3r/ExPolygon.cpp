@@ -162,7 +162,7 @@ ExPolygon::simplify_p(double tolerance) const
     {
         Polygon p = this->contour;
         p.points.push_back(p.points.front());
-        p.points = MultiPoint::_douglas_peucker(p.points, tolerance);
+        MultiPoint::_douglas_peucker(&p.points, tolerance);
         p.points.pop_back();
         pp.push_back(p);
     }
@@ -171,7 +171,7 @@ ExPolygon::simplify_p(double tolerance) const
     for (Polygons::const_iterator it = this->holes.begin(); it != this->holes.end(); ++it) {
         Polygon p = *it;
         p.points.push_back(p.points.front());
-        p.points = MultiPoint::_douglas_peucker(p.points, tolerance);
+        MultiPoint::_douglas_peucker(&p.points, tolerance);
         p.points.pop_back();
         pp.push_back(p);
     }
@@ -119,11 +119,23 @@ public:
 
 typedef std::vector<ExtrusionPath> ExtrusionPaths;
 
+/// Vertices of a loop where its seam may be placed, see GCode::seam_candidates().
+struct SeamCandidates {
+    /// Extruder whose nozzle diameter they were found for, -1 if not found yet.
+    int extruder {-1};
+    /// Concave vertices, or convex ones if there are none.
+    Points points;
+    /// The candidates not extruded with a bridging flow.
+    Points non_overhang;
+};
+
 class ExtrusionLoop : public ExtrusionEntity
 {
     public:
     ExtrusionPaths paths;
     ExtrusionLoopRole role;
+    /// Found ahead of the export by PrintGCode::plan_layer(), if any.
+    SeamCandidates seam_candidates;
     
     ExtrusionLoop(ExtrusionLoopRole role = elrDefault) : role(role) {};
     ExtrusionLoop(const ExtrusionPaths &paths, ExtrusionLoopRole role = elrDefault)
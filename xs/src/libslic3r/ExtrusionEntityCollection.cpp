@@ -1,4 +1,5 @@
 #include "ExtrusionEntityCollection.hpp"
+#include "ChainedPath.hpp"
 #include <algorithm>
 #include <cmath>
 #include <map>
@@ -158,43 +159,86 @@ ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEntityCo
     retval->entities.reserve(this->entities.size());
     retval->orig_indices.reserve(this->entities.size());
     
-    // if we're asked to return the original indices, build a map
-    std::map<ExtrusionEntity*,size_t> indices_map;
-    
+    // my_paths keeps the original order, so item ids are the original indices
     ExtrusionEntitiesPtr my_paths;
-    for (ExtrusionEntitiesPtr::const_iterator it = this->entities.begin(); it != this->entities.end(); ++it) {
-        ExtrusionEntity* entity = (*it)->clone();
-        my_paths.push_back(entity);
-        if (orig_indices != NULL) indices_map[entity] = it - this->entities.begin();
-    }
+    my_paths.reserve(this->entities.size());
+    for (ExtrusionEntitiesPtr::const_iterator it = this->entities.begin(); it != this->entities.end(); ++it)
+        my_paths.push_back((*it)->clone());
     
-    Points endpoints;
+    // ties are resolved like Point::nearest_point_index() would do on the
+    // flat list of (first, last) endpoint pairs
+    ChainingIndex index(ChainingIndex::tbLast);
+    index.reserve(my_paths.size() * 2);
     for (ExtrusionEntitiesPtr::iterator it = my_paths.begin(); it != my_paths.end(); ++it) {
-        endpoints.push_back((*it)->first_point());
+        const size_t path_index = it - my_paths.begin();
+        index.add((*it)->first_point(), path_index);
         if (no_reverse || !(*it)->can_reverse()) {
-            endpoints.push_back((*it)->first_point());
+            index.add((*it)->first_point(), path_index);
         } else {
-            endpoints.push_back((*it)->last_point());
+            index.add((*it)->last_point(), path_index);
         }
     }
+    index.build();
     
-    while (!my_paths.empty()) {
+    while (!index.empty()) {
         // find nearest point
-        int start_index = start_near.nearest_point_index(endpoints);
-        int path_index = start_index/2;
+        int start_index = index.nearest(start_near);
+        int path_index = index.item(start_index);
         ExtrusionEntity* entity = my_paths.at(path_index);
         // never reverse loops, since it's pointless for chained path and callers might depend on orientation
         if (start_index % 2 && !no_reverse && entity->can_reverse()) {
             entity->reverse();
         }
-        retval->entities.push_back(my_paths.at(path_index));
-        if (orig_indices != NULL) orig_indices->push_back(indices_map[entity]);
-        my_paths.erase(my_paths.begin() + path_index);
-        endpoints.erase(endpoints.begin() + 2*path_index, endpoints.begin() + 2*path_index + 2);
+        retval->entities.push_back(entity);
+        if (orig_indices != NULL) orig_indices->push_back(path_index);
+        index.remove_item(path_index);
         start_near = retval->entities.back()->last_point();
     }
 }
 
+double
+ExtrusionEntityCollection::optimize_travel(const Point &start_near, const std::vector<ExtrusionRole> &roles, bool no_reverse)
+{
+    if (this->no_sort || this->entities.size() < 2 || roles.empty()) return 0;
+    
+    ChainOptimizer::Items chain;
+    chain.reserve(this->entities.size());
+    for (ExtrusionEntitiesPtr::const_iterator it = this->entities.begin(); it != this->entities.end(); ++it) {
+        // collections are kept in place, loops and paths are identified by their (first) role
+        ExtrusionRole role = erNone;
+        if (const ExtrusionPath* path = dynamic_cast<const ExtrusionPath*>(*it)) {
+            role = path->role;
+        } else if (const ExtrusionLoop* loop = dynamic_cast<const ExtrusionLoop*>(*it)) {
+            if (!loop->paths.empty()) role = loop->paths.front().role;
+        }
+        chain.push_back(ChainOptimizer::Item(
+            (*it)->first_point(),
+            (*it)->last_point(),
+            it - this->entities.begin(),
+            !no_reverse && (*it)->can_reverse(),
+            std::find(roles.begin(), roles.end(), role) != roles.end()
+        ));
+    }
+    
+    const double saved = ChainOptimizer().optimize(start_near, &chain);
+    if (saved <= 0) return 0;
+    
+    // keep orig_indices in sync if they describe the current entities
+    const bool has_orig_indices = this->orig_indices.size() == this->entities.size();
+    ExtrusionEntitiesPtr entities;
+    std::vector<size_t> orig_indices;
+    entities.reserve(chain.size());
+    for (const ChainOptimizer::Item &item : chain) {
+        ExtrusionEntity* entity = this->entities[item.id];
+        if (item.reversed) entity->reverse();
+        entities.push_back(entity);
+        if (has_orig_indices) orig_indices.push_back(this->orig_indices[item.id]);
+    }
+    this->entities.swap(entities);
+    if (has_orig_indices) this->orig_indices.swap(orig_indices);
+    return saved;
+}
+
 Polygons
 ExtrusionEntityCollection::grow() const
 {
@@ -258,6 +302,15 @@ ExtrusionEntityCollection::flatten(bool preserve_ordering) const
     return coll;
 }
 
+double
+ExtrusionEntityCollection::length() const
+{
+    double len = 0;
+    for (ExtrusionEntitiesPtr::const_iterator it = this->entities.begin(); it != this->entities.end(); ++it)
+        len += (*it)->length();
+    return len;
+}
+
 double
 ExtrusionEntityCollection::min_mm3_per_mm() const
 {
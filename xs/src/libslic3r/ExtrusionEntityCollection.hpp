@@ -50,6 +50,12 @@ class ExtrusionEntityCollection : public ExtrusionEntity
     ExtrusionEntityCollection chained_path(bool no_reverse = false, std::vector<size_t>* orig_indices = NULL) const;
     void chained_path(ExtrusionEntityCollection* retval, bool no_reverse = false, std::vector<size_t>* orig_indices = NULL) const;
     void chained_path_from(Point start_near, ExtrusionEntityCollection* retval, bool no_reverse = false, std::vector<size_t>* orig_indices = NULL) const;
+
+    /// Refine the current order of the entities (usually the result of chained_path_from())
+    /// with a bounded 2-opt/Or-opt search to shorten the travel moves between them.
+    /// Only the entities having one of the given roles are moved or reversed.
+    /// \return the travel length saved, in scaled units.
+    double optimize_travel(const Point &start_near, const std::vector<ExtrusionRole> &roles, bool no_reverse = false);
     void reverse();
     Point first_point() const;
     Point last_point() const;
@@ -69,6 +75,8 @@ class ExtrusionEntityCollection : public ExtrusionEntity
     ExtrusionEntityCollection flatten(bool preserve_ordering = false) const;
 
 
+    /// Total length of the extrusions contained in this collection.
+    double length() const;
     double min_mm3_per_mm() const;
     Polyline as_polyline() const {
         CONFESS("Calling as_polyline() on a ExtrusionEntityCollection");
@@ -1,5 +1,7 @@
 #include "GCode.hpp"
 #include "ExtrusionEntity.hpp"
+#include "GCodeTimeEstimator.hpp"
+#include "Geometry.hpp"
 #include <algorithm>
 #include <cstdlib>
 #include <math.h>
@@ -10,31 +12,122 @@ namespace Slic3r {
 
 AvoidCrossingPerimeters::AvoidCrossingPerimeters()
     : use_external_mp(false), use_external_mp_once(false), disable_once(true),
-        _external_mp(NULL), _layer_mp(NULL)
+        _layer_mps(std::make_shared<LayerMps>())
 {
 }
 
-AvoidCrossingPerimeters::~AvoidCrossingPerimeters()
+void
+AvoidCrossingPerimeters::init_external_mp(const ExPolygons &islands, int threads)
 {
-    delete this->_external_mp;
-    
-    delete this->_layer_mp;
+    this->_external_mp = std::make_shared<MotionPlanner>(islands);
+    if (threads > 1) this->_external_mp->prepare();
 }
 
 void
-AvoidCrossingPerimeters::init_external_mp(const ExPolygons &islands)
+AvoidCrossingPerimeters::init_layer_mp(const ExPolygons &islands)
 {
-    delete this->_external_mp;
-    
-    this->_external_mp = new MotionPlanner(islands);
+    this->_layer_mp = std::make_shared<MotionPlanner>(islands);
 }
 
 void
-AvoidCrossingPerimeters::init_layer_mp(const ExPolygons &islands)
+AvoidCrossingPerimeters::init_layer_mp(const Layer &layer)
+{
+    {
+        boost::lock_guard<boost::mutex> l(this->_layer_mps->mutex);
+        const auto it = this->_layer_mps->planners.find(&layer);
+        if (it != this->_layer_mps->planners.end()) {
+            this->_layer_mp = it->second.first;
+            if (--it->second.second == 0) this->_layer_mps->planners.erase(it);
+            return;
+        }
+    }
+    this->init_layer_mp(union_ex(layer.slices, true));
+}
+
+void
+AvoidCrossingPerimeters::share_mps(const AvoidCrossingPerimeters &other)
+{
+    this->_external_mp  = other._external_mp;
+    this->_layer_mps    = other._layer_mps;
+}
+
+static size_t
+hash_points(size_t hash, const Points &points)
+{
+    hash = hash * 31 + points.size();
+    for (const Point &point : points)
+        hash = (hash * 31 + point.x) * 31 + point.y;
+    return hash;
+}
+
+static size_t
+hash_islands(const ExPolygons &islands)
+{
+    size_t hash = islands.size();
+    for (const ExPolygon &island : islands) {
+        hash = hash_points(hash, island.contour.points);
+        for (const Polygon &hole : island.holes)
+            hash = hash_points(hash, hole.points);
+    }
+    return hash;
+}
+
+static bool
+same_islands(const ExPolygons &a, const ExPolygons &b)
 {
-    delete this->_layer_mp;
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].contour.points != b[i].contour.points || a[i].holes.size() != b[i].holes.size())
+            return false;
+        for (size_t j = 0; j < a[i].holes.size(); ++j)
+            if (a[i].holes[j].points != b[i].holes[j].points) return false;
+    }
+    return true;
+}
+
+void
+AvoidCrossingPerimeters::prepare_layer_mps(const std::vector<const Layer*> &exported_layers, int threads)
+{
+    if (exported_layers.empty()) return;
+    
+    std::map<const Layer*, size_t> exports;
+    std::vector<const Layer*> layers;
+    for (const Layer* layer : exported_layers)
+        if (exports[layer]++ == 0) layers.push_back(layer);
+    
+    std::vector<ExPolygons> islands(layers.size());
+    parallelize<size_t>(0, layers.size() - 1, [&layers, &islands] (size_t i) {
+        islands[i] = union_ex(layers[i]->slices, true);
+    }, threads);
     
-    this->_layer_mp = new MotionPlanner(islands);
+    // find the layers with the same islands
+    std::vector<size_t> planner_of(layers.size());
+    std::vector<size_t> planner_layers;     // first layer of each planner
+    std::multimap<size_t, size_t> planners_by_hash;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        const size_t hash = hash_islands(islands[i]);
+        const auto range = planners_by_hash.equal_range(hash);
+        auto planner = range.first;
+        while (planner != range.second && !same_islands(islands[planner_layers[planner->second]], islands[i]))
+            ++planner;
+        if (planner != range.second) {
+            planner_of[i] = planner->second;
+        } else {
+            planner_of[i] = planner_layers.size();
+            planners_by_hash.insert(std::make_pair(hash, planner_layers.size()));
+            planner_layers.push_back(i);
+        }
+    }
+    
+    // with a single thread, the graphs are still built lazily since a layer
+    // might not need all of them
+    std::vector<std::shared_ptr<MotionPlanner>> planners(planner_layers.size());
+    parallelize<size_t>(0, planners.size() - 1, [&planners, &planner_layers, &islands, threads] (size_t i) {
+        planners[i] = std::make_shared<MotionPlanner>(islands[planner_layers[i]]);
+        if (threads > 1) planners[i]->prepare();
+    }, threads);
+    for (size_t i = 0; i < layers.size(); ++i)
+        this->_layer_mps->planners[layers[i]] = std::make_pair(planners[planner_of[i]], exports[layers[i]]);
 }
 
 Polyline
@@ -176,8 +269,9 @@ Wipe::wipe(GCode &gcodegen, bool toolchange)
             /*  Reduce retraction length a bit to avoid effective retraction speed to be greater than the configured one
                 due to rounding (TODO: test and/or better math for this)  */
             double dE = length * (segment_length / wipe_dist) * 0.95;
-            gcode += gcodegen.writer.set_speed(wipe_speed*60, "", gcodegen.enable_cooling_markers ? ";_WIPE" : "");
-            gcode += gcodegen.writer.extrude_to_xy(
+            gcodegen.writer.set_speed(&gcode, wipe_speed*60, "", gcodegen.enable_cooling_markers ? ";_WIPE" : "");
+            gcodegen.writer.extrude_to_xy(
+                &gcode,
                 gcodegen.point_to_gcode(line->b),
                 -dE,
                 "wipe and retract"
@@ -199,8 +293,10 @@ GCode::GCode()
     : placeholder_parser(NULL), enable_loop_clipping(true), enable_cooling_markers(false), layer_count(0),
         layer_index(-1), layer(NULL), first_layer(false), elapsed_time(0.0),
         elapsed_time_bridges(0.0), elapsed_time_external(0.0), volumetric_speed(0),
-        _last_pos_defined(false)
+        recording(NULL), toolchanges(0), toolchange_time(0), _extrusion_length(0), _last_pos_defined(false),
+        _last_role(erNone)
 {
+    this->update_motion();
 }
 
 const Point&
@@ -227,6 +323,53 @@ GCode::apply_print_config(const PrintConfig &print_config)
 {
     this->writer.apply_print_config(print_config);
     this->config.apply(print_config);
+    this->update_motion();
+}
+
+void
+GCode::apply_object_config(const PrintObjectConfig &object_config)
+{
+    this->config.apply(object_config, true);
+    this->update_motion();
+}
+
+void
+GCode::apply_region_config(const PrintRegionConfig &region_config)
+{
+    this->config.apply(region_config);
+    this->update_motion();
+}
+
+void
+GCode::update_motion()
+{
+    // the options are looked up by name here, once per configuration change,
+    // so that ratios over other options are resolved like everywhere else
+    for (ExtrusionMotion &motion : this->_motion)
+        motion.speed = -1;
+    this->_motion[erPerimeter].speed         = this->config.get_abs_value("perimeter_speed");
+    this->_motion[erExternalPerimeter].speed = this->config.get_abs_value("external_perimeter_speed");
+    this->_motion[erOverhangPerimeter].speed = this->config.get_abs_value("bridge_speed");
+    this->_motion[erBridgeInfill].speed      = this->config.get_abs_value("bridge_speed");
+    this->_motion[erInternalInfill].speed    = this->config.get_abs_value("infill_speed");
+    this->_motion[erSolidInfill].speed       = this->config.get_abs_value("solid_infill_speed");
+    this->_motion[erTopSolidInfill].speed    = this->config.get_abs_value("top_solid_infill_speed");
+    this->_motion[erGapFill].speed           = this->config.get_abs_value("gap_fill_speed");
+    this->_small_perimeter_speed = this->config.get_abs_value("small_perimeter_speed");
+
+    for (size_t role = 0; role <= erSupportMaterialInterface; ++role) {
+        ExtrusionPath path((ExtrusionRole)role);
+        double &acceleration = this->_motion[role].acceleration;
+        if (this->config.perimeter_acceleration.value > 0 && path.is_perimeter()) {
+            acceleration = this->config.perimeter_acceleration.value;
+        } else if (this->config.bridge_acceleration.value > 0 && path.is_bridge()) {
+            acceleration = this->config.bridge_acceleration.value;
+        } else if (this->config.infill_acceleration.value > 0 && path.is_infill()) {
+            acceleration = this->config.infill_acceleration.value;
+        } else {
+            acceleration = this->config.default_acceleration.value;
+        }
+    }
 }
 
 void
@@ -271,7 +414,16 @@ GCode::change_layer(const Layer &layer)
     
     // avoid computing islands and overhangs if they're not needed
     if (this->config.avoid_crossing_perimeters)
-        this->avoid_crossing_perimeters.init_layer_mp(union_ex(layer.slices, true));
+        this->avoid_crossing_perimeters.init_layer_mp(layer);
+    
+    // decode the packed slices once for all the travels of the layer
+    this->_region_slices.clear();
+    if (this->config.only_retract_when_crossing_perimeters) {
+        this->_region_slices.resize(layer.regions.size());
+        for (size_t i = 0; i < layer.regions.size(); ++i)
+            if (layer.regions[i]->is_compact())
+                layer.regions[i]->get_slices(&this->_region_slices[i]);
+    }
     
     std::string gcode;
     if (this->layer_count > 0) {
@@ -297,11 +449,19 @@ GCode::change_layer(const Layer &layer)
 std::string
 GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
 {
+    return this->extrude(this->split_loop(std::move(loop)), description, speed);
+}
+
+SplitLoop
+GCode::split_loop(ExtrusionLoop loop)
+{
+    SplitLoop split;
+    
     // get a copy; don't modify the orientation of the original loop object otherwise
     // next copies (if any) would not detect the correct orientation
     
     // extrude all loops ccw
-    bool was_clockwise = loop.make_counter_clockwise();
+    const bool was_clockwise = split.was_clockwise = loop.make_counter_clockwise();
     
     SeamPosition seam_position = this->config.seam_position;
     if (loop.role == elrSkirt) seam_position = spNearest;
@@ -314,25 +474,11 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
     } else if (seam_position == spNearest || seam_position == spAligned || seam_position == spRear) {
         const Polygon polygon = loop.polygon();
         
-        // simplify polygon in order to skip false positives in concave/convex detection
-        // (loop is always ccw as polygon.simplify() only works on ccw polygons)
-        Polygons simplified = polygon.simplify(scale_(EXTRUDER_CONFIG(nozzle_diameter))/2);
-        
-        // restore original winding order so that concave and convex detection always happens
-        // on the right/outer side of the polygon
-        if (was_clockwise)
-            for (Polygon &p : simplified)
-                p.reverse();
-        
-        // concave vertices have priority
-        Points candidates;
-        for (const Polygon &p : simplified)
-            append_to(candidates, p.concave_points(PI*4/3));
-        
-        // if no concave points were found, look for convex vertices
-        if (candidates.empty())
-            for (const Polygon &p : simplified)
-                append_to(candidates, p.convex_points(PI*2/3));
+        // use the candidates found while planning the layer, unless they were
+        // found for another extruder
+        SeamCandidates seam = std::move(loop.seam_candidates);
+        if (seam.extruder != static_cast<int>(this->writer.extruder()->id))
+            seam = GCode::seam_candidates(loop, was_clockwise, this->config, this->writer.extruder()->id);
         
         // retrieve the last start position for this object
         if (this->layer != NULL) {
@@ -346,23 +492,14 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
         
         Point point;
         if (seam_position == spNearest) {
-            if (candidates.empty()) candidates = polygon.points;
-            last_pos.nearest_point(candidates, &point);
+            last_pos.nearest_point(seam.points.empty() ? polygon.points : seam.points, &point);
             
             // On 32-bit Linux, Clipper will change some point coordinates by 1 unit
             // while performing simplify_polygons(), thus split_at_vertex() won't 
             // find them anymore.
             if (!loop.split_at_vertex(point)) loop.split_at(point);
-        } else if (!candidates.empty()) {
-            Points non_overhang;
-            for (const Point &p : candidates)
-                if (!loop.has_overhang_point(p))
-                    non_overhang.push_back(p);
-            
-            if (!non_overhang.empty())
-                candidates = non_overhang;
-            
-            last_pos.nearest_point(candidates, &point);
+        } else if (!seam.points.empty()) {
+            last_pos.nearest_point(seam.non_overhang.empty() ? seam.points : seam.non_overhang, &point);
             if (!loop.split_at_vertex(point)) loop.split_at(point);  // see note above
         } else {
             point = last_pos.projection_onto(polygon);
@@ -396,16 +533,24 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
         : 0;
     
     // get paths
-    ExtrusionPaths paths;
-    loop.clip_end(clip_length, &paths);
+    loop.clip_end(clip_length, &split.paths);
+    split.small_perimeter = !split.paths.empty()
+        && split.paths.front().is_perimeter()
+        && !loop.has(erOverhangPerimeter)
+        && loop.length() <= SMALL_PERIMETER_LENGTH;
+    return split;
+}
+
+std::string
+GCode::extrude(const SplitLoop &loop, std::string description, double speed)
+{
+    const ExtrusionPaths &paths = loop.paths;
+    const bool was_clockwise = loop.was_clockwise;
     if (paths.empty()) return "";
     
     // apply the small perimeter speed
-    if (paths.front().is_perimeter()
-        && !loop.has(erOverhangPerimeter)
-        && loop.length() <= SMALL_PERIMETER_LENGTH
-        && speed == -1) {
-        speed = this->config.get_abs_value("small_perimeter_speed");
+    if (loop.small_perimeter && speed == -1) {
+        speed = this->_small_perimeter_speed;
         description = "small perimeter";
     }
     if (paths.front().role == erExternalPerimeter)
@@ -421,6 +566,10 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
     
     if (this->wipe.enable)
         this->wipe.path = paths.front().polyline;  // TODO: don't limit wipe to last path
+    if (this->recording != NULL) {
+        this->recording->loop = true;
+        this->recording->wipe_path = this->wipe.path;
+    }
     
     // make a little move inwards before leaving loop
     if (paths.back().role == erExternalPerimeter && this->layer != NULL && this->config.perimeters > 1) {
@@ -454,11 +603,47 @@ GCode::extrude(ExtrusionLoop loop, std::string description, double speed)
         
         // generate the travel move
         gcode += this->writer.travel_to_xy(this->point_to_gcode(point), "move inwards before travel");
+        if (this->recording != NULL) {
+            this->recording->move_inwards = true;
+            this->recording->inwards = point;
+        }
     }
     
     return gcode;
 }
 
+SeamCandidates
+GCode::seam_candidates(const ExtrusionLoop &loop, bool was_clockwise, const PrintConfig &config, unsigned int extruder_id)
+{
+    SeamCandidates seam;
+    seam.extruder = extruder_id;
+    const coord_t tolerance = scale_(config.nozzle_diameter.get_at(extruder_id)) / 2;
+    
+    // simplify polygon in order to skip false positives in concave/convex detection
+    // (loop is always ccw as polygon.simplify() only works on ccw polygons)
+    Polygons simplified = loop.polygon().simplify(tolerance);
+    
+    // restore original winding order so that concave and convex detection always happens
+    // on the right/outer side of the polygon
+    if (was_clockwise)
+        for (Polygon &p : simplified)
+            p.reverse();
+    
+    // concave vertices have priority
+    for (const Polygon &p : simplified)
+        append_to(seam.points, p.concave_points(PI*4/3));
+    
+    // if no concave points were found, look for convex vertices
+    if (seam.points.empty())
+        for (const Polygon &p : simplified)
+            append_to(seam.points, p.convex_points(PI*2/3));
+    
+    for (const Point &p : seam.points)
+        if (!loop.has_overhang_point(p))
+            seam.non_overhang.push_back(p);
+    return seam;
+}
+
 std::string
 GCode::extrude(const ExtrusionEntity &entity, std::string description, double speed)
 {
@@ -484,70 +669,53 @@ GCode::extrude(const ExtrusionPath &path, std::string description, double speed)
 }
 
 std::string
-GCode::_extrude(ExtrusionPath path, std::string description, double speed)
+GCode::extrude(const WrittenExtrusion &written)
 {
-    path.simplify(SCALED_RESOLUTION);
     std::string gcode;
-    description = path.is_bridge() ? description + " (bridge)" : description;
+    for (const WrittenExtrusion::Path &path : written.paths)
+        gcode += this->_extrude(path);
     
-    // go to first point of extrusion path
-    if (!this->_last_pos_defined || !this->_last_pos.coincides_with(path.first_point())) {
-        gcode += this->travel_to(
-            path.first_point(),
-            path.role,
-            "move to first " + description + " point"
-        );
-    }
+    // reset acceleration
+    gcode += this->writer.set_acceleration(this->config.default_acceleration.value);
     
-    // compensate retraction
-    gcode += this->unretract();
+    if (written.loop) {
+        if (this->wipe.enable)
+            this->wipe.path = written.wipe_path;
+        if (written.move_inwards)
+            gcode += this->writer.travel_to_xy(this->point_to_gcode(written.inwards), "move inwards before travel");
+    }
+    return gcode;
+}
+
+std::string
+GCode::_extrude(ExtrusionPath path, std::string description, double speed)
+{
+    WrittenExtrusion::Path written;
+    path.simplify(SCALED_RESOLUTION);
+    written.description = path.is_bridge() ? description + " (bridge)" : description;
     
     // adjust acceleration
-    {
-        double acceleration;
-        if (this->config.first_layer_acceleration.value > 0 && this->first_layer) {
-            acceleration = this->config.first_layer_acceleration.value;
-        } else if (this->config.perimeter_acceleration.value > 0 && path.is_perimeter()) {
-            acceleration = this->config.perimeter_acceleration.value;
-        } else if (this->config.bridge_acceleration.value > 0 && path.is_bridge()) {
-            acceleration = this->config.bridge_acceleration.value;
-        } else if (this->config.infill_acceleration.value > 0 && path.is_infill()) {
-            acceleration = this->config.infill_acceleration.value;
-        } else {
-            acceleration = this->config.default_acceleration.value;
-        }
-        gcode += this->writer.set_acceleration(acceleration);
+    const ExtrusionMotion &motion = this->_motion[path.role];
+    if (this->config.first_layer_acceleration.value > 0 && this->first_layer) {
+        written.acceleration = this->config.first_layer_acceleration.value;
+    } else {
+        written.acceleration = motion.acceleration;
     }
     
     // calculate extrusion length per distance unit
-    double e_per_mm = this->writer.extruder()->e_per_mm3 * path.mm3_per_mm;
-    if (this->writer.extrusion_axis().empty()) e_per_mm = 0;
+    written.e_per_mm = this->writer.extruder()->e_per_mm3 * path.mm3_per_mm;
+    if (this->writer.extrusion_axis().empty()) written.e_per_mm = 0;
     
     // set speed
     if (speed == -1) {
-        if (path.role == erPerimeter) {
-            speed = this->config.get_abs_value("perimeter_speed");
-        } else if (path.role == erExternalPerimeter) {
-            speed = this->config.get_abs_value("external_perimeter_speed");
-        } else if (path.role == erOverhangPerimeter || path.role == erBridgeInfill) {
-            speed = this->config.get_abs_value("bridge_speed");
-        } else if (path.role == erInternalInfill) {
-            speed = this->config.get_abs_value("infill_speed");
-        } else if (path.role == erSolidInfill) {
-            speed = this->config.get_abs_value("solid_infill_speed");
-        } else if (path.role == erTopSolidInfill) {
-            speed = this->config.get_abs_value("top_solid_infill_speed");
-        } else if (path.role == erGapFill) {
-            speed = this->config.get_abs_value("gap_fill_speed");
-        } else {
-            CONFESS("Invalid speed");
-        }
+        speed = motion.speed;
+        if (speed == -1) CONFESS("Invalid speed");
     }
     if (this->volumetric_speed != 0 && speed == 0) {
         speed = this->volumetric_speed / path.mm3_per_mm;
     }
     if (this->first_layer) {
-        speed = this->config.get_abs_value("first_layer_speed", speed);
+        speed = this->config.first_layer_speed.get_abs_value(speed);
     }
     if (this->config.max_volumetric_speed.value > 0) {
         // cap speed with max_volumetric_speed anyway (even if user is not using autospeed)
@@ -563,31 +731,113 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
             EXTRUDER_CONFIG(filament_max_volumetric_speed) / path.mm3_per_mm
         );
     }
-    double F = speed * 60;  // convert mm/sec to mm/min
+    written.F = speed * 60;  // convert mm/sec to mm/min
+    
+    // runs of segments to write as arcs
+    if (this->config.gcode_arcs && !this->config.spiral_vase && path.polyline.points.size() > 3) {
+        Pointfs points;
+        points.reserve(path.polyline.points.size());
+        for (const Point &p : path.polyline.points)
+            points.push_back(this->point_to_gcode(p));
+        written.arcs = Geometry::fit_arcs(points, this->config.gcode_arcs_tolerance.value);
+        written.origin = this->origin;
+    }
+    
+    written.lengths.reserve(path.polyline.points.size());
+    for (size_t i = 1; i < path.polyline.points.size(); ++i) {
+        written.lengths.push_back(path.polyline.points[i - 1].distance_to(path.polyline.points[i]) * SCALING_FACTOR);
+        written.length += written.lengths.back();
+    }
+    written.path = std::move(path);
+    
+    std::string gcode = this->_extrude(written);
+    if (this->recording != NULL)
+        this->recording->paths.push_back(std::move(written));
+    return gcode;
+}
+
+std::string
+GCode::_extrude(const WrittenExtrusion::Path &written)
+{
+    const ExtrusionPath &path = written.path;
+    std::string gcode;
+    
+    // go to first point of extrusion path
+    if (!this->_last_pos_defined || !this->_last_pos.coincides_with(path.first_point())) {
+        gcode += this->travel_to(
+            path.first_point(),
+            path.role,
+            "move to first " + written.description + " point"
+        );
+    }
+    
+    // compensate retraction
+    gcode += this->unretract();
+    
+    // name the role of the following extrusions for the G-code analysis tools
+    if (path.role != this->_last_role) {
+        gcode += ";" + GCodeTimeEstimator::ROLE_TAG + GCodeTimeEstimator::role_name(path.role) + "\n";
+        this->_last_role = path.role;
+    }
+    
+    // adjust acceleration
+    gcode += this->writer.set_acceleration(written.acceleration);
     
     // extrude arc or line
+    const double F = written.F;
     if (path.is_bridge() && this->enable_cooling_markers)
         gcode += ";_BRIDGE_FAN_START\n";
     std::string comment = ";_EXTRUDE_SET_SPEED";
     if (path.role == erExternalPerimeter) comment += ";_EXTERNAL_PERIMETER";
-    gcode += this->writer.set_speed(F, "", this->enable_cooling_markers ? comment : "");
-    Pointf start;
-    double path_length = 0;
+    this->writer.set_speed(&gcode, F, "", this->enable_cooling_markers ? comment : "");
+    if (this->enable_cooling_markers) {
+        const double scale = pow(10., this->config.gcode_precision_xyz.value);
+        ExtrusionSpeed speed;
+        speed.F                  = std::round(F * scale) / scale;
+        speed.bridge             = path.is_bridge();
+        speed.external_perimeter = path.role == erExternalPerimeter;
+        this->extrusion_speeds.push_back(speed);
+    }
     {
-        std::string comment = this->config.gcode_comments ? description : "";
-        Lines lines = path.polyline.lines();
-        for (Lines::const_iterator line = lines.begin(); line != lines.end(); ++line) {
-            const double line_length = line->length() * SCALING_FACTOR;
-            path_length += line_length;
+        std::string comment = this->config.gcode_comments ? written.description : "";
+        const Points &points = path.polyline.points;
+        // the arcs were fitted for another copy when the origin has changed since
+        const Pointf shift(this->origin.x - written.origin.x, this->origin.y - written.origin.y);
+        Geometry::FittedArcs::const_iterator arc = written.arcs.begin();
+        double arc_E = 0;
+        for (size_t idx = 0; idx < written.lengths.size(); ++idx) {
+            const Point &a = points[idx];
+            const Point &b = points[idx + 1];
+            const double line_length = written.lengths[idx];
 
-            this->_cog.x += (this->point_to_gcode(line->a).x + this->point_to_gcode(line->b).x)/2 * line_length;
-            this->_cog.y += (this->point_to_gcode(line->a).y + this->point_to_gcode(line->b).y)/2 * line_length;
+            this->_cog.x += (this->point_to_gcode(a).x + this->point_to_gcode(b).x)/2 * line_length;
+            this->_cog.y += (this->point_to_gcode(a).y + this->point_to_gcode(b).y)/2 * line_length;
             this->_cog.z += this->writer.get_position().z * line_length;
             this->_extrusion_length += line_length;
 
-            gcode += this->writer.extrude_to_xy(
-                this->point_to_gcode(line->b),
-                e_per_mm * line_length,
+            if (arc != written.arcs.end() && idx >= arc->start) {
+                // the whole arc is written with its last segment
+                arc_E += written.e_per_mm * line_length;
+                if (idx + 1 == arc->end) {
+                    const Pointf start = this->point_to_gcode(points[arc->start]);
+                    this->writer.extrude_arc_to_xy(
+                        &gcode,
+                        this->point_to_gcode(b),
+                        Pointf(arc->center.x + shift.x - start.x, arc->center.y + shift.y - start.y),
+                        arc->ccw,
+                        arc_E,
+                        comment
+                    );
+                    arc_E = 0;
+                    ++arc;
+                }
+                continue;
+            }
+
+            this->writer.extrude_to_xy(
+                &gcode,
+                this->point_to_gcode(b),
+                written.e_per_mm * line_length,
                 comment
             );
         }
@@ -602,7 +852,7 @@ GCode::_extrude(ExtrusionPath path, std::string description, double speed)
     this->set_last_pos(path.last_point());
     
     if (this->config.cooling) {
-        float t = path_length / F * 60;
+        float t = written.length / F * 60;
         this->elapsed_time += t;
         if (path.is_bridge()) this->elapsed_time_bridges += t;
         if (path.role == erExternalPerimeter) this->elapsed_time_external += t;
@@ -648,7 +898,7 @@ GCode::travel_to(const Point &point, ExtrusionRole role, std::string comment)
     // use G1 because we rely on paths being straight (G0 may make round paths)
     Lines lines = travel.lines();
     for (Lines::const_iterator line = lines.begin(); line != lines.end(); ++line)
-        gcode += this->writer.travel_to_xy(this->point_to_gcode(line->b), comment);
+        this->writer.travel_to_xy(&gcode, this->point_to_gcode(line->b), comment);
     
     /*  While this makes the estimate more accurate, CoolingBuffer calculates the slowdown
         factor on the whole elapsed time but only alters non-travel moves, thus the resulting
@@ -679,7 +929,7 @@ GCode::needs_retraction(const Polyline &travel, ExtrusionRole role)
     
     if (this->config.only_retract_when_crossing_perimeters && this->layer != NULL) {
         if (this->config.fill_density.value > 0
-            && this->layer->any_internal_region_slice_contains(travel)) {
+            && this->_any_internal_region_slice_contains(travel)) {
             /*  skip retraction if travel is contained in an internal slice *and*
                 internal infill is enabled (so that stringing is entirely not visible)  */
             return false;
@@ -690,6 +940,19 @@ GCode::needs_retraction(const Polyline &travel, ExtrusionRole role)
     return true;
 }
 
+bool
+GCode::_any_internal_region_slice_contains(const Polyline &travel) const
+{
+    for (size_t i = 0; i < this->layer->regions.size(); ++i) {
+        const LayerRegion* layerm = this->layer->regions[i];
+        const SurfaceCollection &slices = layerm->is_compact() && i < this->_region_slices.size()
+            ? this->_region_slices[i]
+            : layerm->slices;
+        if (slices.any_internal_contains(travel)) return true;
+    }
+    return false;
+}
+
 std::string
 GCode::retract(bool toolchange)
 {
@@ -737,17 +1000,32 @@ GCode::set_extruder(unsigned int extruder_id)
         return this->writer.toolchange(extruder_id);
     }
     
+    // state of the machine before the toolchange, for timing it; the first
+    // selection of an extruder isn't a change
+    const bool change = this->writer.extruder() != NULL;
+    GCodeTimeEstimator estimator;
+    estimator.apply_config(this->config);
+    if (change) {
+        const Pointf3 position = this->writer.get_position();
+        estimator.X = position.x;
+        estimator.Y = position.y;
+        estimator.Z = position.z;
+        estimator.E = this->writer.extruder()->E;
+    }
+    
     // prepend retraction on the current extruder
     std::string gcode = this->retract(true);
     
     // append custom toolchange G-code
     if (this->writer.extruder() != NULL && !this->config.toolchange_gcode.value.empty()) {
-        PlaceholderParser pp = *this->placeholder_parser;
-        pp.set("previous_extruder", this->writer.extruder()->id);
-        pp.set("next_extruder",     extruder_id);
-        pp.set("previous_retraction", this->writer.extruder()->retracted);
-        pp.set("next_retraction", this->writer.extruders.find(extruder_id)->second.retracted);
-        gcode += Slic3r::apply_math(pp.process(this->config.toolchange_gcode.value))  + '\n';
+        if (this->_toolchange_gcode.gcode() != this->config.toolchange_gcode.value)
+            this->_toolchange_gcode = GCodeTemplate(this->config.toolchange_gcode.value);
+        GCodeTemplate::Values values;
+        values.set("previous_extruder", this->writer.extruder()->id);
+        values.set("next_extruder",     extruder_id);
+        values.set("previous_retraction", this->writer.extruder()->retracted);
+        values.set("next_retraction", this->writer.extruders.find(extruder_id)->second.retracted);
+        gcode += this->_toolchange_gcode.process(*this->placeholder_parser, values) + '\n';
     }
     
     // if ooze prevention is enabled, park current extruder in the nearest
@@ -762,6 +1040,11 @@ GCode::set_extruder(unsigned int extruder_id)
     if (this->ooze_prevention.enable)
         gcode += this->ooze_prevention.post_toolchange(*this);
     
+    if (change) {
+        estimator.parse(gcode);
+        ++this->toolchanges;
+        this->toolchange_time += estimator.time;
+    }
     return gcode;
 }
 
@@ -799,3 +1082,64 @@ GCode::cog_stats() {
 
     return gcode;
 }
+
+bool
+GCode::State::operator==(const State &other) const
+{
+    return this->origin.x == other.origin.x
+        && this->origin.y == other.origin.y
+        && this->last_pos == other.last_pos
+        && this->last_pos_defined == other.last_pos_defined
+        && this->wipe_path == other.wipe_path
+        && this->use_external_mp == other.use_external_mp
+        && this->use_external_mp_once == other.use_external_mp_once
+        && this->disable_once == other.disable_once
+        && this->layer_index == other.layer_index
+        && this->volumetric_speed == other.volumetric_speed
+        && this->writer == other.writer;
+}
+
+GCode::State
+GCode::state() const
+{
+    State state;
+    state.origin                = this->origin;
+    state.last_pos              = this->_last_pos;
+    state.last_pos_defined      = this->_last_pos_defined;
+    state.wipe_path             = this->wipe.path.points;
+    state.use_external_mp       = this->avoid_crossing_perimeters.use_external_mp;
+    state.use_external_mp_once  = this->avoid_crossing_perimeters.use_external_mp_once;
+    state.disable_once          = this->avoid_crossing_perimeters.disable_once;
+    state.layer_index           = this->layer_index;
+    state.volumetric_speed      = this->volumetric_speed;
+    state.writer                = this->writer.state();
+    return state;
+}
+
+void
+GCode::set_state(const State &state)
+{
+    this->origin                = state.origin;
+    this->_last_pos             = state.last_pos;
+    this->_last_pos_defined     = state.last_pos_defined;
+    this->wipe.path.points      = state.wipe_path;
+    this->avoid_crossing_perimeters.use_external_mp         = state.use_external_mp;
+    this->avoid_crossing_perimeters.use_external_mp_once    = state.use_external_mp_once;
+    this->avoid_crossing_perimeters.disable_once            = state.disable_once;
+    this->layer_index           = state.layer_index;
+    this->volumetric_speed      = state.volumetric_speed;
+    this->writer.set_state(state.writer);
+}
+
+void
+GCode::add_stats(const GCode &other)
+{
+    for (auto &e : this->writer.extruders)
+        e.second.absolute_E += other.writer.extruders.at(e.first).absolute_E;
+    this->toolchanges       += other.toolchanges;
+    this->toolchange_time   += other.toolchange_time;
+    this->_cog.x            += other._cog.x;
+    this->_cog.y            += other._cog.y;
+    this->_cog.z            += other._cog.z;
+    this->_extrusion_length += other._extrusion_length;
+}
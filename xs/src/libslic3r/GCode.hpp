@@ -4,6 +4,7 @@
 #include "libslic3r.h"
 #include "ExPolygon.hpp"
 #include "GCodeWriter.hpp"
+#include "Geometry.hpp"
 #include "Layer.hpp"
 #include "MotionPlanner.hpp"
 #include "Point.hpp"
@@ -11,6 +12,9 @@
 #include "Print.hpp"
 #include "PrintConfig.hpp"
 #include "ConditionalGCode.hpp"
+#include "GCodeTemplate.hpp"
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <set>
@@ -19,6 +23,62 @@ namespace Slic3r {
 
 class GCode;
 
+/// Feedrate written by GCode::_extrude() on a line marked with _EXTRUDE_SET_SPEED,
+/// so that the CoolingBuffer can slow it down without parsing it back.
+struct ExtrusionSpeed {
+    float F;                    ///< mm/min, rounded like in the G-code
+    bool bridge;
+    bool external_perimeter;
+};
+
+/// Speed and acceleration of the extrusions of one role, resolved from the
+/// configuration of the current region by GCode::update_motion().
+struct ExtrusionMotion {
+    double speed;               ///< mm/s; 0 for autospeed, -1 if the role has no speed setting
+    double acceleration;        ///< mm/s^2, when not on the first layer
+};
+
+/// A loop split at its seam and clipped at its end by GCode::split_loop(),
+/// ready to be written by GCode::extrude().
+struct SplitLoop {
+    ExtrusionPaths paths;
+    /// Orientation of the original loop; the paths are ccw.
+    bool was_clockwise {false};
+    /// Written at the small perimeter speed when no speed is given.
+    bool small_perimeter {false};
+};
+
+/// A path or a loop as written by GCode::extrude(), with the speed, the
+/// extrusion amounts and the arcs already worked out, so that it can be
+/// written again for another copy of the object: only the travel to it,
+/// the retraction and the coordinates, translated by GCode::origin, are
+/// handled again.
+struct WrittenExtrusion {
+    struct Path {
+        /// Simplified path, in print coordinates.
+        ExtrusionPath path {erNone};
+        /// Description, for the comments.
+        std::string description;
+        unsigned int acceleration {0};
+        double F {0};
+        double e_per_mm {0};
+        /// Length of each line of the path and their sum, in mm.
+        std::vector<double> lengths;
+        double length {0};
+        /// Runs of lines written as arcs, with their centers in G-code
+        /// coordinates for the origin below.
+        Geometry::FittedArcs arcs;
+        Pointf origin;
+    };
+    std::vector<Path> paths;
+    /// Loops: the path to wipe along when leaving it, and the end of the
+    /// move inwards, if any.
+    bool loop {false};
+    Polyline wipe_path;
+    bool move_inwards {false};
+    Point inwards;
+};
+
 class AvoidCrossingPerimeters {
     public:
     
@@ -31,14 +91,31 @@ class AvoidCrossingPerimeters {
     bool disable_once;
     
     AvoidCrossingPerimeters();
-    ~AvoidCrossingPerimeters();
-    void init_external_mp(const ExPolygons &islands);
+    /// Builds the planner of the travels between objects; with several
+    /// threads, it is prepared so that share_mps() copies can use it at once.
+    void init_external_mp(const ExPolygons &islands, int threads = 1);
     void init_layer_mp(const ExPolygons &islands);
+    /// Uses the planner built for this layer by prepare_layer_mps(), if any.
+    void init_layer_mp(const Layer &layer);
+    /// Builds the planners of these layers ahead of the export, with the given
+    /// number of threads. Layers with the same slices, like the ones of
+    /// prismatic parts, share a single planner. A layer is listed once for
+    /// each time it is exported; its planner is released after the last one.
+    void prepare_layer_mps(const std::vector<const Layer*> &layers, int threads);
+    /// Uses the planners of another instance, the ones prepared ahead included,
+    /// for the G-code of other copies written by another thread at the same time.
+    void share_mps(const AvoidCrossingPerimeters &other);
     Polyline travel_to(GCode &gcodegen, Point point);
     
     private:
-    MotionPlanner* _external_mp;
-    MotionPlanner* _layer_mp;
+    /// Planner of each layer and the number of exports of the layer left.
+    struct LayerMps {
+        boost::mutex mutex;
+        std::map<const Layer*, std::pair<std::shared_ptr<MotionPlanner>, size_t>> planners;
+    };
+    std::shared_ptr<MotionPlanner> _external_mp;
+    std::shared_ptr<MotionPlanner> _layer_mp;
+    std::shared_ptr<LayerMps> _layer_mps;
 };
 
 class OozePrevention {
@@ -68,6 +145,27 @@ class Wipe {
 class GCode {
     public:
     
+    /// What the G-code written next depends on besides the configuration:
+    /// the origin and the last position, the writer, the wipe path, the
+    /// travel flags, the layer counter and the volumetric speed limit.
+    /// A generator set up from the same configuration continues the G-code
+    /// of another one from its state; the seams, the last role and the
+    /// region configuration are not part of it, and start afresh.
+    struct State {
+        Pointf origin;
+        Point last_pos;
+        bool last_pos_defined {false};
+        Points wipe_path;
+        bool use_external_mp {false};
+        bool use_external_mp_once {false};
+        bool disable_once {false};
+        int layer_index {-1};
+        double volumetric_speed {0};
+        GCodeWriter::State writer;
+        bool operator==(const State &other) const;
+        bool operator!=(const State &other) const { return !(*this == other); }
+    };
+    
     /* Origin of print coordinates expressed in unscaled G-code coordinates.
        This affects the input arguments supplied to the extrude*() and travel_to()
        methods. */
@@ -93,13 +191,27 @@ class GCode {
     // it does not account for wipe, retract / unretract moves.
     // second it does not account for the velocity profiles of the printer.
     float elapsed_time, elapsed_time_bridges, elapsed_time_external; // seconds
+    // One entry per _EXTRUDE_SET_SPEED marker, in G-code order; taken over by the CoolingBuffer.
+    std::vector<ExtrusionSpeed> extrusion_speeds;
     double volumetric_speed;
+    /// When set, extrude() also records what it writes there.
+    WrittenExtrusion* recording;
+    /// Changes from one extruder to another made by set_extruder(), and the
+    /// time the G-code written for them takes according to GCodeTimeEstimator.
+    size_t toolchanges;
+    double toolchange_time; // seconds
     
     GCode();
     const Point& last_pos() const;
     void set_last_pos(const Point &pos);
     bool last_pos_defined() const;
     void apply_print_config(const PrintConfig &print_config);
+    void apply_object_config(const PrintObjectConfig &object_config);
+    void apply_region_config(const PrintRegionConfig &region_config);
+    /// Resolves the speeds and accelerations of each extrusion role from config.
+    /// The apply_*_config() methods take care of it; it has to be called after
+    /// any other change to the speed or acceleration settings of config.
+    void update_motion();
 
     /// Template function.
     template <typename Iter>
@@ -130,7 +242,18 @@ class GCode {
     std::string change_layer(const Layer &layer);
     std::string extrude(const ExtrusionEntity &entity, std::string description = "", double speed = -1);
     std::string extrude(ExtrusionLoop loop, std::string description = "", double speed = -1);
+    /// Places the seam of a loop after the previous moves, as extrude() does
+    /// before writing the loop, and clips its end.
+    SplitLoop split_loop(ExtrusionLoop loop);
+    std::string extrude(const SplitLoop &loop, std::string description = "", double speed = -1);
+    /// Seam candidates of a ccw loop for aligned, nearest and rear seams:
+    /// the concave vertices of the loop simplified by half the nozzle diameter
+    /// of the extruder, or the convex ones if there are none, on the outer
+    /// side given by was_clockwise.
+    static SeamCandidates seam_candidates(const ExtrusionLoop &loop, bool was_clockwise, const PrintConfig &config, unsigned int extruder_id);
     std::string extrude(const ExtrusionPath &path, std::string description = "", double speed = -1);
+    /// Writes a recorded extrusion again from the current origin.
+    std::string extrude(const WrittenExtrusion &written);
     std::string travel_to(const Point &point, ExtrusionRole role, std::string comment);
     bool needs_retraction(const Polyline &travel, ExtrusionRole role = erNone);
     std::string retract(bool toolchange = false);
@@ -139,13 +262,31 @@ class GCode {
     Pointf point_to_gcode(const Point &point);
     Pointf3 get_cog();
     std::string cog_stats();
+    State state() const;
+    void set_state(const State &state);
+    /// Adds the filament, the toolchanges and the extrusions of the center of
+    /// gravity counted by a generator which continued the G-code of this one.
+    void add_stats(const GCode &other);
     
     private:
     Point _last_pos;
     Pointf3 _cog;
     float _extrusion_length;
     bool _last_pos_defined;
+    /// Role named by the last GCodeTimeEstimator::ROLE_TAG comment written.
+    ExtrusionRole _last_role;
+    /// Slices of the regions of this->layer whose geometry is packed, decoded
+    /// by change_layer() for needs_retraction().
+    std::vector<SurfaceCollection> _region_slices;
+    ExtrusionMotion _motion[erSupportMaterialInterface + 1];
+    double _small_perimeter_speed;
+    /// config.toolchange_gcode parsed, parsed again when it changes.
+    GCodeTemplate _toolchange_gcode;
     std::string _extrude(ExtrusionPath path, std::string description = "", double speed = -1);
+    /// Writes a path whose speed, extrusion amounts and arcs are worked out.
+    std::string _extrude(const WrittenExtrusion::Path &path);
+    /// Layer::any_internal_region_slice_contains(), reading the packed slices from _region_slices.
+    bool _any_internal_region_slice_contains(const Polyline &travel) const;
 };
 
 }
@@ -1,22 +1,33 @@
 #include "CoolingBuffer.hpp"
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/replace.hpp>
-#include <iostream>
+#include "../GCodeFormatter.hpp"
+#include <algorithm>
+#include <cstdlib>
 
 namespace Slic3r {
 
 std::string
 CoolingBuffer::append(const std::string &gcode, std::string obj_id, size_t layer_id, float print_z)
 {
-    std::string out;
+    GCodeSink layer, out;
+    layer += gcode;
+    this->append(std::move(layer), obj_id, layer_id, print_z, &out);
+    return out.str();
+}
+
+void
+CoolingBuffer::append(GCodeSink &&gcode, std::string obj_id, size_t layer_id, float print_z, GCodeSink* out)
+{
     if (this->_last_z.find(obj_id) != this->_last_z.end()) {
         // A layer was finished, Z of the object's layer changed. Process the layer.
-        out = this->flush();
+        this->flush(out);
     }
     
     this->_layer_id = layer_id;
     this->_last_z[obj_id] = print_z;
-    this->_gcode += gcode;
+    this->_gcode += std::move(gcode);
+    this->_speeds.insert(this->_speeds.end(),
+        this->_gcodegen->extrusion_speeds.begin(), this->_gcodegen->extrusion_speeds.end());
+    this->_gcodegen->extrusion_speeds.clear();
     // This is a very rough estimate of the print time, 
     // not taking into account the acceleration curves generated by the printer firmware.
     this->_elapsed_time          += this->_gcodegen->elapsed_time;
@@ -25,42 +36,45 @@ CoolingBuffer::append(const std::string &gcode, std::string obj_id, size_t layer
     this->_gcodegen->elapsed_time          = 0;
     this->_gcodegen->elapsed_time_bridges  = 0;
     this->_gcodegen->elapsed_time_external = 0;
-    
-    return out;
+}
+
+// Replaces the number following the F at pos with speed, formatted like
+// GCodeWriter formats the feedrates.
+static void
+set_feedrate(std::string* line, size_t pos, float speed, int precision, bool trim_zeros)
+{
+    const size_t last_pos = std::min(line->find_first_not_of("0123456789.-", pos+1), line->size());
+    std::string F;
+    GCodeFormatter::append_fixed(&F, speed, precision, trim_zeros);
+    line->replace(pos+1, last_pos-pos-1, F);
 }
 
 void
-apply_speed_factor(std::string &line, float speed_factor, float min_print_speed)
+apply_speed_factor(std::string &line, float speed_factor, float min_print_speed, int precision, bool trim_zeros)
 {
     // find pos of F
     size_t pos = line.find_first_of('F');
-    size_t last_pos = line.find_first_of(' ', pos+1);
     
-    // extract current speed
-    float speed;
-    {
-        std::istringstream iss(line.substr(pos+1, last_pos));
-        iss >> speed;
-    }
-    
-    // change speed
+    // extract current speed and change it
+    float speed = strtof(line.c_str() + pos+1, NULL);
     speed *= speed_factor;
     speed = std::max(speed, min_print_speed);
     
-    // replace speed in string
-    {
-        std::ostringstream oss;
-        oss.precision(3);
-        oss << std::fixed << speed;
-        line.replace(pos+1, (last_pos-pos), oss.str());
-    }
+    set_feedrate(&line, pos, speed, precision, trim_zeros);
 }
 
 std::string
 CoolingBuffer::flush()
+{
+    GCodeSink out;
+    this->flush(&out);
+    return out.str();
+}
+
+void
+CoolingBuffer::flush(GCodeSink* out)
 {
     GCode &gg = *this->_gcodegen;
-    std::string gcode = this->_gcode;
     
     int fan_speed           = gg.config.fan_always_on ? gg.config.min_fan_speed.value : 0;
     float speed_factor      = 1.0;
@@ -100,55 +114,113 @@ CoolingBuffer::flush()
         #ifdef SLIC3R_DEBUG
         printf("  fan = %d%%, speed = %f%%\n", fan_speed, speed_factor * 100);
         #endif
-        
-        if (speed_factor < 1.0) {
-            // Adjust feed rate of G1 commands marked with an _EXTRUDE_SET_SPEED
-            // as long as they are not _WIPE moves (they cannot if they are _EXTRUDE_SET_SPEED)
-            // and they are not preceded directly by _BRIDGE_FAN_START (do not adjust bridging speed).
-            std::string new_gcode;
-            std::istringstream ss(gcode);
-            std::string line;
-            bool bridge_fan_start = false;
-            while (std::getline(ss, line)) {
-                if (boost::starts_with(line, "G1")
-                    && boost::contains(line, ";_EXTRUDE_SET_SPEED")
-                    && !boost::contains(line, ";_WIPE")
-                    && !bridge_fan_start
-                    && (slowdown_external || !boost::contains(line, ";_EXTERNAL_PERIMETER"))) {
-                    apply_speed_factor(line, speed_factor, this->_min_print_speed);
-                    boost::replace_first(line, ";_EXTRUDE_SET_SPEED", "");
-                }
-                bridge_fan_start = boost::starts_with(line, ";_BRIDGE_FAN_START");
-                new_gcode += line + '\n';
-            }
-            gcode = new_gcode;
-        }
     }
     if (this->_layer_id < gg.config.disable_fan_first_layers)
         fan_speed = 0;
     
-    gcode = gg.writer.set_fan(fan_speed) + gcode;
+    *out += gg.writer.set_fan(fan_speed);
     
     // bridge fan speed
-    if (!gg.config.cooling || gg.config.bridge_fan_speed == 0 || this->_layer_id < gg.config.disable_fan_first_layers) {
-        boost::replace_all(gcode, ";_BRIDGE_FAN_START", "");
-        boost::replace_all(gcode, ";_BRIDGE_FAN_END", "");
-    } else {
-        boost::replace_all(gcode, ";_BRIDGE_FAN_START", gg.writer.set_fan(gg.config.bridge_fan_speed, true));
-        boost::replace_all(gcode, ";_BRIDGE_FAN_END",   gg.writer.set_fan(fan_speed, true));
-    }
-    boost::replace_all(gcode, ";_WIPE", "");
-    boost::replace_all(gcode, ";_EXTRUDE_SET_SPEED", "");
-    boost::replace_all(gcode, ";_EXTERNAL_PERIMETER", "");
+    const bool bridge_fan = !(!gg.config.cooling || gg.config.bridge_fan_speed == 0 || this->_layer_id < gg.config.disable_fan_first_layers);
+    const std::string bridge_fan_start = bridge_fan ? gg.writer.set_fan(gg.config.bridge_fan_speed, true) : "";
+    const std::string bridge_fan_end   = bridge_fan ? gg.writer.set_fan(fan_speed, true) : "";
+    this->_process_markers(speed_factor, slowdown_external, bridge_fan_start, bridge_fan_end);
+    *out += std::move(this->_gcode);
     
     // Reset the buffer.
     this->_elapsed_time          = 0;
     this->_elapsed_time_bridges  = 0;
     this->_elapsed_time_external = 0;
-    this->_gcode = "";
+    this->_gcode.clear();
+    this->_speeds.clear();
     this->_last_z.clear(); // reset the whole table otherwise we would compute overlapping times
+}
+
+static inline bool
+marker_at(const std::string &gcode, size_t pos, const char* marker, size_t length)
+{
+    return gcode.compare(pos, length, marker) == 0;
+}
+
+void
+CoolingBuffer::_process_markers(float speed_factor, bool slowdown_external,
+    const std::string &bridge_fan_start, const std::string &bridge_fan_end)
+{
+    static const char   EXTRUDE_SET_SPEED[]  = ";_EXTRUDE_SET_SPEED";
+    static const char   EXTERNAL_PERIMETER[] = ";_EXTERNAL_PERIMETER";
+    static const char   WIPE[]               = ";_WIPE";
+    static const char   BRIDGE_FAN_START[]   = ";_BRIDGE_FAN_START";
+    static const char   BRIDGE_FAN_END[]     = ";_BRIDGE_FAN_END";
     
-    return gcode;
+    // Adjust feed rate of G1 commands marked with an _EXTRUDE_SET_SPEED
+    // as long as they are not bridges (do not adjust bridging speed)
+    // and external perimeters unless slowdown_external is set.
+    // The feedrates and the kind of extrusion come from the speeds recorded by
+    // GCode::_extrude(), in the order of the markers; G-code that wasn't produced
+    // by it (when passed as text through the Perl bindings) is parsed instead,
+    // a bridge being recognized by the _BRIDGE_FAN_START line preceding it.
+    // Chunks hold whole lines, so they are rewritten one at a time and the
+    // markers are replaced in the same pass.
+    const GCodeConfig &writer_config = this->_gcodegen->writer.config;
+    size_t speed_idx = 0;
+    bool after_bridge_fan_start = false;    // the previous chunk ended with a _BRIDGE_FAN_START line
+    for (std::string &chunk : this->_gcode.chunks()) {
+        size_t marker = chunk.find(";_");
+        if (marker == std::string::npos) {
+            after_bridge_fan_start = false;
+            continue;
+        }
+        std::string gcode;
+        gcode.reserve(chunk.size() + 64);
+        // start of the line following the last _BRIDGE_FAN_START line, in gcode
+        size_t bridge_line = after_bridge_fan_start ? 0 : std::string::npos;
+        size_t pos = 0;
+        for (; marker != std::string::npos; marker = chunk.find(";_", pos)) {
+            gcode.append(chunk, pos, marker - pos);
+            pos = marker;
+            if (marker_at(chunk, pos, EXTRUDE_SET_SPEED, sizeof(EXTRUDE_SET_SPEED) - 1)) {
+                pos += sizeof(EXTRUDE_SET_SPEED) - 1;
+                const size_t line_start = gcode.rfind('\n') + 1;    // npos + 1 == 0
+                const size_t F_pos      = gcode.find('F', line_start);
+                float F;
+                bool bridge, external_perimeter;
+                if (speed_idx < this->_speeds.size()) {
+                    const ExtrusionSpeed &speed = this->_speeds[speed_idx];
+                    F                  = speed.F;
+                    bridge             = speed.bridge;
+                    external_perimeter = speed.external_perimeter;
+                } else {
+                    F                  = F_pos == std::string::npos ? 0 : strtof(gcode.c_str() + F_pos+1, NULL);
+                    bridge             = line_start == bridge_line;
+                    external_perimeter = marker_at(chunk, pos, EXTERNAL_PERIMETER, sizeof(EXTERNAL_PERIMETER) - 1);
+                }
+                ++speed_idx;
+                if (speed_factor < 1.0 && F_pos != std::string::npos && !bridge
+                    && (slowdown_external || !external_perimeter)) {
+                    set_feedrate(&gcode, F_pos, std::max(F * speed_factor, this->_min_print_speed),
+                        writer_config.gcode_precision_xyz.value, writer_config.gcode_trim_zeros.value);
+                }
+            } else if (marker_at(chunk, pos, EXTERNAL_PERIMETER, sizeof(EXTERNAL_PERIMETER) - 1)) {
+                pos += sizeof(EXTERNAL_PERIMETER) - 1;
+            } else if (marker_at(chunk, pos, WIPE, sizeof(WIPE) - 1)) {
+                pos += sizeof(WIPE) - 1;
+            } else if (marker_at(chunk, pos, BRIDGE_FAN_START, sizeof(BRIDGE_FAN_START) - 1)) {
+                pos += sizeof(BRIDGE_FAN_START) - 1;
+                gcode += bridge_fan_start;
+                if (pos < chunk.size() && chunk[pos] == '\n')
+                    bridge_line = gcode.size() + 1;
+            } else if (marker_at(chunk, pos, BRIDGE_FAN_END, sizeof(BRIDGE_FAN_END) - 1)) {
+                pos += sizeof(BRIDGE_FAN_END) - 1;
+                gcode += bridge_fan_end;
+            } else {
+                gcode += ";_";
+                pos += 2;
+            }
+        }
+        gcode.append(chunk, pos, std::string::npos);
+        after_bridge_fan_start = bridge_line == gcode.size();
+        chunk.swap(gcode);
+    }
 }
 
 }
@@ -3,8 +3,10 @@
 
 #include "libslic3r.h"
 #include "GCode.hpp"
+#include "GCodeSink.hpp"
 #include <map>
 #include <string>
+#include <vector>
 
 namespace Slic3r {
 
@@ -24,21 +26,31 @@ class CoolingBuffer {
     };
     std::string append(const std::string &gcode, std::string obj_id, size_t layer_id, float print_z);
     std::string flush();
+    /// Takes over the G-code of a layer; if that finishes the previous layer,
+    /// its processed G-code is moved to out first.
+    void append(GCodeSink &&gcode, std::string obj_id, size_t layer_id, float print_z, GCodeSink* out);
+    /// Processes the buffered layer and moves its G-code to out.
+    void flush(GCodeSink* out);
     GCode* gcodegen() { return this->_gcodegen; };
     
     private:
     GCode*                      _gcodegen;
-    std::string                 _gcode;
+    GCodeSink                   _gcode;
     float                       _elapsed_time;
     float                       _elapsed_time_bridges;
     float                       _elapsed_time_external;
     size_t                      _layer_id;
     std::map<std::string,float> _last_z;
     float                       _min_print_speed;
+    /// Feedrates behind the _EXTRUDE_SET_SPEED markers of the buffered G-code.
+    std::vector<ExtrusionSpeed> _speeds;
+    
+    void _process_markers(float speed_factor, bool slowdown_external,
+        const std::string &bridge_fan_start, const std::string &bridge_fan_end);
 };
 
 #ifdef SLIC3R_TEST
-void apply_speed_factor(std::string &line, float speed_factor, float min_print_speed);
+void apply_speed_factor(std::string &line, float speed_factor, float min_print_speed, int precision = 3, bool trim_zeros = false);
 #endif
 
 }
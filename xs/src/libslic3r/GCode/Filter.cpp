@@ -0,0 +1,105 @@
+#include "Filter.hpp"
+
+namespace Slic3r {
+
+void
+GCodeFilter::rewrite(GCodeReader* reader, GCodeSink* gcode,
+    std::function<void(GCodeReader&, const GCodeReader::GCodeLine&, GCodeSink*)> callback)
+{
+    GCodeSink new_gcode;
+    for (const std::string &chunk : gcode->chunks()) {
+        reader->parse(chunk, [&callback, &new_gcode] (GCodeReader &reader, const GCodeReader::GCodeLine &line) {
+            callback(reader, line, &new_gcode);
+        });
+    }
+    *gcode = std::move(new_gcode);
+}
+
+const size_t GCodeFilterPipeline::max_queued;
+
+GCodeFilterPipeline::~GCodeFilterPipeline()
+{
+    if (this->_worker.joinable()) {
+        {
+            boost::unique_lock<boost::mutex> lock(this->_mutex);
+            this->_stop = true;
+        }
+        this->_changed.notify_all();
+        this->_worker.join();
+    }
+}
+
+void
+GCodeFilterPipeline::add(std::unique_ptr<GCodeFilter> filter)
+{
+    if (filter) this->_filters.emplace_back(std::move(filter));
+}
+
+void
+GCodeFilterPipeline::push(GCodeSink &&gcode, bool flush)
+{
+    if (this->_filters.empty()) {
+        gcode.write(*this->_out);
+        return;
+    }
+    if (!this->_worker.joinable())
+        this->_worker = boost::thread(&GCodeFilterPipeline::_run, this);
+
+    boost::unique_lock<boost::mutex> lock(this->_mutex);
+    while (this->_queue.size() >= max_queued && !this->_error)
+        this->_changed.wait(lock);
+    if (!this->_error) {
+        this->_queue.emplace_back(std::move(gcode), flush);
+        this->_changed.notify_all();
+        if (flush) this->_wait(lock);
+    }
+    if (this->_error) {
+        std::exception_ptr error = this->_error;
+        this->_error = nullptr;
+        this->_queue.clear();
+        std::rethrow_exception(error);
+    }
+}
+
+void
+GCodeFilterPipeline::_wait(boost::unique_lock<boost::mutex> &lock)
+{
+    while ((!this->_queue.empty() || this->_busy) && !this->_error)
+        this->_changed.wait(lock);
+}
+
+void
+GCodeFilterPipeline::_run()
+{
+    boost::unique_lock<boost::mutex> lock(this->_mutex);
+    for (;;) {
+        while (this->_queue.empty() && !this->_stop)
+            this->_changed.wait(lock);
+        if (this->_queue.empty()) return;
+
+        std::pair<GCodeSink,bool> item = std::move(this->_queue.front());
+        this->_queue.pop_front();
+        this->_busy = true;
+        this->_changed.notify_all();
+        lock.unlock();
+
+        std::exception_ptr error;
+        try {
+            for (const std::unique_ptr<GCodeFilter> &filter : this->_filters)
+                filter->process(&item.first, item.second);
+            item.first.write(*this->_out);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+        this->_busy = false;
+        if (error) {
+            this->_error = error;
+            this->_queue.clear();
+        }
+        this->_changed.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef slic3r_GCode_Filter_hpp_
+#define slic3r_GCode_Filter_hpp_
+
+#include "libslic3r.h"
+#include "GCodeReader.hpp"
+#include "GCodeSink.hpp"
+#include "PrintConfig.hpp"
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include <boost/thread.hpp>
+
+namespace Slic3r {
+
+/// Base class of the G-code post-processing filters.
+/// A filter receives the G-code in order, one layer at a time, and edits it
+/// in place; it keeps whatever state it needs from one layer to the next.
+class GCodeFilter {
+    public:
+    virtual ~GCodeFilter() {};
+
+    /// Processes the next piece of G-code. flush is set on the last one before
+    /// the generator writes something that doesn't go through the filters
+    /// (the end of the print, or of an object when printing them one by one),
+    /// so that the filter can write out what it was holding back.
+    virtual void process(GCodeSink* gcode, bool flush) = 0;
+
+    /// Helper for the filters working line by line: feeds every line of gcode
+    /// to reader and replaces gcode with what callback appended to the new sink.
+    static void rewrite(GCodeReader* reader, GCodeSink* gcode,
+        std::function<void(GCodeReader&, const GCodeReader::GCodeLine&, GCodeSink*)> callback);
+};
+
+/// Creates a filter for the configuration of a print, or returns nothing when
+/// the filter isn't needed by this configuration.
+typedef std::function<std::unique_ptr<GCodeFilter>(const PrintConfig&)> GCodeFilterFactory;
+
+/// Chain of filters applied to the G-code before it is written to a stream.
+/// When there is any filter, the G-code is filtered and written by a separate
+/// thread while the generator goes on with the next layers.
+class GCodeFilterPipeline {
+    public:
+    /// How many pieces of G-code can wait for the filters before push() blocks.
+    static const size_t max_queued = 16;
+
+    GCodeFilterPipeline(std::ostream &out) : _out(&out) {};
+    ~GCodeFilterPipeline();
+    GCodeFilterPipeline(const GCodeFilterPipeline&) = delete;
+    GCodeFilterPipeline& operator=(const GCodeFilterPipeline&) = delete;
+
+    /// Appends a filter to the chain; filters must be added before the first push().
+    void add(std::unique_ptr<GCodeFilter> filter);
+    bool empty() const { return this->_filters.empty(); };
+    size_t size() const { return this->_filters.size(); };
+
+    /// Hands gcode over to the filters. Without filters it is written right
+    /// away. With flush set, the call returns only once all the G-code pushed
+    /// so far is written, the filters being asked to flush their state.
+    /// An exception thrown by a filter is rethrown here.
+    void push(GCodeSink &&gcode, bool flush = false);
+
+    private:
+    std::ostream* _out;
+    std::vector<std::unique_ptr<GCodeFilter>> _filters;
+
+    boost::thread _worker;
+    boost::mutex _mutex;
+    boost::condition_variable _changed;
+    std::deque<std::pair<GCodeSink,bool>> _queue;
+    bool _busy {false};
+    bool _stop {false};
+    std::exception_ptr _error;
+
+    void _run();
+    /// Waits for the worker to write everything queued.
+    void _wait(boost::unique_lock<boost::mutex> &lock);
+};
+
+}
+
+#endif
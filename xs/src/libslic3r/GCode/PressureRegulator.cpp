@@ -0,0 +1,107 @@
+#include "PressureRegulator.hpp"
+#include "GCodeFormatter.hpp"
+#include <cmath>
+#include <cstdlib>
+
+namespace Slic3r {
+
+PressureRegulator::PressureRegulator(const PrintConfig &config)
+    : _config(&config), _extrusion_axis(config.get_extrusion_axis())
+{
+    this->_reader.apply_config(config);
+}
+
+std::unique_ptr<GCodeFilter>
+PressureRegulator::create(const PrintConfig &config)
+{
+    if (config.pressure_advance.value <= 0) return nullptr;
+    return std::unique_ptr<GCodeFilter>(new PressureRegulator(config));
+}
+
+void
+PressureRegulator::process(GCodeSink* gcode, bool flush)
+{
+    GCodeFilter::rewrite(&this->_reader, gcode, [this] (GCodeReader &reader, const GCodeReader::GCodeLine &line, GCodeSink* new_gcode) {
+        if (line.cmd.size() > 1 && line.cmd[0] == 'T' && isdigit(line.cmd[1])) {
+            this->_tool = atoi(line.cmd.c_str() + 1);
+        } else if (line.extruding() && line.dist_XY() > 0) {
+            // This is a print move.
+            const double F = line.new_F();
+            if (F != this->_last_print_F || this->_advance == 0) {
+                // We are setting a (potentially) new speed or a discharge event happened since the last speed change, so we calculate the new advance amount.
+                
+                // First calculate relative flow rate (mm of filament over mm of travel)
+                const double rel_flow_rate = line.dist_E() / line.dist_XY();
+                
+                // Then calculate absolute flow rate (mm/sec of feedstock)
+                const double flow_rate = rel_flow_rate * F / 60;
+                
+                // And finally calculate advance by using the user-configured K factor.
+                const double new_advance = this->_config->pressure_advance.value * (flow_rate * flow_rate);
+                
+                if (std::abs(new_advance - this->_advance) > 1E-5) {
+                    const double new_E = (this->_config->use_relative_e_distances ? 0 : reader.E) + (new_advance - this->_advance);
+                    std::string gcode = "G1 " + this->_extrusion_axis;
+                    GCodeFormatter::append_fixed(&gcode, new_E, 5);
+                    gcode += " F";
+                    GCodeFormatter::append_fixed(&gcode, this->_unretract_speed(), 3);
+                    gcode += " ; pressure advance\n";
+                    if (!this->_config->use_relative_e_distances) {
+                        gcode += "G92 " + this->_extrusion_axis;
+                        GCodeFormatter::append_fixed(&gcode, reader.E, 5);
+                        gcode += " ; restore E\n";
+                    }
+                    gcode += "G1 F";
+                    GCodeFormatter::append_fixed(&gcode, F, 3);
+                    gcode += " ; restore F\n";
+                    *new_gcode += gcode;
+                    this->_advance = new_advance;
+                }
+                
+                this->_last_print_F = F;
+            }
+        } else if ((line.retracting() || line.cmd == "G10") && this->_advance != 0) {
+            // We need to bring pressure to zero when retracting.
+            const double F = line.has('F') ? line.get_float('F') : 0;
+            *new_gcode += this->_discharge(F, line.has('F') ? F : reader.F);
+        }
+        
+        *new_gcode += line.raw;
+        *new_gcode += "\n";
+    });
+    
+    if (flush && this->_advance != 0)
+        *gcode += this->_discharge();
+}
+
+std::string
+PressureRegulator::_discharge(double F, double old_F)
+{
+    const double new_E = (this->_config->use_relative_e_distances ? 0 : this->_reader.E) - this->_advance;
+    std::string gcode = "G1 " + this->_extrusion_axis;
+    GCodeFormatter::append_fixed(&gcode, new_E, 5);
+    gcode += " F";
+    GCodeFormatter::append_fixed(&gcode, F != 0 ? F : this->_unretract_speed(), 3);
+    gcode += " ; pressure discharge\n";
+    if (!this->_config->use_relative_e_distances) {
+        gcode += "G92 " + this->_extrusion_axis;
+        GCodeFormatter::append_fixed(&gcode, this->_reader.E, 5);
+        gcode += " ; restore E\n";
+    }
+    if (old_F != 0) {
+        gcode += "G1 F";
+        GCodeFormatter::append_fixed(&gcode, old_F, 3);
+        gcode += " ; restore F\n";
+    }
+    this->_advance = 0;
+    
+    return gcode;
+}
+
+double
+PressureRegulator::_unretract_speed() const
+{
+    return this->_config->retract_speed.get_at(this->_tool) * 60;
+}
+
+}
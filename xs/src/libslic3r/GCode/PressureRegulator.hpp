@@ -0,0 +1,39 @@
+#ifndef slic3r_PressureRegulator_hpp_
+#define slic3r_PressureRegulator_hpp_
+
+#include "libslic3r.h"
+#include "GCode/Filter.hpp"
+#include "GCodeReader.hpp"
+#include <string>
+
+namespace Slic3r {
+
+/// G-code filter controlling the pressure inside the nozzle: extra filament is
+/// pushed (advance) when the flow rate goes up, and it is released
+/// (discharge) before retracting.
+/// The advance algorithm was proposed by Matthew Roberts.
+/// The initial work on this Slic3r feature was done by Luís Andrade (lluis).
+class PressureRegulator : public GCodeFilter {
+    public:
+    PressureRegulator(const PrintConfig &config);
+    void process(GCodeSink* gcode, bool flush) override;
+
+    static std::unique_ptr<GCodeFilter> create(const PrintConfig &config);
+
+    private:
+    const PrintConfig* _config;
+    GCodeReader _reader;
+    std::string _extrusion_axis;
+    size_t _tool {0};
+    double _last_print_F {0};
+    double _advance {0};        ///< extra E injected
+
+    /// G-code releasing the pressure, moving at F (or at the unretract speed
+    /// if F is 0) and then restoring old_F (unless it is 0).
+    std::string _discharge(double F = 0, double old_F = 0);
+    double _unretract_speed() const;
+};
+
+}
+
+#endif
@@ -92,4 +92,17 @@ SpiralVase::process_layer(const std::string &gcode)
     return new_gcode;
 }
 
+void
+SpiralVase::process_layer(GCodeSink* gcode)
+{
+    if (!this->enable) {
+        for (const std::string &chunk : gcode->chunks())
+            this->_reader.parse(chunk, {});
+        return;
+    }
+    std::string new_gcode = this->process_layer(gcode->str());
+    gcode->clear();
+    *gcode += std::move(new_gcode);
+}
+
 }
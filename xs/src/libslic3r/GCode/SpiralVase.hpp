@@ -4,6 +4,7 @@
 #include "libslic3r.h"
 #include "GCode.hpp"
 #include "GCodeReader.hpp"
+#include "GCodeSink.hpp"
 
 namespace Slic3r {
 
@@ -18,6 +19,9 @@ class SpiralVase {
         this->_reader.apply_config(*this->_config);
     };
     std::string process_layer(const std::string &gcode);
+    /// Same as above, editing the G-code of the layer in place. When the
+    /// layer isn't transformed, the chunks are only read.
+    void process_layer(GCodeSink* gcode);
     
     private:
     const PrintConfig* _config;
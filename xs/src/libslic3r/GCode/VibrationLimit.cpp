@@ -0,0 +1,59 @@
+#include "VibrationLimit.hpp"
+#include "GCodeFormatter.hpp"
+#include <algorithm>
+
+namespace Slic3r {
+
+VibrationLimit::VibrationLimit(const PrintConfig &config)
+    : _min_time(1. / (config.vibration_limit.value * 60))
+{
+    this->_reader.apply_config(config);
+}
+
+std::unique_ptr<GCodeFilter>
+VibrationLimit::create(const PrintConfig &config)
+{
+    if (config.vibration_limit.value == 0) return nullptr;
+    return std::unique_ptr<GCodeFilter>(new VibrationLimit(config));
+}
+
+void
+VibrationLimit::process(GCodeSink* gcode, bool flush)
+{
+    GCodeFilter::rewrite(&this->_reader, gcode, [this] (GCodeReader &reader, const GCodeReader::GCodeLine &line, GCodeSink* new_gcode) {
+        if (line.cmd == "G1" && line.dist_XY() > 0) {
+            const int dir[2] = {
+                (line.new_X() > reader.X) - (line.new_X() < reader.X),
+                (line.new_Y() > reader.Y) - (line.new_Y() < reader.Y),
+            };
+            const double F = line.new_F();
+            const double time = F > 0 ? line.dist_XY() / F : 0;  // in minutes
+            
+            if (time > 0) {
+                double pause = 0;
+                for (size_t axis = 0; axis < 2; ++axis) {
+                    if (dir[axis] != 0 && this->_last_dir[axis] != dir[axis]) {
+                        // this axis is changing direction: check whether we need to pause
+                        if (this->_last_dir[axis] != 0 && this->_dir_time[axis] < this->_min_time)
+                            pause = std::max(pause, this->_min_time - this->_dir_time[axis]);
+                        this->_last_dir[axis] = dir[axis];
+                        this->_dir_time[axis] = 0;
+                    }
+                    this->_dir_time[axis] += time;
+                }
+                
+                if (pause > 0) {
+                    std::string G4 = "G4 P";
+                    GCodeFormatter::append_int(&G4, (long long)(pause * 60 * 1000));
+                    G4 += "\n";
+                    *new_gcode += G4;
+                }
+            }
+        }
+        
+        *new_gcode += line.raw;
+        *new_gcode += "\n";
+    });
+}
+
+}
@@ -0,0 +1,29 @@
+#ifndef slic3r_VibrationLimit_hpp_
+#define slic3r_VibrationLimit_hpp_
+
+#include "libslic3r.h"
+#include "GCode/Filter.hpp"
+#include "GCodeReader.hpp"
+
+namespace Slic3r {
+
+/// G-code filter pausing the moves that would make an axis change direction
+/// more often than vibration_limit times per second.
+/// Inspired by http://hydraraptor.blogspot.it/2010/12/frequency-limit.html
+class VibrationLimit : public GCodeFilter {
+    public:
+    VibrationLimit(const PrintConfig &config);
+    void process(GCodeSink* gcode, bool flush) override;
+
+    static std::unique_ptr<GCodeFilter> create(const PrintConfig &config);
+
+    private:
+    GCodeReader _reader;
+    double _min_time;           ///< minutes
+    int _last_dir[2] {0, 0};
+    double _dir_time[2] {0, 0};
+};
+
+}
+
+#endif
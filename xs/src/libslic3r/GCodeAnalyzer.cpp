@@ -0,0 +1,348 @@
+#include "GCodeAnalyzer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace Slic3r {
+
+void
+GCodeStats::append(const GCodeStats &other)
+{
+    this->lines += other.lines;
+    this->moves += other.moves;
+    this->toolchanges += other.toolchanges;
+    if (other.extent.defined) this->extent.merge(other.extent);
+    if (this->filament_used.size() < other.filament_used.size())
+        this->filament_used.resize(other.filament_used.size(), 0);
+    for (size_t i = 0; i < other.filament_used.size(); ++i)
+        this->filament_used[i] += other.filament_used[i];
+    if (other.max_volumetric_speed > this->max_volumetric_speed) {
+        this->max_volumetric_speed   = other.max_volumetric_speed;
+        this->max_volumetric_speed_z = other.max_volumetric_speed_z;
+    }
+    this->time        += other.time;
+    this->travel_time += other.travel_time;
+    for (size_t role = 0; role <= erSupportMaterialInterface; ++role) {
+        this->role_times[role]    += other.role_times[role];
+        this->role_filament[role] += other.role_filament[role];
+    }
+    // a layer can be split between the two
+    auto layer = other.layers.cbegin();
+    if (!this->layers.empty() && layer != other.layers.cend()
+        && std::abs(this->layers.back().print_z - layer->print_z) < EPSILON) {
+        this->layers.back().time += layer->time;
+        ++layer;
+    }
+    this->layers.insert(this->layers.end(), layer, other.layers.cend());
+}
+
+std::string
+GCodeStats::json() const
+{
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(3)
+        << "{\n"
+        << "    \"lines\": " << this->lines << ",\n"
+        << "    \"moves\": " << this->moves << ",\n"
+        << "    \"toolchanges\": " << this->toolchanges << ",\n";
+    if (this->extent.defined) {
+        json << "    \"extent\": { "
+            << "\"min\": [" << this->extent.min.x << ", " << this->extent.min.y << ", " << this->extent.min.z << "], "
+            << "\"max\": [" << this->extent.max.x << ", " << this->extent.max.y << ", " << this->extent.max.z << "] },\n";
+    }
+    json << "    \"filament_used\": [";
+    for (size_t i = 0; i < this->filament_used.size(); ++i)
+        json << (i > 0 ? ", " : "") << this->filament_used[i];
+    json << "],\n"
+        << "    \"max_volumetric_speed\": " << this->max_volumetric_speed << ",\n"
+        << "    \"max_volumetric_speed_z\": " << this->max_volumetric_speed_z << ",\n"
+        << "    \"time\": " << this->time << ",\n"
+        << "    \"travel_time\": " << this->travel_time << ",\n"
+        << "    \"features\": {";
+    bool first = true;
+    for (size_t role = 0; role <= erSupportMaterialInterface; ++role) {
+        if (this->role_times[role] == 0 && this->role_filament[role] == 0) continue;
+        json << (first ? "\n" : ",\n")
+            << "        \"" << GCodeTimeEstimator::role_name(ExtrusionRole(role)) << "\": { "
+            << "\"time\": " << this->role_times[role] << ", "
+            << "\"filament\": " << this->role_filament[role] << " }";
+        first = false;
+    }
+    json << (first ? "},\n" : "\n    },\n")
+        << "    \"layers\": [";
+    for (size_t i = 0; i < this->layers.size(); ++i) {
+        json << (i > 0 ? ",\n" : "\n")
+            << "        { \"print_z\": " << this->layers[i].print_z << ", \"time\": " << this->layers[i].time << " }";
+    }
+    json << (this->layers.empty() ? "]\n" : "\n    ]\n")
+        << "}\n";
+    return json.str();
+}
+
+namespace {
+
+static const char axes[5] = { 'X', 'Y', 'Z', 'E', 'F' };
+static const char* limit_commands[4] = { "M201", "M203", "M204", "M205" };
+static const char limit_letters[] = "XYZESPRT";
+
+static bool
+is_move(const std::string &cmd)
+{
+    return cmd == "G0" || cmd == "G1" || cmd == "G2" || cmd == "G3" || cmd == "G92";
+}
+
+static int
+tool_change(const std::string &cmd)
+{
+    return cmd.size() > 1 && cmd[0] == 'T' && isdigit(cmd[1]) ? atoi(cmd.c_str() + 1) : -1;
+}
+
+/// What a chunk of G-code sets of the state of the machine, looking at it from its end.
+struct ChunkEnd {
+    float values[5] {};     ///< X Y Z E F
+    bool known[5] {};
+    int tool {-1};
+    /// Role of the last ROLE_TAG comment.
+    ExtrusionRole role {erNone};
+    bool role_known {false};
+    /// Last lines setting each firmware limit, in G-code order.
+    std::vector<std::string> limits;
+};
+
+/// State of the machine at the start of a chunk.
+struct ChunkStart {
+    float values[5] {};
+    int tool {0};
+    bool tool_selected {false};
+    ExtrusionRole role {erNone};
+    GCodeTimeEstimator::Limits limits;
+};
+
+static ChunkEnd
+scan_chunk_end(const GCodeConfig &config, const char* begin, const char* end)
+{
+    ChunkEnd chunk_end;
+    GCodeReader reader;
+    reader.apply_config(config);
+    size_t known = 0;
+    uint32_t limits_seen[4] {};
+    const auto callback = [&] (GCodeReader &, const GCodeReader::GCodeLine &line) {
+        if (is_move(line.cmd)) {
+            for (size_t i = 0; i < 5; ++i) {
+                if (!chunk_end.known[i] && line.has(axes[i])) {
+                    chunk_end.values[i] = line.get_float(axes[i]);
+                    chunk_end.known[i]  = true;
+                    ++known;
+                }
+            }
+        } else if (line.cmd.empty()) {
+            if (!chunk_end.role_known)
+                chunk_end.role_known = GCodeTimeEstimator::role_from_tag(line.comment, &chunk_end.role);
+        } else if (line.cmd[0] == 'T') {
+            if (chunk_end.tool < 0) chunk_end.tool = tool_change(line.cmd);
+        } else {
+            for (size_t i = 0; i < 4; ++i) {
+                if (line.cmd != limit_commands[i]) continue;
+                // keep the line if it has a setting not seen yet
+                bool useful = false;
+                for (size_t j = 0; limit_letters[j] != 0; ++j) {
+                    if (line.has(limit_letters[j]) && (limits_seen[i] & (1 << j)) == 0) {
+                        limits_seen[i] |= 1 << j;
+                        useful = true;
+                    }
+                }
+                if (useful) chunk_end.limits.push_back(line.raw);
+            }
+        }
+    };
+
+    const char* line_end = end;
+    while (line_end != begin) {
+        const char* line_begin = line_end;
+        while (line_begin != begin && line_begin[-1] != '\n') --line_begin;
+        // only parse the lines that can still tell something
+        if (line_begin != line_end
+            && ((*line_begin == 'G' && known < 5)
+                || (*line_begin == 'T' && chunk_end.tool < 0)
+                || (*line_begin == ';' && !chunk_end.role_known)
+                || (*line_begin == 'M' && line_end - line_begin > 3 && line_begin[1] == '2' && line_begin[2] == '0')))
+            reader.parse(line_begin, line_end, callback);
+        line_end = line_begin == begin ? begin : line_begin - 1;
+    }
+    std::reverse(chunk_end.limits.begin(), chunk_end.limits.end());
+    return chunk_end;
+}
+
+/// Computes the statistics of a chunk of G-code, starting from a known state.
+class ChunkAnalyzer : public GCodeTimeEstimator {
+    public:
+    GCodeStats stats;
+
+    ChunkAnalyzer(const GCodeConfig &config, const ChunkStart &start)
+        : _config(config), _tool(start.tool), _tool_selected(start.tool_selected) {
+        this->apply_config(config);
+        this->X = start.values[0];
+        this->Y = start.values[1];
+        this->Z = start.values[2];
+        this->E = start.values[3];
+        this->F = start.values[4];
+        this->limits = start.limits;
+        this->_role = start.role;
+    };
+
+    void analyze(const char* begin, const char* end) {
+        GCodeReader::parse(begin, end, [this] (GCodeReader &reader, const GCodeReader::GCodeLine &line) {
+            this->_count(line);
+            this->_parser(reader, line);
+        });
+        this->flush();
+        this->stats.time        = this->time;
+        this->stats.travel_time = this->travel_time;
+        std::copy(this->role_times, this->role_times + erSupportMaterialInterface + 1, this->stats.role_times);
+        this->stats.layers      = this->layers;
+    };
+
+    private:
+    const GCodeConfig &_config;
+    int _tool;
+    bool _tool_selected;
+
+    void _count(const GCodeReader::GCodeLine &line) {
+        ++this->stats.lines;
+        if (line.cmd[0] == 'T') {
+            const int tool = tool_change(line.cmd);
+            if (tool < 0) return;
+            if (this->_tool_selected && tool != this->_tool) ++this->stats.toolchanges;
+            this->_tool = tool;
+            this->_tool_selected = true;
+            return;
+        }
+        if (!is_move(line.cmd) || line.cmd == "G92") return;
+        ++this->stats.moves;
+
+        const float dE = line.dist_E();
+        if (dE == 0) return;
+        if (this->stats.filament_used.size() <= size_t(this->_tool))
+            this->stats.filament_used.resize(this->_tool + 1, 0);
+        this->stats.filament_used[this->_tool] += dE;
+
+        const float dXY = line.dist_XY();
+        if (dE < 0 || dXY == 0) return;
+        this->stats.extent.merge(Pointf3(this->X, this->Y, this->Z));
+        this->stats.extent.merge(Pointf3(line.new_X(), line.new_Y(), line.new_Z()));
+        this->stats.role_filament[this->_role] += dE;
+
+        if (line.cmd == "G1") {
+            const float dZ = line.dist_Z();
+            const double length = std::sqrt(dXY*dXY + dZ*dZ);
+            double area = 1;
+            if (!this->_config.use_volumetric_e) {
+                const double diameter = this->_config.filament_diameter.get_at(this->_tool);
+                area = PI * diameter * diameter / 4;
+            }
+            const double flow = dE / length * line.new_F() / 60 * area;
+            if (flow > this->stats.max_volumetric_speed) {
+                this->stats.max_volumetric_speed   = flow;
+                this->stats.max_volumetric_speed_z = line.new_Z();
+            }
+        }
+    };
+};
+
+}
+
+GCodeAnalyzer::GCodeAnalyzer(const PrintConfigBase &config)
+{
+    this->_config.apply(config, true);
+}
+
+GCodeStats
+GCodeAnalyzer::analyze(const std::string &gcode) const
+{
+    return this->analyze(gcode.data(), gcode.data() + gcode.size());
+}
+
+GCodeStats
+GCodeAnalyzer::analyze_file(const std::string &file) const
+{
+    if (!boost::filesystem::exists(file))
+        throw std::runtime_error("No such file: " + file);
+    if (boost::filesystem::file_size(file) == 0)
+        return GCodeStats();
+    boost::interprocess::file_mapping mapping(file.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(mapping, boost::interprocess::read_only);
+    const char* begin = static_cast<const char*>(region.get_address());
+    return this->analyze(begin, begin + region.get_size());
+}
+
+GCodeStats
+GCodeAnalyzer::analyze(const char* begin, const char* end) const
+{
+    // cut the G-code in a few chunks per thread
+    std::vector<const char*> bounds { begin };
+    const size_t size = end - begin;
+    const size_t chunks = std::max<size_t>(1, std::min<size_t>(std::max(this->threads, 1) * 4, size / std::max<size_t>(this->min_chunk_size, 1)));
+    for (size_t i = 1; i < chunks; ++i) {
+        const char* p = begin + size * i / chunks;
+        if (p <= bounds.back()) continue;
+        p = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (p == nullptr || ++p == end) break;
+        // rather cut before a Z move, where the layers change
+        const char* limit = std::min(end, p + 64 * 1024);
+        for (const char* q = p; q != nullptr && q < limit; ) {
+            if (limit - q > 4 && (strncmp(q, "G1 Z", 4) == 0 || strncmp(q, "G0 Z", 4) == 0)) {
+                p = q;
+                break;
+            }
+            q = static_cast<const char*>(memchr(q, '\n', limit - q));
+            if (q != nullptr) ++q;
+        }
+        bounds.push_back(p);
+    }
+    bounds.push_back(end);
+    const size_t n = bounds.size() - 1;
+
+    // find what each chunk sets, and then the state each one starts with
+    std::vector<ChunkEnd> ends(n);
+    if (n > 1) {
+        parallelize<size_t>(0, n - 2, [this, &ends, &bounds] (size_t i) {
+            ends[i] = scan_chunk_end(this->_config, bounds[i], bounds[i + 1]);
+        }, this->threads);
+    }
+    std::vector<ChunkStart> starts(n);
+    {
+        GCodeTimeEstimator limits;
+        for (size_t i = 1; i < n; ++i) {
+            starts[i] = starts[i - 1];
+            for (size_t j = 0; j < 5; ++j)
+                if (ends[i - 1].known[j]) starts[i].values[j] = ends[i - 1].values[j];
+            if (ends[i - 1].tool >= 0) {
+                starts[i].tool = ends[i - 1].tool;
+                starts[i].tool_selected = true;
+            }
+            if (ends[i - 1].role_known) starts[i].role = ends[i - 1].role;
+            for (const std::string &line : ends[i - 1].limits)
+                limits.parse(line);
+            starts[i].limits = limits.limits;
+        }
+    }
+
+    std::vector<GCodeStats> stats(n);
+    parallelize<size_t>(0, n - 1, [this, &stats, &starts, &bounds] (size_t i) {
+        ChunkAnalyzer analyzer(this->_config, starts[i]);
+        analyzer.analyze(bounds[i], bounds[i + 1]);
+        stats[i] = std::move(analyzer.stats);
+    }, this->threads);
+
+    for (size_t i = 1; i < n; ++i)
+        stats.front().append(stats[i]);
+    return stats.front();
+}
+
+}
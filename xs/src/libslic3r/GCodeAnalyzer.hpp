@@ -0,0 +1,63 @@
+#ifndef slic3r_GCodeAnalyzer_hpp_
+#define slic3r_GCodeAnalyzer_hpp_
+
+#include "libslic3r.h"
+#include "BoundingBox.hpp"
+#include "ExtrusionEntity.hpp"
+#include "GCodeTimeEstimator.hpp"
+#include "PrintConfig.hpp"
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+namespace Slic3r {
+
+/// Statistics of a G-code program, as computed by GCodeAnalyzer.
+struct GCodeStats {
+    size_t lines {0};
+    size_t moves {0};
+    /// Extent of the extrusions.
+    BoundingBoxf3 extent;
+    /// Filament used by each extruder, in mm (mm^3 with use_volumetric_e).
+    std::vector<double> filament_used;
+    /// Changes from one tool to another; selecting the first one isn't counted.
+    size_t toolchanges {0};
+    /// Highest volumetric flow commanded by an extrusion, in mm^3/s, and its height.
+    double max_volumetric_speed {0};
+    float max_volumetric_speed_z {0};
+    /// Print time, see GCodeTimeEstimator.
+    double time {0};
+    double travel_time {0};
+    double role_times[erSupportMaterialInterface + 1] {};
+    /// Filament extruded for each role, as named by the ROLE_TAG comments.
+    double role_filament[erSupportMaterialInterface + 1] {};
+    std::vector<GCodeTimeEstimator::LayerTime> layers;
+
+    /// Adds the statistics of the G-code that follows the one of these statistics.
+    void append(const GCodeStats &other);
+    std::string json() const;
+};
+
+/// Computes the statistics of G-code in parallel. The G-code is cut in
+/// chunks, preferably at Z moves. The state each chunk starts with (position,
+/// extruder, extrusion role and firmware limits) is found by scanning the previous chunks
+/// backwards from their end, and then every chunk is parsed by its own thread.
+class GCodeAnalyzer {
+    public:
+    int threads { int(boost::thread::hardware_concurrency()) };
+    /// G-code smaller than this isn't cut, in bytes.
+    size_t min_chunk_size { 1024 * 1024 };
+
+    GCodeAnalyzer(const PrintConfigBase &config);
+    GCodeStats analyze(const std::string &gcode) const;
+    /// Analyzes a file through a memory mapping.
+    GCodeStats analyze_file(const std::string &file) const;
+    GCodeStats analyze(const char* begin, const char* end) const;
+
+    private:
+    GCodeConfig _config;
+};
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "GCodeFormatter.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+namespace Slic3r { namespace GCodeFormatter {
+
+static const double pow10_double[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+static const uint64_t pow10_int[]  = { 1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL,
+                                       1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL };
+
+// Writes the digits of value right aligned in buf, which ends at end, and
+// returns a pointer to the first one.
+static inline char*
+write_digits(char* end, uint64_t value, int min_digits = 1)
+{
+    char* p = end;
+    do {
+        *--p = char('0' + value % 10);
+        value /= 10;
+        --min_digits;
+    } while (value != 0 || min_digits > 0);
+    return p;
+}
+
+static void
+append_printf(std::string* out, const char* format, int precision, double value)
+{
+    char buf[512];
+    const int n = snprintf(buf, sizeof(buf), format, precision, value);
+    if (n >= 0 && n < (int)sizeof(buf)) {
+        out->append(buf, n);
+    } else {
+        std::string big(n + 1, '\0');
+        snprintf(&big[0], big.size(), format, precision, value);
+        big.resize(n);
+        *out += big;
+    }
+}
+
+void
+append_fixed(std::string* out, double value, int precision, bool trim_zeros)
+{
+    const double scaled = std::fabs(value) * (precision >= 0 && precision <= 9 ? pow10_double[precision] : 0);
+
+    // The product is off by half an ulp at most, which only matters for the
+    // rounding when the exact value is that close to a tie.
+    const double integral = std::floor(scaled);
+    const double fraction = scaled - integral;
+    if (precision < 0 || precision > 9 || !(scaled < 4e15)
+        || std::fabs(fraction - 0.5) <= scaled * 1e-15) {
+        std::string s;
+        append_printf(&s, "%.*f", precision, value);
+        if (trim_zeros && s.find('.') != std::string::npos) {
+            s.erase(s.find_last_not_of('0') + 1);
+            if (s.back() == '.') s.pop_back();
+            if (s == "-0") s = "0";
+        }
+        *out += s;
+        return;
+    }
+    const uint64_t rounded = (uint64_t)integral + (fraction > 0.5 ? 1 : 0);
+    uint64_t int_part  = rounded / pow10_int[precision];
+    uint64_t frac_part = rounded % pow10_int[precision];
+    int frac_digits = precision;
+    if (trim_zeros) {
+        while (frac_digits > 0 && frac_part % 10 == 0) {
+            frac_part /= 10;
+            --frac_digits;
+        }
+    }
+
+    char buf[32];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    if (frac_digits > 0) {
+        p = write_digits(p, frac_part, frac_digits);
+        *--p = '.';
+    }
+    p = write_digits(p, int_part);
+    // printf keeps the sign of negative values rounded to zero
+    if (std::signbit(value) && !(trim_zeros && rounded == 0))
+        *--p = '-';
+    out->append(p, end - p);
+}
+
+void
+append_general(std::string* out, double value)
+{
+    append_printf(out, "%.*g", 6, value);
+}
+
+void
+append_int(std::string* out, long long value)
+{
+    char buf[24];
+    char* end = buf + sizeof(buf);
+    char* p = write_digits(end, value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value);
+    if (value < 0) *--p = '-';
+    out->append(p, end - p);
+}
+
+} }
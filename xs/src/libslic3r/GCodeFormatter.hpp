@@ -0,0 +1,26 @@
+#ifndef slic3r_GCodeFormatter_hpp_
+#define slic3r_GCodeFormatter_hpp_
+
+#include "libslic3r.h"
+#include <string>
+
+namespace Slic3r { namespace GCodeFormatter {
+
+/// Appends value in fixed notation with the given number of decimals.
+/// The rounding is the same as printf("%.*f") and std::fixed, so the output
+/// doesn't change when moving away from iostreams; the rare values that are
+/// too close to a rounding tie to be decided in double precision, and the
+/// ones too large or not finite, go through snprintf.
+/// If trim_zeros is set, the trailing zeros of the decimals and a trailing
+/// dot are dropped ("1.500" -> "1.5", "2.000" -> "2", "-0.000" -> "0").
+void append_fixed(std::string* out, double value, int precision, bool trim_zeros = false);
+
+/// Appends value like an std::ostream with default flags, i.e. printf("%g").
+void append_general(std::string* out, double value);
+
+/// Appends an integer in decimal notation.
+void append_int(std::string* out, long long value);
+
+} }
+
+#endif
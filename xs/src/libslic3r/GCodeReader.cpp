@@ -1,11 +1,47 @@
 #include "GCodeReader.hpp"
-#include <boost/algorithm/string/classification.hpp>
-#include <boost/algorithm/string/split.hpp>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
 namespace Slic3r {
 
+static inline bool
+is_separator(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+static inline bool
+is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Parses the numbers written by the G-code generator (like -12.345) with
+// the same result as atof(), and anything else with atof() itself.
+static float
+parse_float(const char* begin, const char* end)
+{
+    static const double powers_of_10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+    const char* p = begin;
+    const bool negative = p != end && *p == '-';
+    if (p != end && (*p == '-' || *p == '+')) ++p;
+    // the digits are read as a single integer, which is exact as long as
+    // there are at most 15 of them, and divided once by the power of 10
+    uint64_t digits = 0;
+    int count = 0, decimals = 0;
+    for (; p != end && is_digit(*p); ++p, ++count)
+        digits = digits * 10 + (*p - '0');
+    if (p != end && *p == '.') {
+        for (++p; p != end && is_digit(*p); ++p, ++count, ++decimals)
+            digits = digits * 10 + (*p - '0');
+    }
+    if (count == 0 || count > 15 || (p != end && *p != '\r'))
+        return atof(std::string(begin, end).c_str());
+    const double value = double(digits) / powers_of_10[decimals];
+    return float(negative ? -value : value);
+}
+
 void
 GCodeReader::apply_config(const PrintConfigBase &config)
 {
@@ -16,65 +52,80 @@ GCodeReader::apply_config(const PrintConfigBase &config)
 void
 GCodeReader::parse(const std::string &gcode, callback_t callback)
 {
-    std::istringstream ss(gcode);
-    this->parse_stream(ss, callback);
+    this->parse(gcode.data(), gcode.data() + gcode.size(), callback);
+}
+
+void
+GCodeReader::parse(const char* begin, const char* end, callback_t callback)
+{
+    while (begin != end) {
+        const char* eol = static_cast<const char*>(memchr(begin, '\n', end - begin));
+        if (eol == nullptr) eol = end;
+        this->_parse_line(begin, eol, callback);
+        begin = eol == end ? end : eol + 1;
+    }
 }
 
 void GCodeReader::parse_stream(std::istream &gcode, callback_t callback)
 {
-    std::string line;
-    while (std::getline(gcode, line))
-        this->parse_line(line, callback);
+    while (std::getline(gcode, this->_buffer))
+        this->_parse_line(this->_buffer.data(), this->_buffer.data() + this->_buffer.size(), callback);
 }
 
 void
 GCodeReader::parse_line(std::string line, callback_t callback)
 {
-    GCodeLine gline(this);
-    gline.raw = line;
+    this->_parse_line(line.data(), line.data() + line.size(), callback);
+}
+
+void
+GCodeReader::_parse_line(const char* begin, const char* end, const callback_t &callback)
+{
+    GCodeLine &gline = this->_line;
+    gline.reader = this;
+    gline.raw.assign(begin, end);
+    gline._mask = 0;
     if (this->verbose)
-        std::cout << line << std::endl;
-    
+        std::cout << gline.raw << std::endl;
+
     // strip comment
-    {
-        size_t pos = line.find(';');
-        if (pos != std::string::npos) {
-            gline.comment = line.substr(pos+1);
-            line.erase(pos);
-        }
+    const char* p = gline.raw.data();
+    end = p + gline.raw.size();
+    if (const char* semicolon = static_cast<const char*>(memchr(p, ';', end - p))) {
+        gline.comment.assign(semicolon + 1, end);
+        end = semicolon;
+    } else {
+        gline.comment.clear();
     }
-    
+
     // command and args
-    {
-        std::vector<std::string> args;
-        boost::split(args, line, boost::is_any_of(" "));
-        
-        // first one is cmd
-        gline.cmd = args.front();
-        args.erase(args.begin());
-        
-        for (std::string &arg : args) {
-            if (arg.size() < 2) continue;
-            gline.args.insert(std::make_pair(arg[0], arg.substr(1)));
-        }
+    const char* token = p;
+    while (p != end && !is_separator(*p)) ++p;
+    gline.cmd.assign(token, p);
+    while (p != end) {
+        while (p != end && is_separator(*p)) ++p;
+        token = p;
+        while (p != end && !is_separator(*p)) ++p;
+        const uint32_t bit = GCodeLine::_bit(*token);
+        // the first occurrence of an argument wins
+        if (p - token < 2 || bit == 0 || (gline._mask & bit) != 0) continue;
+        gline._mask |= bit;
+        gline._values[*token - 'A'] = parse_float(token + 1, p);
     }
-    
+
     // convert extrusion axis
-    if (this->_extrusion_axis != 'E') {
-        const auto it = gline.args.find(this->_extrusion_axis);
-        if (it != gline.args.end()) {
-            std::swap(gline.args['E'], it->second);
-            gline.args.erase(it);
-        }
+    if (this->_extrusion_axis != 'E' && gline.has(this->_extrusion_axis)) {
+        gline._values['E' - 'A'] = gline._values[this->_extrusion_axis - 'A'];
+        gline._mask = (gline._mask & ~GCodeLine::_bit(this->_extrusion_axis)) | GCodeLine::_bit('E');
     }
-    
+
     if (gline.has('E') && this->_config.use_relative_e_distances)
         this->E = 0;
-    
+
     if (callback) callback(*this, gline);
-    
+
     // update coordinates
-    if (gline.cmd == "G0" || gline.cmd == "G1" || gline.cmd == "G92") {
+    if (gline.cmd == "G0" || gline.cmd == "G1" || gline.cmd == "G2" || gline.cmd == "G3" || gline.cmd == "G92") {
         this->X = gline.new_X();
         this->Y = gline.new_Y();
         this->Z = gline.new_Z();
@@ -87,9 +138,28 @@ void
 GCodeReader::parse_file(const std::string &file, callback_t callback)
 {
     std::ifstream f(file);
-    std::string line;
-    while (std::getline(f, line))
-        this->parse_line(line, callback);
+    this->parse_stream(f, callback);
+}
+
+std::string
+GCodeReader::GCodeLine::get_string(char arg) const
+{
+    if (!this->has(arg)) return "";
+    if (arg == 'E') arg = this->reader->_extrusion_axis;
+    const char* p   = this->raw.data();
+    const char* end = p + this->raw.size();
+    if (const char* semicolon = static_cast<const char*>(memchr(p, ';', end - p)))
+        end = semicolon;
+    // skip the command
+    while (p != end && !is_separator(*p)) ++p;
+    while (p != end) {
+        while (p != end && is_separator(*p)) ++p;
+        const char* token = p;
+        while (p != end && !is_separator(*p)) ++p;
+        if (p - token >= 2 && *token == arg)
+            return std::string(token + 1, p);
+    }
+    return "";
 }
 
 void
@@ -108,7 +178,10 @@ GCodeReader::GCodeLine::set(char arg, std::string value)
             this->raw = this->raw.replace(pos, 0, space + arg + value);
         }
     }
-    this->args[arg] = value;
+    if (const uint32_t bit = _bit(arg)) {
+        this->_mask |= bit;
+        this->_values[arg - 'A'] = parse_float(value.data(), value.data() + value.size());
+    }
 }
 
 }
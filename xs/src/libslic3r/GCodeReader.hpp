@@ -3,6 +3,7 @@
 
 #include "libslic3r.h"
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <string>
@@ -13,24 +14,29 @@ namespace Slic3r {
 class GCodeReader;
 class GCodeReader {
     public:
-    
+
+    /// A parsed line. The reader reuses the same object for every line, so
+    /// that parsing doesn't allocate once its buffers have grown; callbacks
+    /// must copy it if they want to keep it.
     class GCodeLine {
         public:
         GCodeReader* reader;
         std::string raw;
         std::string cmd;
         std::string comment;
-        std::map<char,std::string> args;
-        
+
         GCodeLine(GCodeReader* _reader) : reader(_reader) {};
-        
-        bool has(char arg) const { return this->args.count(arg) > 0; };
-        float get_float(char arg) const { return atof(this->args.at(arg).c_str()); };
-        float new_X() const { return this->has('X') ? atof(this->args.at('X').c_str()) : this->reader->X; };
-        float new_Y() const { return this->has('Y') ? atof(this->args.at('Y').c_str()) : this->reader->Y; };
-        float new_Z() const { return this->has('Z') ? atof(this->args.at('Z').c_str()) : this->reader->Z; };
-        float new_E() const { return this->has('E') ? atof(this->args.at('E').c_str()) : this->reader->E; };
-        float new_F() const { return this->has('F') ? atof(this->args.at('F').c_str()) : this->reader->F; };
+
+        bool has(char arg) const { return (this->_mask & _bit(arg)) != 0; };
+        /// Value of an argument, parsed along with the line.
+        float get_float(char arg) const { return this->has(arg) ? this->_values[arg - 'A'] : 0; };
+        /// Text of an argument, as written in the line.
+        std::string get_string(char arg) const;
+        float new_X() const { return this->has('X') ? this->_values['X' - 'A'] : this->reader->X; };
+        float new_Y() const { return this->has('Y') ? this->_values['Y' - 'A'] : this->reader->Y; };
+        float new_Z() const { return this->has('Z') ? this->_values['Z' - 'A'] : this->reader->Z; };
+        float new_E() const { return this->has('E') ? this->_values['E' - 'A'] : this->reader->E; };
+        float new_F() const { return this->has('F') ? this->_values['F' - 'A'] : this->reader->F; };
         float dist_X() const { return this->new_X() - this->reader->X; };
         float dist_Y() const { return this->new_Y() - this->reader->Y; };
         float dist_Z() const { return this->new_Z() - this->reader->Z; };
@@ -44,23 +50,39 @@ class GCodeReader {
         bool retracting() const { return this->cmd == "G1" && this->dist_E() < 0; };
         bool travel() const { return this->cmd == "G1" && !this->has('E'); };
         void set(char arg, std::string value);
+
+        private:
+        friend class GCodeReader;
+        /// One bit per argument letter present in the line.
+        uint32_t _mask {0};
+        /// Values of the arguments, indexed by letter.
+        float _values[26] {};
+
+        static uint32_t _bit(char arg) { return (arg >= 'A' && arg <= 'Z') ? (uint32_t(1) << (arg - 'A')) : 0; };
     };
     typedef std::function<void(GCodeReader&, const GCodeLine&)> callback_t;
-    
+
     float X, Y, Z, E, F;
     bool verbose;
-    callback_t callback; 
-    
-    GCodeReader() : X(0), Y(0), Z(0), E(0), F(0), verbose(false), _extrusion_axis('E') {};
+    callback_t callback;
+
+    GCodeReader() : X(0), Y(0), Z(0), E(0), F(0), verbose(false), _line(this), _extrusion_axis('E') {};
     void apply_config(const PrintConfigBase &config);
     void parse(const std::string &gcode, callback_t callback);
+    /// Parses the lines between begin and end, like in a memory mapped file.
+    void parse(const char* begin, const char* end, callback_t callback);
     void parse_stream(std::istream &gcode, callback_t callback);
     void parse_line(std::string line, callback_t callback);
     void parse_file(const std::string &file, callback_t callback);
-    
+
     private:
     GCodeConfig _config;
+    /// Buffers reused from one line to the next.
+    GCodeLine _line;
+    std::string _buffer;
     char _extrusion_axis;
+
+    void _parse_line(const char* begin, const char* end, const callback_t &callback);
 };
 
 } /* namespace Slic3r */
@@ -0,0 +1,87 @@
+#include "GCodeSink.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace Slic3r {
+
+const size_t GCodeSink::chunk_size;
+
+void
+GCodeSink::append(const char* data, size_t length)
+{
+    if (length == 0) return;
+    if (this->_chunks.empty()
+        || (this->_chunks.back().size() + length > chunk_size && this->_at_line_start())) {
+        this->_chunks.emplace_back();
+        this->_chunks.back().reserve(std::max(chunk_size, length));
+    }
+    this->_chunks.back().append(data, length);
+}
+
+GCodeSink&
+GCodeSink::operator+=(const char* gcode)
+{
+    this->append(gcode, strlen(gcode));
+    return *this;
+}
+
+GCodeSink&
+GCodeSink::operator+=(std::string &&gcode)
+{
+    if (gcode.size() >= chunk_size / 2 && this->_at_line_start()) {
+        this->_chunks.emplace_back(std::move(gcode));
+    } else {
+        this->append(gcode.data(), gcode.size());
+    }
+    return *this;
+}
+
+GCodeSink&
+GCodeSink::operator+=(GCodeSink &&other)
+{
+    for (std::string &chunk : other._chunks) {
+        if (this->_at_line_start()) {
+            this->_chunks.emplace_back(std::move(chunk));
+        } else {
+            this->_chunks.back() += chunk;
+        }
+    }
+    other._chunks.clear();
+    return *this;
+}
+
+bool
+GCodeSink::empty() const
+{
+    for (const std::string &chunk : this->_chunks)
+        if (!chunk.empty()) return false;
+    return true;
+}
+
+size_t
+GCodeSink::size() const
+{
+    size_t size = 0;
+    for (const std::string &chunk : this->_chunks)
+        size += chunk.size();
+    return size;
+}
+
+std::string
+GCodeSink::str() const
+{
+    std::string gcode;
+    gcode.reserve(this->size());
+    for (const std::string &chunk : this->_chunks)
+        gcode += chunk;
+    return gcode;
+}
+
+void
+GCodeSink::write(std::ostream &out) const
+{
+    for (const std::string &chunk : this->_chunks)
+        out.write(chunk.data(), chunk.size());
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef slic3r_GCodeSink_hpp_
+#define slic3r_GCodeSink_hpp_
+
+#include "libslic3r.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Slic3r {
+
+/// Append-only G-code buffer made of chunks. It lets the G-code of a layer
+/// be passed from one stage of the export to the next, and written to the
+/// output stream, without ever being copied or reallocated as a whole.
+/// A new chunk is only started after a newline, so chunks always hold whole
+/// lines and line based filters can process them one at a time.
+class GCodeSink
+{
+    public:
+    /// Size above which a chunk is closed once it ends with a newline.
+    static const size_t chunk_size = 64 * 1024;
+
+    GCodeSink() {};
+    GCodeSink(GCodeSink &&other) = default;
+    GCodeSink& operator=(GCodeSink &&other) = default;
+    GCodeSink(const GCodeSink &other) = default;
+    GCodeSink& operator=(const GCodeSink &other) = default;
+
+    void append(const char* data, size_t length);
+    GCodeSink& operator+=(const std::string &gcode) { this->append(gcode.data(), gcode.size()); return *this; };
+    GCodeSink& operator+=(const char* gcode);
+    /// Large strings are adopted as chunks instead of being copied.
+    GCodeSink& operator+=(std::string &&gcode);
+    /// Moves the chunks of other at the end of this buffer.
+    GCodeSink& operator+=(GCodeSink &&other);
+
+    bool empty() const;
+    size_t size() const;
+    void clear() { this->_chunks.clear(); };
+    /// Concatenates the chunks; only meant for the consumers that need the
+    /// whole text at once.
+    std::string str() const;
+    void write(std::ostream &out) const;
+
+    /// The chunks can be edited in place as long as they keep ending with a
+    /// newline (except the last one).
+    std::vector<std::string>& chunks() { return this->_chunks; };
+    const std::vector<std::string>& chunks() const { return this->_chunks; };
+
+    private:
+    std::vector<std::string> _chunks;
+
+    /// Can the next append go to a new chunk?
+    bool _at_line_start() const { return this->_chunks.empty() || this->_chunks.back().empty() || this->_chunks.back().back() == '\n'; };
+};
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "GCodeTemplate.hpp"
+#include "ConditionalGCode.hpp"
+#include <cctype>
+
+namespace Slic3r {
+
+void
+GCodeTemplate::Values::set(const std::string &key, const std::string &value)
+{
+    this->_values[key] = value;
+}
+
+void
+GCodeTemplate::Values::set(const std::string &key, int value)
+{
+    this->set(key, std::to_string(value));
+}
+
+GCodeTemplate::GCodeTemplate(const std::string &gcode)
+    : _gcode(gcode)
+{
+    std::string text;
+    size_t i = 0;
+    while (i < gcode.size()) {
+        const size_t open = gcode.find('[', i);
+        const size_t close = open == std::string::npos ? std::string::npos : gcode.find(']', open + 1);
+        if (close == std::string::npos) break;
+        // the placeholder starts at the last bracket before the closing one
+        const size_t start = gcode.rfind('[', close);
+        if (start != open) this->_nested = true;
+        text.append(gcode, i, start - i);
+        if (close == start + 1) {
+            text += "[]";
+        } else {
+            this->_segments.push_back(text);
+            this->_segments.push_back(gcode.substr(start + 1, close - start - 1));
+            text.clear();
+        }
+        i = close + 1;
+    }
+    if (i < gcode.size()) text.append(gcode, i, std::string::npos);
+    this->_segments.push_back(text);
+}
+
+const std::string*
+GCodeTemplate::_value(const PlaceholderParser &parser, const Values &values, const std::string &name, bool* exact) const
+{
+    const std::string* value = nullptr;
+    auto set = values._values.find(name);
+    auto single = parser._single.find(name);
+    if (set != values._values.end()) {
+        value = &set->second;
+    } else if (single != parser._single.end()) {
+        value = &single->second;
+    } else {
+        // [key_i] is the ith value of a placeholder with multiple values
+        const size_t underscore = name.rfind('_');
+        if (underscore == std::string::npos || underscore + 1 == name.size()) return nullptr;
+        const std::string key = name.substr(0, underscore);
+        const std::string index = name.substr(underscore + 1);
+        if (index.size() > 9 || (index.size() > 1 && index[0] == '0')) return nullptr;
+        for (const char c : index)
+            if (!std::isdigit(static_cast<unsigned char>(c))) return nullptr;
+        auto multiple = parser._multiple.find(key);
+        if (multiple == parser._multiple.end() || values._values.count(key) > 0) return nullptr;
+        const size_t i = std::stoul(index);
+        if (i >= multiple->second.size()) {
+            // replaced by the first value depending on the other placeholders
+            *exact = false;
+            return nullptr;
+        }
+        value = &multiple->second[i];
+    }
+    if (value->find_first_of("[]") != std::string::npos) *exact = false;
+    return value;
+}
+
+std::string
+GCodeTemplate::process(const PlaceholderParser &parser, const Values &values) const
+{
+    bool exact = !this->_nested;
+    std::string gcode;
+    for (size_t i = 0; i < this->_segments.size() && exact; ++i) {
+        if (i % 2 == 0) {
+            gcode += this->_segments[i];
+        } else if (const std::string* value = this->_value(parser, values, this->_segments[i], &exact)) {
+            gcode += *value;
+        } else {
+            gcode += '[' + this->_segments[i] + ']';
+        }
+    }
+    if (!exact) {
+        PlaceholderParser pp { parser };
+        for (const auto &value : values._values)
+            pp.set(value.first, value.second);
+        gcode = pp.process(this->_gcode);
+    }
+    return apply_math(gcode);
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef slic3r_GCodeTemplate_hpp_
+#define slic3r_GCodeTemplate_hpp_
+
+#include "libslic3r.h"
+#include "PlaceholderParser.hpp"
+#include <string>
+#include <vector>
+
+namespace Slic3r {
+
+/// Custom G-code parsed once into literal text and placeholders, so that it
+/// can be expanded again and again, like for each layer, without searching
+/// it for every placeholder of the parser. The math in braces is then done
+/// by apply_math(), which compiles each form of expression once.
+class GCodeTemplate {
+    public:
+    /// Values set for one expansion over the ones of the parser, converted
+    /// like by PlaceholderParser::set().
+    class Values {
+        public:
+        void set(const std::string &key, const std::string &value);
+        void set(const std::string &key, int value);
+
+        private:
+        friend class GCodeTemplate;
+        t_strstr_map _values;
+    };
+
+    GCodeTemplate() {};
+    explicit GCodeTemplate(const std::string &gcode);
+    const std::string& gcode() const { return this->_gcode; };
+    bool empty() const { return this->_gcode.empty(); };
+    /// Same as apply_math() on the G-code processed by a copy of the parser
+    /// with the values set in it.
+    std::string process(const PlaceholderParser &parser, const Values &values = Values()) const;
+
+    private:
+    std::string _gcode;
+    /// Literal text and placeholder names, alternating, starting with text.
+    std::vector<std::string> _segments;
+    /// Are there brackets inside placeholders? Expanding those can make new
+    /// placeholders, which only PlaceholderParser::process() handles.
+    bool _nested {false};
+
+    /// Value of a placeholder, or nullptr if it stays as it is; sets *exact to
+    /// false if only PlaceholderParser::process() can tell.
+    const std::string* _value(const PlaceholderParser &parser, const Values &values, const std::string &name, bool* exact) const;
+};
+
+}
+
+#endif
@@ -1,5 +1,7 @@
 #include "GCodeTimeEstimator.hpp"
+#include <algorithm>
 #include <cmath>
+#include <fstream>
 #include <boost/version.hpp>
 #if BOOST_VERSION >= 107300
 #include <boost/bind/bind.hpp>
@@ -16,67 +18,282 @@ void
 GCodeTimeEstimator::parse(const std::string &gcode)
 {
     GCodeReader::parse(gcode, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+    this->flush();
+}
+
+void
+GCodeTimeEstimator::parse_stream(std::istream &gcode)
+{
+    GCodeReader::parse_stream(gcode, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+    this->flush();
 }
 
 void
 GCodeTimeEstimator::parse_file(const std::string &file)
 {
-    GCodeReader::parse_file(file, boost::bind(&GCodeTimeEstimator::_parser, this, _1, _2));
+    std::ifstream f(file);
+    this->parse_stream(f);
+}
+
+void
+GCodeTimeEstimator::flush()
+{
+    this->_plan(this->_blocks.size());
+    this->_nominal_speed = 0;
+    std::fill(this->_axis_speeds, this->_axis_speeds + 4, 0.f);
+}
+
+const std::string GCodeTimeEstimator::ROLE_TAG = "ROLE:";
+
+bool
+GCodeTimeEstimator::role_from_tag(const std::string &comment, ExtrusionRole* role)
+{
+    if (comment.compare(0, ROLE_TAG.size(), ROLE_TAG) != 0) return false;
+    std::string name = comment.substr(ROLE_TAG.size());
+    if (!name.empty() && name.back() == '\r') name.pop_back();
+    for (size_t i = 0; i <= erSupportMaterialInterface; ++i) {
+        if (name == role_name(ExtrusionRole(i))) {
+            *role = ExtrusionRole(i);
+            return true;
+        }
+    }
+    *role = erNone;
+    return true;
+}
+
+const char*
+GCodeTimeEstimator::role_name(ExtrusionRole role)
+{
+    switch (role) {
+        case erPerimeter:                   return "perimeter";
+        case erExternalPerimeter:           return "external perimeter";
+        case erOverhangPerimeter:           return "overhang perimeter";
+        case erInternalInfill:              return "infill";
+        case erSolidInfill:                 return "solid infill";
+        case erTopSolidInfill:              return "top solid infill";
+        case erBridgeInfill:                return "bridge infill";
+        case erGapFill:                     return "gap fill";
+        case erSkirt:                       return "skirt";
+        case erSupportMaterial:             return "support material";
+        case erSupportMaterialInterface:    return "support material interface";
+        default:                            return "other";
+    }
 }
 
 void
 GCodeTimeEstimator::_parser(GCodeReader&, const GCodeReader::GCodeLine &line)
 {
-    // std::cout << "[" << this->time << "] " << line.raw << std::endl;
-    if (line.cmd == "G1") {
-        const float dist_XY = line.dist_XY();
-        const float new_F = line.new_F();
-        
-        if (dist_XY > 0) {
-            //this->time += dist_XY / new_F * 60;
-            this->time += _accelerated_move(dist_XY, new_F/60, this->acceleration);
-        } else {
-            //this->time += std::abs(line.dist_E()) / new_F * 60;
-            this->time += _accelerated_move(std::abs(line.dist_E()), new_F/60, this->acceleration);
+    static const char axes[4] = { 'X', 'Y', 'Z', 'E' };
+
+    if (line.cmd == "G1" || line.cmd == "G0" || line.cmd == "G2" || line.cmd == "G3") {
+        const float delta[4] = { line.dist_X(), line.dist_Y(), line.dist_Z(), line.dist_E() };
+        float length_XY = std::sqrt(delta[0]*delta[0] + delta[1]*delta[1]);
+        if ((line.cmd == "G2" || line.cmd == "G3") && (line.has('I') || line.has('J'))) {
+            // the arc is planned as a single move along its length
+            const float I = line.has('I') ? line.get_float('I') : 0;
+            const float J = line.has('J') ? line.get_float('J') : 0;
+            const float radius = std::sqrt(I*I + J*J);
+            double sweep = std::atan2(delta[1] - J, delta[0] - I) - std::atan2(-J, -I);
+            if (line.cmd == "G2" && sweep >= 0) sweep -= 2*PI;
+            if (line.cmd == "G3" && sweep <= 0) sweep += 2*PI;
+            length_XY = radius * std::abs(sweep);
         }
-        //this->time += std::abs(line.dist_Z()) / new_F * 60;
-        this->time += _accelerated_move(std::abs(line.dist_Z()), new_F/60, this->acceleration);
-    } else if (line.cmd == "M204" && line.has('S')) {
-        this->acceleration = line.get_float('S');
-    } else if (line.cmd == "G4") { // swell
+        float length = std::sqrt(length_XY*length_XY + delta[2]*delta[2]);
+        if (length == 0) length = std::abs(delta[3]);
+        this->_add_move(delta, length, line.new_F() / 60);
+    } else if (line.cmd.empty()) {
+        role_from_tag(line.comment, &this->_role);
+    } else if (line.cmd == "G4") {
+        // dwelling waits for the moves to be done
+        this->flush();
+        float dwell = 0;
         if (line.has('S')) {
-            this->time += line.get_float('S');
+            dwell = line.get_float('S');
         } else if (line.has('P')) {
-            this->time += line.get_float('P')/1000;
+            dwell = line.get_float('P')/1000;
+        }
+        this->time += dwell;
+        if (this->layers.size() <= this->_layer)
+            this->layers.resize(this->_layer + 1, LayerTime { this->Z, 0 });
+        this->layers[this->_layer].time += dwell;
+    } else if (line.cmd == "M109" || line.cmd == "M190" || line.cmd == "M400") {
+        this->flush();
+    } else if (line.cmd == "M201" || line.cmd == "M203") {
+        float* values = line.cmd == "M201" ? this->limits.max_acceleration : this->limits.max_feedrate;
+        for (size_t i = 0; i < 4; ++i)
+            if (line.has(axes[i])) values[i] = line.get_float(axes[i]);
+    } else if (line.cmd == "M204") {
+        if (line.has('S')) {
+            this->limits.acceleration = this->limits.travel_acceleration = line.get_float('S');
         }
+        if (line.has('P')) this->limits.acceleration         = line.get_float('P');
+        if (line.has('R')) this->limits.retract_acceleration = line.get_float('R');
+        if (line.has('T')) this->limits.travel_acceleration  = line.get_float('T');
+    } else if (line.cmd == "M205") {
+        for (size_t i = 0; i < 4; ++i)
+            if (line.has(axes[i])) this->limits.max_jerk[i] = line.get_float(axes[i]);
+        // older firmwares set the jerk of both X and Y with M205 X
+        if (line.has('X') && !line.has('Y')) this->limits.max_jerk[1] = this->limits.max_jerk[0];
     }
 }
 
-// Wildly optimistic acceleration "bell" curve modeling.
-// Returns an estimate of how long the move with a given accel
-// takes in seconds.
-// It is assumed that the movement is smooth and uniform.
-float
-GCodeTimeEstimator::_accelerated_move(double length, double v, double acceleration) 
+void
+GCodeTimeEstimator::_add_move(const float delta[4], float length, float feedrate)
 {
-    // for half of the move, there are 2 zones, where the speed is increasing/decreasing and 
-    // where the speed is constant.
-    // Since the slowdown is assumed to be uniform, calculate the average velocity for half of the 
-    // expected displacement.
-    // final velocity v = a*t => a * (dx / 0.5v) => v^2 = 2*a*dx
-    // v_avg = 0.5v => 2*v_avg = v
-    // d_x = v_avg*t => t = d_x / v_avg
-    acceleration = (acceleration == 0.0 ? 4000.0 : acceleration); // Set a default accel to use for print time in case it's 0 somehow.
-    auto half_length = length / 2.0;
-    auto t_init = v / acceleration; // time to final velocity
-    auto dx_init = (0.5*v*t_init); // Initial displacement for the time to get to final velocity
-    auto t = 0.0;
-    if (half_length >= dx_init) {
-        half_length -= (0.5*v*t_init);
-        t += t_init;
+    if (length <= 0 || feedrate <= 0) return;
+
+    Block block;
+    block.length = length;
+    const bool moves_XYZ = delta[0] != 0 || delta[1] != 0 || delta[2] != 0;
+    block.travel = !moves_XYZ || delta[3] <= 0;
+
+    // limit the speed and acceleration so that no axis goes past its own limits
+    block.nominal_speed = feedrate;
+    if (!moves_XYZ) {
+        block.acceleration = this->limits.retract_acceleration;
+    } else if (delta[3] == 0) {
+        block.acceleration = this->limits.travel_acceleration;
+    } else {
+        block.acceleration = this->limits.acceleration;
     }
-    t += (half_length / v); // constant speed for rest of the time and too short displacements
-    return 2.0*t; // cut in half before, so double to get full time spent.
+    for (size_t i = 0; i < 4; ++i) {
+        const float ratio = std::abs(delta[i]) / length;
+        if (ratio == 0) continue;
+        if (this->limits.max_feedrate[i] > 0 && block.nominal_speed * ratio > this->limits.max_feedrate[i])
+            block.nominal_speed = this->limits.max_feedrate[i] / ratio;
+        if (this->limits.max_acceleration[i] > 0 && block.acceleration * ratio > this->limits.max_acceleration[i])
+            block.acceleration = this->limits.max_acceleration[i] / ratio;
+    }
+    block.acceleration = std::max(block.acceleration, 1.f);
+
+    // speed of each axis during this move
+    float axis_speeds[4];
+    for (size_t i = 0; i < 4; ++i)
+        axis_speeds[i] = block.nominal_speed * delta[i] / length;
+
+    // highest speed at which the move can be started from a standstill
+    float safe_speed = block.nominal_speed;
+    for (size_t i = 0; i < 4; ++i) {
+        const float jerk = std::abs(axis_speeds[i]);
+        if (jerk > this->limits.max_jerk[i])
+            safe_speed = std::min(safe_speed, block.nominal_speed * this->limits.max_jerk[i] / jerk);
+    }
+
+    // highest speed at the junction with the previous move
+    if (this->_nominal_speed > 0) {
+        float junction_speed = std::min(block.nominal_speed, this->_nominal_speed);
+        const float exit_factor  = junction_speed / this->_nominal_speed;
+        const float entry_factor = junction_speed / block.nominal_speed;
+        float factor = 1;
+        for (size_t i = 0; i < 4; ++i) {
+            const float v_exit  = this->_axis_speeds[i] * exit_factor;
+            const float v_entry = axis_speeds[i] * entry_factor;
+            // the speed changes by the difference when the axis keeps its
+            // direction, and by the fastest of both when it reverses
+            const float jerk = (v_exit > 0) == (v_entry > 0) || v_exit == 0 || v_entry == 0
+                ? std::abs(v_exit - v_entry)
+                : std::max(std::abs(v_exit), std::abs(v_entry));
+            if (jerk > this->limits.max_jerk[i])
+                factor = std::min(factor, this->limits.max_jerk[i] / jerk);
+        }
+        block.max_entry_speed = std::max(junction_speed * factor, std::min(safe_speed, junction_speed));
+    } else {
+        block.max_entry_speed = safe_speed;
+    }
+    block.entry_speed = block.max_entry_speed;
+    this->_nominal_speed = block.nominal_speed;
+    std::copy(axis_speeds, axis_speeds + 4, this->_axis_speeds);
+
+    // extrusion role and layer
+    if (block.travel) {
+        block.role = erNone;
+    } else {
+        block.role = this->_role;
+        // (extrusions moving Z, like in spiral vase mode, stay in the current layer)
+        const float z = this->Z;
+        if (delta[2] == 0 && (!this->_layer_started || std::abs(z - this->_layer_z) > EPSILON)) {
+            if (this->_layer_started) ++this->_layer;
+            this->_layer_started = true;
+            this->_layer_z = z;
+            if (this->layers.size() <= this->_layer)
+                this->layers.resize(this->_layer + 1, LayerTime { z, 0 });
+            this->layers[this->_layer].print_z = z;
+        }
+    }
+    block.layer = this->_layer;
+
+    this->_blocks.push_back(block);
+    if (this->_blocks.size() >= 2 * this->lookahead)
+        this->_plan(this->_blocks.size() - this->lookahead);
+}
+
+void
+GCodeTimeEstimator::_plan(size_t count)
+{
+    const size_t n = this->_blocks.size();
+    if (n == 0) return;
+
+    // backwards: every move must be able to slow down to the entry speed of
+    // the next one, and the last one to stop
+    float next_entry_speed = 0;
+    for (size_t i = n; i-- > (this->_entry_fixed ? 1 : 0); ) {
+        Block &block = this->_blocks[i];
+        block.entry_speed = std::min(
+            block.max_entry_speed,
+            std::sqrt(next_entry_speed*next_entry_speed + 2 * block.acceleration * block.length)
+        );
+        next_entry_speed = block.entry_speed;
+    }
+    // forwards: every move must be able to reach the entry speed of the next one
+    for (size_t i = 0; i + 1 < n; ++i) {
+        const Block &block = this->_blocks[i];
+        const float max_exit_speed = std::sqrt(block.entry_speed*block.entry_speed + 2 * block.acceleration * block.length);
+        float &next_entry = this->_blocks[i + 1].entry_speed;
+        next_entry = std::min(next_entry, max_exit_speed);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        const float exit_speed = i + 1 < n ? this->_blocks[i + 1].entry_speed : 0;
+        this->_account(this->_blocks[i], _trapezoid_time(this->_blocks[i], exit_speed));
+    }
+    this->_blocks.erase(this->_blocks.begin(), this->_blocks.begin() + count);
+    this->_entry_fixed = !this->_blocks.empty();
+}
+
+void
+GCodeTimeEstimator::_account(const Block &block, double time)
+{
+    this->time += time;
+    if (block.travel) {
+        this->travel_time += time;
+    } else {
+        this->role_times[block.role] += time;
+    }
+    if (this->layers.size() <= block.layer)
+        this->layers.resize(block.layer + 1, LayerTime { this->Z, 0 });
+    this->layers[block.layer].time += time;
+}
+
+// Time of a move accelerating from its entry speed to its nominal speed,
+// cruising and decelerating to exit_speed, or accelerating and decelerating
+// right away if it is too short to reach the nominal speed.
+double
+GCodeTimeEstimator::_trapezoid_time(const Block &block, float exit_speed)
+{
+    const double v0 = block.entry_speed;
+    const double v1 = exit_speed;
+    const double vc = block.nominal_speed;
+    const double a  = block.acceleration;
+    const double accelerate_length = (vc*vc - v0*v0) / (2*a);
+    const double decelerate_length = (vc*vc - v1*v1) / (2*a);
+    if (accelerate_length + decelerate_length <= block.length)
+        return (vc - v0)/a + (vc - v1)/a + (block.length - accelerate_length - decelerate_length)/vc;
+
+    const double peak_speed = std::sqrt(std::max(
+        (2*a*block.length + v0*v0 + v1*v1) / 2,
+        std::max(v0*v0, v1*v1)
+    ));
+    return (peak_speed - v0)/a + (peak_speed - v1)/a;
 }
 
 }
@@ -2,21 +2,99 @@
 #define slic3r_GCodeTimeEstimator_hpp_
 
 #include "libslic3r.h"
+#include "ExtrusionEntity.hpp"
 #include "GCodeReader.hpp"
+#include <deque>
+#include <istream>
+#include <string>
+#include <vector>
 
 namespace Slic3r {
 
+/// Estimates the print time of G-code the way the firmware plans the moves:
+/// each move accelerates, cruises and decelerates along a trapezoid, the speed
+/// at the junction of two moves is limited by the jerk settings, and a
+/// lookahead buffer of moves is planned so that the printer can always come
+/// to a stop at its end.
+/// The time is also broken down per layer and per extrusion role. The roles
+/// are read from the ROLE_TAG comments written by GCode::_extrude().
 class GCodeTimeEstimator : public GCodeReader {
     public:
-    float time = 0;  // in seconds
-    
+    /// Limits of the planner, with the defaults of Marlin. They are changed
+    /// by the M201, M203, M204 and M205 commands found in the G-code.
+    struct Limits {
+        float max_feedrate[4]       { 300, 300, 5, 25 };        ///< X Y Z E, mm/s (M203)
+        float max_acceleration[4]   { 3000, 3000, 100, 10000 }; ///< X Y Z E, mm/s^2 (M201)
+        float max_jerk[4]           { 10, 10, 0.4f, 5 };        ///< X Y Z E, mm/s (M205)
+        float acceleration          { 3000 };   ///< printing moves, mm/s^2 (M204 P or S)
+        float travel_acceleration   { 3000 };   ///< moves without extrusion (M204 T or S)
+        float retract_acceleration  { 3000 };   ///< extruder only moves (M204 R)
+    };
+
+    struct LayerTime {
+        float print_z;
+        double time;    ///< seconds
+    };
+
+    Limits limits;
+    /// Number of moves planned ahead of the one being timed.
+    size_t lookahead = 16;
+
+    double time = 0;  // in seconds
+    /// Time spent in moves that don't extrude.
+    double travel_time = 0;
+    /// Time spent extruding each role; moves before any ROLE_TAG go to erNone.
+    double role_times[erSupportMaterialInterface + 1] {};
+    /// A layer starts with the first flat extrusion at a new height; the moves
+    /// before the first extrusion are counted in the first layer.
+    std::vector<LayerTime> layers;
+
     void parse(const std::string &gcode);
+    void parse_stream(std::istream &gcode);
     void parse_file(const std::string &file);
-    
+    /// Times the moves still in the lookahead buffer, the printer stopping
+    /// after the last one. The parse*() methods call it when they are done.
+    void flush();
+
+    /// Comment written by GCode::_extrude() before the extrusions of each
+    /// role, followed by role_name(), like ";ROLE:external perimeter".
+    static const std::string ROLE_TAG;
+    /// Reads the role named by a ROLE_TAG comment, given without its ';'.
+    /// Returns false if the comment isn't one.
+    static bool role_from_tag(const std::string &comment, ExtrusionRole* role);
+    /// Description of a role, as written in the ROLE_TAG comments.
+    static const char* role_name(ExtrusionRole role);
+
     protected:
-    float acceleration = 9000;
+    /// A move as seen by the planner.
+    struct Block {
+        float length;           ///< mm
+        float nominal_speed;    ///< mm/s
+        float acceleration;     ///< mm/s^2
+        float max_entry_speed;  ///< mm/s, limited by the jerk with the previous move
+        float entry_speed;      ///< mm/s
+        bool travel;
+        ExtrusionRole role;
+        size_t layer;
+    };
+    std::deque<Block> _blocks;
+    /// Was the entry speed of the first buffered move set by the moves already timed?
+    bool _entry_fixed = false;
+    /// Speed of each axis at the end of the last move, for the jerk limits.
+    float _axis_speeds[4] {};
+    float _nominal_speed = 0;
+    size_t _layer = 0;
+    bool _layer_started = false;
+    float _layer_z = 0;
+    /// Role named by the last ROLE_TAG comment.
+    ExtrusionRole _role = erNone;
+
     void _parser(GCodeReader&, const GCodeReader::GCodeLine &line);
-    static float _accelerated_move(double length, double v, double acceleration);
+    void _add_move(const float delta[4], float length, float feedrate);
+    /// Plans the entry speeds of the buffered moves and times the first count ones.
+    void _plan(size_t count);
+    void _account(const Block &block, double time);
+    static double _trapezoid_time(const Block &block, float exit_speed);
 };
 
 } /* namespace Slic3r */
@@ -1,4 +1,5 @@
 #include "GCodeWriter.hpp"
+#include "GCodeFormatter.hpp"
 #include "utils.hpp"
 #include <algorithm>
 #include <iomanip>
@@ -7,10 +8,9 @@
 
 #define FLAVOR_IS(val) this->config.gcode_flavor == val
 #define FLAVOR_IS_NOT(val) this->config.gcode_flavor != val
-#define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) gcode << " ; " << comment;
-#define PRECISION(val, precision) std::fixed << std::setprecision(precision) << val
-#define XYZF_NUM(val) PRECISION(val, 3)
-#define E_NUM(val) PRECISION(val, 5)
+#define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) { gcode += " ; "; gcode += comment; }
+#define XYZF_NUM(val) GCodeFormatter::append_fixed(&gcode, val, this->config.gcode_precision_xyz.value, this->config.gcode_trim_zeros.value)
+#define E_NUM(val) GCodeFormatter::append_fixed(&gcode, val, this->config.gcode_precision_e.value, this->config.gcode_trim_zeros.value)
 
 namespace Slic3r {
 
@@ -162,38 +162,38 @@ GCodeWriter::set_bed_temperature(unsigned int temperature, bool wait) const
 std::string
 GCodeWriter::set_fan(unsigned int speed, bool dont_save)
 {
-    std::ostringstream gcode;
+    std::string gcode;
     const double baseline_factor = (this->config.fan_percentage ? 100.0 : 255.0);
     if (this->_last_fan_speed != speed || dont_save) {
         if (!dont_save) this->_last_fan_speed = speed;
         
         if (speed == 0) {
             if (FLAVOR_IS(gcfTeacup)) {
-                gcode << "M106 S0";
+                gcode += "M106 S0";
             } else if (FLAVOR_IS(gcfMakerWare) || FLAVOR_IS(gcfSailfish)) {
-                gcode << "M127";
+                gcode += "M127";
             } else {
-                gcode << "M107";
+                gcode += "M107";
             }
-            if (this->config.gcode_comments) gcode << " ; disable fan";
-            gcode << "\n";
+            if (this->config.gcode_comments) gcode += " ; disable fan";
+            gcode += "\n";
         } else {
             if (FLAVOR_IS(gcfMakerWare) || FLAVOR_IS(gcfSailfish)) {
-                gcode << "M126";
+                gcode += "M126";
             } else {
-                gcode << "M106 ";
+                gcode += "M106 ";
                 if (FLAVOR_IS(gcfMach3) || FLAVOR_IS(gcfMachinekit)) {
-                    gcode << "P";
+                    gcode += "P";
                 } else {
-                    gcode << "S";
+                    gcode += "S";
                 }
-                gcode << (baseline_factor * speed / 100.0);
+                GCodeFormatter::append_general(&gcode, baseline_factor * speed / 100.0);
             }
-            if (this->config.gcode_comments) gcode << " ; enable fan";
-            gcode << "\n";
+            if (this->config.gcode_comments) gcode += " ; enable fan";
+            gcode += "\n";
         }
     }
-    return gcode.str();
+    return gcode;
 }
 
 std::string
@@ -309,28 +309,42 @@ std::string
 GCodeWriter::set_speed(double F, const std::string &comment,
                        const std::string &cooling_marker) const
 {
-    std::ostringstream gcode;
-    gcode.precision(3);
-    gcode << "G1 F" << std::fixed << F;
+    std::string gcode;
+    this->set_speed(&gcode, F, comment, cooling_marker);
+    return gcode;
+}
+
+void
+GCodeWriter::set_speed(std::string* out, double F, const std::string &comment,
+                       const std::string &cooling_marker) const
+{
+    std::string &gcode = *out;
+    gcode += "G1 F"; XYZF_NUM(F);
     COMMENT(comment);
-    gcode << cooling_marker;
-    gcode << "\n";
-    return gcode.str();
+    gcode += cooling_marker;
+    gcode += "\n";
 }
 
 std::string
 GCodeWriter::travel_to_xy(const Pointf &point, const std::string &comment)
+{
+    std::string gcode;
+    this->travel_to_xy(&gcode, point, comment);
+    return gcode;
+}
+
+void
+GCodeWriter::travel_to_xy(std::string* out, const Pointf &point, const std::string &comment)
 {
     this->_pos.x = point.x;
     this->_pos.y = point.y;
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string &gcode = *out;
+    gcode += "G1 X"; XYZF_NUM(point.x);
+    gcode +=  " Y";  XYZF_NUM(point.y);
+    gcode +=  " F";  XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += "\n";
 }
 
 std::string
@@ -351,14 +365,14 @@ GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
     this->_lifted = 0;
     this->_pos = point;
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<   " Z" << XYZF_NUM(point.z)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string gcode;
+    gcode += "G1 X"; XYZF_NUM(point.x);
+    gcode +=  " Y";  XYZF_NUM(point.y);
+    gcode +=  " Z";  XYZF_NUM(point.z);
+    gcode +=  " F";  XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += "\n";
+    return gcode;
 }
 
 std::string
@@ -384,12 +398,12 @@ GCodeWriter::_travel_to_z(double z, const std::string &comment)
 {
     this->_pos.z = z;
     
-    std::ostringstream gcode;
-    gcode << "G1 Z" << XYZF_NUM(z)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string gcode;
+    gcode += "G1 Z"; XYZF_NUM(z);
+    gcode +=  " F";  XYZF_NUM(this->config.travel_speed.value * 60.0);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += "\n";
+    return gcode;
 }
 
 bool
@@ -407,18 +421,43 @@ GCodeWriter::will_move_z(double z) const
 
 std::string
 GCodeWriter::extrude_to_xy(const Pointf &point, double dE, const std::string &comment)
+{
+    std::string gcode;
+    this->extrude_to_xy(&gcode, point, dE, comment);
+    return gcode;
+}
+
+void
+GCodeWriter::extrude_to_xy(std::string* out, const Pointf &point, double dE, const std::string &comment)
 {
     this->_pos.x = point.x;
     this->_pos.y = point.y;
     this->_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<    " " << this->_extrusion_axis << E_NUM(this->_extruder->E);
+    std::string &gcode = *out;
+    gcode += "G1 X"; XYZF_NUM(point.x);
+    gcode +=  " Y";  XYZF_NUM(point.y);
+    gcode +=  " ";   gcode += this->_extrusion_axis; E_NUM(this->_extruder->E);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += "\n";
+}
+
+void
+GCodeWriter::extrude_arc_to_xy(std::string* out, const Pointf &point, const Pointf &center, bool ccw,
+    double dE, const std::string &comment)
+{
+    this->_pos.x = point.x;
+    this->_pos.y = point.y;
+    this->_extruder->extrude(dE);
+    
+    std::string &gcode = *out;
+    gcode += ccw ? "G3 X" : "G2 X"; XYZF_NUM(point.x);
+    gcode +=  " Y";  XYZF_NUM(point.y);
+    gcode +=  " I";  XYZF_NUM(center.x);
+    gcode +=  " J";  XYZF_NUM(center.y);
+    gcode +=  " ";   gcode += this->_extrusion_axis; E_NUM(this->_extruder->E);
+    COMMENT(comment);
+    gcode += "\n";
 }
 
 std::string
@@ -428,14 +467,14 @@ GCodeWriter::extrude_to_xyz(const Pointf3 &point, double dE, const std::string &
     this->_lifted = 0;
     this->_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<   " Z" << XYZF_NUM(point.z)
-          <<    " " << this->_extrusion_axis << E_NUM(this->_extruder->E);
+    std::string gcode;
+    gcode += "G1 X"; XYZF_NUM(point.x);
+    gcode +=  " Y";  XYZF_NUM(point.y);
+    gcode +=  " Z";  XYZF_NUM(point.z);
+    gcode +=  " ";   gcode += this->_extrusion_axis; E_NUM(this->_extruder->E);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += "\n";
+    return gcode;
 }
 
 std::string
@@ -462,10 +501,8 @@ GCodeWriter::retract_for_toolchange()
 std::string
 GCodeWriter::_retract(double length, double restart_extra, const std::string &comment, bool long_retract)
 {
-    std::ostringstream gcode;
-    std::ostringstream outcomment;
-
-    outcomment << comment;
+    std::string gcode;
+    std::string outcomment = comment;
     
     /*  If firmware retraction is enabled, we use a fake value of 1
         since we ignore the actual configured retract_length which 
@@ -482,56 +519,64 @@ GCodeWriter::_retract(double length, double restart_extra, const std::string &co
 
     double dE = this->_extruder->retract(length, restart_extra);
     if (dE != 0) {
-        outcomment << " extruder " << this->_extruder->id;
+        outcomment += " extruder ";
+        GCodeFormatter::append_int(&outcomment, this->_extruder->id);
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
-                gcode << "G22";
+                gcode += "G22";
             else if ((FLAVOR_IS(gcfRepRap) || FLAVOR_IS(gcfRepetier)) && long_retract)
-                gcode << "G10 S1";
+                gcode += "G10 S1";
             else
-                gcode << "G10";
+                gcode += "G10";
         } else {
-            gcode << "G1 " << this->_extrusion_axis << E_NUM(this->_extruder->E)
-                           << " F" << this->_extruder->retract_speed_mm_min;
+            // the feedrate has always been written with the precision of E
+            gcode += "G1 "; gcode += this->_extrusion_axis; E_NUM(this->_extruder->E);
+            gcode += " F";  E_NUM(this->_extruder->retract_speed_mm_min);
         }
-        COMMENT(outcomment.str());
-        gcode << "\n";
+        COMMENT(outcomment);
+        gcode += "\n";
     }
     
     if (FLAVOR_IS(gcfMakerWare))
-        gcode << "M103 ; extruder off\n";
+        gcode += "M103 ; extruder off\n";
     
-    return gcode.str();
+    return gcode;
 }
 
 std::string
 GCodeWriter::unretract()
 {
-    std::ostringstream gcode;
+    std::string gcode;
     
     if (FLAVOR_IS(gcfMakerWare))
-        gcode << "M101 ; extruder on\n";
+        gcode += "M101 ; extruder on\n";
     
     double dE = this->_extruder->unretract();
     if (dE != 0) {
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
-                 gcode << "G23";
+                 gcode += "G23";
             else
-                 gcode << "G11";
-            if (this->config.gcode_comments) gcode << " ; unretract extruder " << this->_extruder->id;
-            gcode << "\n";
-            gcode << this->reset_e();
+                 gcode += "G11";
+            if (this->config.gcode_comments) {
+                gcode += " ; unretract extruder ";
+                GCodeFormatter::append_int(&gcode, this->_extruder->id);
+            }
+            gcode += "\n";
+            gcode += this->reset_e();
         } else {
             // use G1 instead of G0 because G0 will blend the restart with the previous travel move
-            gcode << "G1 " << this->_extrusion_axis << E_NUM(this->_extruder->E)
-                           << " F" << this->_extruder->retract_speed_mm_min;
-            if (this->config.gcode_comments) gcode << " ; unretract extruder " << this->_extruder->id;
-            gcode << "\n";
+            gcode += "G1 "; gcode += this->_extrusion_axis; E_NUM(this->_extruder->E);
+            gcode += " F";  E_NUM(this->_extruder->retract_speed_mm_min);
+            if (this->config.gcode_comments) {
+                gcode += " ; unretract extruder ";
+                GCodeFormatter::append_int(&gcode, this->_extruder->id);
+            }
+            gcode += "\n";
         }
     }
     
-    return gcode.str();
+    return gcode;
 }
 
 /*  If this method is called more than once before calling unlift(),
@@ -571,4 +616,42 @@ GCodeWriter::unlift()
     return gcode;
 }
 
+bool
+GCodeWriter::State::operator==(const State &other) const
+{
+    return this->position.x == other.position.x
+        && this->position.y == other.position.y
+        && this->position.z == other.position.z
+        && this->lifted == other.lifted
+        && this->extruder == other.extruder
+        && this->extruders == other.extruders;
+}
+
+GCodeWriter::State
+GCodeWriter::state() const
+{
+    State state;
+    state.position = this->_pos;
+    state.lifted = this->_lifted;
+    if (this->_extruder != NULL)
+        state.extruder = this->_extruder->id;
+    for (const auto &e : this->extruders)
+        state.extruders[e.first] = {{ e.second.E, e.second.retracted, e.second.restart_extra }};
+    return state;
+}
+
+void
+GCodeWriter::set_state(const State &state)
+{
+    this->_pos = state.position;
+    this->_lifted = state.lifted;
+    this->_extruder = state.extruder < 0 ? NULL : &this->extruders.find(state.extruder)->second;
+    for (const auto &e : state.extruders) {
+        Extruder &extruder = this->extruders.find(e.first)->second;
+        extruder.E              = e.second[0];
+        extruder.retracted      = e.second[1];
+        extruder.restart_extra  = e.second[2];
+    }
+}
+
 }
@@ -2,6 +2,7 @@
 #define slic3r_GCodeWriter_hpp_
 
 #include "libslic3r.h"
+#include <array>
 #include <string>
 #include "Extruder.hpp"
 #include "Point.hpp"
@@ -56,11 +57,19 @@ public:
     std::string set_extruder(unsigned int extruder_id);
     std::string toolchange(unsigned int extruder_id);
     std::string set_speed(double F, const std::string &comment = std::string(), const std::string &cooling_marker = std::string()) const;
+    /// Same as set_speed() but appends to gcode instead of returning a new string.
+    void set_speed(std::string* gcode, double F, const std::string &comment = std::string(), const std::string &cooling_marker = std::string()) const;
     std::string travel_to_xy(const Pointf &point, const std::string &comment = std::string());
+    /// Same as travel_to_xy() but appends to gcode instead of returning a new string.
+    void travel_to_xy(std::string* gcode, const Pointf &point, const std::string &comment = std::string());
     std::string travel_to_xyz(const Pointf3 &point, const std::string &comment = std::string());
     std::string travel_to_z(double z, const std::string &comment = std::string());
     bool will_move_z(double z) const;
     std::string extrude_to_xy(const Pointf &point, double dE, const std::string &comment = std::string());
+    /// Same as extrude_to_xy() but appends to gcode instead of returning a new string.
+    void extrude_to_xy(std::string* gcode, const Pointf &point, double dE, const std::string &comment = std::string());
+    /// Extrudes along an arc of circle (G2/G3) to point; center is relative to the current position.
+    void extrude_arc_to_xy(std::string* gcode, const Pointf &point, const Pointf &center, bool ccw, double dE, const std::string &comment = std::string());
     std::string extrude_to_xyz(const Pointf3 &point, double dE, const std::string &comment = std::string());
     std::string retract();
     std::string retract_for_toolchange();
@@ -68,6 +77,21 @@ public:
     std::string lift();
     std::string unlift();
     Pointf3 get_position() const { return this->_pos; }
+
+    /// What the moves written next depend on: the position, the lift, the
+    /// current extruder and the E, retraction and restart extra of each
+    /// extruder. The filament used so far is not part of it.
+    struct State {
+        Pointf3 position;
+        double lifted {0};
+        int extruder {-1};
+        std::map<unsigned int,std::array<double,3>> extruders;
+        bool operator==(const State &other) const;
+        bool operator!=(const State &other) const { return !(*this == other); }
+    };
+    State state() const;
+    /// Continues from a state taken from a writer with the same extruders, without writing anything.
+    void set_state(const State &state);
 private:
     std::string _extrusion_axis;
     Extruder* _extruder;
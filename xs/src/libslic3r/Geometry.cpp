@@ -1,4 +1,5 @@
 #include "Geometry.hpp"
+#include "ChainedPath.hpp"
 #include "ClipperUtils.hpp"
 #include "ExPolygon.hpp"
 #include "Line.hpp"
@@ -250,20 +251,19 @@ convex_hull(const Polygons &polygons)
 void
 chained_path(const Points &points, std::vector<Points::size_type> &retval, Point start_near)
 {
-    PointConstPtrs my_points;
-    std::map<const Point*,Points::size_type> indices;
-    my_points.reserve(points.size());
-    for (Points::const_iterator it = points.begin(); it != points.end(); ++it) {
-        my_points.push_back(&*it);
-        indices[&*it] = it - points.begin();
-    }
+    // ties are resolved like Point::nearest_point_index() would do
+    ChainingIndex index(ChainingIndex::tbLast);
+    index.reserve(points.size());
+    for (Points::const_iterator it = points.begin(); it != points.end(); ++it)
+        index.add(*it, it - points.begin());
+    index.build();
     
     retval.reserve(points.size());
-    while (!my_points.empty()) {
-        Points::size_type idx = start_near.nearest_point_index(my_points);
-        start_near = *my_points[idx];
-        retval.push_back(indices[ my_points[idx] ]);
-        my_points.erase(my_points.begin() + idx);
+    while (!index.empty()) {
+        const size_t idx = index.nearest(start_near);
+        start_near = index.point(idx);
+        retval.push_back(index.item(idx));
+        index.remove_item(index.item(idx));
     }
 }
 
@@ -448,6 +448,96 @@ circle_taubin_newton(const Pointfs::const_iterator& input_begin, const Pointfs::
     
 }
 
+static inline double
+cross(const Pointf &o, const Pointf &a, const Pointf &b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static inline double
+distance(const Pointf &a, const Pointf &b)
+{
+    return std::hypot(b.x - a.x, b.y - a.y);
+}
+
+/// Signed angle between the segments a-b and b-c.
+static inline double
+turn(const Pointf &a, const Pointf &b, const Pointf &c)
+{
+    return std::atan2((b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x),
+        (b.x - a.x) * (c.x - b.x) + (b.y - a.y) * (c.y - b.y));
+}
+
+/// Whether points[start..end] fit an arc, whose center is stored in center.
+static bool
+fits_arc(const Pointfs& points, size_t start, size_t end, double tolerance, Pointf* center)
+{
+    *center = circle_taubin_newton(points.cbegin() + start, points.cbegin() + end + 1);
+    // the arc goes from the first point, so its radius is the distance to it
+    const double radius = distance(*center, points[start]);
+    if (!(radius > 0)) return false;    // also catches a failed fit
+    for (size_t i = start + 1; i <= end; ++i) {
+        const Pointf middle((points[i-1].x + points[i].x) / 2, (points[i-1].y + points[i].y) / 2);
+        if (std::abs(distance(*center, points[i]) - radius) > tolerance
+            || std::abs(distance(*center, middle) - radius) > tolerance)
+            return false;
+    }
+    return true;
+}
+
+FittedArcs
+fit_arcs(const Pointfs& points, double tolerance, size_t min_segments, double max_turn)
+{
+    FittedArcs arcs;
+    if (min_segments < 2) min_segments = 2;
+    size_t start = 0;
+    while (start + min_segments < points.size()) {
+        // longest run of segments turning the same way by small angles
+        const double first_turn = turn(points[start], points[start+1], points[start+2]);
+        size_t end = start;
+        if (first_turn != 0 && std::abs(first_turn) <= max_turn) {
+            double total_turn = std::abs(first_turn);
+            end = start + 2;
+            while (end + 1 < points.size()) {
+                const double t = turn(points[end-1], points[end], points[end+1]);
+                if (t * first_turn <= 0 || std::abs(t) > max_turn || total_turn + std::abs(t) > PI) break;
+                total_turn += std::abs(t);
+                ++end;
+            }
+        }
+        
+        // the longest part of it that fits an arc
+        FittedArc arc;
+        if (end >= start + min_segments && fits_arc(points, start, start + min_segments, tolerance, &arc.center)) {
+            size_t good = start + min_segments;
+            if (fits_arc(points, start, end, tolerance, &arc.center)) {
+                good = end;
+            } else {
+                size_t bad = end;
+                while (bad - good > 1) {
+                    const size_t mid = (good + bad) / 2;
+                    Pointf center;
+                    if (fits_arc(points, start, mid, tolerance, &center)) {
+                        good = mid;
+                    } else {
+                        bad = mid;
+                    }
+                }
+                fits_arc(points, start, good, tolerance, &arc.center);
+            }
+            arc.start = start;
+            arc.end   = good;
+            // counter-clockwise when the center is on the left of the first segment
+            arc.ccw   = cross(points[start], points[start+1], arc.center) > 0;
+            arcs.push_back(arc);
+            start = good;
+        } else {
+            ++start;
+        }
+    }
+    return arcs;
+}
+
 /*
 == Perl implementations for methods tested in geometry.t but not translated.  ==
 == The first three are unreachable in the current perl code and the fourth is ==
@@ -33,6 +33,22 @@ Point circle_taubin_newton(const Points::const_iterator& input_start, const Poin
 Pointf circle_taubin_newton(const Pointfs& input, size_t cycles = 20);
 Pointf circle_taubin_newton(const Pointfs::const_iterator& input_start, const Pointfs::const_iterator& input_end, size_t cycles = 20);
 
+/// A run of segments of a polyline that can be replaced by an arc of circle:
+/// the points from start to end (indices in the polyline) lie on the arc.
+struct FittedArc {
+    size_t start;
+    size_t end;
+    Pointf center;
+    bool ccw;
+};
+typedef std::vector<FittedArc> FittedArcs;
+
+/// Find the runs of at least min_segments segments of a polyline that follow
+/// an arc of circle: the points, as well as the middle of the segments, are
+/// within tolerance of the circle fitted with circle_taubin_newton().
+/// An arc turns at most by max_turn between two segments and by half a circle overall.
+FittedArcs fit_arcs(const Pointfs& points, double tolerance, size_t min_segments = 3, double max_turn = PI/12);
+
 /// Epsilon value
 // FIXME: this is a duplicate from libslic3r.h
 constexpr double epsilon { 1e-4 };
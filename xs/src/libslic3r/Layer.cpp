@@ -161,7 +161,7 @@ template bool Layer::any_bottom_region_slice_contains<Polyline>(const Polyline &
 /// The perimeter paths and the thin fills (ExtrusionEntityCollection) are assigned to the first compatible layer region.
 /// The resulting fill surface is split back among the originating regions.
 void
-Layer::make_perimeters()
+Layer::make_perimeters(int threads)
 {
     #ifdef SLIC3R_DEBUG
     printf("Making perimeters for layer %zu\n", this->id());
@@ -198,7 +198,7 @@ Layer::make_perimeters()
         
         if (layerms.size() == 1) {  // optimization
             (*layerm)->fill_surfaces.surfaces.clear();
-            (*layerm)->make_perimeters((*layerm)->slices, &(*layerm)->fill_surfaces);
+            (*layerm)->make_perimeters((*layerm)->slices, &(*layerm)->fill_surfaces, threads);
         } else {
             // group slices (surfaces) according to number of extra perimeters
             std::map<unsigned short,Surfaces> slices;  // extra_perimeters => [ surface, surface... ]
@@ -221,7 +221,7 @@ Layer::make_perimeters()
             
             // make perimeters
             SurfaceCollection fill_surfaces;
-            (*layerm)->make_perimeters(new_slices, &fill_surfaces);
+            (*layerm)->make_perimeters(new_slices, &fill_surfaces, threads);
             
             // assign fill_surfaces to each layer
             if (!fill_surfaces.surfaces.empty()) {
@@ -445,4 +445,18 @@ Layer::process_external_surfaces()
         layerm->process_external_surfaces();
 }
 
+void
+Layer::compact_geometry(size_t* unpacked_bytes, size_t* packed_bytes)
+{
+    for (LayerRegion* &layerm : this->regions)
+        layerm->compact_geometry(unpacked_bytes, packed_bytes);
+}
+
+void
+Layer::expand_geometry()
+{
+    for (LayerRegion* &layerm : this->regions)
+        layerm->expand_geometry();
+}
+
 }
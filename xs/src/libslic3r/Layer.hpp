@@ -2,6 +2,7 @@
 #define slic3r_Layer_hpp_
 
 #include "libslic3r.h"
+#include "CompactGeometry.hpp"
 #include "Flow.hpp"
 #include "SurfaceCollection.hpp"
 #include "ExtrusionEntityCollection.hpp"
@@ -62,14 +63,33 @@ class LayerRegion
     void merge_slices();
     /// Preprocesses fill surfaces
     void prepare_fill_surfaces();
-    /// Generates and stores the perimeters and thin fills
-    void make_perimeters(const SurfaceCollection &slices, SurfaceCollection* fill_surfaces);
+    /// Generates and stores the perimeters and thin fills, processing the islands
+    /// with the given number of threads
+    void make_perimeters(const SurfaceCollection &slices, SurfaceCollection* fill_surfaces, int threads = 1);
     /// Generate infills for a LayerRegion.
     void make_fill();
     /// Processes external surfaces for bridges and top/bottom surfaces
     void process_external_surfaces();
     /// Gets the smallest fillable area
     double infill_area_threshold() const;
+
+    /// Packs the surfaces, polygons and extrusions of the region and clears
+    /// them. The G-code export reads the slices, perimeters and fills through
+    /// the accessors below, which decode them one layer at a time.
+    /// The memory used before and after packing is added to the counters.
+    void compact_geometry(size_t* unpacked_bytes, size_t* packed_bytes);
+    /// Restores the geometry packed by compact_geometry(), if any.
+    void expand_geometry();
+    bool is_compact() const { return this->_compact; };
+
+    /// The slices, perimeters and fills of the region: the members themselves,
+    /// or, while the region is compacted, their copy decoded into *decoded.
+    const SurfaceCollection& get_slices(SurfaceCollection* decoded) const;
+    const ExtrusionEntityCollection& get_perimeters(ExtrusionEntityCollection* decoded) const;
+    const ExtrusionEntityCollection& get_fills(ExtrusionEntityCollection* decoded) const;
+    /// items_count() of the perimeters and fills, without decoding them.
+    size_t perimeters_items_count() const;
+    size_t fills_items_count() const;
     
     private:
     /// Pointer to associated Layer
@@ -79,9 +99,19 @@ class LayerRegion
     /// Mutex object for slices.
     mutable boost::mutex _slices_mutex;
 
+    /// Packed geometry while the region is compacted.
+    bool _compact;
+    CompactSurfaces _compact_slices;
+    CompactExtrusions _compact_thin_fills;
+    CompactSurfaces _compact_fill_surfaces;
+    CompactPolygons _compact_bridged;
+    CompactPolygons _compact_unsupported_bridge_edges;
+    CompactExtrusions _compact_perimeters;
+    CompactExtrusions _compact_fills;
+
     ///Constructor
     LayerRegion(Layer *layer, PrintRegion *region)
-        : _layer(layer), _region(region) {};
+        : _layer(layer), _region(region), _compact(false) {};
     ///Destructor
     ~LayerRegion() {};
 };
@@ -130,13 +160,17 @@ class Layer {
     /// Template which iterates over all of the LayerRegion for containing on the bottom the argument
     template <class T> bool any_bottom_region_slice_contains(const T &item) const;
     /// Creates the perimeters cummulatively for all layer regions sharing the same parameters influencing the perimeters.
-    void make_perimeters();
+    void make_perimeters(int threads = 1);
     /// Makes fills for all the LayerRegion
     void make_fills();
     /// Determines the type of surface (top/bottombridge/bottom/internal) each region is
     void detect_surfaces_type();
     /// Processes the external surfaces
     void process_external_surfaces();
+    /// Packs the geometry of all regions, see LayerRegion::compact_geometry().
+    void compact_geometry(size_t* unpacked_bytes, size_t* packed_bytes);
+    /// Restores the geometry of all regions.
+    void expand_geometry();
 
     /// polymorphic id
     virtual bool is_support() const { return false;}
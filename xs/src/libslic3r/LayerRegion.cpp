@@ -38,7 +38,7 @@ LayerRegion::merge_slices()
 /// Creates a new PerimeterGenerator object
 /// Which will return the perimeters by its construction
 void
-LayerRegion::make_perimeters(const SurfaceCollection &slices, SurfaceCollection* fill_surfaces)
+LayerRegion::make_perimeters(const SurfaceCollection &slices, SurfaceCollection* fill_surfaces, int threads)
 {
     this->perimeters.clear();
     this->thin_fills.clear();
@@ -66,6 +66,7 @@ LayerRegion::make_perimeters(const SurfaceCollection &slices, SurfaceCollection*
     g.ext_perimeter_flow    = this->flow(frExternalPerimeter);
     g.overhang_flow         = this->region()->flow(frPerimeter, -1, true, false, -1, *this->layer()->object());
     g.solid_infill_flow     = this->flow(frSolidInfill);
+    g.threads               = threads;
     
     g.process();
 }
@@ -277,4 +278,103 @@ LayerRegion::infill_area_threshold() const
     return ss*ss;
 }
 
+void
+LayerRegion::compact_geometry(size_t* unpacked_bytes, size_t* packed_bytes)
+{
+    if (this->_compact) return;
+
+    *unpacked_bytes += memory_usage(this->slices.surfaces)
+        + memory_usage(this->thin_fills)
+        + memory_usage(this->fill_surfaces.surfaces)
+        + memory_usage(this->bridged)
+        + memory_usage(this->unsupported_bridge_edges.polylines)
+        + memory_usage(this->perimeters)
+        + memory_usage(this->fills);
+
+    this->_compact_slices = CompactSurfaces(this->slices.surfaces);
+    this->_compact_thin_fills = CompactExtrusions(this->thin_fills);
+    this->_compact_fill_surfaces = CompactSurfaces(this->fill_surfaces.surfaces);
+    this->_compact_bridged = CompactPolygons(this->bridged);
+    this->_compact_unsupported_bridge_edges = CompactPolygons(this->unsupported_bridge_edges.polylines);
+    this->_compact_perimeters = CompactExtrusions(this->perimeters);
+    this->_compact_fills = CompactExtrusions(this->fills);
+
+    // swap with empty containers to actually release the memory
+    Surfaces().swap(this->slices.surfaces);
+    ExtrusionEntityCollection().swap(this->thin_fills);
+    Surfaces().swap(this->fill_surfaces.surfaces);
+    Polygons().swap(this->bridged);
+    Polylines().swap(this->unsupported_bridge_edges.polylines);
+    ExtrusionEntityCollection().swap(this->perimeters);
+    ExtrusionEntityCollection().swap(this->fills);
+    this->_compact = true;
+
+    *packed_bytes += this->_compact_slices.memory_usage()
+        + this->_compact_thin_fills.memory_usage()
+        + this->_compact_fill_surfaces.memory_usage()
+        + this->_compact_bridged.memory_usage()
+        + this->_compact_unsupported_bridge_edges.memory_usage()
+        + this->_compact_perimeters.memory_usage()
+        + this->_compact_fills.memory_usage();
+}
+
+void
+LayerRegion::expand_geometry()
+{
+    if (!this->_compact) return;
+
+    this->slices.surfaces = this->_compact_slices.surfaces();
+    this->_compact_thin_fills.collection(&this->thin_fills);
+    this->fill_surfaces.surfaces = this->_compact_fill_surfaces.surfaces();
+    this->bridged = this->_compact_bridged.polygons();
+    this->unsupported_bridge_edges.polylines = this->_compact_unsupported_bridge_edges.polylines();
+    this->_compact_perimeters.collection(&this->perimeters);
+    this->_compact_fills.collection(&this->fills);
+
+    this->_compact_slices = CompactSurfaces();
+    this->_compact_thin_fills = CompactExtrusions();
+    this->_compact_fill_surfaces = CompactSurfaces();
+    this->_compact_bridged = CompactPolygons();
+    this->_compact_unsupported_bridge_edges = CompactPolygons();
+    this->_compact_perimeters = CompactExtrusions();
+    this->_compact_fills = CompactExtrusions();
+    this->_compact = false;
+}
+
+const SurfaceCollection&
+LayerRegion::get_slices(SurfaceCollection* decoded) const
+{
+    if (!this->_compact) return this->slices;
+    decoded->surfaces = this->_compact_slices.surfaces();
+    return *decoded;
+}
+
+const ExtrusionEntityCollection&
+LayerRegion::get_perimeters(ExtrusionEntityCollection* decoded) const
+{
+    if (!this->_compact) return this->perimeters;
+    this->_compact_perimeters.collection(decoded);
+    return *decoded;
+}
+
+const ExtrusionEntityCollection&
+LayerRegion::get_fills(ExtrusionEntityCollection* decoded) const
+{
+    if (!this->_compact) return this->fills;
+    this->_compact_fills.collection(decoded);
+    return *decoded;
+}
+
+size_t
+LayerRegion::perimeters_items_count() const
+{
+    return this->_compact ? this->_compact_perimeters.items_count() : this->perimeters.items_count();
+}
+
+size_t
+LayerRegion::fills_items_count() const
+{
+    return this->_compact ? this->_compact_fills.items_count() : this->fills.items_count();
+}
+
 }
@@ -1,5 +1,10 @@
 #include "BoundingBox.hpp"
 #include "MotionPlanner.hpp"
+#include "PointKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
 #include <limits> // for numeric_limits
 #include <assert.h>
 
@@ -65,11 +70,21 @@ MotionPlanner::initialize()
     this->outer.island = outer.front();
     
     this->outer.env = ExPolygonCollection(diff_ex(contour, offset(outer_holes, +MP_OUTER_MARGIN)));
+    this->outer.build_index();
     
     this->graphs.resize(this->islands.size() + 1, NULL);
     this->initialized = true;
 }
 
+void
+MotionPlanner::prepare()
+{
+    this->initialize();
+    if (!this->initialized) return;
+    for (int island_idx = -1; island_idx < int(this->islands.size()); ++island_idx)
+        this->init_graph(island_idx);
+}
+
 const MotionPlannerEnv&
 MotionPlanner::get_env(int island_idx) const
 {
@@ -105,7 +120,7 @@ MotionPlanner::shortest_path(const Point &from, const Point &to)
     this->initialize();
     
     // get environment
-    MotionPlannerEnv env = this->get_env(island_idx);
+    const MotionPlannerEnv &env = this->get_env(island_idx);
     if (env.env.expolygons.empty()) {
         // if this environment is empty (probably because it's too small), perform straight move
         // and avoid running the algorithms on empty dataset
@@ -119,7 +134,7 @@ MotionPlanner::shortest_path(const Point &from, const Point &to)
     if (island_idx == -1) {
         // TODO: instead of using the nearest_env_point() logic, we should
         // create a temporary graph where we connect 'from' and 'to' to the
-        // nodes which don't require more than one crossing, and let Dijkstra
+        // nodes which don't require more than one crossing, and let A*
         // figure out the entire path - this should also replace the call to
         // find_node() below
         if (!env.island.contains(inner_from)) {
@@ -140,14 +155,12 @@ MotionPlanner::shortest_path(const Point &from, const Point &to)
     polyline.points.push_back(to);
     
     {
-        // grow our environment slightly in order for simplify_by_visibility()
-        // to work best by considering moves on boundaries valid as well
-        ExPolygonCollection grown_env(offset_ex((Polygons)env.env, +SCALED_EPSILON));
-        
         if (island_idx == -1) {
+            const ExPolygonCollection &grown_env = env.grown_env;
+            
             /*  If 'from' or 'to' are not inside our env, they were connected using the 
                 nearest_env_point() search which maybe produce ugly paths since it does not
-                include the endpoint in the Dijkstra search; the simplify_by_visibility() 
+                include the endpoint in the A* search; the simplify_by_visibility() 
                 call below will not work in many cases where the endpoint is not contained in
                 grown_env (whose contour was arbitrarily constructed with MP_OUTER_MARGIN,
                 which may not be enough for, say, including a skirt point). So we prune
@@ -155,12 +168,12 @@ MotionPlanner::shortest_path(const Point &from, const Point &to)
             if (!grown_env.contains(from)) {
                 // delete second point while the line connecting first to third crosses the
                 // boundaries as many times as the current first to second
-                while (polyline.points.size() > 2 && intersection_ln(Line(from, polyline.points[2]), grown_env).size() == 1) {
+                while (polyline.points.size() > 2 && env.grown_env_clipper.clip(Line(from, polyline.points[2])).size() == 1) {
                     polyline.points.erase(polyline.points.begin() + 1);
                 }
             }
             if (!grown_env.contains(to)) {
-                while (polyline.points.size() > 2 && intersection_ln(Line(*(polyline.points.end() - 3), to), grown_env).size() == 1) {
+                while (polyline.points.size() > 2 && env.grown_env_clipper.clip(Line(*(polyline.points.end() - 3), to)).size() == 1) {
                     polyline.points.erase(polyline.points.end() - 2);
                 }
             }
@@ -213,12 +226,8 @@ MotionPlanner::init_graph(int island_idx)
         typedef voronoi_diagram<double> VD;
         VD vd;
         
-        // mapping between Voronoi vertices and graph nodes
-        typedef std::map<const VD::vertex_type*,size_t> t_vd_vertices;
-        t_vd_vertices vd_vertices;
-        
         // get boundaries as lines
-        MotionPlannerEnv env = this->get_env(island_idx);
+        const MotionPlannerEnv &env = this->get_env(island_idx);
         Lines lines = env.env.lines();
         boost::polygon::construct_voronoi(lines.begin(), lines.end(), &vd);
         
@@ -234,34 +243,98 @@ MotionPlanner::init_graph(int island_idx)
             // skip edge if any of its endpoints is outside our configuration space
             if (!env.island.contains_b(p0) || !env.island.contains_b(p1)) continue;
             
-            t_vd_vertices::const_iterator i_v0 = vd_vertices.find(v0);
-            size_t v0_idx;
-            if (i_v0 == vd_vertices.end()) {
+            // the color of a Voronoi vertex stores the index of its graph node plus one
+            if (v0->color() == 0) {
                 graph->nodes.push_back(p0);
-                vd_vertices[v0] = v0_idx = graph->nodes.size()-1;
-            } else {
-                v0_idx = i_v0->second;
+                v0->color(graph->nodes.size());
             }
-            
-            t_vd_vertices::const_iterator i_v1 = vd_vertices.find(v1);
-            size_t v1_idx;
-            if (i_v1 == vd_vertices.end()) {
+            const size_t v0_idx = v0->color() - 1;
+            if (v1->color() == 0) {
                 graph->nodes.push_back(p1);
-                vd_vertices[v1] = v1_idx = graph->nodes.size()-1;
-            } else {
-                v1_idx = i_v1->second;
+                v1->color(graph->nodes.size());
             }
+            const size_t v1_idx = v1->color() - 1;
             
             // Euclidean distance is used as weight for the graph edge
             double dist = graph->nodes[v0_idx].distance_to(graph->nodes[v1_idx]);
             graph->add_edge(v0_idx, v1_idx, dist);
         }
+        graph->build_index();
         
         return graph;
     }
     return this->graphs[island_idx + 1];
 }
 
+LineClipper::LineClipper(const ExPolygons &expolygons)
+    : polygons(to_polygons(expolygons))
+{
+    this->bbs.reserve(this->polygons.size());
+    for (const Polygon &polygon : this->polygons)
+        this->bbs.push_back(polygon.bounding_box());
+}
+
+Lines
+LineClipper::clip(const Line &line) const
+{
+    // a polygon that neither crosses nor contains the line doesn't change
+    // the winding number along it
+    const coord_t min_x = std::min(line.a.x, line.b.x), max_x = std::max(line.a.x, line.b.x);
+    const coord_t min_y = std::min(line.a.y, line.b.y), max_y = std::max(line.a.y, line.b.y);
+    const double dx = line.b.x - line.a.x, dy = line.b.y - line.a.y;
+    // distance of a point to the line, signed by the side, times the length of the line
+    const auto side = [&line, dx, dy] (coord_t x, coord_t y) {
+        return dx * double(y - line.a.y) - dy * double(x - line.a.x);
+    };
+    const double margin = SCALED_EPSILON * std::sqrt(dx*dx + dy*dy);
+    Polygons near;
+    for (size_t i = 0; i < this->polygons.size(); ++i) {
+        const BoundingBox &bb = this->bbs[i];
+        if (bb.min.x > max_x || bb.max.x < min_x || bb.min.y > max_y || bb.max.y < min_y)
+            continue;
+        // skip the boxes entirely on one side of a diagonal line
+        const double corners[4] = { side(bb.min.x, bb.min.y), side(bb.max.x, bb.min.y), side(bb.max.x, bb.max.y), side(bb.min.x, bb.max.y) };
+        if (*std::min_element(corners, corners + 4) > margin || *std::max_element(corners, corners + 4) < -margin)
+            continue;
+        near.push_back(this->polygons[i]);
+    }
+    return intersection_ln((Lines)line, near);
+}
+
+void
+MotionPlannerEnv::build_index()
+{
+    const auto index = [] (PointSet* set) {
+        if (set->points.empty()) return;
+        set->bb = BoundingBox(set->points);
+        set->index.reserve(set->points.size());
+        for (size_t i = 0; i < set->points.size(); ++i)
+            set->index.add(Point(set->points[i].x * 2, set->points[i].y * 2), i);
+        set->index.build();
+    };
+    
+    // grow our environment slightly in order for simplify_by_visibility()
+    // to work best by considering moves on boundaries valid as well
+    this->grown_env = ExPolygonCollection(offset_ex((Polygons)this->env, +SCALED_EPSILON));
+    this->grown_env_clipper = LineClipper(this->grown_env.expolygons);
+    this->island_clipper = LineClipper(ExPolygons { this->island });
+    
+    this->holes.clear();
+    this->contours = PointSet();
+    for (size_t i = 0; i < this->env.expolygons.size(); ++i) {
+        const ExPolygon &expolygon = this->env.expolygons[i];
+        for (const Polygon &hole : expolygon.holes) {
+            this->holes.push_back(PointSet());
+            this->holes.back().expolygon = i;
+            this->holes.back().points = hole.points;
+            index(&this->holes.back());
+        }
+        this->contours.points.insert(this->contours.points.end(), expolygon.contour.points.begin(), expolygon.contour.points.end());
+    }
+    index(&this->contours);
+    this->indexed = true;
+}
+
 Point
 MotionPlannerEnv::nearest_env_point(const Point &from, const Point &to) const
 {
@@ -272,33 +345,61 @@ MotionPlannerEnv::nearest_env_point(const Point &from, const Point &to) const
     /*  Assume that this method is never called when 'env' contains 'from';
         so 'from' is either inside a hole or outside all contours */
     
-    // get the points of the hole containing 'from', if any
-    Points pp;
-    for (ExPolygons::const_iterator ex = this->env.expolygons.begin(); ex != this->env.expolygons.end(); ++ex) {
-        for (Polygons::const_iterator h = ex->holes.begin(); h != ex->holes.end(); ++h) {
-            if (h->contains(from)) {
-                pp = *h;
+    if (!this->indexed) {
+        // get the points of the hole containing 'from', if any
+        Points pp;
+        for (ExPolygons::const_iterator ex = this->env.expolygons.begin(); ex != this->env.expolygons.end(); ++ex) {
+            for (Polygons::const_iterator h = ex->holes.begin(); h != ex->holes.end(); ++h) {
+                if (h->contains(from)) {
+                    pp = *h;
+                }
+            }
+            if (!pp.empty()) break;
+        }
+        
+        /*  If 'from' is not inside a hole, it's outside of all contours, so take all
+            contours' points */
+        if (pp.empty()) {
+            for (ExPolygons::const_iterator ex = this->env.expolygons.begin(); ex != this->env.expolygons.end(); ++ex) {
+                Points contour_pp = ex->contour;
+                pp.insert(pp.end(), contour_pp.begin(), contour_pp.end());
             }
         }
-        if (!pp.empty()) break;
+        return this->_nearest_env_point(pp, from, to);
     }
     
-    /*  If 'from' is not inside a hole, it's outside of all contours, so take all
-        contours' points */
-    if (pp.empty()) {
-        for (ExPolygons::const_iterator ex = this->env.expolygons.begin(); ex != this->env.expolygons.end(); ++ex) {
-            Points contour_pp = ex->contour;
-            pp.insert(pp.end(), contour_pp.begin(), contour_pp.end());
-        }
+    // same search as above through the indexes
+    const PointSet* set = nullptr;
+    for (const PointSet &hole : this->holes) {
+        if (set != nullptr && hole.expolygon != set->expolygon) break;
+        if (hole.bb.contains(from) && PointKernels::polygon_contains(hole.points, from))
+            set = &hole;
     }
+    if (set == nullptr) set = &this->contours;
     
+    const Points &pp = set->points;
+    if (pp.size() < 2) return this->_nearest_env_point(pp, from, to);
+    
+    // the first candidate is usually the right one
+    const int result = set->index.nearest(Point(from.x + to.x, from.y + to.y));
+    if (this->island_clipper.clip(Line(from, pp[result])).size() <= 1)
+        return pp[result];
+    Points candidates = pp;
+    candidates.erase(candidates.begin() + result);
+    return this->_nearest_env_point(candidates, from, to);
+}
+
+Point
+MotionPlannerEnv::_nearest_env_point(Points pp, const Point &from, const Point &to) const
+{
     /*  Find the candidate result and check that it doesn't cross too many boundaries. */
     while (pp.size() >= 2) {
         // find the point in pp that is closest to both 'from' and 'to'
         size_t result = from.nearest_waypoint_index(pp, to);
         
         // as we assume 'from' is outside env, any node will require at least one crossing
-        if (intersection_ln(Line(from, pp[result]), this->island).size() > 1) {
+        const Line line(from, pp[result]);
+        if ((this->indexed ? this->island_clipper.clip(line) : intersection_ln(line, this->island)).size() > 1) {
             // discard result
             pp.erase(pp.begin() + result);
         } else {
@@ -326,6 +427,16 @@ MotionPlannerGraph::add_edge(node_t from, node_t to, double weight)
     this->adjacency_list[from].push_back(neighbor(to, weight));
 }
 
+void
+MotionPlannerGraph::build_index()
+{
+    this->node_index = ChainingIndex(ChainingIndex::tbLast);
+    this->node_index.reserve(this->nodes.size());
+    for (size_t i = 0; i < this->nodes.size(); ++i)
+        this->node_index.add(this->nodes[i], i);
+    this->node_index.build();
+}
+
 size_t
 MotionPlannerGraph::find_node(const Point &point) const
 {
@@ -334,81 +445,86 @@ MotionPlannerGraph::find_node(const Point &point) const
         if (p->coincides_with(point)) return p - this->nodes.begin();
     }
     */
-    return point.nearest_point_index(this->nodes);
+    if (this->node_index.empty())
+        return point.nearest_point_index(this->nodes);
+    return this->node_index.nearest(point);
 }
 
+/// Arrays of the searches run by a thread, reused from one search to the next.
+/// A node's cost and previous node are only valid if it was reached by the
+/// current search, as told by its stamp, so they are never cleared.
+struct MotionPlannerSearch {
+    std::vector<double> cost;
+    std::vector<int> previous;
+    std::vector<uint32_t> reached;
+    std::vector<uint32_t> closed;
+    std::vector<std::pair<double,int>> open;
+    uint32_t search = 0;
+};
+
 Polyline
-MotionPlannerGraph::shortest_path(node_t from, node_t to)
+MotionPlannerGraph::shortest_path(node_t from, node_t to) const
 {
     // this prevents a crash in case for some reason we got here with an empty adjacency list
     if (this->adjacency_list.empty()) return Polyline();
     
-    const weight_t max_weight = std::numeric_limits<weight_t>::infinity();
+    static thread_local MotionPlannerSearch scratch;
+    const size_t n = std::max(this->adjacency_list.size(), this->nodes.size());
+    if (scratch.reached.size() < n) {
+        scratch.cost.resize(n);
+        scratch.previous.resize(n);
+        scratch.reached.resize(n, 0);
+        scratch.closed.resize(n, 0);
+    }
+    if (++scratch.search == 0) {
+        std::fill(scratch.reached.begin(), scratch.reached.end(), 0);
+        std::fill(scratch.closed.begin(), scratch.closed.end(), 0);
+        scratch.search = 1;
+    }
+    const uint32_t search = scratch.search;
     
-    std::vector<weight_t> dist;
-    std::vector<node_t> previous;
-    {
-        // number of nodes
-        const int n = this->adjacency_list.size();
-        
-        // initialize dist and previous
-        dist.clear();
-        dist.resize(n, max_weight);
-        dist[from] = 0;  // distance from 'from' to itself
-        previous.clear();
-        previous.resize(n, -1);
+    // the open nodes are sorted by their cost plus their distance to the target
+    const Point &target = this->nodes[to];
+    std::vector<std::pair<weight_t,node_t>> &open = scratch.open;
+    const std::greater<std::pair<weight_t,node_t>> later;
+    open.clear();
+    scratch.cost[from]      = 0;
+    scratch.previous[from]  = -1;
+    scratch.reached[from]   = search;
+    open.push_back(std::make_pair(this->nodes[from].distance_to(target), from));
+    
+    while (!open.empty()) {
+        std::pop_heap(open.begin(), open.end(), later);
+        const node_t u = open.back().second;
+        open.pop_back();
+        if (scratch.closed[u] == search) continue;
+        scratch.closed[u] = search;
         
-        // initialize the Q with all nodes
-        std::set<node_t> Q;
-        for (node_t i = 0; i < n; ++i) Q.insert(i);
+        // stop searching if we reached our destination
+        if (u == to) break;
+        if ((size_t)u >= this->adjacency_list.size()) continue;
         
-        while (!Q.empty()) 
-        {
-            // get node in Q having the minimum dist ('from' in the first loop)
-            node_t u;
-            {
-                double min_dist = -1;
-                for (std::set<node_t>::const_iterator n = Q.begin(); n != Q.end(); ++n) {
-                    if (dist[*n] < min_dist || min_dist == -1) {
-                        u = *n;
-                        min_dist = dist[*n];
-                    }
-                }
-            }
-            Q.erase(u);
-            
-            // stop searching if we reached our destination
-            if (u == to) break;
-            
-            // Visit each edge starting from node u
-            const std::vector<neighbor> &neighbors = this->adjacency_list[u];
-            for (std::vector<neighbor>::const_iterator neighbor_iter = neighbors.begin();
-                 neighbor_iter != neighbors.end();
-                 ++neighbor_iter)
-            {
-                // neighbor node is v
-                node_t v = neighbor_iter->target;
-                
-                // skip if we already visited this
-                if (Q.find(v) == Q.end()) continue;
-                
-                // calculate total distance
-                weight_t alt = dist[u] + neighbor_iter->weight;
-                
-                // if total distance through u is shorter than the previous
-                // distance (if any) between 'from' and 'v', replace it
-                if (alt < dist[v]) {
-                    dist[v]     = alt;
-                    previous[v] = u;
-                }
-
+        for (const neighbor &edge : this->adjacency_list[u]) {
+            const node_t v = edge.target;
+            if (scratch.closed[v] == search) continue;
+            const weight_t cost = scratch.cost[u] + edge.weight;
+            if (scratch.reached[v] != search || cost < scratch.cost[v]) {
+                scratch.cost[v]     = cost;
+                scratch.previous[v] = u;
+                scratch.reached[v]  = search;
+                open.push_back(std::make_pair(cost + this->nodes[v].distance_to(target), v));
+                std::push_heap(open.begin(), open.end(), later);
             }
         }
     }
     
     Polyline polyline;
-    for (node_t vertex = to; vertex != -1; vertex = previous[vertex])
-        polyline.points.push_back(this->nodes[vertex]);
+    if (scratch.reached[to] == search) {
+        for (node_t vertex = to; vertex != -1; vertex = scratch.previous[vertex])
+            polyline.points.push_back(this->nodes[vertex]);
+    } else {
+        polyline.points.push_back(target);
+    }
     polyline.points.push_back(this->nodes[from]);
     polyline.reverse();
     return polyline;
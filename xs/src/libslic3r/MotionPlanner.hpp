@@ -2,6 +2,8 @@
 #define slic3r_MotionPlanner_hpp_
 
 #include "libslic3r.h"
+#include "BoundingBox.hpp"
+#include "ChainedPath.hpp"
 #include "ClipperUtils.hpp"
 #include "ExPolygonCollection.hpp"
 #include "Polyline.hpp"
@@ -16,6 +18,20 @@ constexpr coord_t MP_OUTER_MARGIN = scale_(2.0);
 
 class MotionPlanner;
 
+/// Clips lines like intersection_ln(), leaving out the polygons whose bounding
+/// box is away from the line since they can't change the result.
+class LineClipper
+{
+    public:
+    LineClipper() {};
+    LineClipper(const ExPolygons &expolygons);
+    Lines clip(const Line &line) const;
+    
+    private:
+    Polygons polygons;
+    std::vector<BoundingBox> bbs;
+};
+
 class MotionPlannerEnv
 {
     friend class MotionPlanner;
@@ -26,6 +42,30 @@ class MotionPlannerEnv
     MotionPlannerEnv() {};
     MotionPlannerEnv(const ExPolygon &island) : island(island) {};
     Point nearest_env_point(const Point &from, const Point &to) const;
+    /// Indexes the points of env for nearest_env_point() and grows it;
+    /// env must not change afterwards.
+    void build_index();
+    
+    private:
+    ExPolygonCollection grown_env;
+    LineClipper island_clipper;
+    LineClipper grown_env_clipper;
+    /// Points of a hole of env (or of all the contours), with their bounding
+    /// box and an index of the points doubled: the point nearest to both
+    /// 'from' and 'to' is the doubled point nearest to from + to.
+    struct PointSet {
+        /// Index in env of the expolygon the hole belongs to.
+        size_t expolygon {0};
+        BoundingBox bb;
+        Points points;
+        ChainingIndex index;
+        PointSet() : index(ChainingIndex::tbLast) {};
+    };
+    std::vector<PointSet> holes;
+    PointSet contours;
+    bool indexed = false;
+    
+    Point _nearest_env_point(Points pp, const Point &from, const Point &to) const;
 };
 
 class MotionPlannerGraph
@@ -44,12 +84,20 @@ class MotionPlannerGraph
     typedef std::vector< std::vector<neighbor> > adjacency_list_t;
     adjacency_list_t adjacency_list;
     
+    /// Spatial index of the positions of the nodes, giving the index in
+    /// nodes of the one nearest to a point, for find_node().
+    ChainingIndex node_index { ChainingIndex::tbLast };
+    
     public:
     Points nodes;
     //std::map<std::pair<size_t,size_t>, double> edges;
     void add_edge(node_t from, node_t to, double weight);
+    /// Indexes the nodes for find_node(); no node must be added afterwards.
+    void build_index();
     size_t find_node(const Point &point) const;
-    Polyline shortest_path(node_t from, node_t to);
+    /// A* search, the weights of the edges being their Euclidean length
+    /// (or more) so that the distance to the target is a lower bound.
+    Polyline shortest_path(node_t from, node_t to) const;
 };
 
 class MotionPlanner
@@ -57,6 +105,10 @@ class MotionPlanner
     public:
     MotionPlanner(const ExPolygons &islands);
     ~MotionPlanner();
+    /// Builds the configuration space and the graphs of all the islands,
+    /// which are otherwise built by the first query needing them. Once
+    /// prepared, the planner can be queried by several threads at once.
+    void prepare();
     Polyline shortest_path(const Point &from, const Point &to);
     size_t islands_count() const;
     
@@ -1,5 +1,6 @@
 #include "MultiPoint.hpp"
 #include "BoundingBox.hpp"
+#include <cassert>
 
 namespace Slic3r {
 
@@ -171,45 +172,103 @@ MultiPoint::dump_perl() const
     return ret.str();
 }
 
-//FIXME This is very inefficient in term of memory use.
-// The recursive algorithm shall run in place, not allocating temporary data in each recursion.
+static inline double
+_squared_distance(const Point &p, const Point &q)
+{
+    const double dx = (double)q.x - p.x;
+    const double dy = (double)q.y - p.y;
+    return dx*dx + dy*dy;
+}
+
+// Distance from a point to the segment (a, b), computed exactly like Point::distance_to(Line)
+// but inlined and with the segment delta and squared length hoisted out of the loop.
+static inline double
+_segment_distance(const Point &p, const Point &a, const Point &b, double dx, double dy, double l2)
+{
+    if (l2 == 0.0) return sqrt(_squared_distance(p, a));
+    const double t = ((p.x - a.x) * dx + (p.y - a.y) * dy) / l2;
+    if (t < 0.0)      return sqrt(_squared_distance(p, a));
+    else if (t > 1.0) return sqrt(_squared_distance(p, b));
+    const Point projection(lrint(a.x + t * dx), lrint(a.y + t * dy));
+    return sqrt(_squared_distance(p, projection));
+}
+
+// Scratch buffers of the Douglas-Peucker simplification, kept per thread so that
+// simplifying many paths doesn't allocate once the buffers have grown.
+struct DouglasPeuckerScratch {
+    std::vector<std::pair<size_t,size_t>> ranges;
+    std::vector<bool> keep;
+};
+
+// Marks the points kept by the Douglas-Peucker algorithm. The ranges still
+// to be split are kept on an explicit stack instead of recursing, the result
+// is the same as the one of the recursive formulation.
+static const std::vector<bool>&
+_douglas_peucker_mark(const Points &points, const double tolerance)
+{
+    static thread_local DouglasPeuckerScratch scratch;
+    std::vector<bool> &keep = scratch.keep;
+    std::vector<std::pair<size_t,size_t>> &ranges = scratch.ranges;
+    keep.assign(points.size(), false);
+    keep.front() = keep.back() = true;
+    ranges.clear();
+    ranges.emplace_back(0, points.size() - 1);
+
+    while (!ranges.empty()) {
+        const size_t first = ranges.back().first;
+        const size_t last  = ranges.back().second;
+        ranges.pop_back();
+        if (last - first < 2) continue;
+
+        const Point &a = points[first];
+        const Point &b = points[last];
+        const double dx = b.x - a.x;
+        const double dy = b.y - a.y;
+        const double l2 = dx*dx + dy*dy;
+        double dmax = 0;
+        size_t index = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            const Point &p = points[i];
+            // we use shortest distance, not perpendicular distance
+            const double d = _segment_distance(p, a, b, dx, dy, l2);
+            if (d > dmax) {
+                index = i;
+                dmax = d;
+            }
+        }
+        if (dmax >= tolerance && index != first) {
+            keep[index] = true;
+            ranges.emplace_back(index, last);
+            ranges.emplace_back(first, index);
+        }
+    }
+    return keep;
+}
+
 Points
 MultiPoint::_douglas_peucker(const Points &points, const double tolerance)
 {
-    assert(points.size() >= 2);
+    assert(!points.empty());
+    // like the recursive formulation, a single point yields both ends
+    if (points.size() == 1) return Points(2, points.front());
+    const std::vector<bool> &keep = _douglas_peucker_mark(points, tolerance);
     Points results;
-    double dmax = 0;
-    size_t index = 0;
-    Line full(points.front(), points.back());
-    for (Points::const_iterator it = points.begin() + 1; it != points.end(); ++it) {
-        // we use shortest distance, not perpendicular distance
-        double d = it->distance_to(full);
-        if (d > dmax) {
-            index = it - points.begin();
-            dmax = d;
-        }
-    }
-    if (dmax >= tolerance) {
-        Points dp0;
-        dp0.reserve(index + 1);
-        dp0.insert(dp0.end(), points.begin(), points.begin() + index + 1);
-        // Recursive call.
-        Points dp1 = MultiPoint::_douglas_peucker(dp0, tolerance);
-        results.reserve(results.size() + dp1.size() - 1);
-        results.insert(results.end(), dp1.begin(), dp1.end() - 1);
-        
-        dp0.clear();
-        dp0.reserve(points.size() - index);
-        dp0.insert(dp0.end(), points.begin() + index, points.end());
-        // Recursive call.
-        dp1 = MultiPoint::_douglas_peucker(dp0, tolerance);
-        results.reserve(results.size() + dp1.size());
-        results.insert(results.end(), dp1.begin(), dp1.end());
-    } else {
-        results.push_back(points.front());
-        results.push_back(points.back());
-    }
+    results.reserve(std::count(keep.begin(), keep.end(), true));
+    for (size_t i = 0; i < points.size(); ++i)
+        if (keep[i]) results.push_back(points[i]);
     return results;
 }
 
+void
+MultiPoint::_douglas_peucker(Points* points, const double tolerance)
+{
+    if (points->size() == 1) points->push_back(points->front());
+    if (points->size() < 3) return;
+    const std::vector<bool> &keep = _douglas_peucker_mark(*points, tolerance);
+    size_t j = 0;
+    for (size_t i = 0; i < points->size(); ++i)
+        if (keep[i]) (*points)[j++] = (*points)[i];
+    points->resize(j);
+}
+
 }
@@ -46,6 +46,9 @@ class MultiPoint
     std::string dump_perl() const;
     
     static Points _douglas_peucker(const Points &points, const double tolerance);
+    /// In place variant of _douglas_peucker(), which doesn't allocate once its
+    /// per-thread scratch buffers have grown.
+    static void _douglas_peucker(Points* points, const double tolerance);
     
     protected:
     MultiPoint() {};
@@ -0,0 +1,162 @@
+#include "OverhangClassifier.hpp"
+#include "ClipperUtils.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace Slic3r {
+
+template <class Visitor> void
+OverhangClassifier::_visit_cells(const Point &a, const Point &b, Visitor visit) const
+{
+    // points outside of the grid are clamped to its border cells
+    const auto cell = [this] (coord_t c, coord_t min, size_t count) {
+        return std::min<size_t>(count - 1, std::max<coord_t>(0, c - min) / this->_cell_size);
+    };
+    const size_t x0 = cell(std::min(a.x, b.x), this->_bb.min.x, this->_columns);
+    const size_t x1 = cell(std::max(a.x, b.x), this->_bb.min.x, this->_columns);
+    const size_t y0 = cell(std::min(a.y, b.y), this->_bb.min.y, this->_rows);
+    const size_t y1 = cell(std::max(a.y, b.y), this->_bb.min.y, this->_rows);
+    for (size_t y = y0; y <= y1; ++y)
+        for (size_t x = x0; x <= x1; ++x)
+            visit(y * this->_columns + x);
+}
+
+OverhangClassifier::OverhangClassifier(const Polygons &supporting)
+    : _polygons(supporting), _cell_size(1), _columns(0), _rows(0)
+{
+    size_t edges = 0;
+    this->_bbs.reserve(this->_polygons.size());
+    for (const Polygon &polygon : this->_polygons) {
+        this->_bbs.push_back(polygon.bounding_box());
+        this->_bb.merge(this->_bbs.back());
+        edges += polygon.points.size();
+    }
+    if (edges == 0) return;
+
+    // cells of about half a millimeter, so that the paths lying away from
+    // the edges of the region don't share their cells, up to 256 x 256 cells
+    const Point size = this->_bb.size();
+    this->_cell_size = std::max<coord_t>(scale_(0.5), std::max(size.x, size.y) / 256 + 1);
+    this->_columns   = size.x / this->_cell_size + 1;
+    this->_rows      = size.y / this->_cell_size + 1;
+
+    // each edge is registered in the cells covered by its bounding box: count
+    // the polygons of each cell, then store them
+    std::vector<size_t> last(this->_columns * this->_rows, size_t(-1));
+    this->_cells.assign(this->_columns * this->_rows + 1, 0);
+    for (size_t i = 0; i < this->_polygons.size(); ++i) {
+        const Points &points = this->_polygons[i].points;
+        for (size_t j = 0; j < points.size(); ++j)
+            this->_visit_cells(points[j], points[j + 1 == points.size() ? 0 : j + 1], [this, &last, i] (size_t cell) {
+                if (last[cell] != i) {
+                    last[cell] = i;
+                    ++this->_cells[cell + 1];
+                }
+            });
+    }
+    for (size_t cell = 1; cell < this->_cells.size(); ++cell)
+        this->_cells[cell] += this->_cells[cell - 1];
+    this->_cell_polygons.assign(this->_cells.back(), 0);
+    std::vector<size_t> end(this->_cells.begin(), this->_cells.end() - 1);
+    std::fill(last.begin(), last.end(), size_t(-1));
+    for (size_t i = 0; i < this->_polygons.size(); ++i) {
+        const Points &points = this->_polygons[i].points;
+        for (size_t j = 0; j < points.size(); ++j)
+            this->_visit_cells(points[j], points[j + 1 == points.size() ? 0 : j + 1], [this, &last, &end, i] (size_t cell) {
+                if (last[cell] != i) {
+                    last[cell] = i;
+                    this->_cell_polygons[end[cell]++] = i;
+                }
+            });
+    }
+}
+
+Polygons
+OverhangClassifier::_clip_polygons(const Points &path, bool closed, bool* inside) const
+{
+    *inside = false;
+    if (this->_cells.empty() || path.empty()) return Polygons();
+    const BoundingBox bb(path);
+    if (bb.min.x > this->_bb.max.x || bb.max.x < this->_bb.min.x
+        || bb.min.y > this->_bb.max.y || bb.max.y < this->_bb.min.y)
+        return Polygons();
+
+    // polygons having an edge in the cells the path goes through
+    std::vector<bool> near(this->_polygons.size(), false);
+    const auto mark = [this, &near] (size_t cell) {
+        for (size_t k = this->_cells[cell]; k < this->_cells[cell + 1]; ++k)
+            near[this->_cell_polygons[k]] = true;
+    };
+    for (size_t j = 0; j + 1 < path.size(); ++j)
+        this->_visit_cells(path[j], path[j + 1], mark);
+    if (closed || path.size() == 1)
+        this->_visit_cells(path.back(), path.front(), mark);
+
+    // The other polygons don't cross the path, so each of them either
+    // contains all of it or none of it: their winding number is the same
+    // everywhere along the path.
+    Polygons polygons;
+    int winding = 0;
+    for (size_t i = 0; i < this->_polygons.size(); ++i) {
+        const BoundingBox &pbb = this->_bbs[i];
+        if (pbb.min.x > bb.max.x || pbb.max.x < bb.min.x || pbb.min.y > bb.max.y || pbb.max.y < bb.min.y)
+            continue;
+        if (near[i]) {
+            polygons.push_back(this->_polygons[i]);
+        } else if (pbb.min.x <= bb.min.x && pbb.max.x >= bb.max.x && pbb.min.y <= bb.min.y && pbb.max.y >= bb.max.y
+            && this->_polygons[i].contains(path.front())) {
+            winding += this->_polygons[i].is_counter_clockwise() ? 1 : -1;
+        }
+    }
+
+    if (polygons.empty()) {
+        *inside = winding != 0;
+        return polygons;
+    }
+
+    // replace the polygons containing the path by a rectangle around it
+    // having the same winding number
+    if (winding != 0) {
+        BoundingBox rectangle = bb;
+        rectangle.offset(scale_(1));
+        Polygon polygon = rectangle.polygon();
+        if (winding < 0) polygon.reverse();
+        for (int k = 0; k < std::abs(winding); ++k)
+            polygons.push_back(polygon);
+    }
+    return polygons;
+}
+
+void
+OverhangClassifier::classify(const Polygon &polygon, Polylines* supported, Polylines* overhanging) const
+{
+    bool inside;
+    const Polygons clip = this->_clip_polygons(polygon.points, true, &inside);
+    if (clip.empty()) {
+        (inside ? supported : overhanging)->push_back(polygon.split_at_first_point());
+        return;
+    }
+    const Polylines supported_parts   = intersection_pl(polygon, clip);
+    const Polylines overhanging_parts = diff_pl(polygon, clip);
+    supported->insert(supported->end(), supported_parts.begin(), supported_parts.end());
+    overhanging->insert(overhanging->end(), overhanging_parts.begin(), overhanging_parts.end());
+}
+
+Polylines
+OverhangClassifier::overhanging(const Polylines &polylines) const
+{
+    Polylines retval;
+    for (const Polyline &polyline : polylines) {
+        bool inside;
+        const Polygons clip = this->_clip_polygons(polyline.points, false, &inside);
+        if (clip.empty()) {
+            if (!inside) retval.push_back(polyline);
+            continue;
+        }
+        const Polylines parts = diff_pl(polyline, clip);
+        retval.insert(retval.end(), parts.begin(), parts.end());
+    }
+    return retval;
+}
+
+}
@@ -0,0 +1,51 @@
+#ifndef slic3r_OverhangClassifier_hpp_
+#define slic3r_OverhangClassifier_hpp_
+
+#include "libslic3r.h"
+#include "BoundingBox.hpp"
+#include "Polygon.hpp"
+#include "Polyline.hpp"
+#include <vector>
+
+namespace Slic3r {
+
+/// Splits paths into the parts lying on a supporting region, like the grown
+/// slices of the layer below, and the overhanging parts. The edges of the
+/// region are indexed in a grid, so that a path is only clipped against the
+/// polygons having edges in the cells it goes through, and isn't clipped at
+/// all if there are none.
+class OverhangClassifier
+{
+    public:
+    OverhangClassifier() : _cell_size(1), _columns(0), _rows(0) {};
+    /// The polygons must not overlap each other, like the ones returned by
+    /// offset() or union_().
+    OverhangClassifier(const Polygons &supporting);
+    bool empty() const { return this->_polygons.empty(); };
+    /// Splits a loop like intersection_pl() and diff_pl() with the region.
+    void classify(const Polygon &polygon, Polylines* supported, Polylines* overhanging) const;
+    /// Overhanging parts of paths, like diff_pl() with the region.
+    Polylines overhanging(const Polylines &polylines) const;
+
+    private:
+    Polygons _polygons;
+    std::vector<BoundingBox> _bbs;
+    BoundingBox _bb;
+    coord_t _cell_size;
+    size_t _columns, _rows;
+    /// Polygons having an edge in each cell: those of cell i are
+    /// _cell_polygons[_cells[i]] to _cell_polygons[_cells[i + 1]].
+    std::vector<size_t> _cells;
+    std::vector<size_t> _cell_polygons;
+
+    /// Calls visit(cell) for the cells covered by the bounding box of a segment.
+    template <class Visitor> void _visit_cells(const Point &a, const Point &b, Visitor visit) const;
+    /// Polygons giving the same winding numbers as the region along a path,
+    /// or nothing if the path lies entirely inside (*inside set to true) or
+    /// outside of the region.
+    Polygons _clip_polygons(const Points &path, bool closed, bool* inside) const;
+};
+
+}
+
+#endif
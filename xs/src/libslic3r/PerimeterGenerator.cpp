@@ -3,6 +3,7 @@
 #include "ExtrusionEntityCollection.hpp"
 #include <cmath>
 #include <cassert>
+#include <memory>
 
 namespace Slic3r {
 
@@ -11,18 +12,58 @@ PerimeterGenerator::process()
 {
     // other perimeters
     this->_mm3_per_mm           = this->perimeter_flow.mm3_per_mm();
+    
+    // external perimeters
+    this->_ext_mm3_per_mm       = this->ext_perimeter_flow.mm3_per_mm();
+    
+    // overhang perimeters
+    this->_mm3_per_mm_overhang  = this->overhang_flow.mm3_per_mm();
+    
+    // prepare grown lower layer slices for overhang detection
+    if (this->lower_slices != NULL && this->config->overhangs) {
+        // We consider overhang any part where the entire nozzle diameter is not supported by the
+        // lower layer, so we take lower slices and offset them by half the nozzle diameter used 
+        // in the current layer
+        double nozzle_diameter = this->print_config->nozzle_diameter.get_at(this->config->perimeter_extruder-1);
+        
+        this->_lower_slices_index = OverhangClassifier(offset(*this->lower_slices, scale_(+nozzle_diameter/2)));
+    }
+    
+    const Surfaces &surfaces = this->slices->surfaces;
+    if (this->threads > 1 && surfaces.size() > 1) {
+        // the islands are independent, so they can be processed in parallel
+        // as long as their results are appended in the same order
+        std::vector<ExtrusionEntityCollection> perimeters(surfaces.size()), gap_fills(surfaces.size());
+        std::vector<SurfaceCollection> fill_surfaces(surfaces.size());
+        parallelize<size_t>(0, surfaces.size() - 1, [this, &perimeters, &gap_fills, &fill_surfaces] (size_t i) {
+            this->_process_islands(i, i + 1, &perimeters[i], &gap_fills[i], &fill_surfaces[i]);
+        }, this->threads);
+        for (size_t i = 0; i < surfaces.size(); ++i) {
+            // move the entities rather than cloning them
+            this->loops->entities.insert(this->loops->entities.end(), perimeters[i].entities.begin(), perimeters[i].entities.end());
+            perimeters[i].entities.clear();
+            this->gap_fill->entities.insert(this->gap_fill->entities.end(), gap_fills[i].entities.begin(), gap_fills[i].entities.end());
+            gap_fills[i].entities.clear();
+            this->fill_surfaces->append(fill_surfaces[i].surfaces);
+        }
+    } else {
+        this->_process_islands(0, surfaces.size(), this->loops, this->gap_fill, this->fill_surfaces);
+    }
+}
+
+void
+PerimeterGenerator::_process_islands(size_t first, size_t last, ExtrusionEntityCollection* perimeters,
+    ExtrusionEntityCollection* gap_fills, SurfaceCollection* fill_surfaces) const
+{
+    // other perimeters
     coord_t pwidth              = this->perimeter_flow.scaled_width();
     coord_t pspacing            = this->perimeter_flow.scaled_spacing();
     
     // external perimeters
-    this->_ext_mm3_per_mm       = this->ext_perimeter_flow.mm3_per_mm();
     coord_t ext_pwidth          = this->ext_perimeter_flow.scaled_width();
     coord_t ext_pspacing        = this->ext_perimeter_flow.scaled_spacing();
     coord_t ext_pspacing2       = this->ext_perimeter_flow.scaled_spacing(this->perimeter_flow);
     
-    // overhang perimeters
-    this->_mm3_per_mm_overhang  = this->overhang_flow.mm3_per_mm();
-    
     // solid infill
     coord_t ispacing            = this->solid_infill_flow.scaled_spacing();
     
@@ -42,20 +83,10 @@ PerimeterGenerator::process()
     // minimum shell thickness
     coord_t min_shell_thickness = scale_(this->config->min_shell_thickness);
     
-    // prepare grown lower layer slices for overhang detection
-    if (this->lower_slices != NULL && this->config->overhangs) {
-        // We consider overhang any part where the entire nozzle diameter is not supported by the
-        // lower layer, so we take lower slices and offset them by half the nozzle diameter used 
-        // in the current layer
-        double nozzle_diameter = this->print_config->nozzle_diameter.get_at(this->config->perimeter_extruder-1);
-        
-        this->_lower_slices_p = offset(*this->lower_slices, scale_(+nozzle_diameter/2));
-    }
-    
     // we need to process each island separately because we might have different
     // extra perimeters for each one
-    for (Surfaces::const_iterator surface = this->slices->surfaces.begin();
-        surface != this->slices->surfaces.end(); ++surface) {
+    for (Surfaces::const_iterator surface = this->slices->surfaces.begin() + first;
+        surface != this->slices->surfaces.begin() + last; ++surface) {
         // detect how many perimeters must be generated for this island
         int loops = this->config->perimeters + surface->extra_perimeters;
 
@@ -81,25 +112,31 @@ PerimeterGenerator::process()
             std::vector<PerimeterGeneratorLoops> holes(loop_number+1);       // depth => loops
             ThickPolylines thin_walls;
             
+            // Every level of loops is offset by all the distances it is needed at
+            // (the next level and the gaps on both of its sides) from the same
+            // Clipper state, instead of being converted again for each of them.
+            std::unique_ptr<PolygonOffsetter> level(new PolygonOffsetter(last));
+            
             // we loop one time more than needed in order to find gaps after the last perimeter was applied
             for (int i = 0; i <= loop_number+1; ++i) {  // outer loop is 0
                 Polygons offsets;
+                std::unique_ptr<PolygonOffsetter> next_level;
                 if (i == 0) {
                     // the minimum thickness of a single loop is:
                     // ext_width/2 + ext_spacing/2 + spacing/2 + width/2
                     if (this->config->thin_walls) {
-                        offsets = offset2(
-                            last,
+                        offsets = level->offset2(
                             -(ext_pwidth/2 + ext_min_spacing/2 - 1),
                             +(ext_min_spacing/2 - 1)
                         );
                     } else {
-                        offsets = offset(last, -ext_pwidth/2);
+                        offsets = level->offset(-ext_pwidth/2);
                     }
+                    next_level.reset(new PolygonOffsetter(offsets));
                     
                     // look for thin walls
                     if (this->config->thin_walls) {
-                        Polygons no_thin_zone = offset(offsets, +ext_pwidth/2);
+                        Polygons no_thin_zone = next_level->offset(+ext_pwidth/2);
                         Polygons diffpp = diff(
                             last,
                             no_thin_zone,
@@ -154,19 +191,16 @@ PerimeterGenerator::process()
                         // reliable gap fill algorithm.
                         // Also the offset2(perimeter, -x, x) may sometimes lead to a perimeter, which is larger than
                         // the original.
-                        offsets = offset2(
-                            last,
+                        offsets = level->offset2(
                             -(distance + min_spacing/2 - 1),
                             +(min_spacing/2 - 1)
                         );
                     } else {
                         // If "detect thin walls" is not enabled, this paths will be entered, which 
                         // leads to overflows, as in prusa3d/Slic3r GH #32
-                        offsets = offset(
-                            last,
-                            -distance
-                        );
+                        offsets = level->offset(-distance);
                     }
+                    next_level.reset(new PolygonOffsetter(offsets));
                     
                     // look for gaps
                     if (this->config->fill_gaps && this->config->fill_density.value > 0) {
@@ -174,8 +208,8 @@ PerimeterGenerator::process()
                         // (but still long enough to escape the area threshold) that gap fill
                         // won't be able to fill but we'd still remove from infill area
                         Polygons diff_pp = diff(
-                            offset(last, -0.5*distance),
-                            offset(offsets, +0.5*distance + 10)  // safety offset
+                            level->offset(-0.5*distance),
+                            next_level->offset(+0.5*distance + 10)  // safety offset
                         );
                         gaps.insert(gaps.end(), diff_pp.begin(), diff_pp.end());
                     }
@@ -185,6 +219,7 @@ PerimeterGenerator::process()
                 if (i > loop_number) break; // we were only looking for gaps this time
                 
                 last = offsets;
+                level = std::move(next_level);
                 for (Polygons::const_iterator polygon = offsets.begin(); polygon != offsets.end(); ++polygon) {
                     PerimeterGeneratorLoop loop(*polygon, i);
                     loop.is_contour = polygon->is_counter_clockwise();
@@ -271,7 +306,7 @@ PerimeterGenerator::process()
             
             // append perimeters for this slice as a collection
             if (!entities.empty())
-                this->loops->append(entities);
+                perimeters->append(entities);
         }
         
         // fill gaps
@@ -285,9 +320,10 @@ PerimeterGenerator::process()
             // collapse 
             double min = 0.2*pwidth * (1 - INSET_OVERLAP_TOLERANCE);
             double max = 2*pspacing;
+            PolygonOffsetter gaps_offsetter(gaps);
             ExPolygons gaps_ex = diff_ex(
-                offset2(gaps, -min/2, +min/2),
-                offset2(gaps, -max/2, +max/2),
+                gaps_offsetter.offset2(-min/2, +min/2),
+                gaps_offsetter.offset2(-max/2, +max/2),
                 true
             );
             
@@ -299,7 +335,7 @@ PerimeterGenerator::process()
                 ExtrusionEntityCollection gap_fill = this->_variable_width(polylines, 
                     erGapFill, this->solid_infill_flow);
                 
-                this->gap_fill->append(gap_fill.entities);
+                gap_fills->append(gap_fill.entities);
             
                 /*  Make sure we don't infill narrow parts that are already gap-filled
                     (we only consider this surface's gaps to reduce the diff() complexity).
@@ -343,7 +379,7 @@ PerimeterGenerator::process()
             );
             
             // append infill areas to fill_surfaces
-            this->fill_surfaces->append(expp, stInternal);  // use a bogus surface type
+            fill_surfaces->append(expp, stInternal);  // use a bogus surface type
         }
     }
 }
@@ -375,10 +411,12 @@ PerimeterGenerator::_traverse_loops(const PerimeterGeneratorLoops &loops,
         ExtrusionPaths paths;
         if (this->config->overhangs && this->layer_id > 0
             && !(this->object_config->support_material && this->object_config->support_material_contact_distance.value == 0)) {
+            Polylines supported, overhanging;
+            this->_lower_slices_index.classify(loop->polygon, &supported, &overhanging);
+            
             // get non-overhang paths by intersecting this loop with the grown lower slices
             {
-                const Polylines polylines = intersection_pl(loop->polygon, this->_lower_slices_p);
-                for (const Polyline &polyline : polylines) {
+                for (const Polyline &polyline : supported) {
                     ExtrusionPath path(role);
                     path.polyline   = polyline;
                     path.mm3_per_mm = is_external ? this->_ext_mm3_per_mm           : this->_mm3_per_mm;
@@ -392,8 +430,7 @@ PerimeterGenerator::_traverse_loops(const PerimeterGeneratorLoops &loops,
             // outside the grown lower slices (thus where the distance between
             // the loop centerline and original lower slices is >= half nozzle diameter
             {
-                const Polylines polylines = diff_pl(loop->polygon, this->_lower_slices_p);
-                for (const Polyline &polyline : polylines) {
+                for (const Polyline &polyline : overhanging) {
                     ExtrusionPath path(erOverhangPerimeter);
                     path.polyline   = polyline;
                     path.mm3_per_mm = this->_mm3_per_mm_overhang;
@@ -5,6 +5,7 @@
 #include <vector>
 #include "ExPolygonCollection.hpp"
 #include "Flow.hpp"
+#include "OverhangClassifier.hpp"
 #include "Polygon.hpp"
 #include "PrintConfig.hpp"
 #include "SurfaceCollection.hpp"
@@ -53,6 +54,8 @@ public:
     ExtrusionEntityCollection* loops;
     ExtrusionEntityCollection* gap_fill;
     SurfaceCollection* fill_surfaces;
+    /// Number of threads the islands are processed with.
+    int threads;
     
     PerimeterGenerator(
         // Input:
@@ -73,7 +76,7 @@ public:
             layer_id(-1), perimeter_flow(flow), ext_perimeter_flow(flow),
             overhang_flow(flow), solid_infill_flow(flow),
             config(config), object_config(object_config), print_config(print_config),
-            loops(loops), gap_fill(gap_fill), fill_surfaces(fill_surfaces),
+            loops(loops), gap_fill(gap_fill), fill_surfaces(fill_surfaces), threads(1),
             _ext_mm3_per_mm(-1), _mm3_per_mm(-1), _mm3_per_mm_overhang(-1)
         {};
     void process();
@@ -82,8 +85,10 @@ public:
     double _ext_mm3_per_mm;
     double _mm3_per_mm;
     double _mm3_per_mm_overhang;
-    Polygons _lower_slices_p;
+    OverhangClassifier _lower_slices_index;
     
+    void _process_islands(size_t first, size_t last, ExtrusionEntityCollection* perimeters,
+        ExtrusionEntityCollection* gap_fills, SurfaceCollection* fill_surfaces) const;
     ExtrusionEntityCollection _traverse_loops(const PerimeterGeneratorLoops &loops,
         ThickPolylines &thin_walls) const;
     ExtrusionEntityCollection _variable_width
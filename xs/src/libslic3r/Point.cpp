@@ -1,6 +1,7 @@
 #include "Point.hpp"
 #include "Line.hpp"
 #include "MultiPoint.hpp"
+#include "PointKernels.hpp"
 #include <algorithm>
 #include <cmath>
 
@@ -98,11 +99,7 @@ Point::coincides_with_epsilon(const Point &point) const
 int
 Point::nearest_point_index(const Points &points) const
 {
-    PointConstPtrs p;
-    p.reserve(points.size());
-    for (Points::const_iterator it = points.begin(); it != points.end(); ++it)
-        p.push_back(&*it);
-    return this->nearest_point_index(p);
+    return PointKernels::nearest_point_index(points, *this);
 }
 
 int
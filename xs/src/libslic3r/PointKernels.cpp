@@ -0,0 +1,328 @@
+#include "PointKernels.hpp"
+#include <algorithm>
+#include <limits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define SLIC3R_POINT_KERNELS_AVX2
+    #include <immintrin.h>
+#endif
+
+namespace Slic3r { namespace PointKernels {
+
+// Does the ray with y == point.y starting at point and going to +X cross the edge (j, i)?
+// http://www.ecse.rpi.edu/Homepages/wrf/Research/Short_Notes/pnpoly.html
+static inline bool
+crosses(const Point &i, const Point &j, const Point &point)
+{
+    //FIXME this test is not numerically robust. Particularly, it does not handle horizontal segments at y == point.y well.
+    return ((i.y > point.y) != (j.y > point.y))
+        && ((double)point.x < (double)(j.x - i.x) * (double)(point.y - i.y) / (double)(j.y - i.y) + (double)i.x);
+}
+
+namespace scalar {
+
+bool
+polygon_contains(const Points &polygon, const Point &point)
+{
+    bool result = false;
+    if (polygon.empty()) return result;
+    Points::const_iterator i = polygon.begin();
+    Points::const_iterator j = polygon.end() - 1;
+    for (; i != polygon.end(); j = i++)
+        if (crosses(*i, *j, point))
+            result = !result;
+    return result;
+}
+
+int
+nearest_point_index(const Points &points, const Point &from)
+{
+    int idx = -1;
+    double distance = -1;  // double because long is limited to 2147483647 on some platforms and it's not enough
+
+    for (Points::const_iterator it = points.begin(); it != points.end(); ++it) {
+        /* If the X distance of the candidate is > than the total distance of the
+           best previous candidate, we know we don't want it */
+        const double dx = (double)(from.x - it->x);
+        double d = dx*dx;
+        if (distance != -1 && d > distance) continue;
+
+        /* If the Y distance of the candidate is > than the total distance of the
+           best previous candidate, we know we don't want it */
+        const double dy = (double)(from.y - it->y);
+        d += dy*dy;
+        if (distance != -1 && d > distance) continue;
+
+        idx = it - points.begin();
+        distance = d;
+
+        if (distance < EPSILON) break;
+    }
+
+    return idx;
+}
+
+void
+bounding_box(const Points &points, Point* min, Point* max)
+{
+    Points::const_iterator it = points.begin();
+    *min = *max = *it;
+    for (++it; it != points.end(); ++it) {
+        min->x = std::min(it->x, min->x);
+        min->y = std::min(it->y, min->y);
+        max->x = std::max(it->x, max->x);
+        max->y = std::max(it->y, max->y);
+    }
+}
+
+}
+
+#ifdef SLIC3R_POINT_KERNELS_AVX2
+
+// The kernels read Points as packed pairs of 64 bit integers.
+static_assert(sizeof(Point) == 2 * sizeof(int64_t), "Point is expected to be a packed pair of int64");
+
+namespace avx2 {
+
+#define SLIC3R_AVX2 __attribute__((target("avx2")))
+
+// Load the coordinates of four consecutive points as [x0 x1 x2 x3] and [y0 y1 y2 y3].
+SLIC3R_AVX2 static inline void
+load4(const Point* p, __m256i* xs, __m256i* ys)
+{
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));     // x0 y0 x1 y1
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 2)); // x2 y2 x3 y3
+    // unpacking works within 128 bit lanes and yields [v0 v2 v1 v3]
+    *xs = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+    *ys = _mm256_permute4x64_epi64(_mm256_unpackhi_epi64(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+// Exact int64 to double conversion, valid for |v| <= 2^51.
+SLIC3R_AVX2 static inline __m256d
+to_double(__m256i v)
+{
+    const __m256i magic_i = _mm256_set1_epi64x(0x4338000000000000LL);
+    const __m256d magic_d = _mm256_set1_pd(6755399441055744.0);  // 2^52 + 2^51
+    return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(v, magic_i)), magic_d);
+}
+
+SLIC3R_AVX2 static bool
+polygon_contains(const Points &polygon, const Point &point)
+{
+    const size_t n = polygon.size();
+    if (n < 5) return scalar::polygon_contains(polygon, point);
+    const Point* p = polygon.data();
+
+    // closing edge (last point, first point)
+    bool result = crosses(p[0], p[n-1], point);
+
+    // Only edges straddling the ray's line need the exact floating point test.
+    // The straddle test is done four edges at a time on the integer coordinates.
+    const __m256i py = _mm256_set1_epi64x(point.y);
+    size_t k = 1;
+    for (; k + 4 <= n; k += 4) {
+        __m256i xi, yi, xj, yj;
+        load4(p + k, &xi, &yi);
+        load4(p + k - 1, &xj, &yj);
+        const __m256i straddle = _mm256_xor_si256(_mm256_cmpgt_epi64(yi, py), _mm256_cmpgt_epi64(yj, py));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(straddle));
+        while (mask != 0) {
+            const int lane = __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (crosses(p[k+lane], p[k+lane-1], point))
+                result = !result;
+        }
+    }
+    for (; k < n; ++k)
+        if (crosses(p[k], p[k-1], point))
+            result = !result;
+    return result;
+}
+
+SLIC3R_AVX2 static int
+nearest_point_index(const Points &points, const Point &from)
+{
+    const size_t n = points.size();
+    if (n < 8) return scalar::nearest_point_index(points, from);
+    const Point* p = points.data();
+
+    const __m256i fx    = _mm256_set1_epi64x(from.x);
+    const __m256i fy    = _mm256_set1_epi64x(from.y);
+    const __m256i limit = _mm256_set1_epi64x(1LL << 51);
+    const __m256i nlimit = _mm256_set1_epi64x(-(1LL << 51));
+    const __m256d eps   = _mm256_set1_pd(EPSILON);
+    const __m256i step  = _mm256_set1_epi64x(4);
+
+    // per lane best distance and index; on ties the later index wins like in the scalar loop
+    __m256d best_d = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    __m256i best_i = _mm256_set1_epi64x(-1);
+    __m256i idx    = _mm256_set_epi64x(3, 2, 1, 0);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256i xs, ys;
+        load4(p + k, &xs, &ys);
+        const __m256i dx = _mm256_sub_epi64(fx, xs);
+        const __m256i dy = _mm256_sub_epi64(fy, ys);
+
+        // coordinates this far apart do not occur in practice, but the fast
+        // conversion to double would not be exact for them
+        const __m256i out_of_range = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi64(dx, limit), _mm256_cmpgt_epi64(nlimit, dx)),
+            _mm256_or_si256(_mm256_cmpgt_epi64(dy, limit), _mm256_cmpgt_epi64(nlimit, dy)));
+        if (!_mm256_testz_si256(out_of_range, out_of_range))
+            return scalar::nearest_point_index(points, from);
+
+        const __m256d dxd = to_double(dx);
+        const __m256d dyd = to_double(dy);
+        const __m256d d = _mm256_add_pd(_mm256_mul_pd(dxd, dxd), _mm256_mul_pd(dyd, dyd));
+
+        // the first coincident point ends the search
+        const int coincident = _mm256_movemask_pd(_mm256_cmp_pd(d, eps, _CMP_LT_OQ));
+        if (coincident != 0)
+            return k + __builtin_ctz(coincident);
+
+        const __m256d better = _mm256_cmp_pd(d, best_d, _CMP_LE_OQ);
+        best_d = _mm256_blendv_pd(best_d, d, better);
+        best_i = _mm256_castpd_si256(_mm256_blendv_pd(
+            _mm256_castsi256_pd(best_i), _mm256_castsi256_pd(idx), better));
+        idx = _mm256_add_epi64(idx, step);
+    }
+
+    // reduce the lanes: smallest distance, largest index among equal distances
+    alignas(32) double  lane_d[4];
+    alignas(32) int64_t lane_i[4];
+    _mm256_store_pd(lane_d, best_d);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lane_i), best_i);
+    double distance = lane_d[0];
+    int64_t best = lane_i[0];
+    for (int lane = 1; lane < 4; ++lane) {
+        if (lane_d[lane] < distance || (lane_d[lane] == distance && lane_i[lane] > best)) {
+            distance = lane_d[lane];
+            best = lane_i[lane];
+        }
+    }
+
+    for (; k < n; ++k) {
+        const double dx = (double)(from.x - p[k].x);
+        const double dy = (double)(from.y - p[k].y);
+        const double d = dx*dx + dy*dy;
+        if (d > distance) continue;
+        best = k;
+        distance = d;
+        if (distance < EPSILON) break;
+    }
+    return (int)best;
+}
+
+SLIC3R_AVX2 static void
+bounding_box(const Points &points, Point* min, Point* max)
+{
+    const size_t n = points.size();
+    if (n < 4) {
+        scalar::bounding_box(points, min, max);
+        return;
+    }
+    const Point* p = points.data();
+
+    // two points per register, kept interleaved as [x y x y]
+    __m256i mn = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    __m256i mx = mn;
+    size_t k = 0;
+    for (; k + 2 <= n; k += 2) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + k));
+        mn = _mm256_blendv_epi8(mn, v, _mm256_cmpgt_epi64(mn, v));
+        mx = _mm256_blendv_epi8(mx, v, _mm256_cmpgt_epi64(v, mx));
+    }
+    __m128i mn2 = _mm256_castsi256_si128(mn);
+    __m128i mx2 = _mm256_castsi256_si128(mx);
+    const __m128i mn_hi = _mm256_extracti128_si256(mn, 1);
+    const __m128i mx_hi = _mm256_extracti128_si256(mx, 1);
+    mn2 = _mm_blendv_epi8(mn2, mn_hi, _mm_cmpgt_epi64(mn2, mn_hi));
+    mx2 = _mm_blendv_epi8(mx2, mx_hi, _mm_cmpgt_epi64(mx_hi, mx2));
+    if (k < n) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + k));
+        mn2 = _mm_blendv_epi8(mn2, v, _mm_cmpgt_epi64(mn2, v));
+        mx2 = _mm_blendv_epi8(mx2, v, _mm_cmpgt_epi64(v, mx2));
+    }
+    alignas(16) int64_t out[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(out), mn2);
+    min->x = out[0];
+    min->y = out[1];
+    _mm_store_si128(reinterpret_cast<__m128i*>(out), mx2);
+    max->x = out[0];
+    max->y = out[1];
+}
+
+#undef SLIC3R_AVX2
+
+}
+
+static bool
+detect_avx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+bool
+vectorized()
+{
+    static const bool avx2 = detect_avx2();
+    return avx2;
+}
+
+bool
+polygon_contains(const Points &polygon, const Point &point)
+{
+    return vectorized()
+        ? avx2::polygon_contains(polygon, point)
+        : scalar::polygon_contains(polygon, point);
+}
+
+int
+nearest_point_index(const Points &points, const Point &from)
+{
+    return vectorized()
+        ? avx2::nearest_point_index(points, from)
+        : scalar::nearest_point_index(points, from);
+}
+
+void
+bounding_box(const Points &points, Point* min, Point* max)
+{
+    if (vectorized()) {
+        avx2::bounding_box(points, min, max);
+    } else {
+        scalar::bounding_box(points, min, max);
+    }
+}
+
+#else
+
+bool
+vectorized()
+{
+    return false;
+}
+
+bool
+polygon_contains(const Points &polygon, const Point &point)
+{
+    return scalar::polygon_contains(polygon, point);
+}
+
+int
+nearest_point_index(const Points &points, const Point &from)
+{
+    return scalar::nearest_point_index(points, from);
+}
+
+void
+bounding_box(const Points &points, Point* min, Point* max)
+{
+    scalar::bounding_box(points, min, max);
+}
+
+#endif
+
+} }
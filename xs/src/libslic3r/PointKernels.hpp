@@ -0,0 +1,37 @@
+#ifndef slic3r_PointKernels_hpp_
+#define slic3r_PointKernels_hpp_
+
+#include "libslic3r.h"
+#include "Point.hpp"
+
+namespace Slic3r { namespace PointKernels {
+
+/// Tight loops over Points used by Polygon::contains(), Point::nearest_point_index()
+/// and the BoundingBox constructor.
+/// On x86-64 builds with GCC or Clang an AVX2 variant is selected at runtime when
+/// the CPU supports it; it processes four points per iteration and returns exactly
+/// the same results as the scalar variant, which is used everywhere else.
+
+/// Crossing number test of an unoriented polygon (see Polygon::contains()).
+bool polygon_contains(const Points &polygon, const Point &point);
+
+/// Index of the point nearest to the given one, -1 if the vector is empty.
+/// Among equidistant points the last one wins, except for coincident points
+/// where the first one is returned (see Point::nearest_point_index()).
+int nearest_point_index(const Points &points, const Point &from);
+
+/// Component-wise minimum and maximum of a non-empty vector of points.
+void bounding_box(const Points &points, Point* min, Point* max);
+
+/// Whether the vectorized variants are in use.
+bool vectorized();
+
+namespace scalar {
+bool polygon_contains(const Points &polygon, const Point &point);
+int nearest_point_index(const Points &points, const Point &from);
+void bounding_box(const Points &points, Point* min, Point* max);
+}
+
+} }
+
+#endif
@@ -1,4 +1,5 @@
 #include "ClipperUtils.hpp"
+#include "PointKernels.hpp"
 #include "Polygon.hpp"
 #include "Polyline.hpp"
 
@@ -134,25 +135,14 @@ Polygon::is_valid() const
 bool
 Polygon::contains(const Point &point) const
 {
-    // http://www.ecse.rpi.edu/Homepages/wrf/Research/Short_Notes/pnpoly.html
-    bool result = false;
-    Points::const_iterator i = this->points.begin();
-    Points::const_iterator j = this->points.end() - 1;
-    for (; i != this->points.end(); j = i++) {
-        //FIXME this test is not numerically robust. Particularly, it does not handle horizontal segments at y == point.y well.
-        // Does the ray with y == point.y intersect this line segment?
-        if ( ((i->y > point.y) != (j->y > point.y))
-            && ((double)point.x < (double)(j->x - i->x) * (double)(point.y - i->y) / (double)(j->y - i->y) + (double)i->x) )
-            result = !result;
-    }
-    return result;
+    return PointKernels::polygon_contains(this->points, point);
 }
 
 void
 Polygon::douglas_peucker(double tolerance)
 {
     this->points.push_back(this->points.front());
-    this->points = MultiPoint::_douglas_peucker(this->points, tolerance);
+    MultiPoint::_douglas_peucker(&this->points, tolerance);
     this->points.pop_back();
 }
 
@@ -217,9 +207,11 @@ Polygon::simplify(double tolerance) const
 {
     // repeat first point at the end in order to apply Douglas-Peucker
     // on the whole polygon
-    Points points = this->points;
-    points.push_back(points.front());
-    Polygon p(MultiPoint::_douglas_peucker(points, tolerance));
+    Polygon p;
+    p.points.reserve(this->points.size() + 1);
+    p.points = this->points;
+    p.points.push_back(p.points.front());
+    MultiPoint::_douglas_peucker(&p.points, tolerance);
     p.points.pop_back();
     
     return simplify_polygons(p);
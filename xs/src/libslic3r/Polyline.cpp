@@ -131,7 +131,7 @@ Polyline::equally_spaced_points(double distance) const
 void
 Polyline::simplify(double tolerance)
 {
-    this->points = MultiPoint::_douglas_peucker(this->points, tolerance);
+    MultiPoint::_douglas_peucker(&this->points, tolerance);
 }
 
 /* This method simplifies all *lines* contained in the supplied area */
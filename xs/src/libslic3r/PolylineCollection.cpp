@@ -1,50 +1,9 @@
 #include "PolylineCollection.hpp"
+#include "ChainedPath.hpp"
+#include <cassert>
 
 namespace Slic3r {
 
-struct Chaining
-{
-    Point first;
-    Point last;
-    size_t idx;
-};
-
-#ifndef sqr
-    #define sqr(x) (x * x);
-#endif
-
-template<typename T>
-inline int nearest_point_index(const std::vector<Chaining> &pairs, const Point &start_near, bool no_reverse)
-{
-    T dmin = std::numeric_limits<T>::max();
-    int idx = 0;
-    for (std::vector<Chaining>::const_iterator it = pairs.begin(); it != pairs.end(); ++it) {
-        T d = sqr(T(start_near.x - it->first.x));
-        if (d <= dmin) {
-            d += sqr(T(start_near.y - it->first.y));
-            if (d < dmin) {
-                idx = (it - pairs.begin()) * 2;
-                dmin = d;
-                if (dmin < EPSILON)
-                    break;
-            }
-        }
-        if (! no_reverse) {
-            d = sqr(T(start_near.x - it->last.x));
-            if (d <= dmin) {
-                d += sqr(T(start_near.y - it->last.y));
-                if (d < dmin) {
-                    idx = (it - pairs.begin()) * 2 + 1;
-                    dmin = d;
-                    if (dmin < EPSILON)
-                        break;
-                }
-            }
-        }
-    }
-    return idx;
-}
-
 Polylines PolylineCollection::_chained_path_from(
     const Polylines &src,
     Point start_near,
@@ -54,33 +13,35 @@ Polylines PolylineCollection::_chained_path_from(
 #endif
     )
 {
-    std::vector<Chaining> endpoints;
-    endpoints.reserve(src.size());
+    // the first endpoint at the minimum distance wins, and a polyline's first
+    // point is registered before its last one
+    ChainingIndex index(ChainingIndex::tbFirst);
+    index.reserve(no_reverse ? src.size() : src.size() * 2);
     for (size_t i = 0; i < src.size(); ++ i) {
-        Chaining c;
-        c.first = src[i].first_point();
+        index.add(src[i].first_point(), i);
         if (! no_reverse)
-            c.last = src[i].last_point();
-        c.idx = i;
-        endpoints.push_back(c);
+            index.add(src[i].last_point(), i);
     }
+    index.build();
     Polylines retval;
-    while (! endpoints.empty()) {
+    retval.reserve(src.size());
+    while (! index.empty()) {
         // find nearest point
-        int endpoint_index = nearest_point_index<double>(endpoints, start_near, no_reverse);
-        assert(endpoint_index >= 0 && endpoint_index < (int)endpoints.size() * 2);
+        int endpoint_index = index.nearest(start_near);
+        assert(endpoint_index >= 0);
+        const size_t idx = index.item(endpoint_index);
 #if SLIC3R_CPPVER > 11
         if (move_from_src) {
-            retval.push_back(std::move(src[endpoints[endpoint_index/2].idx]));
+            retval.push_back(std::move(src[idx]));
         } else {
-            retval.push_back(src[endpoints[endpoint_index/2].idx]);
+            retval.push_back(src[idx]);
         }
 #else
-        retval.push_back(src[endpoints[endpoint_index/2].idx]);
+        retval.push_back(src[idx]);
 #endif
-        if (endpoint_index & 1)
+        if (! no_reverse && (endpoint_index & 1))
             retval.back().reverse();
-        endpoints.erase(endpoints.begin() + endpoint_index/2);
+        index.remove_item(idx);
         start_near = retval.back().last_point();
     }
     return retval;
@@ -5,6 +5,7 @@
 #include "Fill/Fill.hpp"
 #include "Flow.hpp"
 #include "Geometry.hpp"
+#include "Log.hpp"
 #include "SupportMaterial.hpp"
 #include <algorithm>
 #include <boost/filesystem.hpp>
@@ -106,6 +107,12 @@ Print::delete_object(size_t idx)
 void
 Print::process() 
 {
+    // layer geometry packed by a previous run is needed if any step below
+    // has to be computed again
+    if (!this->step_done(posInfill) || !this->step_done(posSupportMaterial)
+        || !this->state.is_done(psSkirt) || !this->state.is_done(psBrim))
+        this->expand_layer_geometry();
+
     /// No need to call this as we call it as part of prepare_infill()
     /// until we fix the idempotency issue.
 //    if (this->status_cb != nullptr)
@@ -118,6 +125,36 @@ Print::process()
 
     this->make_skirt();
     this->make_brim(); // must follow make_skirt
+
+    if (this->config.compact_layer_geometry)
+        this->compact_layer_geometry();
+}
+
+size_t
+Print::compact_layer_geometry()
+{
+    size_t unpacked = 0, packed = 0;
+    for (PrintObject* object : this->objects) {
+        for (Layer* layer : object->layers)
+            layer->compact_geometry(&unpacked, &packed);
+        for (SupportLayer* layer : object->support_layers)
+            layer->compact_geometry(&unpacked, &packed);
+    }
+    const size_t saved = unpacked > packed ? unpacked - packed : 0;
+    Slic3r::Log::info("Print") << "Compacted layer geometry from " << unpacked / 1024
+        << " KiB to " << packed / 1024 << " KiB (" << saved / 1024 << " KiB saved)\n";
+    return saved;
+}
+
+void
+Print::expand_layer_geometry()
+{
+    for (PrintObject* object : this->objects) {
+        for (Layer* layer : object->layers)
+            layer->expand_geometry();
+        for (SupportLayer* layer : object->support_layers)
+            layer->expand_geometry();
+    }
 }
 
 void
@@ -365,6 +402,7 @@ Print::invalidate_state_by_config(const PrintConfigBase &config)
             || opt_key == "between_objects_gcode"
             || opt_key == "bridge_acceleration"
             || opt_key == "bridge_fan_speed"
+            || opt_key == "compact_layer_geometry"
             || opt_key == "complete_objects"
             || opt_key == "cooling"
             || opt_key == "default_acceleration"
@@ -386,8 +424,12 @@ Print::invalidate_state_by_config(const PrintConfigBase &config)
             || opt_key == "first_layer_speed"
             || opt_key == "first_layer_temperature"
             || opt_key == "gcode_arcs"
+            || opt_key == "gcode_arcs_tolerance"
             || opt_key == "gcode_comments"
             || opt_key == "gcode_flavor"
+            || opt_key == "gcode_precision_e"
+            || opt_key == "gcode_precision_xyz"
+            || opt_key == "gcode_trim_zeros"
             || opt_key == "infill_acceleration"
             || opt_key == "infill_first"
             || opt_key == "layer_gcode"
@@ -396,11 +438,15 @@ Print::invalidate_state_by_config(const PrintConfigBase &config)
             || opt_key == "min_print_speed"
             || opt_key == "notes"
             || opt_key == "only_retract_when_crossing_perimeters"
+            || opt_key == "optimize_gap_fill_travel"
+            || opt_key == "optimize_infill_travel"
+            || opt_key == "optimize_support_material_travel"
             || opt_key == "output_filename_format"
             || opt_key == "perimeter_acceleration"
             || opt_key == "post_process"
             || opt_key == "pressure_advance"
             || opt_key == "printer_notes"
+            || opt_key == "render_copies_once"
             || opt_key == "retract_before_travel"
             || opt_key == "retract_layer_change"
             || opt_key == "retract_length"
@@ -11,6 +11,7 @@
 #include <boost/thread.hpp>
 #include "BoundingBox.hpp"
 #include "Flow.hpp"
+#include "GCode/Filter.hpp"
 #include "PrintConfig.hpp"
 #include "Config.hpp"
 #include "Point.hpp"
@@ -236,6 +237,10 @@ class Print
     /// Function pointer for the UI side to call post-processing scripts.
     /// Vector is assumed to be the executable script and all arguments.
     std::function<void(std::vector<std::string>)> post_process_cb {nullptr};
+
+    /// Additional G-code filters, run after the built-in ones (vibration limit,
+    /// pressure regulator) on the G-code exported by export_gcode().
+    std::vector<GCodeFilterFactory> gcode_filters;
     
     double total_used_filament, total_extruded_volume, total_cost, total_weight;
     std::map<size_t,float> filament_stats;
@@ -264,6 +269,13 @@ class Print
     /// Triggers the rest of the print process
     void process(); 
 
+    /// Packs the geometry of the layer regions (see LayerRegion::compact_geometry())
+    /// and returns the bytes saved.
+    /// Done by process() when compact_layer_geometry is set.
+    size_t compact_layer_geometry();
+    /// Restores the layer geometry packed by compact_layer_geometry().
+    void expand_layer_geometry();
+
     /// Performs a gcode export.
     void export_gcode(std::ostream& output, bool quiet = false);
     
@@ -190,6 +190,13 @@ PrintConfigDef::PrintConfigDef()
     def->label = __TRANS("Compatible printers");
     def->default_value = new ConfigOptionStrings();
 
+    def = this->add("compact_layer_geometry", coBool);
+    def->label = __TRANS("Compact layer geometry");
+    def->category = __TRANS("Advanced");
+    def->tooltip = __TRANS("Once all the toolpaths are generated, store the slices, toolpaths, infill regions and bridge data of each layer in a packed form. The G-code export unpacks the layers one at a time. This reduces memory usage for tall prints; the geometry is unpacked again when it is needed.");
+    def->cli = "compact-layer-geometry!";
+    def->default_value = new ConfigOptionBool(false);
+
     def = this->add("complete_objects", coBool);
     def->label = __TRANS("Complete individual objects");
     def->category = __TRANS("Advanced");
@@ -643,10 +650,18 @@ PrintConfigDef::PrintConfigDef()
 
     def = this->add("gcode_arcs", coBool);
     def->label = __TRANS("Use native G-code arcs");
-    def->tooltip = __TRANS("This experimental feature tries to detect arcs from segments and generates G2/G3 arc commands instead of multiple straight G1 commands.");
+    def->tooltip = __TRANS("This experimental feature tries to detect arcs from segments and generates G2/G3 arc commands instead of multiple straight G1 commands. Your firmware must support arcs. It has no effect in spiral vase mode.");
     def->cli = "gcode-arcs!";
     def->default_value = new ConfigOptionBool(0);
 
+    def = this->add("gcode_arcs_tolerance", coFloat);
+    def->label = __TRANS("Arc tolerance");
+    def->tooltip = __TRANS("Largest distance between an arc and the segments it replaces, when native G-code arcs are used.");
+    def->sidetext = "mm";
+    def->cli = "gcode-arcs-tolerance=f";
+    def->min = 0;
+    def->default_value = new ConfigOptionFloat(0.02);
+
     def = this->add("gcode_comments", coBool);
     def->label = __TRANS("Verbose G-code");
     def->tooltip = __TRANS("Enable this to get a commented G-code file, with each line explained by a descriptive text. If you print from SD card, the additional weight of the file could make your firmware slow down.");
@@ -678,6 +693,28 @@ PrintConfigDef::PrintConfigDef()
     def->enum_labels.push_back("No extrusion");
     def->default_value = new ConfigOptionEnum<GCodeFlavor>(gcfRepRap);
 
+    def = this->add("gcode_precision_e", coInt);
+    def->label = __TRANS("E decimals");
+    def->tooltip = __TRANS("Number of decimals written for extrusion (E) values and retraction feedrates.");
+    def->cli = "gcode-precision-e=i";
+    def->min = 0;
+    def->max = 9;
+    def->default_value = new ConfigOptionInt(5);
+
+    def = this->add("gcode_precision_xyz", coInt);
+    def->label = __TRANS("XYZ decimals");
+    def->tooltip = __TRANS("Number of decimals written for X, Y and Z coordinates and feedrates.");
+    def->cli = "gcode-precision-xyz=i";
+    def->min = 0;
+    def->max = 9;
+    def->default_value = new ConfigOptionInt(3);
+
+    def = this->add("gcode_trim_zeros", coBool);
+    def->label = __TRANS("Trim trailing zeros");
+    def->tooltip = __TRANS("Drop the trailing zeros of the numbers written in the G-code (e.g. X10.5 instead of X10.500) to make the file smaller.");
+    def->cli = "gcode-trim-zeros!";
+    def->default_value = new ConfigOptionBool(false);
+
     def = this->add("host_type", coEnum);
     def->label = "Host type";
     def->tooltip = "Select Octoprint or Duet to connect to your machine via LAN";
@@ -954,6 +991,27 @@ PrintConfigDef::PrintConfigDef()
     def->cli = "ooze-prevention!";
     def->default_value = new ConfigOptionBool(false);
 
+    def = this->add("optimize_gap_fill_travel", coBool);
+    def->label = __TRANS("Optimize gap fill travel");
+    def->category = __TRANS("Infill");
+    def->tooltip = __TRANS("Refine the nearest-neighbor order of gap fill paths by a local search that reorders and reverses them to shorten travel moves.");
+    def->cli = "optimize-gap-fill-travel!";
+    def->default_value = new ConfigOptionBool(false);
+
+    def = this->add("optimize_infill_travel", coBool);
+    def->label = __TRANS("Optimize infill travel");
+    def->category = __TRANS("Infill");
+    def->tooltip = __TRANS("Refine the nearest-neighbor order of infill paths by a local search that reorders and reverses them to shorten travel moves. This is useful on sparse layers made of many islands.");
+    def->cli = "optimize-infill-travel!";
+    def->default_value = new ConfigOptionBool(false);
+
+    def = this->add("optimize_support_material_travel", coBool);
+    def->label = __TRANS("Optimize support material travel");
+    def->category = __TRANS("Support material");
+    def->tooltip = __TRANS("Refine the nearest-neighbor order of support material paths by a local search that reorders and reverses them to shorten travel moves.");
+    def->cli = "optimize-support-material-travel!";
+    def->default_value = new ConfigOptionBool(false);
+
     def = this->add("output_filename_format", coString);
     def->label = __TRANS("Output filename format");
     def->tooltip = __TRANS("You can use all configuration options as variables inside this template. For example: [layer_height], [fill_density] etc. You can also use [timestamp], [year], [month], [day], [hour], [minute], [second], [version], [input_filename], [input_filename_base].");
@@ -1088,6 +1146,12 @@ PrintConfigDef::PrintConfigDef()
     def->min = 0;
     def->default_value = new ConfigOptionFloat(4);
 
+    def = this->add("render_copies_once", coBool);
+    def->label = __TRANS("Render copies once");
+    def->tooltip = __TRANS("Order the extrusions of each layer of an object and place their seams for its first copy only, and extrude the other copies in the same way from their own position. This speeds up the export of plates with many copies, which then all have the same seams and extrusion order. The extrusions of the other copies are written from the ones of the first copy, with their coordinates translated; only their travel moves and retractions are planned separately. It has no effect with complete_objects.");
+    def->cli = "render-copies-once!";
+    def->default_value = new ConfigOptionBool(false);
+
     def = this->add("resolution", coFloat);
     def->label = __TRANS("Resolution (deprecated)");
     def->tooltip = __TRANS("Minimum detail resolution, used to simplify the input file for speeding up the slicing job and reducing memory usage. High-resolution models often carry more detail than printers can render. Set to zero to disable any simplification and use full resolution from input.");
@@ -1627,7 +1691,7 @@ PrintConfigDef::PrintConfigDef()
 
     def = this->add("threads", coInt);
     def->label = __TRANS("Threads");
-    def->tooltip = __TRANS("Threads are used to parallelize long-running tasks. Optimal threads number is slightly above the number of available cores/processors.");
+    def->tooltip = __TRANS("Threads are used to parallelize long-running tasks. The G-code export uses them to plan the layers ahead and, with complete_objects, to write the G-code of several objects at once; the layers of an object are written one after the other. Optimal threads number is slightly above the number of available cores/processors.");
     def->readonly = true;
     def->cli = "threads=i";
     def->min = 1;
@@ -1986,6 +2050,18 @@ CLIActionsConfigDef::CLIActionsConfigDef()
     def->tooltip = __TRANS("Write information about the model to the console.");
     def->cli = "info";
     def->default_value = new ConfigOptionBool(false);
+
+    def = this->add("estimate_time", coBool);
+    def->label = __TRANS("Estimate print time");
+    def->tooltip = __TRANS("Estimate the print time of the G-code file supplied with --gcode-file, or of the one just exported, and write it to the console per feature and per layer.");
+    def->cli = "estimate-time";
+    def->default_value = new ConfigOptionBool(false);
+    
+    def = this->add("gcode_stats", coBool);
+    def->label = __TRANS("G-code statistics");
+    def->tooltip = __TRANS("Analyze the G-code file supplied with --gcode-file, or the one just exported, and write its statistics to the console as JSON.");
+    def->cli = "gcode-stats";
+    def->default_value = new ConfigOptionBool(false);
     
     def = this->add("save", coString);
     def->label = __TRANS("Save config file");
@@ -2125,7 +2201,7 @@ CLIMiscConfigDef::CLIMiscConfigDef()
 
     def = this->add("gcode_file", coString);
     def->label = __TRANS("G-code file");
-    def->tooltip = __TRANS("The G-code file to send to the printer.");
+    def->tooltip = __TRANS("The G-code file to send to the printer or to estimate the print time of.");
     def->cli = "gcode-file";
     
     #ifdef USE_WX
@@ -339,6 +339,9 @@ class GCodeConfig : public virtual StaticPrintConfig
     ConfigOptionStrings             filament_notes;
     ConfigOptionBool                gcode_comments;
     ConfigOptionEnum<GCodeFlavor>   gcode_flavor;
+    ConfigOptionInt                 gcode_precision_e;
+    ConfigOptionInt                 gcode_precision_xyz;
+    ConfigOptionBool                gcode_trim_zeros;
     ConfigOptionBool                label_printed_objects;
     ConfigOptionString              layer_gcode;
     ConfigOptionFloat               max_print_speed;
@@ -384,6 +387,9 @@ class GCodeConfig : public virtual StaticPrintConfig
         OPT_PTR(filament_notes);
         OPT_PTR(gcode_comments);
         OPT_PTR(gcode_flavor);
+        OPT_PTR(gcode_precision_e);
+        OPT_PTR(gcode_precision_xyz);
+        OPT_PTR(gcode_trim_zeros);
         OPT_PTR(label_printed_objects);
         OPT_PTR(layer_gcode);
         OPT_PTR(max_print_speed);
@@ -438,6 +444,7 @@ class PrintConfig : public GCodeConfig
     ConfigOptionBool                brim_ears;
     ConfigOptionFloat               brim_ears_max_angle;
     ConfigOptionFloat               brim_width;
+    ConfigOptionBool                compact_layer_geometry;
     ConfigOptionBool                complete_objects;
     ConfigOptionBool                cooling;
     ConfigOptionFloat               default_acceleration;
@@ -455,6 +462,7 @@ class PrintConfig : public GCodeConfig
     ConfigOptionFloatOrPercent      first_layer_speed;
     ConfigOptionInts                first_layer_temperature;
     ConfigOptionBool                gcode_arcs;
+    ConfigOptionFloat               gcode_arcs_tolerance;
     ConfigOptionFloat               infill_acceleration;
     ConfigOptionBool                infill_first;
     ConfigOptionFloat               interior_brim_width;
@@ -467,9 +475,13 @@ class PrintConfig : public GCodeConfig
     ConfigOptionFloats              nozzle_diameter;
     ConfigOptionBool                only_retract_when_crossing_perimeters;
     ConfigOptionBool                ooze_prevention;
+    ConfigOptionBool                optimize_gap_fill_travel;
+    ConfigOptionBool                optimize_infill_travel;
+    ConfigOptionBool                optimize_support_material_travel;
     ConfigOptionString              output_filename_format;
     ConfigOptionFloat               perimeter_acceleration;
     ConfigOptionStrings             post_process;
+    ConfigOptionBool                render_copies_once;
     ConfigOptionFloat               resolution;
     ConfigOptionFloats              retract_before_travel;
     ConfigOptionBools               retract_layer_change;
@@ -502,6 +514,7 @@ class PrintConfig : public GCodeConfig
         OPT_PTR(brim_ears);
         OPT_PTR(brim_ears_max_angle);
         OPT_PTR(brim_width);
+        OPT_PTR(compact_layer_geometry);
         OPT_PTR(complete_objects);
         OPT_PTR(cooling);
         OPT_PTR(default_acceleration);
@@ -519,6 +532,7 @@ class PrintConfig : public GCodeConfig
         OPT_PTR(first_layer_speed);
         OPT_PTR(first_layer_temperature);
         OPT_PTR(gcode_arcs);
+        OPT_PTR(gcode_arcs_tolerance);
         OPT_PTR(infill_acceleration);
         OPT_PTR(infill_first);
         OPT_PTR(interior_brim_width);
@@ -531,9 +545,13 @@ class PrintConfig : public GCodeConfig
         OPT_PTR(nozzle_diameter);
         OPT_PTR(only_retract_when_crossing_perimeters);
         OPT_PTR(ooze_prevention);
+        OPT_PTR(optimize_gap_fill_travel);
+        OPT_PTR(optimize_infill_travel);
+        OPT_PTR(optimize_support_material_travel);
         OPT_PTR(output_filename_format);
         OPT_PTR(perimeter_acceleration);
         OPT_PTR(post_process);
+        OPT_PTR(render_copies_once);
         OPT_PTR(resolution);
         OPT_PTR(retract_before_travel);
         OPT_PTR(retract_layer_change);
@@ -1,10 +1,61 @@
 #include "PrintGCode.hpp"
 #include "PrintConfig.hpp"
+#include "GCode/PressureRegulator.hpp"
+#include "GCode/VibrationLimit.hpp"
 #include "Log.hpp"
 #include <ctime>
+#include <exception>
 #include <iostream>
+#include <limits>
+#include <set>
 
 namespace Slic3r {
+
+/// Order in which the extruders of a layer are used: the current one first,
+/// as it needs no toolchange, then the others by id, keeping last_extruder
+/// for the end.
+static std::vector<size_t>
+extruder_order(const std::vector<size_t>& extruders, size_t current, int last_extruder)
+{
+    std::vector<size_t> order;
+    const bool has_last { last_extruder >= 0 && static_cast<size_t>(last_extruder) != current
+        && std::find(extruders.cbegin(), extruders.cend(), static_cast<size_t>(last_extruder)) != extruders.cend() };
+    if (std::find(extruders.cbegin(), extruders.cend(), current) != extruders.cend())
+        order.push_back(current);
+    for (const auto extruder_id : extruders) {
+        if (extruder_id != current && (!has_last || extruder_id != static_cast<size_t>(last_extruder)))
+            order.push_back(extruder_id);
+    }
+    if (has_last) order.push_back(last_extruder);
+    return order;
+}
+
+/// Adds the extruders of the extrusions of a collection to extruders, the way
+/// plan_layer() groups them, without flattening the collection.
+static void
+collect_extruders(const ExtrusionEntityCollection& collection, const PrintRegionConfig& config, bool fills, std::set<size_t>* extruders)
+{
+    // plan_layer() keeps the infill groups that can't be reordered, like the
+    // concentric ones, whole, and a collection is never a solid infill
+    if (fills && collection.no_sort) {
+        if (collection.length() > 0)
+            extruders->insert(config.infill_extruder - 1);
+        return;
+    }
+    for (const auto* entity : collection.entities) {
+        if (entity->is_collection()) {
+            collect_extruders(*dynamic_cast<const ExtrusionEntityCollection*>(entity), config, fills, extruders);
+        } else if (entity->length() > 0) {
+            if (!fills)
+                extruders->insert(config.perimeter_extruder - 1);
+            else if (entity->is_solid_infill())
+                extruders->insert(config.solid_infill_extruder - 1);
+            else
+                extruders->insert(config.infill_extruder - 1);
+        }
+    }
+}
+
 void
 PrintGCode::output()
 {
@@ -123,7 +174,7 @@ PrintGCode::output()
         include_end_extruder_temp = include_end_extruder_temp && !std::regex_search(end_gcode, ex_temp_regex);
     }
 
-    if (include_start_extruder_temp) this->_print_first_layer_temperature(0);
+    if (include_start_extruder_temp) fh << this->_first_layer_temperature(0);
 
     // Apply gcode math to start gcode
     fh << apply_math(_gcodegen.placeholder_parser->process(config.start_gcode.value));
@@ -135,7 +186,7 @@ PrintGCode::output()
         }
     }
 
-    if (include_start_extruder_temp) this->_print_first_layer_temperature(1);
+    if (include_start_extruder_temp) fh << this->_first_layer_temperature(1);
 
 
     // Set other general things (preamble)
@@ -164,6 +215,18 @@ PrintGCode::output()
         }
 
         _gcodegen.avoid_crossing_perimeters.init_external_mp(union_ex(islands_p));
+
+        // build the planners of the layers ahead, listing the layers of
+        // sequential prints once for each copy
+        std::vector<const Layer*> layers;
+        for (const auto object : this->objects) {
+            const size_t exports { config.complete_objects ? object->copies().size() : 1 };
+            for (size_t i = 0; i < exports; ++i) {
+                layers.insert(layers.end(), object->layers.cbegin(), object->layers.cend());
+                layers.insert(layers.end(), object->support_layers.cbegin(), object->support_layers.cend());
+            }
+        }
+        _gcodegen.avoid_crossing_perimeters.prepare_layer_mps(layers, config.threads.value);
     }
 
     // Calculate wiping points if needed.
@@ -207,53 +270,28 @@ PrintGCode::output()
         std::sort(_print.objects.begin(), _print.objects.end(), [] (const PrintObject* a, const PrintObject* b) {
             return (a->config.sequential_print_priority < a->config.sequential_print_priority) || (a->size.z < b->size.z);
         });
-        size_t finished_objects {0};
 
+        // The layers of every copy of every object, one copy after the other.
+        CopyJobs copy_jobs;
         for (size_t obj_idx {0}; obj_idx < _print.objects.size(); ++obj_idx) {
             PrintObject& object {*(this->objects.at(obj_idx))};
+            std::vector<Layer*> layers;
+            layers.reserve(object.layers.size() + object.support_layers.size());
+            for (auto l : object.layers) {
+                layers.emplace_back(l);
+            }
+            for (auto l : object.support_layers) {
+                layers.emplace_back(static_cast<Layer*>(l));
+            }
+            std::sort(layers.begin(), layers.end(), [] (const Layer* a, const Layer* b) { return a->print_z < b->print_z; });
             for (const Point& copy : object._shifted_copies) {
-                if (finished_objects > 0) {
-                    _gcodegen.set_origin(Pointf::new_unscale(copy));
-                    _gcodegen.enable_cooling_markers = false;
-                    _gcodegen.avoid_crossing_perimeters.use_external_mp_once = true;
-                    fh << _gcodegen.retract();
-                    fh << _gcodegen.travel_to(Point(0,0), erNone, "move to origin position for next object");
-
-                    _gcodegen.enable_cooling_markers = true;
-                    // disable motion planner when traveling to first object point
-                    _gcodegen.avoid_crossing_perimeters.disable_once = true;
-                }
-                std::vector<Layer*> layers;
-                layers.reserve(object.layers.size() + object.support_layers.size());
-                for (auto l : object.layers) {
-                    layers.emplace_back(l);
-                }
-                for (auto l : object.support_layers) {
-                    layers.emplace_back(static_cast<Layer*>(l));
-                }
-                std::sort(layers.begin(), layers.end(), [] (const Layer* a, const Layer* b) { return a->print_z < b->print_z; });
-                for (Layer* layer : layers) {
-                    // if we are printing the bottom layer of an object, and we have already finished
-                    // another one, set first layer temperatures. this happens before the Z move
-                    // is triggered, so machine has more time to reach such temperatures
-                    if (layer->id() == 0 && finished_objects > 0) {
-                        if (config.first_layer_bed_temperature > 0 &&
-                                config.has_heatbed &&
-                                std::regex_search(config.between_objects_gcode.getString(), bed_temp_regex))
-                        {
-                            fh << _gcodegen.writer.set_bed_temperature(config.first_layer_bed_temperature);
-                        }
-                        if (std::regex_search(config.between_objects_gcode.getString(), ex_temp_regex)) {
-                            _print_first_layer_temperature(false);
-                        }
-                    }
-                    this->process_layer(obj_idx, layer, Points({copy}));
-                }
-                this->flush_filters();
-                finished_objects++;
-                this->_second_layer_things_done = false;
+                copy_jobs.copies.push_back(std::make_pair(copy_jobs.jobs.size(), copy));
+                for (const Layer* layer : layers)
+                    copy_jobs.jobs.push_back(LayerJob { obj_idx, layer, static_cast<coord_t>(scale_(layer->print_z)), Points({copy}) });
             }
         }
+        copy_jobs.last_extruders = this->_plan_toolchanges(copy_jobs.jobs);
+        this->_process_copies(copy_jobs);
     } else {
         // order objects using a nearest neighbor search
         std::vector<Points::size_type> obj_idx {};
@@ -289,15 +327,16 @@ PrintGCode::output()
         // pass the comparator to leave no doubt.
         std::sort(z.begin(), z.end(),  std::less<size_t>());
         //  call process_layers in the order given by obj_idx
+        std::vector<LayerJob> jobs;
         for (const auto& print_z : z) {
             for (const auto& idx : obj_idx) {
                 for (const auto* layer : layers[print_z][idx] ) {
-                    this->process_layer(idx, layer, layer->object()->_shifted_copies);
+                    jobs.push_back(LayerJob { idx, layer, static_cast<coord_t>(print_z) });
                 }
             }
-            _gcodegen.placeholder_parser->set("layer_z", unscale(print_z));
-            _gcodegen.placeholder_parser->set("layer_num", _gcodegen.layer_index);
+            jobs.push_back(LayerJob { 0, nullptr, static_cast<coord_t>(print_z) });
         }
+        this->_process_layers_planned_ahead(jobs);
 
         this->flush_filters();
     }
@@ -361,6 +400,14 @@ PrintGCode::output()
     fh << "; total filament cost = "
        << std::fixed << std::setprecision(2) << _print.total_cost << "\n";
 
+    if (_gcodegen.writer.multiple_extruders) {
+        // the toolchanges avoided would have taken as long as the others
+        const auto toolchange_time = _gcodegen.toolchanges > 0 ? _gcodegen.toolchange_time / _gcodegen.toolchanges : 0.0;
+        fh << "; toolchanges = " << _gcodegen.toolchanges << "\n";
+        fh << "; toolchanges avoided = " << this->_toolchanges_avoided << " ("
+           << std::fixed << std::setprecision(2) << this->_toolchanges_avoided * toolchange_time << "s)\n";
+    }
+
     // Append full config
     fh << std::endl;
 
@@ -370,19 +417,451 @@ PrintGCode::output()
     _print_config(_print.default_region_config);
 }
 
+void
+PrintGCode::_process_layers_planned_ahead(const std::vector<LayerJob>& jobs)
+{
+    // The G-code of a layer depends on where the previous one ended (chaining,
+    // seams, travels), so it is rendered in order by this thread: a layer
+    // rendered ahead from a guessed writer state would have to be rendered
+    // again whenever the guess is wrong, which is the common case. The plans
+    // don't depend on it, and those of the next batch of layers are prepared
+    // in parallel while the current batch is emitted.
+    const int threads { std::max(config.threads.value, 1) };
+    const size_t batch_size { static_cast<size_t>(threads) * 4 };
+
+    std::vector<size_t> batches;    // index of the first job of each batch
+    for (size_t i = 0; i < jobs.size(); i += batch_size)
+        batches.emplace_back(i);
+
+    const auto last_extruders = this->_plan_toolchanges(jobs);
+
+    // An exception thrown while planning a batch is kept until the batch is
+    // emitted, and rethrown there.
+    std::vector<std::vector<LayerPlan>> plans(batches.size());
+    std::vector<std::exception_ptr> errors(batches.size());
+    boost::mutex errors_mutex;
+    auto plan_batch = [this, &jobs, &batches, &plans, &errors, &errors_mutex, &last_extruders, batch_size, threads] (size_t batch) {
+        const auto keep_error = [&errors, &errors_mutex, batch] () {
+            boost::lock_guard<boost::mutex> lock(errors_mutex);
+            if (!errors[batch]) errors[batch] = std::current_exception();
+        };
+        try {
+            const size_t first { batches.at(batch) };
+            const size_t count { std::min(batch_size, jobs.size() - first) };
+            plans.at(batch).resize(count);
+            parallelize<size_t>(0, count - 1, [this, &jobs, &plans, &last_extruders, &keep_error, batch, first] (size_t i) {
+                try {
+                    if (jobs[first + i].layer != nullptr) {
+                        plans[batch][i] = this->plan_layer(jobs[first + i].layer);
+                        plans[batch][i].last_extruders = last_extruders[first + i];
+                    }
+                } catch (...) {
+                    keep_error();
+                }
+            }, threads);
+        } catch (...) {
+            keep_error();
+        }
+    };
+
+    // joins the planner thread when leaving the loop body, even by an
+    // exception, before the plans it writes are destroyed
+    struct PlannerThread {
+        boost::thread thread;
+        ~PlannerThread() { if (this->thread.joinable()) this->thread.join(); }
+    };
+
+    if (!batches.empty()) plan_batch(0);
+    for (size_t batch = 0; batch < batches.size(); ++batch) {
+        if (errors.at(batch)) std::rethrow_exception(errors.at(batch));
+        PlannerThread planner;
+        if (threads > 1 && batch + 1 < batches.size())
+            planner.thread = boost::thread(plan_batch, batch + 1);
+
+        const size_t first { batches.at(batch) };
+        for (size_t i = 0; i < plans.at(batch).size(); ++i) {
+            const LayerJob& job { jobs.at(first + i) };
+            if (job.layer != nullptr) {
+                this->process_layer(job.obj_idx, job.layer, job.copies.empty() ? job.layer->object()->_shifted_copies : job.copies, plans[batch][i]);
+            } else {
+                _gcodegen.placeholder_parser->set("layer_z", unscale(job.print_z));
+                _gcodegen.placeholder_parser->set("layer_num", _gcodegen.layer_index);
+            }
+        }
+        plans.at(batch).clear();
+        plans.at(batch).shrink_to_fit();
+
+        if (planner.thread.joinable()) {
+            planner.thread.join();
+        } else if (batch + 1 < batches.size()) {
+            plan_batch(batch + 1);
+        }
+    }
+}
+
+bool
+PrintGCode::_needs_skirt(const Layer* layer, const std::map<coord_t, bool>& skirt_done) const
+{
+    return layer->id() < static_cast<size_t>(layer->object()->config.raft_layers)
+        || ((_print.has_infinite_skirt()
+        || skirt_done.size() == 0
+        || (skirt_done.rbegin())->first < scale_(_print.skirt_height_z))
+        && skirt_done.count(scale_(layer->print_z)) == 0
+        && typeid(layer) != typeid(SupportLayer*));
+}
+
+std::vector<std::vector<int>>
+PrintGCode::_plan_toolchanges(const std::vector<LayerJob>& jobs)
+{
+    std::vector<std::vector<int>> last_extruders(jobs.size());
+    if (!_gcodegen.writer.multiple_extruders || _gcodegen.writer.extruder() == nullptr)
+        return last_extruders;
+
+    // The extruders of each copy of each layer: the skirt and brim ones
+    // before the first copy, the support material ones in a fixed order, then
+    // the ones ordered by extruder_order(). With render_copies_once, the other
+    // copies repeat the order of the first one.
+    struct Visit {
+        size_t job;
+        size_t copy;
+        std::vector<size_t> skirt;
+        std::vector<size_t> support;
+        std::vector<size_t> extruders;
+        size_t repeat;
+    };
+    std::vector<size_t> all_extruders;
+    for (const auto& extruder : _gcodegen.writer.extruders)
+        all_extruders.push_back(extruder.second.id);
+    std::map<coord_t, bool> skirt_done { this->_skirt_done };
+    bool brim_done { this->_brim_done };
+    std::vector<Visit> visits;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        const Layer* layer { jobs[i].layer };
+        if (layer == nullptr) continue;
+        const PrintObject& obj { *layer->object() };
+        Visit visit { i, 0, {}, {}, {}, 1 };
+
+        // the extruders process_layer() selects for the skirt and the brim
+        if (this->_needs_skirt(layer, skirt_done)) {
+            visit.skirt.push_back(all_extruders.at(0));
+            if (layer->id() == 0 && (_print.has_infinite_skirt() || layer->id() < static_cast<size_t>(_print.config.skirt_height))) {
+                const size_t loops { _print.skirt.flatten().entities.size() };
+                for (size_t l = 0; l < loops; ++l)
+                    visit.skirt.push_back(all_extruders.at((l / all_extruders.size()) % all_extruders.size()));
+            }
+            skirt_done[scale_(layer->print_z)] = true;
+        }
+        if (!brim_done) {
+            visit.skirt.push_back(_print.brim_extruder() - 1);
+            brim_done = true;
+        }
+        if (layer->is_support()) {
+            const SupportLayer* slayer = dynamic_cast<const SupportLayer*>(layer);
+            if (slayer->support_interface_fills.size() > 0)
+                visit.support.push_back(obj.config.support_material_interface_extruder - 1);
+            if (slayer->support_fills.size() > 0)
+                visit.support.push_back(obj.config.support_material_extruder - 1);
+        }
+        std::set<size_t> extruders;
+        for (const auto* layerm : layer->regions) {
+            ExtrusionEntityCollection perimeters, fills;
+            collect_extruders(layerm->get_perimeters(&perimeters), layerm->region()->config, false, &extruders);
+            collect_extruders(layerm->get_fills(&fills), layerm->region()->config, true, &extruders);
+        }
+        visit.extruders.assign(extruders.cbegin(), extruders.cend());
+
+        const size_t n_copies { jobs[i].copies.empty() ? obj._shifted_copies.size() : jobs[i].copies.size() };
+        last_extruders[i].assign(n_copies, -1);
+        if (config.render_copies_once && n_copies > 1) {
+            visit.repeat = n_copies;
+            visits.push_back(visit);
+        } else {
+            for (visit.copy = 0; visit.copy < n_copies; ++visit.copy) {
+                visits.push_back(visit);
+                visit.skirt.clear();
+            }
+        }
+    }
+
+    // the toolchanges of a visit entered with an extruder, and the extruder it ends with
+    const auto toolchanges = [] (const Visit& visit, size_t entry, int last_extruder, size_t* end) -> size_t {
+        size_t count {0};
+        *end = entry;
+        for (const auto extruder_id : visit.skirt) {
+            if (extruder_id != *end) ++count;
+            *end = extruder_id;
+        }
+        std::vector<size_t> sequence { visit.support };
+        const auto order = extruder_order(visit.extruders, sequence.empty() ? *end : sequence.back(), last_extruder);
+        sequence.insert(sequence.end(), order.cbegin(), order.cend());
+        for (size_t r = 0; r < visit.repeat; ++r) {
+            for (const auto extruder_id : sequence) {
+                if (extruder_id != *end) ++count;
+                *end = extruder_id;
+            }
+        }
+        return count;
+    };
+
+    // The toolchanges of a visit only depend on the extruder it is entered
+    // with, so the fewest toolchanges up to each visit and extruder are found
+    // by dynamic programming.
+    const size_t n_extruders { _gcodegen.writer.extruders.rbegin()->first + 1U };
+    const size_t none { std::numeric_limits<size_t>::max() };
+    const size_t start { _gcodegen.writer.extruder()->id };
+    std::vector<size_t> counts(n_extruders, none);
+    counts[start] = 0;
+    // for each visit and extruder it ends with, the one it was entered with and its last extruder
+    std::vector<std::vector<std::pair<size_t,int>>> choices(visits.size(), std::vector<std::pair<size_t,int>>(n_extruders));
+    size_t baseline {0}, baseline_end { start };
+    for (size_t v = 0; v < visits.size(); ++v) {
+        const Visit& visit { visits[v] };
+        baseline += toolchanges(visit, baseline_end, -1, &baseline_end);
+
+        std::vector<size_t> next(n_extruders, none);
+        for (size_t entry = 0; entry < n_extruders; ++entry) {
+            if (counts[entry] == none) continue;
+            std::vector<int> candidates(visit.extruders.cbegin(), visit.extruders.cend());
+            if (candidates.empty()) candidates.push_back(-1);
+            for (const auto last_extruder : candidates) {
+                size_t end;
+                const size_t count { counts[entry] + toolchanges(visit, entry, last_extruder, &end) };
+                if (end < n_extruders && count < next[end]) {
+                    next[end] = count;
+                    choices[v][end] = std::make_pair(entry, last_extruder);
+                }
+            }
+        }
+        counts = std::move(next);
+    }
+    size_t end = std::min_element(counts.cbegin(), counts.cend()) - counts.cbegin();
+    if (visits.empty() || counts[end] == none) return last_extruders;
+    if (counts[end] < baseline) this->_toolchanges_avoided += baseline - counts[end];
+    for (size_t v = visits.size(); v-- > 0; ) {
+        const auto& choice = choices[v][end];
+        last_extruders[visits[v].job][visits[v].copy] = choice.second;
+        end = choice.first;
+    }
+    return last_extruders;
+}
+
+void
+PrintGCode::filter(GCodeSink &&gcode, bool flush)
+{
+    if (this->_rendering != nullptr) {
+        RenderedGCode piece;
+        piece.type = flush ? RenderedGCode::Flushed : RenderedGCode::Filtered;
+        piece.gcode = std::move(gcode);
+        this->_rendering->push_back(std::move(piece));
+        return;
+    }
+    this->_filters.push(std::move(gcode), flush);
+}
+
+void
+PrintGCode::flush_filters()
+{
+    GCodeSink gcode;
+    this->_cooling_buffer.flush(&gcode);
+    this->filter(std::move(gcode), true);
+}
+
+void
+PrintGCode::_process_copies(const CopyJobs& copy_jobs)
+{
+    // The G-code of a copy only depends on the state the previous one leaves,
+    // which is mostly reset by the travel between them. The copies of a batch
+    // are rendered at the same time, the first one from the actual state and
+    // the next ones from the expected one; they are then written in order,
+    // each one being rendered again if its expected state turns out wrong.
+    const size_t threads { static_cast<size_t>(std::max(config.threads.value, 1)) };
+    CopyState state { this->_copy_state() };
+    for (size_t first = 0; first < copy_jobs.copies.size(); first += threads) {
+        const size_t count { std::min(threads, copy_jobs.copies.size() - first) };
+        std::vector<CopyState> entries(count), exits(count);
+        std::vector<std::unique_ptr<PrintGCode>> renders(count);
+        std::vector<std::vector<RenderedGCode>> outputs(count);
+        std::vector<std::exception_ptr> errors(count);
+        entries[0] = state;
+        parallelize<size_t>(0, count - 1, [this, &copy_jobs, &state, &entries, &exits, &renders, &outputs, &errors, first] (size_t i) {
+            try {
+                if (i > 0) entries[i] = this->_predict_copy_state(copy_jobs, first, state, first + i);
+                renders[i].reset(new PrintGCode(*this, entries[i]));
+                exits[i] = renders[i]->_render_copy(copy_jobs, first + i, &outputs[i]);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }, threads);
+
+        for (size_t i = 0; i < count; ++i) {
+            if (i == 0 && errors[i]) std::rethrow_exception(errors[i]);
+            if (errors[i] || entries[i] != state) {
+                outputs[i].clear();
+                renders[i].reset(new PrintGCode(*this, state));
+                exits[i] = renders[i]->_render_copy(copy_jobs, first + i, &outputs[i]);
+            }
+            for (auto& piece : outputs[i]) {
+                if (piece.type == RenderedGCode::Raw)
+                    piece.gcode.write(fh);
+                else
+                    this->filter(std::move(piece.gcode), piece.type == RenderedGCode::Flushed);
+            }
+            outputs[i].clear();
+            _gcodegen.add_stats(renders[i]->_gcodegen);
+            renders[i].reset();
+            state = exits[i];
+        }
+    }
+    this->_set_copy_state(state);
+}
+
+PrintGCode::CopyState
+PrintGCode::_render_copy(const CopyJobs& copy_jobs, size_t copy, std::vector<RenderedGCode>* output)
+{
+    this->_rendering = output;
+    const size_t end { copy + 1 < copy_jobs.copies.size() ? copy_jobs.copies[copy + 1].first : copy_jobs.jobs.size() };
+    for (size_t i = copy_jobs.copies[copy].first; i < end; ++i) {
+        const LayerJob& job { copy_jobs.jobs[i] };
+        // if we are printing the bottom layer of an object, and we have already finished
+        // another one, set first layer temperatures. this happens before the Z move
+        // is triggered, so machine has more time to reach such temperatures
+        if (job.layer->id() == 0 && copy > 0) {
+            RenderedGCode piece;
+            piece.type = RenderedGCode::Raw;
+            if (config.first_layer_bed_temperature > 0 &&
+                    config.has_heatbed &&
+                    std::regex_search(config.between_objects_gcode.getString(), bed_temp_regex))
+            {
+                piece.gcode += _gcodegen.writer.set_bed_temperature(config.first_layer_bed_temperature);
+            }
+            if (std::regex_search(config.between_objects_gcode.getString(), ex_temp_regex)) {
+                piece.gcode += this->_first_layer_temperature(false);
+            }
+            if (!piece.gcode.empty()) output->push_back(std::move(piece));
+        }
+        LayerPlan plan { this->plan_layer(job.layer) };
+        plan.last_extruders = copy_jobs.last_extruders.at(i);
+        this->process_layer(job.obj_idx, job.layer, job.copies, plan);
+    }
+    this->flush_filters();
+
+    if (copy + 1 < copy_jobs.copies.size()) {
+        RenderedGCode piece;
+        piece.type = RenderedGCode::Raw;
+        piece.gcode += this->_travel_to_copy(copy_jobs.copies[copy + 1].second);
+        output->push_back(std::move(piece));
+    }
+    this->_rendering = nullptr;
+    return this->_copy_state();
+}
+
 std::string
-PrintGCode::filter(const std::string& in, bool wait)
+PrintGCode::_travel_to_copy(const Point& copy)
+{
+    std::string gcode;
+    // the fan is set again by the next copy, which starts with it off
+    gcode += _gcodegen.writer.set_fan(0);
+
+    _gcodegen.set_origin(Pointf::new_unscale(copy));
+    _gcodegen.enable_cooling_markers = false;
+    _gcodegen.avoid_crossing_perimeters.use_external_mp_once = true;
+    gcode += _gcodegen.retract();
+    gcode += _gcodegen.travel_to(Point(0,0), erNone, "move to origin position for next object");
+    _gcodegen.set_last_pos(Point(0,0));
+
+    _gcodegen.enable_cooling_markers = true;
+    // disable motion planner when traveling to first object point
+    _gcodegen.avoid_crossing_perimeters.disable_once = true;
+    return gcode;
+}
+
+PrintGCode::CopyState
+PrintGCode::_predict_copy_state(const CopyJobs& copy_jobs, size_t first, const CopyState& state, size_t copy) const
+{
+    // the end of the previous copy, as far as the travel to this one depends on it
+    CopyState end { state };
+    GCode::State& gcodegen { end.gcodegen };
+    gcodegen.wipe_path.clear();
+    const size_t first_job { copy_jobs.copies.at(first).first }, last_job { copy_jobs.copies.at(copy).first };
+    for (size_t i = first_job; i < last_job; ++i) {
+        const LayerJob& job { copy_jobs.jobs[i] };
+        // the bookkeeping of process_layer()
+        if (this->_needs_skirt(job.layer, end.skirt_done)) end.skirt_done[scale_(job.layer->print_z)] = true;
+        end.brim_done = true;
+        if (end.last_obj_copy.first != job.copies.front() && end.last_obj_copy.second)
+            gcodegen.use_external_mp = true;
+        end.last_obj_copy = std::make_pair(job.copies.front(), true);
+        gcodegen.layer_index++;
+    }
+    if (last_job > first_job) {
+        const LayerJob& job { copy_jobs.jobs[last_job - 1] };
+        gcodegen.origin = Pointf::new_unscale(job.copies.front());
+        for (size_t i = last_job; _autospeed && i-- > first_job; ) {
+            const LayerPlan plan { this->plan_layer(copy_jobs.jobs[i].layer) };
+            if (plan.has_volumetric_speed) {
+                gcodegen.volumetric_speed = plan.volumetric_speed;
+                break;
+            }
+        }
+        const auto& last_extruders = copy_jobs.last_extruders.at(last_job - 1);
+        if (!last_extruders.empty() && last_extruders.back() >= 0)
+            gcodegen.writer.extruder = last_extruders.back();
+        if (gcodegen.writer.extruder >= 0) {
+            auto& extruder = gcodegen.writer.extruders[gcodegen.writer.extruder];
+            extruder[1] = extruder[2] = 0;    // unretracted
+        }
+        gcodegen.writer.position.z = job.layer->print_z + config.z_offset.value;
+        gcodegen.writer.lifted = 0;
+    }
+    PrintGCode copy_gcode(*this, end);
+    copy_gcode._travel_to_copy(copy_jobs.copies.at(copy).second);
+    return copy_gcode._copy_state();
+}
+
+PrintGCode::CopyState
+PrintGCode::_copy_state() const
 {
-    return in;
+    CopyState state;
+    state.gcodegen = _gcodegen.state();
+    state.skirt_done = this->_skirt_done;
+    state.brim_done = this->_brim_done;
+    state.last_obj_copy = this->_last_obj_copy;
+    return state;
+}
+
+void
+PrintGCode::_set_copy_state(const CopyState& state)
+{
+    _gcodegen.set_state(state.gcodegen);
+    if (state.gcodegen.writer.extruder >= 0)
+        _gcodegen.placeholder_parser->set("current_extruder", state.gcodegen.writer.extruder);
+    this->_skirt_done = state.skirt_done;
+    this->_brim_done = state.brim_done;
+    this->_last_obj_copy = state.last_obj_copy;
+}
+
+bool
+PrintGCode::CopyState::operator==(const CopyState& other) const
+{
+    return this->gcodegen == other.gcodegen
+        && this->skirt_done == other.skirt_done
+        && this->brim_done == other.brim_done
+        && this->last_obj_copy == other.last_obj_copy;
 }
 
 void
 PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
 {
-    std::string gcode {""};
+    this->process_layer(idx, layer, copies, this->plan_layer(layer));
+}
+
+void
+PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan)
+{
+    GCodeSink gcode;
 
     const PrintObject& obj { *layer->object() };
-    _gcodegen.config.apply(obj.config, true);
+    _gcodegen.apply_object_config(obj.config);
 
     // check for usage of spiralvase logic.
     this->_spiral_vase.enable = (
@@ -390,8 +869,8 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
             && (_print.config.skirts == 0 || (layer->id() >= _print.config.skirt_height && !_print.has_infinite_skirt()))
             && std::find_if(layer->regions.cbegin(), layer->regions.cend(), [layer] (const LayerRegion* l)
                 { return    l->region()->config.bottom_solid_layers > layer->id()
-                         || l->perimeters.items_count() > 1
-                         || l->fills.items_count() > 0;
+                         || l->perimeters_items_count() > 1
+                         || l->fills_items_count() > 0;
                 }) == layer->regions.cend()
             );
     this->_gcodegen.enable_loop_clipping = this->_spiral_vase.enable;
@@ -401,64 +880,9 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
     // if using spiralvase, disable loop clipping.
 
     // initialize autospeed.
-    {
-        // get the minimum cross-section used in the layer.
-        std::vector<double> mm3_per_mm;
-        for (auto region_id = 0U; region_id < _print.regions.size(); ++region_id) {
-            const PrintRegion* region = _print.get_region(region_id);
-            if( region_id >= layer->region_count() ){
-		Slic3r::Log::error("Layer processing") << "Layer #" << layer->id() 
-		    << " doesn't have region " << region_id << ". "
-		    << " The layer has " << layer->region_count() << " regions."
-		    << std::endl;
-		break;
-	    }
-            const LayerRegion* layerm = layer->get_region(region_id);
-
-            if (!(region->config.get_abs_value("perimeter_speed") > 0 &&
-                region->config.get_abs_value("small_perimeter_speed") > 0 &&
-                region->config.get_abs_value("external_perimeter_speed") > 0 &&
-                region->config.get_abs_value("bridge_speed") > 0))
-            {
-                mm3_per_mm.emplace_back(layerm->perimeters.min_mm3_per_mm());
-            }
-            if (!(region->config.get_abs_value("infill_speed") > 0 &&
-                region->config.get_abs_value("solid_infill_speed") > 0 &&
-                region->config.get_abs_value("top_solid_infill_speed") > 0 &&
-                region->config.get_abs_value("bridge_speed") > 0 &&
-                region->config.get_abs_value("gap_fill_speed") > 0)) // TODO: make this configurable?
-            {
-                mm3_per_mm.emplace_back(layerm->fills.min_mm3_per_mm());
-            }
-        }
-        if (typeid(layer) == typeid(SupportLayer*)) {
-            const SupportLayer* slayer = dynamic_cast<const SupportLayer*>(layer);
-            if (!(obj.config.get_abs_value("support_material_speed") > 0 &&
-                  obj.config.get_abs_value("support_material_interface_speed") > 0))
-            {
-                mm3_per_mm.emplace_back(slayer->support_fills.min_mm3_per_mm());
-                mm3_per_mm.emplace_back(slayer->support_interface_fills.min_mm3_per_mm());
-            }
+    if (plan.has_volumetric_speed)
+        _gcodegen.volumetric_speed = plan.volumetric_speed;
 
-        }
-
-        // ignore too-thin segments.
-        // TODO make the definition of "too thin" based on a config somewhere
-        mm3_per_mm.erase(std::remove_if(mm3_per_mm.begin(), mm3_per_mm.end(), [] (const double& vol) { return vol <= 0.01;} ), mm3_per_mm.end());
-        if (mm3_per_mm.size() > 0) {
-            const double min_mm3_per_mm { *(std::min_element(mm3_per_mm.begin(), mm3_per_mm.end())) };
-            // In order to honor max_print_speed we need to find a target volumetric
-            // speed that we can use throughout the _print. So we define this target
-            // volumetric speed as the volumetric speed produced by printing the
-            // smallest cross-section at the maximum speed: any larger cross-section
-            // will need slower feedrates.
-            double volumetric_speed { min_mm3_per_mm * config.max_print_speed };
-            if (config.max_volumetric_speed > 0) {
-                volumetric_speed = std::min(volumetric_speed, config.max_volumetric_speed.getFloat());
-            }
-            _gcodegen.volumetric_speed = volumetric_speed;
-        }
-    }
     // set the second layer + temp
     if (!this->_second_layer_things_done && layer->id() == 1) {
         for (const auto& extruder_ref : _gcodegen.writer.extruders) {
@@ -476,23 +900,23 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
     }
 
     // set new layer - this will change Z and force a retraction if retract_layer_change is enabled
-    if (_print.config.before_layer_gcode.getString().size() > 0) {
-        PlaceholderParser pp { *_gcodegen.placeholder_parser };
-        pp.set("layer_num", layer->id());
-        pp.set("layer_z", layer->print_z);
-        pp.set("current_retraction", _gcodegen.writer.extruder()->retracted);
+    if (!_before_layer_gcode.empty()) {
+        GCodeTemplate::Values values;
+        values.set("layer_num", layer->id());
+        values.set("layer_z", layer->print_z);
+        values.set("current_retraction", _gcodegen.writer.extruder()->retracted);
 
-        gcode += apply_math(pp.process(_print.config.before_layer_gcode.getString()));
+        gcode += _before_layer_gcode.process(*_gcodegen.placeholder_parser, values);
         gcode += "\n";
     }
     gcode += _gcodegen.change_layer(*layer);
-    if (_print.config.layer_gcode.getString().size() > 0) {
-        PlaceholderParser pp { *_gcodegen.placeholder_parser };
-        pp.set("layer_num", layer->id());
-        pp.set("layer_z", layer->print_z);
-        pp.set("current_retraction", _gcodegen.writer.extruder()->retracted);
+    if (!_layer_gcode.empty()) {
+        GCodeTemplate::Values values;
+        values.set("layer_num", layer->id());
+        values.set("layer_z", layer->print_z);
+        values.set("current_retraction", _gcodegen.writer.extruder()->retracted);
 
-        gcode += apply_math(pp.process(_print.config.layer_gcode.getString()));
+        gcode += _layer_gcode.process(*_gcodegen.placeholder_parser, values);
         gcode += "\n";
     }
 
@@ -500,13 +924,7 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
     // extrude skirt along raft layers and normal obj layers
     // (not along interlaced support material layers)
 
-    if (layer->id() < static_cast<size_t>(obj.config.raft_layers)
-        || ((_print.has_infinite_skirt()
-        || _skirt_done.size() == 0
-        || (_skirt_done.rbegin())->first < scale_(_print.skirt_height_z))
-        && _skirt_done.count(scale_(layer->print_z)) == 0
-        && typeid(layer) != typeid(SupportLayer*)) ) {
-
+    if (this->_needs_skirt(layer, this->_skirt_done)) {
 
         _gcodegen.set_origin(Pointf(0,0));
         _gcodegen.avoid_crossing_perimeters.use_external_mp = true;
@@ -572,6 +990,11 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
         _gcodegen.avoid_crossing_perimeters.disable_once = true;
     }
 
+    // with render_copies_once, the extrusions of the first copy are recorded
+    // as written, and written again for the other ones from their origin; only
+    // the travels and retractions are planned again for each copy
+    const bool render_once { config.render_copies_once && copies.size() > 1 };
+    std::vector<CopyMove> moves;
     auto copy_idx = 0U;
     for (const auto& copy : copies) {
         if (config.label_printed_objects) {
@@ -585,191 +1008,377 @@ PrintGCode::process_layer(size_t idx, const Layer* layer, const Points& copies)
         this->_last_obj_copy.second = true;
         _gcodegen.set_origin(Pointf::new_unscale(copy));
 
-        // extrude support material before other things because it might use a lower Z
-        // and also because we avoid travelling on other things when printing it
-        if(layer->is_support()) {
-            const SupportLayer* slayer = dynamic_cast<const SupportLayer*>(layer);
-            ExtrusionEntityCollection paths;
-            if (slayer->support_interface_fills.size() > 0) {
-                gcode += _gcodegen.set_extruder(obj.config.support_material_interface_extruder - 1);
-                slayer->support_interface_fills.chained_path_from(_gcodegen.last_pos(), &paths, false);
-                for (const auto& path : paths) {
-                    gcode += _gcodegen.extrude(*path, "support material interface", obj.config.get_abs_value("support_material_interface_speed"));
-                }
+        if (render_once && copy_idx > 0) {
+            this->_replay(moves, &gcode);
+        } else {
+            this->_recording = render_once ? &moves : nullptr;
+            this->_extrude_copy(layer, plan, copy_idx < plan.last_extruders.size() ? plan.last_extruders[copy_idx] : -1, &gcode);
+            this->_recording = nullptr;
+        }
+
+        if (config.label_printed_objects) {
+            gcode +=   "; stop printing object " + obj.model_object().name + " id:" + std::to_string(idx) + " copy "  + std::to_string(copy_idx) + "\n";
+        }
+        copy_idx++;
+    }
+
+    // Apply spiral vase post-processing if this layer contains suitable geometry
+    // (we must feed all the G-code into the post-processor, including the first
+    // bottom non-spiral layers otherwise it will mess with positions)
+    // we apply spiral vase at this stage because it requires a full layer
+    this->_spiral_vase.process_layer(&gcode);
+    // Apply the cooling logic.
+    GCodeSink output;
+    this->_cooling_buffer.append(std::move(gcode), std::to_string(reinterpret_cast<long long unsigned int>(layer->object())) + std::string(typeid(layer).name()),
+                                 layer->id(), layer->print_z, &output);
+
+    // write the resulting gcode
+    this->filter(std::move(output));
+}
+
+
+// Extrude the support material and the islands of a layer for the current copy.
+void
+PrintGCode::_extrude_copy(const Layer* layer, const LayerPlan& plan, int last_extruder, GCodeSink* gcode)
+{
+    const PrintObject& obj { *layer->object() };
+
+    // extrude support material before other things because it might use a lower Z
+    // and also because we avoid travelling on other things when printing it
+    if(layer->is_support()) {
+        const SupportLayer* slayer = dynamic_cast<const SupportLayer*>(layer);
+        ExtrusionEntityCollection paths;
+        if (slayer->support_interface_fills.size() > 0) {
+            *gcode += this->_set_extruder(obj.config.support_material_interface_extruder - 1);
+            slayer->support_interface_fills.chained_path_from(_gcodegen.last_pos(), &paths, false);
+            if (config.optimize_support_material_travel)
+                paths.optimize_travel(_gcodegen.last_pos(), { erSupportMaterialInterface });
+            for (const auto& path : paths) {
+                *gcode += this->_extrude(*path, "support material interface", obj.config.get_abs_value("support_material_interface_speed"));
             }
-            if (slayer->support_fills.size() > 0) {
-                gcode += _gcodegen.set_extruder(obj.config.support_material_extruder - 1);
-                slayer->support_fills.chained_path_from(_gcodegen.last_pos(), &paths, false);
-                for (const auto& path : paths) {
-                    gcode += _gcodegen.extrude(*path, "support material", obj.config.get_abs_value("support_material_speed"));
-                }
+        }
+        if (slayer->support_fills.size() > 0) {
+            *gcode += this->_set_extruder(obj.config.support_material_extruder - 1);
+            slayer->support_fills.chained_path_from(_gcodegen.last_pos(), &paths, false);
+            if (config.optimize_support_material_travel)
+                paths.optimize_travel(_gcodegen.last_pos(), { erSupportMaterial });
+            for (const auto& path : paths) {
+                *gcode += this->_extrude(*path, "support material", obj.config.get_abs_value("support_material_speed"));
             }
         }
-        // We now define a strategy for building perimeters and fills. The separation
-        // between regions doesn't matter in terms of printing order, as we follow
-        // another logic instead:
-        // - we group all extrusions by extruder so that we minimize toolchanges
-        // - we start from the last used extruder
-        // - for each extruder, we group extrusions by island
-        // - for each island, we extrude perimeters first, unless user set the infill_first
-        //   option
-        // (Still, we have to keep track of regions because we need to apply their config)
-
-        // group extrusions by extruder and then by island
-        //       extruder        island
-        std::map<size_t,std::map<size_t,
-            //                  region
-            std::tuple<std::map<size_t,ExtrusionEntityCollection>, // perimeters
-                       std::map<size_t,ExtrusionEntityCollection>>  // infill
-        >> by_extruder;
-
-        // cache bounding boxes of layer slices
-        std::vector<BoundingBox> layer_slices_bb;
-        std::transform(layer->slices.cbegin(), layer->slices.cend(), std::back_inserter(layer_slices_bb), [] (const ExPolygon& s)-> BoundingBox { return s.bounding_box(); });
-        auto point_inside_surface = [&layer_slices_bb, &layer] (size_t i, Point point) -> bool {
-            const BoundingBox& bbox { layer_slices_bb.at(i) };
-            return bbox.contains(point) && layer->slices.at(i).contour.contains(point);
-        };
-        const size_t n_slices { layer->slices.size() };
+    }
+    // tweak extruder ordering to save toolchanges
+    const auto& by_extruder = plan.by_extruder;
+    std::vector<size_t> extruders;
+    for (const auto &pair : by_extruder)
+        extruders.push_back(pair.first);
+    for (const auto extruder_id : extruder_order(extruders, _gcodegen.writer.extruder()->id, last_extruder)) {
+        *gcode += this->_set_extruder(extruder_id);    // nothing for the current extruder
+        for(const auto &island : by_extruder.at(extruder_id)) {
+           if (_print.config.infill_first()) {
+                this->_extrude_infill(std::get<1>(island.second), gcode);
+                this->_extrude_perimeters(std::get<0>(island.second), gcode);
+            } else {
+                this->_extrude_perimeters(std::get<0>(island.second), gcode);
+                this->_extrude_infill(std::get<1>(island.second), gcode);
+            }
+        }
+    }
+}
+
+void
+PrintGCode::_replay(const std::vector<CopyMove>& moves, GCodeSink* gcode)
+{
+    for (const auto& move : moves) {
+        switch (move.type) {
+            case CopyMove::SetExtruder:
+                *gcode += _gcodegen.set_extruder(move.id);
+                break;
+            case CopyMove::ApplyRegion:
+                _gcodegen.apply_region_config(_print.get_region(move.id)->config);
+                break;
+            case CopyMove::Extrude:
+                *gcode += _gcodegen.extrude(move.extrusion);
+                break;
+        }
+    }
+}
 
+std::string
+PrintGCode::_set_extruder(size_t extruder_id)
+{
+    if (this->_recording != nullptr) {
+        CopyMove move;
+        move.type = CopyMove::SetExtruder;
+        move.id = extruder_id;
+        this->_record(std::move(move));
+    }
+    return _gcodegen.set_extruder(extruder_id);
+}
+
+void
+PrintGCode::_apply_region_config(size_t region_id)
+{
+    if (this->_recording != nullptr) {
+        CopyMove move;
+        move.type = CopyMove::ApplyRegion;
+        move.id = region_id;
+        this->_record(std::move(move));
+    }
+    _gcodegen.apply_region_config(_print.get_region(region_id)->config);
+}
+
+std::string
+PrintGCode::_extrude(const ExtrusionEntity& entity, const std::string& description, double speed)
+{
+    if (this->_recording == nullptr)
+        return _gcodegen.extrude(entity, description, speed);
+
+    CopyMove move;
+    move.type = CopyMove::Extrude;
+    _gcodegen.recording = &move.extrusion;
+    const std::string gcode { _gcodegen.extrude(entity, description, speed) };
+    _gcodegen.recording = nullptr;
+    this->_record(std::move(move));
+    return gcode;
+}
+
+void
+PrintGCode::_record(CopyMove&& move)
+{
+    // the other copies may be entered with another extruder, so the moves
+    // start by selecting the one the first copy extrudes with
+    if (this->_recording->empty() && move.type != CopyMove::SetExtruder) {
+        CopyMove set_extruder;
+        set_extruder.type = CopyMove::SetExtruder;
+        set_extruder.id = _gcodegen.writer.extruder()->id;
+        this->_recording->emplace_back(std::move(set_extruder));
+    }
+    this->_recording->emplace_back(std::move(move));
+}
+
+PrintGCode::LayerPlan
+PrintGCode::plan_layer(const Layer* layer) const
+{
+    LayerPlan plan;
+    const PrintObject& obj { *layer->object() };
+
+    // the extrusions of the regions, decoded here if the layer geometry is packed
+    std::vector<ExtrusionEntityCollection> decoded(2 * layer->region_count());
+    std::vector<const ExtrusionEntityCollection*> perimeters, fills;
+    for (size_t region_id = 0; region_id < layer->region_count(); ++region_id) {
+        const LayerRegion* layerm = layer->get_region(region_id);
+        perimeters.push_back(&layerm->get_perimeters(&decoded[2 * region_id]));
+        fills.push_back(&layerm->get_fills(&decoded[2 * region_id + 1]));
+    }
+
+    // initialize autospeed.
+    {
+        // get the minimum cross-section used in the layer.
+        std::vector<double> mm3_per_mm;
         for (auto region_id = 0U; region_id < _print.regions.size(); ++region_id) {
-            const LayerRegion* layerm;
-            try {
-                layerm = layer->get_region(region_id); // we promise to be good and not give this to anyone who will modify it
-            } catch (std::out_of_range &e) {
-                continue; // if no regions, bail;
+            const PrintRegion* region = _print.get_region(region_id);
+            if( region_id >= layer->region_count() ){
+		Slic3r::Log::error("Layer processing") << "Layer #" << layer->id() 
+		    << " doesn't have region " << region_id << ". "
+		    << " The layer has " << layer->region_count() << " regions."
+		    << std::endl;
+		break;
+	    }
+
+            if (!(region->config.get_abs_value("perimeter_speed") > 0 &&
+                region->config.get_abs_value("small_perimeter_speed") > 0 &&
+                region->config.get_abs_value("external_perimeter_speed") > 0 &&
+                region->config.get_abs_value("bridge_speed") > 0))
+            {
+                mm3_per_mm.emplace_back(perimeters[region_id]->min_mm3_per_mm());
             }
-            const PrintRegion* region { _print.get_region(region_id) };
-            // process perimeters
+            if (!(region->config.get_abs_value("infill_speed") > 0 &&
+                region->config.get_abs_value("solid_infill_speed") > 0 &&
+                region->config.get_abs_value("top_solid_infill_speed") > 0 &&
+                region->config.get_abs_value("bridge_speed") > 0 &&
+                region->config.get_abs_value("gap_fill_speed") > 0)) // TODO: make this configurable?
             {
-                auto extruder_id = region->config.perimeter_extruder-1;
-                // Casting away const just to avoid double dereferences
-                for(const auto* perimeter_coll : layerm->perimeters.flatten().entities) {
-
-                    if(perimeter_coll->length() == 0) continue;  // this shouldn't happen but first_point() would fail
-
-                    // perimeter_coll is an ExtrusionPath::Collection object representing a single slice
-                    for(auto i = 0U; i < n_slices; i++){
-                        if (// perimeter_coll->first_point does not fit inside any slice
-                            i == n_slices - 1
-                            // perimeter_coll->first_point fits inside ith slice
-                            || point_inside_surface(i, perimeter_coll->first_point())) {
-                            std::get<0>(by_extruder[extruder_id][i])[region_id].append(*perimeter_coll);
-                            break;
-                        }
-                    }
-                }
+                mm3_per_mm.emplace_back(fills[region_id]->min_mm3_per_mm());
+            }
+        }
+        if (typeid(layer) == typeid(SupportLayer*)) {
+            const SupportLayer* slayer = dynamic_cast<const SupportLayer*>(layer);
+            if (!(obj.config.get_abs_value("support_material_speed") > 0 &&
+                  obj.config.get_abs_value("support_material_interface_speed") > 0))
+            {
+                mm3_per_mm.emplace_back(slayer->support_fills.min_mm3_per_mm());
+                mm3_per_mm.emplace_back(slayer->support_interface_fills.min_mm3_per_mm());
+            }
+
+        }
+
+        // ignore too-thin segments.
+        // TODO make the definition of "too thin" based on a config somewhere
+        mm3_per_mm.erase(std::remove_if(mm3_per_mm.begin(), mm3_per_mm.end(), [] (const double& vol) { return vol <= 0.01;} ), mm3_per_mm.end());
+        if (mm3_per_mm.size() > 0) {
+            const double min_mm3_per_mm { *(std::min_element(mm3_per_mm.begin(), mm3_per_mm.end())) };
+            // In order to honor max_print_speed we need to find a target volumetric
+            // speed that we can use throughout the _print. So we define this target
+            // volumetric speed as the volumetric speed produced by printing the
+            // smallest cross-section at the maximum speed: any larger cross-section
+            // will need slower feedrates.
+            double volumetric_speed { min_mm3_per_mm * config.max_print_speed };
+            if (config.max_volumetric_speed > 0) {
+                volumetric_speed = std::min(volumetric_speed, config.max_volumetric_speed.getFloat());
             }
+            plan.has_volumetric_speed = true;
+            plan.volumetric_speed = volumetric_speed;
+        }
+    }
 
-            // process infill
-            // $layerm->fills is a collection of ExtrusionPath::Collection objects, each one containing
-            // the ExtrusionPath objects of a certain infill "group" (also called "surface"
-            // throughout the code). We can redefine the order of such Collections but we have to
-            // do each one completely at once.
-            for(auto* fill : layerm->fills.flatten(true).entities) {
-                if(fill->length() == 0) continue;  // this shouldn't happen but first_point() would fail
+    // We now define a strategy for building perimeters and fills. The separation
+    // between regions doesn't matter in terms of printing order, as we follow
+    // another logic instead:
+    // - we group all extrusions by extruder so that we minimize toolchanges
+    // - we start from the last used extruder
+    // - for each extruder, we group extrusions by island
+    // - for each island, we extrude perimeters first, unless user set the infill_first
+    //   option
+    // (Still, we have to keep track of regions because we need to apply their config)
+
+    // group extrusions by extruder and then by island
+    ExtrusionsByExtruder& by_extruder = plan.by_extruder;
+
+    // cache bounding boxes of layer slices
+    std::vector<BoundingBox> layer_slices_bb;
+    std::transform(layer->slices.cbegin(), layer->slices.cend(), std::back_inserter(layer_slices_bb), [] (const ExPolygon& s)-> BoundingBox { return s.bounding_box(); });
+    auto point_inside_surface = [&layer_slices_bb, &layer] (size_t i, Point point) -> bool {
+        const BoundingBox& bbox { layer_slices_bb.at(i) };
+        return bbox.contains(point) && layer->slices.at(i).contour.contains(point);
+    };
+    const size_t n_slices { layer->slices.size() };
+
+    for (auto region_id = 0U; region_id < _print.regions.size(); ++region_id) {
+        if (region_id >= layer->region_count()) continue; // if no regions, bail;
+        const PrintRegion* region { _print.get_region(region_id) };
+        // process perimeters
+        {
+            auto extruder_id = region->config.perimeter_extruder-1;
+            // Casting away const just to avoid double dereferences
+            for(const auto* perimeter_coll : perimeters[region_id]->flatten().entities) {
 
-                auto extruder_id = fill->is_solid_infill()
-                    ? region->config.solid_infill_extruder-1
-                    : region->config.infill_extruder-1;
+                if(perimeter_coll->length() == 0) continue;  // this shouldn't happen but first_point() would fail
 
-                // $fill is an ExtrusionPath::Collection object
+                // perimeter_coll is an ExtrusionPath::Collection object representing a single slice
                 for(auto i = 0U; i < n_slices; i++){
-                    if (i == n_slices - 1
-                        || point_inside_surface(i, fill->first_point())) {
-                        std::get<1>(by_extruder[extruder_id][i])[region_id].append(*fill);
+                    if (// perimeter_coll->first_point does not fit inside any slice
+                        i == n_slices - 1
+                        // perimeter_coll->first_point fits inside ith slice
+                        || point_inside_surface(i, perimeter_coll->first_point())) {
+                        std::get<0>(by_extruder[extruder_id][i])[region_id].append(*perimeter_coll);
                         break;
                     }
                 }
             }
         }
 
-        // tweak extruder ordering to save toolchanges
-
-        auto last_extruder = _gcodegen.writer.extruder()->id;
-        if (by_extruder.count(last_extruder)) {
-            for(auto &island : by_extruder[last_extruder]) {
-               if (_print.config.infill_first()) {
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                } else {
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
+        // process infill
+        // $layerm->fills is a collection of ExtrusionPath::Collection objects, each one containing
+        // the ExtrusionPath objects of a certain infill "group" (also called "surface"
+        // throughout the code). We can redefine the order of such Collections but we have to
+        // do each one completely at once.
+        for(auto* fill : fills[region_id]->flatten(true).entities) {
+            if(fill->length() == 0) continue;  // this shouldn't happen but first_point() would fail
+
+            auto extruder_id = fill->is_solid_infill()
+                ? region->config.solid_infill_extruder-1
+                : region->config.infill_extruder-1;
+
+            // $fill is an ExtrusionPath::Collection object
+            for(auto i = 0U; i < n_slices; i++){
+                if (i == n_slices - 1
+                    || point_inside_surface(i, fill->first_point())) {
+                    std::get<1>(by_extruder[extruder_id][i])[region_id].append(*fill);
+                    break;
                 }
             }
         }
-        for(auto &pair : by_extruder) {
-            if(pair.first == last_extruder)continue;
-            gcode += _gcodegen.set_extruder(pair.first);
-            for(auto &island : pair.second) {
-               if (_print.config.infill_first()) {
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                } else {
-                    gcode += this->_extrude_perimeters(std::get<0>(island.second));
-                    gcode += this->_extrude_infill(std::get<1>(island.second));
+    }
+
+    // The seam candidates of the perimeters only depend on the loops, so they
+    // are found here for all the copies. The seams themselves are chosen among
+    // them while emitting, as aligned and nearest seams follow the previous ones.
+    const SeamPosition seam_position { obj.config.seam_position.value };
+    if (!config.spiral_vase && (seam_position == spNearest || seam_position == spAligned || seam_position == spRear)) {
+        for (auto& extruder : by_extruder) {
+            for (auto& island : extruder.second) {
+                for (auto& region : std::get<0>(island.second)) {
+                    for (auto* entity : region.second.entities) {
+                        if (auto* loop = dynamic_cast<ExtrusionLoop*>(entity)) {
+                            ExtrusionLoop ccw_loop { *loop };
+                            const bool was_clockwise { ccw_loop.make_counter_clockwise() };
+                            loop->seam_candidates = GCode::seam_candidates(ccw_loop, was_clockwise, config, extruder.first);
+                        }
+                    }
                 }
             }
         }
-        if (config.label_printed_objects) {
-            gcode +=   "; stop printing object " + obj.model_object().name + " id:" + std::to_string(idx) + " copy "  + std::to_string(copy_idx) + "\n";
-        }
-        copy_idx++;
     }
 
-    // Apply spiral vase post-processing if this layer contains suitable geometry
-    // (we must feed all the G-code into the post-processor, including the first
-    // bottom non-spiral layers otherwise it will mess with positions)
-    // we apply spiral vase at this stage because it requires a full layer
-    gcode = this->_spiral_vase.process_layer(gcode);
-    // Apply the cooling logic.
-    gcode = this->_cooling_buffer.append(gcode, std::to_string(reinterpret_cast<long long unsigned int>(layer->object())) + std::string(typeid(layer).name()),
-                                         layer->id(), layer->print_z);
-
-    // write the resulting gcode
-    fh << this->filter(gcode);
+    return plan;
 }
 
-
 // Extrude perimeters: Decide where to put seams (hide or align seams).
-std::string
-PrintGCode::_extrude_perimeters(std::map<size_t,ExtrusionEntityCollection> &by_region)
+void
+PrintGCode::_extrude_perimeters(const std::map<size_t,ExtrusionEntityCollection> &by_region, GCodeSink* gcode)
 {
-    std::string gcode = "";
-    for(auto& pair : by_region) {
-        this->_gcodegen.config.apply(this->_print.get_region(pair.first)->config);
+    for(const auto& pair : by_region) {
+        this->_apply_region_config(pair.first);
         for(auto& ee : pair.second){
-            gcode += this->_gcodegen.extrude(*ee, "perimeter");
+            *gcode += this->_extrude(*ee, "perimeter");
         }
     }
-    return gcode;
 }
 
 // Chain the paths hierarchically by a greedy algorithm to minimize a travel distance.
-std::string
-PrintGCode::_extrude_infill(std::map<size_t,ExtrusionEntityCollection> &by_region)
+void
+PrintGCode::_extrude_infill(const std::map<size_t,ExtrusionEntityCollection> &by_region, GCodeSink* gcode)
 {
-    std::string gcode = "";
-    for(auto& pair : by_region) {
-        this->_gcodegen.config.apply(this->_print.get_region(pair.first)->config);
+    for(const auto& pair : by_region) {
+        this->_apply_region_config(pair.first);
         ExtrusionEntityCollection tmp;
         pair.second.chained_path_from(this->_gcodegen.last_pos(),&tmp);
+
+        // optionally refine the greedy order to shorten travel moves
+        std::vector<ExtrusionRole> roles { this->config.optimize_infill_travel
+            ? std::vector<ExtrusionRole> { erInternalInfill, erSolidInfill, erTopSolidInfill, erBridgeInfill }
+            : std::vector<ExtrusionRole>() };
+        if (this->config.optimize_gap_fill_travel)
+            roles.push_back(erGapFill);
+        tmp.optimize_travel(this->_gcodegen.last_pos(), roles);
+
         for(auto& ee : tmp){
-            gcode += this->_gcodegen.extrude(*ee, "infill");
+            if (ee->is_collection()) {
+                // a group that can't be reordered, like a concentric infill,
+                // is extruded whole in its own order
+                ExtrusionEntityCollection group;
+                dynamic_cast<const ExtrusionEntityCollection*>(ee)->chained_path_from(this->_gcodegen.last_pos(), &group);
+                for (const auto* path : group)
+                    *gcode += this->_extrude(*path, "infill");
+            } else {
+                *gcode += this->_extrude(*ee, "infill");
+            }
         }
     }
-    return gcode;
 }
 
 
-void
-PrintGCode::_print_first_layer_temperature(bool wait)
+std::string
+PrintGCode::_first_layer_temperature(bool wait)
 {
+    std::string gcode;
     for (auto& t : _print.extruders()) {
         auto temp = config.first_layer_temperature.get_at(t);
         if (config.ooze_prevention.value) temp += config.standby_temperature_delta.value;
-        if (temp > 0) fh << _gcodegen.writer.set_temperature(temp, wait, t);
+        if (temp > 0) gcode += _gcodegen.writer.set_temperature(temp, wait, t);
     }
+    return gcode;
 }
 
 void
@@ -789,7 +1398,8 @@ PrintGCode::PrintGCode(Slic3r::Print& print, std::ostream& _fh) :
         objects(_print.objects),
         fh(_fh),
         _cooling_buffer(Slic3r::CoolingBuffer(this->_gcodegen)),
-        _spiral_vase(Slic3r::SpiralVase(this->config))
+        _spiral_vase(Slic3r::SpiralVase(this->config)),
+        _filters(_fh)
 {
     size_t layer_count {0};
     if (config.complete_objects) {
@@ -798,14 +1408,61 @@ PrintGCode::PrintGCode(Slic3r::Print& print, std::ostream& _fh) :
         layer_count = std::accumulate(objects.cbegin(), objects.cend(), layer_count, [](const size_t& ret, const PrintObject* obj){ return ret + obj->total_layer_count(); });
     }
     _gcodegen.placeholder_parser = &(_print.placeholder_parser); // initialize
+    _before_layer_gcode = GCodeTemplate(config.before_layer_gcode.getString());
+    _layer_gcode = GCodeTemplate(config.layer_gcode.getString());
     _gcodegen.layer_count = layer_count;
     _gcodegen.enable_cooling_markers = true;
     _gcodegen.apply_print_config(config);
 
     if (config.spiral_vase) _spiral_vase.enable = true;
 
+    // vibration limit injects pauses according to time (thus depends on actual speeds);
+    // pressure regulation depends on actual speeds
+    // (arcs are fitted by the G-code generator, see gcode_arcs)
+    _filters.add(VibrationLimit::create(config));
+    _filters.add(PressureRegulator::create(config));
+    for (const auto& factory : _print.gcode_filters)
+        _filters.add(factory(config));
+
+    const auto extruders = _print.extruders();
+    _gcodegen.set_extruders(extruders.cbegin(), extruders.cend());
+
+    // the layers only change the volumetric speed if a speed is left to autospeed
+    for (const auto* region : _print.regions) {
+        for (const auto key : { "perimeter_speed", "small_perimeter_speed", "external_perimeter_speed", "bridge_speed",
+                                "infill_speed", "solid_infill_speed", "top_solid_infill_speed", "gap_fill_speed" })
+            _autospeed = _autospeed || !(region->config.get_abs_value(key) > 0);
+    }
+    for (const auto* object : objects) {
+        _autospeed = _autospeed || !(object->config.get_abs_value("support_material_speed") > 0
+                                     && object->config.get_abs_value("support_material_interface_speed") > 0);
+    }
+}
+
+PrintGCode::PrintGCode(const PrintGCode& parent, const CopyState& state) :
+        _print(parent._print),
+        config(parent.config),
+        _gcodegen(Slic3r::GCode()),
+        objects(parent.objects),
+        fh(parent.fh),
+        _cooling_buffer(Slic3r::CoolingBuffer(this->_gcodegen)),
+        _spiral_vase(Slic3r::SpiralVase(this->config)),
+        _filters(parent.fh),
+        _before_layer_gcode(parent._before_layer_gcode),
+        _layer_gcode(parent._layer_gcode),
+        _placeholder_parser(new PlaceholderParser(*parent._gcodegen.placeholder_parser))
+{
+    _gcodegen.placeholder_parser = _placeholder_parser.get();
+    _gcodegen.layer_count = parent._gcodegen.layer_count;
+    _gcodegen.enable_cooling_markers = true;
+    _gcodegen.apply_print_config(config);
+
+    if (config.spiral_vase) _spiral_vase.enable = true;
+
     const auto extruders = _print.extruders();
     _gcodegen.set_extruders(extruders.cbegin(), extruders.cend());
+    _gcodegen.avoid_crossing_perimeters.share_mps(parent._gcodegen.avoid_crossing_perimeters);
+    this->_set_copy_state(state);
 }
 
 } // namespace Slic3r
@@ -2,13 +2,17 @@
 #define slic3r_PrintGCode_hpp
 
 #include "GCode.hpp"
+#include "GCodeSink.hpp"
+#include "GCodeTemplate.hpp"
 #include "GCode/CoolingBuffer.hpp"
+#include "GCode/Filter.hpp"
 #include "GCode/SpiralVase.hpp"
 #include "Geometry.hpp"
 #include "Flow.hpp"
 #include "ExtrusionEntity.hpp"
 #include "libslic3r.h"
 
+#include <memory>
 #include <string>
 #include <iostream>
 #include <regex>
@@ -17,6 +21,25 @@ namespace Slic3r {
 
 class PrintGCode {
 public:
+    /// Extrusions of a layer grouped by extruder, then by island, then by region,
+    /// as a tuple of perimeters and infill.
+    typedef std::map<size_t,std::map<size_t,
+        std::tuple<std::map<size_t,ExtrusionEntityCollection>,
+                   std::map<size_t,ExtrusionEntityCollection>>>> ExtrusionsByExtruder;
+
+    /// The part of the work on a layer that doesn't depend on the state of the
+    /// G-code generator, so that it can be prepared ahead and in parallel.
+    struct LayerPlan {
+        /// Target volumetric speed for autospeed, if any extrusion needs one.
+        bool has_volumetric_speed {false};
+        double volumetric_speed {0};
+        /// Extrusions grouped by extruder and island; the same for every copy.
+        ExtrusionsByExtruder by_extruder;
+        /// Extruder to use last on each copy, as planned by _plan_toolchanges();
+        /// -1 or missing to use them in id order.
+        std::vector<int> last_extruders;
+    };
+
     /// Constructor.
     PrintGCode(Slic3r::Print& print, std::ostream& _fh);
 
@@ -26,10 +49,22 @@ public:
     /// Process an individual output for export. Writes to the ostream.
     void process_layer(size_t idx, const Layer* layer, const Points& copies);
 
-    void flush_filters() { fh << this->filter(this->_cooling_buffer.flush(), true); }
+    /// Process a layer whose plan was prepared beforehand.
+    void process_layer(size_t idx, const Layer* layer, const Points& copies, const LayerPlan& plan);
+
+    /// Prepare the state-independent part of process_layer(). Safe to call
+    /// from several threads while another one is emitting G-code.
+    LayerPlan plan_layer(const Layer* layer) const;
+
+    /// Processes the layer left in the cooling buffer and writes everything
+    /// through the filters; returns once it is all written to the output.
+    void flush_filters();
 
-    /// Applies various filters, if enabled.
-    std::string filter(const std::string& in, bool wait = false);
+    /// Passes the G-code through the filters enabled in the configuration and
+    /// the ones registered in Print::gcode_filters, then writes it.
+    /// The filters run on a separate thread; with flush set, they flush their
+    /// state and the call returns once everything is written.
+    void filter(GCodeSink &&gcode, bool flush = false);
 
 private:
 
@@ -44,28 +79,146 @@ private:
 
     Slic3r::CoolingBuffer _cooling_buffer;
     Slic3r::SpiralVase _spiral_vase;
-//    Slic3r::VibrationLimit _vibration_limit;
-//    Slic3r::ArcFitting _arc_fitting;
-//    Slic3r::PressureRegulator _pressure_regulator;
+    Slic3r::GCodeFilterPipeline _filters;
+    /// Custom G-code written around each layer change, parsed once.
+    GCodeTemplate _before_layer_gcode;
+    GCodeTemplate _layer_gcode;
+    /// Own copy of the placeholder parser of the copies of a sequential print
+    /// rendered by other threads, which set the current extruder in it.
+    std::unique_ptr<PlaceholderParser> _placeholder_parser;
 
     /// presence in the array indicates that the
     std::map<coord_t, bool> _skirt_done {};
     bool _brim_done {false};
     bool _second_layer_things_done {false};
     std::pair<Point, bool> _last_obj_copy {std::pair<Point, bool>(Point(), false)};
+    /// Whether a speed is left to autospeed, so that the layers may change
+    /// GCode::volumetric_speed.
     bool _autospeed {false};
+    /// Toolchanges saved by _plan_toolchanges() over using the extruders in id order.
+    size_t _toolchanges_avoided {0};
 
-    void _print_first_layer_temperature(bool wait);
+    std::string _first_layer_temperature(bool wait);
     void _print_off_temperature(bool wait);
 
     /// Utility function to print config options as gcode comments
     void _print_config(const ConfigBase& config);
 
     // Extrude perimeters: Decide where to put seams (hide or align seams).
-    std::string _extrude_perimeters(std::map<size_t,ExtrusionEntityCollection> &by_region);
+    void _extrude_perimeters(const std::map<size_t,ExtrusionEntityCollection> &by_region, GCodeSink* gcode);
 
     // Chain the paths hierarchically by a greedy algorithm to minimize a travel distance.
-    std::string _extrude_infill(std::map<size_t,ExtrusionEntityCollection> &by_region);
+    void _extrude_infill(const std::map<size_t,ExtrusionEntityCollection> &by_region, GCodeSink* gcode);
+
+    /// Extrude the support material and the islands of a layer for the current
+    /// copy, ending with last_extruder if it has extrusions.
+    void _extrude_copy(const Layer* layer, const LayerPlan& plan, int last_extruder, GCodeSink* gcode);
+
+    /// A call of _extrude_copy() to the G-code generator, recorded for the first
+    /// copy of a layer with render_copies_once so that the other copies repeat
+    /// it instead of chaining the extrusions, placing the seams and working out
+    /// the moves again. The extrusions are kept as written, and only their
+    /// travels, retractions and coordinates are handled again for each copy.
+    struct CopyMove {
+        enum Type { SetExtruder, ApplyRegion, Extrude };
+        Type type {SetExtruder};
+        size_t id {0};                  ///< extruder or region
+        WrittenExtrusion extrusion;
+    };
+    /// Moves of the copy being recorded, if any.
+    std::vector<CopyMove>* _recording {nullptr};
+
+    /// Same as the methods of the G-code generator, recording the calls.
+    std::string _set_extruder(size_t extruder_id);
+    void _apply_region_config(size_t region_id);
+    std::string _extrude(const ExtrusionEntity& entity, const std::string& description, double speed = -1);
+    /// Adds a move to the recording.
+    void _record(CopyMove&& move);
+
+    /// Writes the recorded paths and loops again for the current copy, from
+    /// its origin.
+    void _replay(const std::vector<CopyMove>& moves, GCodeSink* gcode);
+
+    /// A layer to emit with the index of its object, or the end of a print_z
+    /// when layer is null.
+    struct LayerJob {
+        size_t obj_idx;
+        const Layer* layer;
+        coord_t print_z;
+        /// Copies to print, all the ones of the object when empty.
+        Points copies;
+    };
+
+    /// Emit the layers in order while the plans of the following ones are
+    /// prepared by other threads. Only the planning runs in parallel: the
+    /// G-code of the layers is rendered one after the other by this thread.
+    void _process_layers_planned_ahead(const std::vector<LayerJob>& jobs);
+
+    /// Does the layer get the skirt, given the print_z already done?
+    bool _needs_skirt(const Layer* layer, const std::map<coord_t, bool>& skirt_done) const;
+
+    /// The layers of the copies of a sequential print, one copy after the other.
+    struct CopyJobs {
+        std::vector<LayerJob> jobs;
+        /// First job and position of each copy.
+        std::vector<std::pair<size_t, Point>> copies;
+        /// Last extruder of each copy of each job, from _plan_toolchanges().
+        std::vector<std::vector<int>> last_extruders;
+    };
+
+    /// What the G-code of a copy of a sequential print depends on besides the
+    /// configuration: the state of the G-code generator and the skirt, brim
+    /// and object bookkeeping of process_layer().
+    struct CopyState {
+        GCode::State gcodegen;
+        std::map<coord_t, bool> skirt_done;
+        bool brim_done {false};
+        std::pair<Point, bool> last_obj_copy;
+        bool operator==(const CopyState& other) const;
+        bool operator!=(const CopyState& other) const { return !(*this == other); }
+    };
+    CopyState _copy_state() const;
+    void _set_copy_state(const CopyState& state);
+
+    /// A piece of the G-code of a copy rendered by another thread, to be
+    /// passed through the filters, flushing them or not, or written as it is.
+    struct RenderedGCode {
+        enum Type { Filtered, Flushed, Raw };
+        Type type {Filtered};
+        GCodeSink gcode;
+    };
+    /// Where filter() puts the G-code instead, while rendering a copy.
+    std::vector<RenderedGCode>* _rendering {nullptr};
+
+    /// A PrintGCode rendering copies of the print of parent from state, with
+    /// the planners of parent and without filters.
+    PrintGCode(const PrintGCode& parent, const CopyState& state);
+
+    /// Emit the copies of a sequential print in order. Each copy is rendered
+    /// by its own PrintGCode, from the state the previous one ends with; with
+    /// several threads, the next copies are rendered at the same time from
+    /// the state _predict_copy_state() expects, and rendered again after the
+    /// previous ones if it turns out to be another one.
+    void _process_copies(const CopyJobs& copy_jobs);
+
+    /// Renders the layers of a copy and the travel to the next one, if any;
+    /// returns the state it ends with.
+    CopyState _render_copy(const CopyJobs& copy_jobs, size_t copy, std::vector<RenderedGCode>* output);
+
+    /// Retracts, and travels to the origin of the next copy.
+    std::string _travel_to_copy(const Point& copy);
+
+    /// The state copy is started with, if copy first was started with first:
+    /// the skirt, brim and layer bookkeeping of the copies in between, and
+    /// the travel from the last layer of the previous one, as if it ended
+    /// unretracted and unlifted.
+    CopyState _predict_copy_state(const CopyJobs& copy_jobs, size_t first, const CopyState& state, size_t copy) const;
+
+    /// Chooses the extruder each copy of each layer ends with, so that the
+    /// next one can start with it, minimizing the toolchanges of the whole
+    /// sequence of layers. Returns the last extruder of each copy of each job,
+    /// for LayerPlan::last_extruders.
+    std::vector<std::vector<int>> _plan_toolchanges(const std::vector<LayerJob>& jobs);
 
     /// regular expression to match heater gcodes
     std::regex bed_temp_regex { std::regex("M(?:190|140)", std::regex_constants::icase)};
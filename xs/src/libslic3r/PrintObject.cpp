@@ -1193,10 +1193,16 @@ PrintObject::make_perimeters()
         }
     }
     
+    // When there are fewer layers than threads, the remaining threads are
+    // used to process the islands of each layer in parallel, so that no more
+    // than threads run at once.
+    const int threads = this->_print->config.threads.value;
+    const int layer_threads = std::max(1, std::min(threads, int(this->layers.size())));
+    const int island_threads = std::max(1, threads / layer_threads);
     parallelize<Layer*>(
         std::queue<Layer*>(std::deque<Layer*>(this->layers.begin(), this->layers.end())),  // cast LayerPtrs to std::queue<Layer*>
-        boost::bind(&Slic3r::Layer::make_perimeters, _1),
-        this->_print->config.threads.value
+        boost::bind(&Slic3r::Layer::make_perimeters, _1, island_threads),
+        layer_threads
     );
     
     /*
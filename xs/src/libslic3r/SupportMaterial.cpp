@@ -1,5 +1,6 @@
 #include "SupportMaterial.hpp"
 #include "Log.hpp"
+#include "OverhangClassifier.hpp"
 
 
 namespace Slic3r
@@ -375,7 +376,7 @@ SupportMaterial::contact_area(PrintObject *object)
                         // workaround for Clipper bug, see Slic3r::Polygon::clip_as_polyline()
                         for (auto &overhang_perimeter : overhang_perimeters)
                             overhang_perimeter.translate(1, 0);
-                        overhang_perimeters = diff_pl(overhang_perimeters, lower_grown_slices);
+                        overhang_perimeters = OverhangClassifier(lower_grown_slices).overhanging(overhang_perimeters);
 
                         // Only consider straight overhangs.
                         Polylines new_overhangs_perimeters_polylines;